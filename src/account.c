@@ -1189,6 +1189,7 @@ static void account_delete(GtkWidget *widget, gpointer data)
 			cur = g_slist_next(cur);
 		}
 	}
+	filtering_rules_changed();
 
 	debug_print("Removing cache directory of this account...\n");
 	account_empty_cache(ac_prefs);
@@ -0,0 +1,997 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#include "claws-features.h"
+#endif
+
+#include "defs.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bodyindex.h"
+#include "folder.h"
+#include "matcher.h"
+#include "procmime.h"
+#include "procmsg.h"
+#include "prefs_common.h"
+#include "utils.h"
+#include "file-utils.h"
+
+/*
+ * File layout, every integer little-endian:
+ *
+ *   header     magic, version, ndocs, nterms, nstale (32 bits each)
+ *   docs       ndocs times msgnum (32), size (32), mtime (64), sorted
+ *              by msgnum: the messages indexed
+ *   terms      nterms times key (32), count (32), offset (64) and
+ *              length (64) of the postings, sorted by key
+ *   postings   per term, the ascending msgnums of the messages
+ *              having the trigram, as LEB128 deltas
+ *
+ * Messages added or removed since the file was written are kept in
+ * memory and merged into a new file from time to time. Only the
+ * postings of the trigrams of the added messages are encoded again,
+ * the others are copied as they are, still listing the nstale
+ * messages removed since all of them were last rewritten. Postings are
+ * thus only ever a superset of the truth: a message is ruled out only
+ * if it is indexed with its current size and mtime and misses a
+ * trigram.
+ */
+
+#define BODY_INDEX_MAGIC	0x31494243	/* "CBI1" */
+#define BODY_INDEX_VERSION	2
+
+#define BODY_INDEX_HEADER_SIZE	20
+#define BODY_INDEX_DOC_SIZE	16
+#define BODY_INDEX_TERM_SIZE	24
+
+/* messages indexed per idle call, and looked at without indexing */
+#define BODY_INDEX_BATCH	20
+#define BODY_INDEX_SKIP_BATCH	1000
+/* messages indexed between two writes of the file; the postings of the
+ * messages not written yet are held in memory */
+#define BODY_INDEX_SAVE_MIN	2000
+#define BODY_INDEX_SAVE_MAX	8000
+
+typedef struct _BodyIndexDoc {
+	guint32 msgnum;
+	guint32 size;
+	gint64 mtime;
+} BodyIndexDoc;
+
+typedef struct _BodyIndexTerm {
+	guint32 key;
+	guint32 count;
+	guint64 offset;
+	guint64 length;
+} BodyIndexTerm;
+
+typedef struct _BodyIndex {
+	FolderItem *item;
+	gchar *file;
+
+	/* last written state */
+	GMappedFile *map;
+	const guchar *data;
+	gsize len;
+	const guchar *docs;
+	guint ndocs;
+	const guchar *terms;
+	guint nterms;
+	guint nstale;
+
+	/* changes since */
+	GHashTable *added;	/* msgnum -> BodyIndexDoc */
+	GHashTable *removed;	/* msgnum set */
+	GHashTable *delta;	/* trigram -> GArray of msgnums */
+	guint changes;
+
+	/* background build */
+	gboolean queued;
+	GArray *todo;		/* msgnums left to look at */
+	guint todo_pos;
+} BodyIndex;
+
+struct _BodyIndexQuery {
+	BodyIndex *index;
+	gboolean bool_and;
+	GPtrArray *hits;	/* per usable condition, sorted GArray of the
+				   msgnums having all its trigrams */
+};
+
+static GHashTable *body_indexes = NULL;	/* FolderItem -> BodyIndex */
+static GQueue build_queue = G_QUEUE_INIT;
+static guint build_source_id = 0;
+
+static void body_index_unmap(BodyIndex *index)
+{
+	if (index->map)
+		g_mapped_file_unref(index->map);
+	index->map = NULL;
+	index->data = NULL;
+	index->len = 0;
+	index->docs = NULL;
+	index->ndocs = 0;
+	index->terms = NULL;
+	index->nterms = 0;
+	index->nstale = 0;
+}
+
+static guint32 body_index_get_32(const guchar *p)
+{
+	guint32 value;
+
+	memcpy(&value, p, sizeof(value));
+	return GUINT32_FROM_LE(value);
+}
+
+static guint64 body_index_get_64(const guchar *p)
+{
+	guint64 value;
+
+	memcpy(&value, p, sizeof(value));
+	return GUINT64_FROM_LE(value);
+}
+
+static void body_index_put_32(GByteArray *buf, guint32 value)
+{
+	value = GUINT32_TO_LE(value);
+	g_byte_array_append(buf, (const guint8 *)&value, sizeof(value));
+}
+
+static void body_index_put_64(GByteArray *buf, guint64 value)
+{
+	value = GUINT64_TO_LE(value);
+	g_byte_array_append(buf, (const guint8 *)&value, sizeof(value));
+}
+
+static guint32 body_index_doc_msgnum(BodyIndex *index, guint i)
+{
+	return body_index_get_32(index->docs + (gsize)i * BODY_INDEX_DOC_SIZE);
+}
+
+static void body_index_read_doc(BodyIndex *index, guint i, BodyIndexDoc *doc)
+{
+	const guchar *p = index->docs + (gsize)i * BODY_INDEX_DOC_SIZE;
+
+	doc->msgnum = body_index_get_32(p);
+	doc->size = body_index_get_32(p + 4);
+	doc->mtime = (gint64)body_index_get_64(p + 8);
+}
+
+static guint32 body_index_term_key(BodyIndex *index, guint i)
+{
+	return body_index_get_32(index->terms + (gsize)i * BODY_INDEX_TERM_SIZE);
+}
+
+static void body_index_read_term(BodyIndex *index, guint i,
+				 BodyIndexTerm *term)
+{
+	const guchar *p = index->terms + (gsize)i * BODY_INDEX_TERM_SIZE;
+
+	term->key = body_index_get_32(p);
+	term->count = body_index_get_32(p + 4);
+	term->offset = body_index_get_64(p + 8);
+	term->length = body_index_get_64(p + 16);
+}
+
+static void body_index_map(BodyIndex *index)
+{
+	GError *error = NULL;
+	guint32 ndocs, nterms;
+	gsize needed;
+
+	body_index_unmap(index);
+
+	if (!is_file_exist(index->file))
+		return;
+
+	index->map = g_mapped_file_new(index->file, FALSE, &error);
+	if (!index->map) {
+		debug_print("body index %s: %s\n", index->file, error->message);
+		g_error_free(error);
+		return;
+	}
+	index->data = (const guchar *)g_mapped_file_get_contents(index->map);
+	index->len = g_mapped_file_get_length(index->map);
+
+	if (index->len < BODY_INDEX_HEADER_SIZE ||
+	    body_index_get_32(index->data) != BODY_INDEX_MAGIC ||
+	    body_index_get_32(index->data + 4) != BODY_INDEX_VERSION) {
+		debug_print("body index %s: unknown format, rebuilding\n",
+			    index->file);
+		body_index_unmap(index);
+		return;
+	}
+	ndocs = body_index_get_32(index->data + 8);
+	nterms = body_index_get_32(index->data + 12);
+	needed = BODY_INDEX_HEADER_SIZE
+		+ (guint64)ndocs * BODY_INDEX_DOC_SIZE
+		+ (guint64)nterms * BODY_INDEX_TERM_SIZE;
+	if (index->len < needed) {
+		debug_print("body index %s: truncated, rebuilding\n",
+			    index->file);
+		body_index_unmap(index);
+		return;
+	}
+
+	index->ndocs = ndocs;
+	index->nterms = nterms;
+	index->nstale = body_index_get_32(index->data + 16);
+	index->docs = index->data + BODY_INDEX_HEADER_SIZE;
+	index->terms = index->docs + (gsize)ndocs * BODY_INDEX_DOC_SIZE;
+}
+
+static void body_index_free_postings(gpointer data)
+{
+	g_array_free((GArray *)data, TRUE);
+}
+
+static void body_index_clear_changes(BodyIndex *index)
+{
+	g_hash_table_remove_all(index->added);
+	g_hash_table_remove_all(index->removed);
+	g_hash_table_remove_all(index->delta);
+	index->changes = 0;
+}
+
+static BodyIndex *body_index_get(FolderItem *item, gboolean create)
+{
+	BodyIndex *index;
+	gchar *path, *file;
+
+	if (!prefs_common.use_body_index || !item || !item->folder ||
+	    item->no_select || !FOLDER_IS_LOCAL(item->folder))
+		return NULL;
+
+	if (!body_indexes)
+		body_indexes = g_hash_table_new(g_direct_hash, g_direct_equal);
+	index = g_hash_table_lookup(body_indexes, item);
+	if (index)
+		return index;
+
+	path = folder_item_get_path(item);
+	if (!path)
+		return NULL;
+	file = g_strconcat(path, G_DIR_SEPARATOR_S, BODY_INDEX_FILE, NULL);
+	g_free(path);
+	if (!create && !is_file_exist(file)) {
+		g_free(file);
+		return NULL;
+	}
+
+	index = g_new0(BodyIndex, 1);
+	index->item = item;
+	index->file = file;
+	index->added = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					     NULL, g_free);
+	index->removed = g_hash_table_new(g_direct_hash, g_direct_equal);
+	index->delta = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					     NULL, body_index_free_postings);
+	body_index_map(index);
+	g_hash_table_insert(body_indexes, item, index);
+
+	return index;
+}
+
+static void body_index_free(BodyIndex *index)
+{
+	body_index_unmap(index);
+	g_hash_table_destroy(index->added);
+	g_hash_table_destroy(index->removed);
+	g_hash_table_destroy(index->delta);
+	if (index->todo)
+		g_array_free(index->todo, TRUE);
+	g_free(index->file);
+	g_free(index);
+}
+
+static gboolean body_index_lookup_doc(BodyIndex *index, guint32 msgnum,
+				      BodyIndexDoc *doc)
+{
+	const BodyIndexDoc *added;
+	guint lo = 0, hi = index->ndocs;
+
+	added = g_hash_table_lookup(index->added, GUINT_TO_POINTER(msgnum));
+	if (added) {
+		*doc = *added;
+		return TRUE;
+	}
+	if (g_hash_table_contains(index->removed, GUINT_TO_POINTER(msgnum)))
+		return FALSE;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		guint32 cur = body_index_doc_msgnum(index, mid);
+
+		if (cur == msgnum) {
+			body_index_read_doc(index, mid, doc);
+			return TRUE;
+		}
+		if (cur < msgnum)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return FALSE;
+}
+
+/* indexed, and not changed since */
+static gboolean body_index_is_current(BodyIndex *index, MsgInfo *msginfo)
+{
+	BodyIndexDoc doc;
+
+	return body_index_lookup_doc(index, msginfo->msgnum, &doc)
+		&& doc.size == (guint32)msginfo->size
+		&& doc.mtime == (gint64)msginfo->mtime;
+}
+
+/* the term of a trigram in the file, if its postings are readable */
+static gboolean body_index_lookup_term(BodyIndex *index, guint32 key,
+				       BodyIndexTerm *term)
+{
+	guint lo = 0, hi = index->nterms;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		guint32 cur = body_index_term_key(index, mid);
+
+		if (cur == key) {
+			body_index_read_term(index, mid, term);
+			return term->offset <= index->len
+				&& term->length <= index->len - term->offset;
+		}
+		if (cur < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return FALSE;
+}
+
+/* sorted msgnums, without duplicates, of the messages with a trigram */
+static GArray *body_index_get_postings(BodyIndex *index, guint32 key)
+{
+	BodyIndexTerm term;
+	gboolean found = body_index_lookup_term(index, key, &term);
+	GArray *delta = g_hash_table_lookup(index->delta, GUINT_TO_POINTER(key));
+	GArray *postings;
+	guint i, j;
+
+	postings = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+				     found ? term.count : 0);
+
+	if (found) {
+		const guchar *p = index->data + term.offset;
+		const guchar *end = p + term.length;
+		guint32 num = 0;
+
+		while (p < end) {
+			guint32 value = 0;
+			gint shift = 0;
+			guchar byte;
+
+			do {
+				byte = *p++;
+				value |= (guint32)(byte & 0x7f) << shift;
+				shift += 7;
+			} while ((byte & 0x80) && p < end && shift < 35);
+			num += value;
+			g_array_append_val(postings, num);
+		}
+	}
+
+	if (delta) {
+		g_array_append_vals(postings, delta->data, delta->len);
+		sort_uint_array((guint *)postings->data, postings->len);
+		for (i = 0, j = 0; i < postings->len; i++) {
+			if (j > 0 && g_array_index(postings, guint, j - 1)
+				     == g_array_index(postings, guint, i))
+				continue;
+			g_array_index(postings, guint, j++) =
+				g_array_index(postings, guint, i);
+		}
+		g_array_set_size(postings, j);
+	}
+
+	return postings;
+}
+
+static gboolean body_index_sorted_contains(GArray *array, guint value)
+{
+	guint lo = 0, hi = array->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		guint cur = g_array_index(array, guint, mid);
+
+		if (cur == value)
+			return TRUE;
+		if (cur < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return FALSE;
+}
+
+static gint body_index_doc_compare(gconstpointer a, gconstpointer b)
+{
+	guint32 na = ((const BodyIndexDoc *)a)->msgnum;
+	guint32 nb = ((const BodyIndexDoc *)b)->msgnum;
+
+	return (na > nb) - (na < nb);
+}
+
+static void body_index_put_varint(GByteArray *buf, guint32 value)
+{
+	guint8 byte;
+
+	do {
+		byte = value & 0x7f;
+		value >>= 7;
+		if (value)
+			byte |= 0x80;
+		g_byte_array_append(buf, &byte, 1);
+	} while (value);
+}
+
+static gboolean body_index_write_all(FILE *fp, gconstpointer data, gsize len)
+{
+	return len == 0 || claws_fwrite(data, 1, len, fp) == len;
+}
+
+/* merge the changes into a new file */
+static void body_index_save(BodyIndex *index)
+{
+	GArray *docs, *keys, *terms;
+	GPtrArray *sources;
+	GByteArray *table, *postings;
+	GHashTableIter iter;
+	gpointer key, value;
+	gchar *tmp_file;
+	FILE *fp;
+	guint i, dropped = 0, nstale;
+	guint64 offset;
+	gboolean rewrite_all, ok;
+
+	/* documents */
+	docs = g_array_sized_new(FALSE, FALSE, sizeof(BodyIndexDoc),
+				 index->ndocs + g_hash_table_size(index->added));
+	for (i = 0; i < index->ndocs; i++) {
+		BodyIndexDoc doc;
+		gpointer num;
+
+		body_index_read_doc(index, i, &doc);
+		num = GUINT_TO_POINTER(doc.msgnum);
+		if (g_hash_table_contains(index->added, num))
+			continue;
+		if (g_hash_table_contains(index->removed, num))
+			dropped++;
+		else
+			g_array_append_val(docs, doc);
+	}
+	g_hash_table_iter_init(&iter, index->added);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		g_array_append_vals(docs, value, 1);
+	g_array_sort(docs, body_index_doc_compare);
+
+	/* removed messages are left in the postings copied as they are,
+	 * until they make up a quarter of the index */
+	nstale = index->nstale + dropped;
+	rewrite_all = (guint64)nstale * 4 > docs->len;
+	if (rewrite_all)
+		nstale = 0;
+
+	/* trigrams, from the file and the delta */
+	keys = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+				 index->nterms + g_hash_table_size(index->delta));
+	for (i = 0; i < index->nterms; i++) {
+		guint k = body_index_term_key(index, i);
+
+		g_array_append_val(keys, k);
+	}
+	g_hash_table_iter_init(&iter, index->delta);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		BodyIndexTerm term;
+		guint k = GPOINTER_TO_UINT(key);
+
+		if (!body_index_lookup_term(index, k, &term))
+			g_array_append_val(keys, k);
+	}
+	sort_uint_array((guint *)keys->data, keys->len);
+
+	/* postings: the unchanged ones point into the current file, the
+	 * others are encoded again, dropping messages no longer indexed,
+	 * and their offset is into the postings buffer until written */
+	terms = g_array_sized_new(FALSE, FALSE, sizeof(BodyIndexTerm), keys->len);
+	sources = g_ptr_array_sized_new(keys->len);
+	postings = g_byte_array_new();
+	for (i = 0; i < keys->len; i++) {
+		guint32 k = g_array_index(keys, guint, i);
+		BodyIndexTerm term;
+		GArray *nums;
+		guint32 last = 0;
+		guint j;
+
+		if (!rewrite_all
+		    && !g_hash_table_contains(index->delta, GUINT_TO_POINTER(k))
+		    && body_index_lookup_term(index, k, &term)) {
+			g_array_append_val(terms, term);
+			g_ptr_array_add(sources, (gpointer)(index->data + term.offset));
+			continue;
+		}
+
+		term.key = k;
+		term.count = 0;
+		term.offset = postings->len;
+		nums = body_index_get_postings(index, k);
+		for (j = 0; j < nums->len; j++) {
+			guint32 num = g_array_index(nums, guint, j);
+			BodyIndexDoc probe;
+
+			probe.msgnum = num;
+			if (!bsearch(&probe, docs->data, docs->len,
+				     sizeof(BodyIndexDoc),
+				     (int (*)(const void *, const void *))
+				     body_index_doc_compare))
+				continue;
+			body_index_put_varint(postings, num - last);
+			last = num;
+			term.count++;
+		}
+		g_array_free(nums, TRUE);
+
+		if (term.count == 0)
+			continue;
+		term.length = postings->len - term.offset;
+		g_array_append_val(terms, term);
+		g_ptr_array_add(sources, NULL);
+	}
+
+	table = g_byte_array_new();
+	body_index_put_32(table, BODY_INDEX_MAGIC);
+	body_index_put_32(table, BODY_INDEX_VERSION);
+	body_index_put_32(table, docs->len);
+	body_index_put_32(table, terms->len);
+	body_index_put_32(table, nstale);
+	for (i = 0; i < docs->len; i++) {
+		BodyIndexDoc *doc = &g_array_index(docs, BodyIndexDoc, i);
+
+		body_index_put_32(table, doc->msgnum);
+		body_index_put_32(table, doc->size);
+		body_index_put_64(table, (guint64)doc->mtime);
+	}
+	offset = table->len + (guint64)terms->len * BODY_INDEX_TERM_SIZE;
+	for (i = 0; i < terms->len; i++) {
+		BodyIndexTerm *term = &g_array_index(terms, BodyIndexTerm, i);
+
+		body_index_put_32(table, term->key);
+		body_index_put_32(table, term->count);
+		body_index_put_64(table, offset);
+		body_index_put_64(table, term->length);
+		offset += term->length;
+	}
+
+	tmp_file = g_strconcat(index->file, ".tmp", NULL);
+	if ((fp = claws_fopen(tmp_file, "wb")) == NULL) {
+		FILE_OP_ERROR(tmp_file, "claws_fopen");
+		ok = FALSE;
+	} else {
+		ok = body_index_write_all(fp, table->data, table->len);
+		for (i = 0; i < terms->len && ok; i++) {
+			BodyIndexTerm *term = &g_array_index(terms, BodyIndexTerm, i);
+			const guchar *src = g_ptr_array_index(sources, i);
+
+			if (!src)
+				src = postings->data + term->offset;
+			ok = body_index_write_all(fp, src, term->length);
+		}
+		if (claws_safe_fclose(fp) == EOF)
+			ok = FALSE;
+		if (!ok)
+			FILE_OP_ERROR(tmp_file, "claws_fwrite");
+	}
+
+	g_array_free(docs, TRUE);
+	g_array_free(keys, TRUE);
+	g_array_free(terms, TRUE);
+	g_ptr_array_free(sources, TRUE);
+	g_byte_array_free(table, TRUE);
+	g_byte_array_free(postings, TRUE);
+
+	/* the old file stays mapped until the new one is in place */
+	if (ok && rename_force(tmp_file, index->file) == 0) {
+		body_index_clear_changes(index);
+		body_index_map(index);
+	} else {
+		claws_unlink(tmp_file);
+	}
+	g_free(tmp_file);
+}
+
+static gboolean body_index_add_line_cb(const gchar *str, gpointer data)
+{
+	GHashTable *keys = (GHashTable *)data;
+	gchar *line = g_utf8_casefold(str, -1);
+	const guchar *p = (const guchar *)line;
+	gsize len = strlen(line), i;
+
+	/* trigrams never span lines, the matcher works line by line */
+	for (i = 0; i + 3 <= len; i++)
+		g_hash_table_add(keys, GUINT_TO_POINTER(
+				(p[i] << 16) | (p[i + 1] << 8) | p[i + 2]));
+	g_free(line);
+
+	return FALSE;
+}
+
+static void body_index_add_msg(BodyIndex *index, MsgInfo *msginfo,
+			       const gchar *file)
+{
+	MimeInfo *mimeinfo, *partinfo;
+	GHashTable *keys;
+	GHashTableIter iter;
+	gpointer key;
+	BodyIndexDoc *doc;
+	gboolean error = FALSE;
+
+	if (!folder_has_parent_of_type(msginfo->folder, F_QUEUE) &&
+	    !folder_has_parent_of_type(msginfo->folder, F_DRAFT))
+		mimeinfo = procmime_scan_file(file);
+	else
+		mimeinfo = procmime_scan_queue_file(file);
+	if (!mimeinfo)
+		return;
+
+	/* the same text matcherlist_match_body() looks at */
+	keys = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (partinfo = procmime_mimeinfo_next(mimeinfo); partinfo != NULL && !error;
+	     partinfo = procmime_mimeinfo_next(partinfo)) {
+		if (partinfo->type == MIMETYPE_TEXT)
+			error = procmime_scan_text_content(partinfo,
+					body_index_add_line_cb, keys);
+	}
+	procmime_mimeinfo_free_all(&mimeinfo);
+
+	/* leave the message unindexed, so that it's always tested */
+	if (error) {
+		g_hash_table_destroy(keys);
+		return;
+	}
+
+	g_hash_table_iter_init(&iter, keys);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		GArray *nums = g_hash_table_lookup(index->delta, key);
+
+		if (!nums) {
+			nums = g_array_new(FALSE, FALSE, sizeof(guint));
+			g_hash_table_insert(index->delta, key, nums);
+		}
+		g_array_append_val(nums, msginfo->msgnum);
+	}
+	g_hash_table_destroy(keys);
+
+	doc = g_new0(BodyIndexDoc, 1);
+	doc->msgnum = msginfo->msgnum;
+	doc->size = msginfo->size;
+	doc->mtime = msginfo->mtime;
+	g_hash_table_replace(index->added, GUINT_TO_POINTER(doc->msgnum), doc);
+	g_hash_table_remove(index->removed, GUINT_TO_POINTER(doc->msgnum));
+	index->changes++;
+}
+
+static gboolean body_index_build_func(gpointer data)
+{
+	BodyIndex *index = g_queue_peek_head(&build_queue);
+	guint indexed = 0, looked = 0;
+
+	if (!index) {
+		build_source_id = 0;
+		return FALSE;
+	}
+
+	if (!index->todo) {
+		GSList *nums = folder_item_get_number_list(index->item), *cur;
+
+		index->todo = g_array_new(FALSE, FALSE, sizeof(guint));
+		for (cur = nums; cur != NULL; cur = cur->next) {
+			guint num = GPOINTER_TO_UINT(cur->data);
+
+			g_array_append_val(index->todo, num);
+		}
+		g_slist_free(nums);
+		index->todo_pos = 0;
+	}
+
+	while (index->todo_pos < index->todo->len
+	       && indexed < BODY_INDEX_BATCH && looked < BODY_INDEX_SKIP_BATCH) {
+		guint num = g_array_index(index->todo, guint, index->todo_pos++);
+		MsgInfo *msginfo = folder_item_get_msginfo(index->item, num);
+
+		looked++;
+		if (!msginfo)
+			continue;
+		if (!body_index_is_current(index, msginfo)) {
+			gchar *file = procmsg_get_message_file(msginfo);
+
+			if (file) {
+				body_index_add_msg(index, msginfo, file);
+				g_free(file);
+			}
+			indexed++;
+		}
+		procmsg_msginfo_free(&msginfo);
+	}
+
+	/* write from time to time, so that an interrupted build can be
+	 * resumed; less often as the index grows, as it is all written */
+	if (index->changes >= MIN(BODY_INDEX_SAVE_MAX,
+				  MAX(BODY_INDEX_SAVE_MIN, index->ndocs / 4)))
+		body_index_save(index);
+
+	if (index->todo_pos >= index->todo->len) {
+		if (index->changes > 0 || g_hash_table_size(index->removed) > 0
+		    || !index->map)
+			body_index_save(index);
+		g_array_free(index->todo, TRUE);
+		index->todo = NULL;
+		index->queued = FALSE;
+		g_queue_pop_head(&build_queue);
+		debug_print("body index of %s is up to date (%u messages)\n",
+			    index->item->path ? index->item->path : "", index->ndocs);
+	}
+
+	return TRUE;
+}
+
+static void body_index_queue(BodyIndex *index)
+{
+	if (index->queued) {
+		/* look at the folder again, for the new messages */
+		if (index->todo) {
+			g_array_free(index->todo, TRUE);
+			index->todo = NULL;
+		}
+		return;
+	}
+
+	index->queued = TRUE;
+	g_queue_push_tail(&build_queue, index);
+	if (build_source_id == 0)
+		build_source_id = g_idle_add_full(G_PRIORITY_LOW,
+				body_index_build_func, NULL, NULL);
+}
+
+/*!
+ *\brief	Bring the body index of a folder up to date in the
+ *		background, if the folder has one
+ *
+ *\param	item Folder
+ */
+void body_index_schedule(FolderItem *item)
+{
+	BodyIndex *index = body_index_get(item, FALSE);
+
+	if (index)
+		body_index_queue(index);
+}
+
+/*!
+ *\brief	Drop messages removed from a folder from its body index
+ *
+ *\param	item Folder
+ *\param	msgnums Removed message numbers
+ *\param	count Number of message numbers
+ */
+void body_index_remove_msgs(FolderItem *item, const guint *msgnums,
+			    guint count)
+{
+	BodyIndex *index;
+	guint i;
+
+	if (count == 0)
+		return;
+	index = body_index_get(item, FALSE);
+	if (!index)
+		return;
+
+	for (i = 0; i < count; i++) {
+		gpointer num = GUINT_TO_POINTER(msgnums[i]);
+
+		g_hash_table_remove(index->added, num);
+		g_hash_table_add(index->removed, num);
+	}
+	/* gets written once the folder is looked at again */
+	body_index_queue(index);
+}
+
+/*!
+ *\brief	Forget the body index of a folder being destroyed
+ *
+ *\param	item Folder
+ */
+void body_index_forget(FolderItem *item)
+{
+	BodyIndex *index;
+
+	if (!body_indexes)
+		return;
+	index = g_hash_table_lookup(body_indexes, item);
+	if (!index)
+		return;
+
+	g_queue_remove(&build_queue, index);
+	g_hash_table_remove(body_indexes, item);
+	body_index_free(index);
+}
+
+static gboolean body_index_prop_usable(MatcherProp *prop)
+{
+	gchar *pattern;
+	gboolean usable;
+
+	if (prop->criteria != MATCHCRITERIA_BODY_PART || prop->expr == NULL)
+		return FALSE;
+	if (prop->matchtype != MATCHTYPE_MATCH &&
+	    prop->matchtype != MATCHTYPE_MATCHCASE)
+		return FALSE;
+
+	pattern = g_utf8_casefold(prop->expr, -1);
+	usable = strlen(pattern) >= 3;
+	g_free(pattern);
+
+	return usable;
+}
+
+/* messages having all the trigrams of the condition's pattern */
+static GArray *body_index_prop_hits(BodyIndex *index, MatcherProp *prop)
+{
+	gchar *pattern = g_utf8_casefold(prop->expr, -1);
+	const guchar *p = (const guchar *)pattern;
+	gsize len = strlen(pattern), i;
+	GArray *hits = NULL;
+
+	/* whatever the case of the pattern, the casefolded text of a
+	 * matching line contains the casefolded pattern */
+	for (i = 0; i + 3 <= len; i++) {
+		guint32 key = (p[i] << 16) | (p[i + 1] << 8) | p[i + 2];
+		GArray *postings = body_index_get_postings(index, key);
+
+		if (hits == NULL) {
+			hits = postings;
+		} else {
+			guint j, k;
+
+			for (j = 0, k = 0; j < hits->len; j++) {
+				guint num = g_array_index(hits, guint, j);
+
+				if (body_index_sorted_contains(postings, num))
+					g_array_index(hits, guint, k++) = num;
+			}
+			g_array_set_size(hits, k);
+			g_array_free(postings, TRUE);
+		}
+		if (hits->len == 0)
+			break;
+	}
+	g_free(pattern);
+
+	return hits;
+}
+
+/*!
+ *\brief	Prepare ruling out messages of a folder that cannot
+ *		match a predicate
+ *
+ *\param	item Folder searched
+ *\param	predicate Search predicate
+ *
+ *\return	BodyIndexQuery * Query, NULL if the folder has no index
+ *		or the index cannot help with the predicate
+ */
+BodyIndexQuery *body_index_query_new(FolderItem *item, MatcherList *predicate)
+{
+	BodyIndex *index;
+	BodyIndexQuery *query;
+	GSList *l;
+	guint usable = 0, total = 0;
+
+	if (!prefs_common.use_body_index || !predicate)
+		return NULL;
+
+	for (l = predicate->matchers; l != NULL; l = g_slist_next(l)) {
+		if (body_index_prop_usable((MatcherProp *)l->data))
+			usable++;
+		total++;
+	}
+	/* in an OR list every condition has to be ruled out */
+	if (usable == 0 || (!predicate->bool_and && usable < total))
+		return NULL;
+
+	index = body_index_get(item, TRUE);
+	if (!index)
+		return NULL;
+	if (index->ndocs == 0 && g_hash_table_size(index->added) == 0) {
+		/* start indexing, for the next searches */
+		body_index_queue(index);
+		return NULL;
+	}
+
+	query = g_new0(BodyIndexQuery, 1);
+	query->index = index;
+	query->bool_and = predicate->bool_and;
+	query->hits = g_ptr_array_new_with_free_func(body_index_free_postings);
+	for (l = predicate->matchers; l != NULL; l = g_slist_next(l)) {
+		MatcherProp *prop = (MatcherProp *)l->data;
+
+		if (body_index_prop_usable(prop))
+			g_ptr_array_add(query->hits, body_index_prop_hits(index, prop));
+	}
+
+	return query;
+}
+
+/*!
+ *\brief	Check if the index tells that a message cannot match
+ *
+ *\param	query Query from \ref body_index_query_new
+ *\param	msginfo Message of the folder searched
+ *
+ *\return	gboolean TRUE if the message doesn't match, FALSE if it
+ *		has to be tested
+ */
+gboolean body_index_query_excludes(BodyIndexQuery *query, MsgInfo *msginfo)
+{
+	guint i;
+
+	cm_return_val_if_fail(query != NULL, FALSE);
+	cm_return_val_if_fail(msginfo != NULL, FALSE);
+
+	if (!body_index_is_current(query->index, msginfo))
+		return FALSE;
+
+	for (i = 0; i < query->hits->len; i++) {
+		gboolean hit = body_index_sorted_contains(
+				g_ptr_array_index(query->hits, i), msginfo->msgnum);
+
+		if (query->bool_and && !hit)
+			return TRUE;
+		if (!query->bool_and && hit)
+			return FALSE;
+	}
+
+	return !query->bool_and;
+}
+
+void body_index_query_free(BodyIndexQuery *query)
+{
+	if (!query)
+		return;
+
+	g_ptr_array_free(query->hits, TRUE);
+	g_free(query);
+}
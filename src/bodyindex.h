@@ -0,0 +1,52 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __BODYINDEX_H__
+#define __BODYINDEX_H__
+
+#ifdef HAVE_CONFIG_H
+#include "claws-features.h"
+#endif
+
+#include <glib.h>
+
+#include "folder.h"
+#include "matchertypes.h"
+#include "proctypes.h"
+
+/* Optional on-disk index of the trigrams of the (casefolded) text
+ * parts of the messages of a local folder. It is only used to rule out
+ * messages that cannot match a "body contains" condition; the other
+ * messages are still tested with the matcher. */
+
+typedef struct _BodyIndexQuery BodyIndexQuery;
+
+void body_index_schedule	(FolderItem	*item);
+void body_index_remove_msgs	(FolderItem	*item,
+				 const guint	*msgnums,
+				 guint		 count);
+void body_index_forget		(FolderItem	*item);
+
+BodyIndexQuery *body_index_query_new	(FolderItem	*item,
+					 MatcherList	*predicate);
+gboolean body_index_query_excludes	(BodyIndexQuery	*query,
+					 MsgInfo	*msginfo);
+void body_index_query_free		(BodyIndexQuery	*query);
+
+#endif /* __BODYINDEX_H__ */
@@ -1615,6 +1615,19 @@ static gboolean conv_is_ja_locale(void)
 	return is_ja_locale != 0;
 }
 
+/* the charset tables and locale settings above are filled on first use
+ * and not locked; calling this from the main thread fills them all, so
+ * the conversion functions can then be used from other threads */
+void conv_init_locale_tables(void)
+{
+	conv_get_charset_str(C_UTF_8);
+	conv_get_charset_from_str(CS_UTF_8);
+	conv_get_locale_charset_str();
+	conv_get_locale_charset_str_no_utf8();
+	conv_get_outgoing_charset_str();
+	conv_is_ja_locale();
+}
+
 gchar *conv_unmime_header(const gchar *str, const gchar *default_encoding,
 			   gboolean addr_field)
 {
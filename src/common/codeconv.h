@@ -199,6 +199,7 @@ const gchar *conv_get_locale_charset_str_no_utf8(void);
 const gchar *conv_get_outgoing_charset_str	(void);
 
 const gchar *conv_get_current_locale		(void);
+void conv_init_locale_tables			(void);
 
 gchar *conv_unmime_header		(const gchar	*str,
 					  const gchar	*default_encoding,
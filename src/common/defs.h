@@ -97,8 +97,9 @@
 #define OLD_MARK_FILE		".sylpheed_mark"
 #define MARK_FILE		".claws_mark"
 #define TAGS_FILE		".claws_tags"
+#define BODY_INDEX_FILE		".claws_bodyindex"
 #define PRINTING_PAGE_SETUP_STORAGE_FILE "print_page_setup"
-#define CACHE_VERSION		24
+#define CACHE_VERSION		25
 #define MARK_VERSION		2
 #define TAGS_VERSION		1
 
@@ -33,6 +33,11 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef G_OS_WIN32
+#include <dirent.h>
+#endif
 
 #include "defs.h"
 #include "codeconv.h"
@@ -884,3 +889,156 @@ gint prefs_chmod_mode(gchar *chmod_pref)
 
 	return newmode;
 }
+
+struct _DirScanner
+{
+#ifdef G_OS_WIN32
+	GDir *dir;
+	gchar *path;
+#else
+	DIR *dir;
+	struct dirent *entry;
+#endif
+	const gchar *name;
+	DirEntryType type;
+};
+
+/* Opens a directory for scanning with dir_scanner_next(); errors are
+ * reported like g_dir_open() does. */
+DirScanner *dir_scanner_open(const gchar *path, GError **error)
+{
+	DirScanner *scanner;
+
+	cm_return_val_if_fail(path != NULL, NULL);
+
+	scanner = g_new0(DirScanner, 1);
+#ifdef G_OS_WIN32
+	scanner->dir = g_dir_open(path, 0, error);
+	if (scanner->dir == NULL) {
+		g_free(scanner);
+		return NULL;
+	}
+	scanner->path = g_strdup(path);
+#else
+	scanner->dir = opendir(path);
+	if (scanner->dir == NULL) {
+		gint err = errno;
+		gchar *utf8_path = g_filename_to_utf8(path, -1, NULL, NULL, NULL);
+
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+			    "Error opening directory '%s': %s",
+			    utf8_path ? utf8_path : path, g_strerror(err));
+		g_free(utf8_path);
+		g_free(scanner);
+		return NULL;
+	}
+#endif
+
+	return scanner;
+}
+
+/* Returns the name of the next entry, skipping "." and "..", or NULL at
+ * the end of the directory. The name is valid until the next call. */
+const gchar *dir_scanner_next(DirScanner *scanner)
+{
+	cm_return_val_if_fail(scanner != NULL, NULL);
+
+	scanner->type = DIR_ENTRY_UNKNOWN;
+#ifdef G_OS_WIN32
+	scanner->name = g_dir_read_name(scanner->dir);
+#else
+	do {
+		scanner->entry = readdir(scanner->dir);
+		scanner->name = scanner->entry ? scanner->entry->d_name : NULL;
+	} while (scanner->name != NULL && scanner->name[0] == '.' &&
+		 (scanner->name[1] == '\0' ||
+		  (scanner->name[1] == '.' && scanner->name[2] == '\0')));
+#endif
+
+	return scanner->name;
+}
+
+/* Returns the current entry's name as a positive number, or -1 if it
+ * isn't made of digits only; the same as to_number() */
+gint dir_scanner_get_number(DirScanner *scanner)
+{
+	const gchar *p;
+
+	cm_return_val_if_fail(scanner != NULL && scanner->name != NULL, -1);
+
+	if (*scanner->name == '\0')
+		return -1;
+	for (p = scanner->name; *p != '\0'; p++)
+		if (!g_ascii_isdigit(*p))
+			return -1;
+
+	return atoi(scanner->name);
+}
+
+/* Returns the type of the current entry, following symlinks */
+DirEntryType dir_scanner_get_type(DirScanner *scanner)
+{
+#ifdef G_OS_WIN32
+	gchar *fullpath;
+#else
+	struct stat s;
+#endif
+
+	cm_return_val_if_fail(scanner != NULL && scanner->name != NULL,
+			      DIR_ENTRY_UNKNOWN);
+
+	if (scanner->type != DIR_ENTRY_UNKNOWN)
+		return scanner->type;
+
+#ifdef G_OS_WIN32
+	fullpath = g_strconcat(scanner->path, G_DIR_SEPARATOR_S,
+			       scanner->name, NULL);
+	if (g_file_test(fullpath, G_FILE_TEST_IS_REGULAR))
+		scanner->type = DIR_ENTRY_FILE;
+	else if (g_file_test(fullpath, G_FILE_TEST_IS_DIR))
+		scanner->type = DIR_ENTRY_DIR;
+	else if (g_file_test(fullpath, G_FILE_TEST_EXISTS))
+		scanner->type = DIR_ENTRY_OTHER;
+	g_free(fullpath);
+#else
+#ifdef DT_UNKNOWN
+	switch (scanner->entry->d_type) {
+	case DT_REG:
+		scanner->type = DIR_ENTRY_FILE;
+		return scanner->type;
+	case DT_DIR:
+		scanner->type = DIR_ENTRY_DIR;
+		return scanner->type;
+	case DT_UNKNOWN:
+	case DT_LNK:
+		break;
+	default:
+		scanner->type = DIR_ENTRY_OTHER;
+		return scanner->type;
+	}
+#endif
+	if (fstatat(dirfd(scanner->dir), scanner->name, &s, 0) == 0) {
+		if (S_ISREG(s.st_mode))
+			scanner->type = DIR_ENTRY_FILE;
+		else if (S_ISDIR(s.st_mode))
+			scanner->type = DIR_ENTRY_DIR;
+		else
+			scanner->type = DIR_ENTRY_OTHER;
+	}
+#endif
+
+	return scanner->type;
+}
+
+void dir_scanner_close(DirScanner *scanner)
+{
+	cm_return_if_fail(scanner != NULL);
+
+#ifdef G_OS_WIN32
+	g_dir_close(scanner->dir);
+	g_free(scanner->path);
+#else
+	closedir(scanner->dir);
+#endif
+	g_free(scanner);
+}
@@ -102,5 +102,24 @@ gint str_write_to_file		(const gchar	*str,
 
 gint prefs_chmod_mode		(gchar *chmod_pref);
 
+/* directory scanning; entry types are taken from the directory entries
+ * where the system provides them, and only stat()ed otherwise */
+typedef enum
+{
+	DIR_ENTRY_UNKNOWN,
+	DIR_ENTRY_FILE,
+	DIR_ENTRY_DIR,
+	DIR_ENTRY_OTHER
+} DirEntryType;
+
+typedef struct _DirScanner	DirScanner;
+
+DirScanner *dir_scanner_open	(const gchar	*path,
+				 GError	       **error);
+const gchar *dir_scanner_next	(DirScanner	*scanner);
+gint dir_scanner_get_number	(DirScanner	*scanner);
+DirEntryType dir_scanner_get_type(DirScanner	*scanner);
+void dir_scanner_close		(DirScanner	*scanner);
+
 
 #endif
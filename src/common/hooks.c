@@ -128,3 +128,22 @@ gboolean hooks_invoke(const gchar *hooklist_name,
 
 	return marshal_data.abort;
 }
+
+/* Whether invoking the hooklist would call anything */
+gboolean hooks_has_hooks(const gchar *hooklist_name)
+{
+	GHookList *hooklist;
+	GHook *hook;
+
+	cm_return_val_if_fail(hooklist_name != NULL, FALSE);
+
+	hooklist = hooks_get_hooklist(hooklist_name);
+	cm_return_val_if_fail(hooklist != NULL, FALSE);
+
+	hook = g_hook_first_valid(hooklist, TRUE);
+	if (hook == NULL)
+		return FALSE;
+	g_hook_unref(hooklist, hook);
+
+	return TRUE;
+}
@@ -34,5 +34,6 @@ void hooks_unregister_hook	(const gchar		*hooklist_name,
 				 gulong			 hook_id);
 gboolean hooks_invoke		(const gchar		*hooklist_name,
 				 gpointer		 source);
+gboolean hooks_has_hooks		(const gchar		*hooklist_name);
 
 #endif /* HOOKS_H */
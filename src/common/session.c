@@ -45,6 +45,8 @@ static gint session_close		(Session	*session);
 static gboolean session_timeout_cb	(gpointer	 data);
 
 static gboolean session_recv_msg_idle_cb	(gpointer	 data);
+static gint session_recv_data_start	(Session	*session,
+					 const gchar	*terminator);
 static gboolean session_recv_data_idle_cb	(gpointer	 data);
 
 static gboolean session_read_msg_cb	(SockInfo	*source,
@@ -86,6 +88,9 @@ void session_init(Session *session, const void *prefs_account, gboolean is_smtp)
 
 	session->read_msg_buf = g_string_sized_new(1024);
 	session->read_data_buf = g_byte_array_new();
+	session->read_data_sink = NULL;
+	session->read_data_sink_data = NULL;
+	session->read_data_sunk = 0;
 
 	session->write_buf = NULL;
 	session->write_buf_p = NULL;
@@ -526,6 +531,32 @@ gint session_recv_data(Session *session, guint size, const gchar *terminator)
 {
 	cm_return_val_if_fail(session->read_data_buf->len == 0, -1);
 
+	session->read_data_sink = NULL;
+	session->read_data_sink_data = NULL;
+	session->read_data_sunk = 0;
+
+	return session_recv_data_start(session, terminator);
+}
+
+/* Like session_recv_data(), but the data are handed to sink as they are
+ * received, so that only the last few bytes, which might be part of the
+ * terminator, are kept in memory. recv_data_finished() is then called
+ * with NULL data and the total length. */
+gint session_recv_data_stream(Session *session, const gchar *terminator,
+			      RecvDataSink sink, gpointer data)
+{
+	cm_return_val_if_fail(session->read_data_buf->len == 0, -1);
+	cm_return_val_if_fail(sink != NULL, -1);
+
+	session->read_data_sink = sink;
+	session->read_data_sink_data = data;
+	session->read_data_sunk = 0;
+
+	return session_recv_data_start(session, terminator);
+}
+
+static gint session_recv_data_start(Session *session, const gchar *terminator)
+{
 	session->state = SESSION_RECV;
 
 	g_free(session->read_data_terminator);
@@ -659,7 +690,8 @@ static gboolean session_read_data_cb(SockInfo *source, GIOCondition condition,
 	GByteArray *data_buf;
 	gint terminator_len;
 	gboolean complete = FALSE;
-	guint data_len;
+	guint data_len = 0;
+	guint scan_from;
 	gint ret;
 
 	cm_return_val_if_fail(condition == G_IO_IN, FALSE);
@@ -698,6 +730,10 @@ static gboolean session_read_data_cb(SockInfo *source, GIOCondition condition,
 	if (session->read_buf_len == 0)
 		return TRUE;
 
+	/* the terminator may have been cut at the end of the previous read */
+	scan_from = data_buf->len > terminator_len + 2 ?
+		data_buf->len - (terminator_len + 2) : 0;
+
 	g_byte_array_append(data_buf, session->read_buf_p,
 			    session->read_buf_len);
 
@@ -705,27 +741,65 @@ static gboolean session_read_data_cb(SockInfo *source, GIOCondition condition,
 	session->read_buf_p = session->read_buf;
 
 	/* check if data is terminated */
-	if (data_buf->len >= terminator_len) {
-		if (memcmp(data_buf->data, session->read_data_terminator,
-			   terminator_len) == 0)
-			complete = TRUE;
-		else if (data_buf->len >= terminator_len + 2 &&
-			 memcmp(data_buf->data + data_buf->len -
-				(terminator_len + 2), "\r\n", 2) == 0 &&
-			 memcmp(data_buf->data + data_buf->len -
-				terminator_len, session->read_data_terminator,
-				terminator_len) == 0)
+	if (session->read_data_sunk == 0 && data_buf->len >= terminator_len &&
+	    memcmp(data_buf->data, session->read_data_terminator,
+		   terminator_len) == 0) {
+		complete = TRUE;
+		data_len = 0;
+	} else {
+		gchar *needle;
+		guchar *found;
+
+		needle = g_strconcat("\r\n", session->read_data_terminator, NULL);
+		found = my_memmem(data_buf->data + scan_from,
+				  data_buf->len - scan_from,
+				  needle, terminator_len + 2);
+		g_free(needle);
+		if (found != NULL) {
 			complete = TRUE;
+			data_len = found + 2 - data_buf->data;
+		}
+	}
+
+	/* what follows the terminator is the next response of a
+	 * pipelining server, leave it to be read */
+	if (complete) {
+		guint rest = data_buf->len - (data_len + terminator_len);
+
+		if (rest > 0) {
+			memcpy(session->read_buf,
+			       data_buf->data + data_len + terminator_len, rest);
+			session->read_buf_len = rest;
+			g_byte_array_set_size(data_buf, data_len + terminator_len);
+		}
 	}
 
 	/* incomplete read */
 	if (!complete) {
-		GDateTime *tv_cur = g_date_time_new_now_local();
+		GDateTime *tv_cur;
+		GTimeSpan ts;
+
+		/* pass on all but what could be the start of the
+		 * terminator and its preceding CRLF */
+		if (session->read_data_sink != NULL &&
+		    data_buf->len > terminator_len + 2) {
+			guint len = data_buf->len - (terminator_len + 2);
+
+			if (session->read_data_sink(session, data_buf->data, len,
+					session->read_data_sink_data) < 0) {
+				g_byte_array_set_size(data_buf, 0);
+				session->state = SESSION_ERROR;
+				return FALSE;
+			}
+			g_byte_array_remove_range(data_buf, 0, len);
+			session->read_data_sunk += len;
+		}
 
-		GTimeSpan ts = g_date_time_difference(tv_cur, session->tv_prev);
+		tv_cur = g_date_time_new_now_local();
+		ts = g_date_time_difference(tv_cur, session->tv_prev);
                 if (1000 - ts < 0 || ts > UI_REFRESH_INTERVAL) {
                         session->recv_data_progressive_notify
-                                (session, data_buf->len, 0,
+                                (session, session->read_data_sunk + data_buf->len, 0,
                                  session->recv_data_progressive_notify_data);
 			g_date_time_unref(session->tv_prev);
                         session->tv_prev = g_date_time_new_now_local();
@@ -740,11 +814,22 @@ static gboolean session_read_data_cb(SockInfo *source, GIOCondition condition,
 		session->io_tag = 0;
 	}
 
-	data_len = data_buf->len - terminator_len;
-
 	/* callback */
-	ret = session->recv_data_finished(session, (gchar *)data_buf->data,
-					  data_len);
+	if (session->read_data_sink != NULL) {
+		ret = 0;
+		if (data_len > 0)
+			ret = session->read_data_sink(session, data_buf->data,
+					data_len, session->read_data_sink_data);
+		data_len += session->read_data_sunk;
+		session->read_data_sink = NULL;
+		session->read_data_sink_data = NULL;
+		session->read_data_sunk = 0;
+		if (ret >= 0)
+			ret = session->recv_data_finished(session, NULL,
+							  data_len);
+	} else
+		ret = session->recv_data_finished(session, (gchar *)data_buf->data,
+						  data_len);
 
 	g_byte_array_set_size(data_buf, 0);
 
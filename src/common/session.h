@@ -66,6 +66,10 @@ typedef gint (*RecvDataProgressiveNotify)	(Session	*session,
 typedef gint (*RecvDataNotify)			(Session	*session,
 						 guint		 len,
 						 gpointer	 user_data);
+typedef gint (*RecvDataSink)			(Session	*session,
+						 const guchar	*data,
+						 guint		 len,
+						 gpointer	 user_data);
 typedef gint (*SendDataProgressiveNotify)	(Session	*session,
 						 guint		 cur_len,
 						 guint		 total_len,
@@ -101,6 +105,12 @@ struct _Session
 	GByteArray *read_data_buf;
 	gchar *read_data_terminator;
 
+	/* where received data goes as it comes, instead of staying in
+	 * read_data_buf, and how much went there */
+	RecvDataSink read_data_sink;
+	gpointer read_data_sink_data;
+	guint read_data_sunk;
+
 	/* buffer for short messages */
 	gchar *write_buf;
 	gchar *write_buf_p;
@@ -210,6 +220,11 @@ gint session_send_data	(Session	*session,
 gint session_recv_data	(Session	*session,
 			 guint		 size,
 			 const gchar	*terminator);
+gint session_recv_data_stream
+			(Session	*session,
+			 const gchar	*terminator,
+			 RecvDataSink	 sink,
+			 gpointer	 data);
 void session_register_ping(Session *session, gboolean (*ping_cb)(gpointer data));
 
 #endif /* __SESSION_H__ */
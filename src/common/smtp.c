@@ -56,6 +56,7 @@ static gint smtp_ehlo_recv(SMTPSession *session, const gchar *msg);
 static gint smtp_helo(SMTPSession *session);
 static gint smtp_rcpt(SMTPSession *session);
 static gint smtp_data(SMTPSession *session);
+static gint smtp_bdat(SMTPSession *session);
 static gint smtp_send_data(SMTPSession *session);
 static gint smtp_make_ready(SMTPSession *session);
 static gint smtp_eom(SMTPSession *session);
@@ -97,6 +98,9 @@ Session *smtp_session_new(void *prefs_account)
 
 	session->send_data                 = NULL;
 	session->send_data_len             = 0;
+	session->send_data_pos             = 0;
+	session->send_data_next            = 0;
+	session->send_cmd                  = NULL;
 
 	session->avail_auth_type           = 0;
 	session->forced_auth_type          = 0;
@@ -119,10 +123,31 @@ static void smtp_session_destroy(Session *session)
 	g_free(smtp_session->from);
 
 	g_free(smtp_session->send_data);
+	g_free(smtp_session->send_cmd);
 
 	g_free(smtp_session->error_msg);
 }
 
+static gboolean smtp_is_pipelining(SMTPSession *session)
+{
+	return session->is_esmtp &&
+		(session->esmtp_flags & ESMTP_PIPELINING) != 0;
+}
+
+static gboolean smtp_is_chunking(SMTPSession *session)
+{
+	return session->is_esmtp &&
+		(session->esmtp_flags & ESMTP_CHUNKING) != 0;
+}
+
+static void smtp_rcpt_command(const gchar *to, gchar *buf, gsize len)
+{
+	if (strchr(to, '<'))
+		g_snprintf(buf, len, "RCPT TO:%s", to);
+	else
+		g_snprintf(buf, len, "RCPT TO:<%s>", to);
+}
+
 gint smtp_from(SMTPSession *session)
 {
 	gchar buf[MESSAGEBUFSIZE];
@@ -147,6 +172,32 @@ gint smtp_from(SMTPSession *session)
 
 	g_free(mail_size);
 
+	if (smtp_is_pipelining(session) && session->cur_to != NULL) {
+		GString *cmds;
+		GSList *cur;
+		gint ret;
+
+		/* send the whole envelope at once (RFC 2920), the replies
+		 * are then read one by one, cur_to following them */
+		log_print(LOG_PROTOCOL, "ESMTP> %s\n", buf);
+		cmds = g_string_new(buf);
+		for (cur = session->cur_to; cur != NULL; cur = cur->next) {
+			smtp_rcpt_command((gchar *)cur->data, buf, sizeof(buf));
+			log_print(LOG_PROTOCOL, "ESMTP> %s\n", buf);
+			g_string_append(cmds, "\r\n");
+			g_string_append(cmds, buf);
+		}
+		/* BDAT needs no reply before the data is sent */
+		if (!smtp_is_chunking(session)) {
+			log_print(LOG_PROTOCOL, "ESMTP> DATA\n");
+			g_string_append(cmds, "\r\nDATA");
+		}
+		ret = session_send_msg(SESSION(session), cmds->str);
+		g_string_free(cmds, TRUE);
+
+		return ret < 0 ? SM_ERROR : SM_OK;
+	}
+
 	if (session_send_msg(SESSION(session), buf) < 0)
 		return SM_ERROR;
 	log_print(LOG_PROTOCOL, "%sSMTP> %s\n", (session->is_esmtp?"E":""), buf);
@@ -298,7 +349,9 @@ static gint smtp_ehlo(SMTPSession *session)
 
 	session->state = SMTP_EHLO;
 
+	/* what was announced before STARTTLS does not count */
 	session->avail_auth_type = 0;
+	session->esmtp_flags = 0;
 
 	g_snprintf(buf, sizeof(buf), "EHLO %s",
 		   session->hostname ? session->hostname : get_domain_name());
@@ -339,6 +392,10 @@ static gint smtp_ehlo_recv(SMTPSession *session, const gchar *msg)
 			p += 9;
 			session->avail_auth_type |= SMTPAUTH_TLS_AVAILABLE;
 		}
+		if (g_ascii_strncasecmp(p, "PIPELINING", 10) == 0)
+			session->esmtp_flags |= ESMTP_PIPELINING;
+		if (g_ascii_strncasecmp(p, "CHUNKING", 8) == 0)
+			session->esmtp_flags |= ESMTP_CHUNKING;
 		return SM_OK;
 	} else if ((msg[0] == '1' || msg[0] == '2' || msg[0] == '3') &&
 	    (msg[3] == ' ' || msg[3] == '\0'))
@@ -472,10 +529,7 @@ static gint smtp_rcpt(SMTPSession *session)
 
 	to = (gchar *)session->cur_to->data;
 
-	if (strchr(to, '<'))
-		g_snprintf(buf, sizeof(buf), "RCPT TO:%s", to);
-	else
-		g_snprintf(buf, sizeof(buf), "RCPT TO:<%s>", to);
+	smtp_rcpt_command(to, buf, sizeof(buf));
 	if (session_send_msg(SESSION(session), buf) < 0)
 		return SM_ERROR;
 	log_print(LOG_PROTOCOL, "SMTP> %s\n", buf);
@@ -496,16 +550,82 @@ static gint smtp_data(SMTPSession *session)
 	return SM_OK;
 }
 
-static gint smtp_send_data(SMTPSession *session)
+/* Writes send_data from send_data_next on, without copying it. For
+ * DATA, a slice ends after the next dot starting a line, and the next
+ * one starts on that same dot so that it is written twice. */
+static gint smtp_send_slice(SMTPSession *session)
+{
+	const guchar *data = session->send_data;
+	guint len = session->send_data_len;
+	guint start = session->send_data_next, end = len;
+	gboolean dot = FALSE;
+
+	if (!smtp_is_chunking(session)) {
+		const guchar *p = data + start, *eol;
+
+		while ((eol = memchr(p, '\n', data + len - p)) != NULL &&
+		       eol + 1 < data + len) {
+			if (eol[1] == '.') {
+				end = eol + 2 - data;
+				dot = TRUE;
+				break;
+			}
+			p = eol + 1;
+		}
+	}
+
+	session->send_data_pos = start;
+	session->send_data_next = dot ? end - 1 : end;
+
+	if (session_send_data(SESSION(session), data + start, end - start) < 0)
+		return SM_ERROR;
+
+	return SM_OK;
+}
+
+/* Sends the message in a single chunk (RFC 3030), as is, right after
+ * the command */
+static gint smtp_bdat(SMTPSession *session)
 {
 	session->state = SMTP_SEND_DATA;
 
-	session_send_data(SESSION(session), session->send_data,
-			  session->send_data_len);
+	g_free(session->send_cmd);
+	session->send_cmd = g_strdup_printf("BDAT %u LAST\r\n",
+					    session->send_data_len);
+	log_print(LOG_PROTOCOL, "ESMTP> BDAT %u LAST\n",
+		  session->send_data_len);
+	session->send_data_pos = 0;
+	session->send_data_next = 0;
+
+	if (session_send_data(SESSION(session),
+			      (const guchar *)session->send_cmd,
+			      strlen(session->send_cmd)) < 0)
+		return SM_ERROR;
 
 	return SM_OK;
 }
 
+static gint smtp_send_data(SMTPSession *session)
+{
+	session->state = SMTP_SEND_DATA;
+
+	session->send_data_pos = 0;
+	session->send_data_next = 0;
+
+	if (session->send_data_len == 0)
+		return smtp_eom(session);
+
+	/* the one dot that doesn't follow a newline */
+	if (session->send_data[0] == '.') {
+		if (session_send_data(SESSION(session),
+				      (const guchar *)".", 1) < 0)
+			return SM_ERROR;
+		return SM_OK;
+	}
+
+	return smtp_send_slice(session);
+}
+
 static gint smtp_make_ready(SMTPSession *session)
 {
 	session->state = SMTP_MAIL_SENT_OK;
@@ -527,6 +647,13 @@ static gint smtp_eom(SMTPSession *session)
 {
 	session->state = SMTP_EOM;
 
+	g_free(session->send_cmd);
+	session->send_cmd = NULL;
+
+	/* the BDAT LAST chunk needs no end marker */
+	if (smtp_is_chunking(session))
+		return session_recv_msg(SESSION(session)) < 0 ? SM_ERROR : SM_OK;
+
 	if (session_send_msg(SESSION(session), ".") < 0)
 		return SM_ERROR;
 	log_print(LOG_PROTOCOL, "SMTP> . (EOM)\n");
@@ -684,12 +811,30 @@ static gint smtp_session_recv_msg(Session *session, const gchar *msg)
 		ret = smtp_from(smtp_session);
 		break;
 	case SMTP_FROM:
-		if (smtp_session->cur_to)
+		if (smtp_session->cur_to == NULL)
+			break;
+		if (smtp_is_pipelining(smtp_session)) {
+			smtp_session->state = SMTP_RCPT;
+			cont = TRUE;
+		} else
 			ret = smtp_rcpt(smtp_session);
 		break;
 	case SMTP_RCPT:
-		if (smtp_session->cur_to)
+		if (smtp_is_pipelining(smtp_session)) {
+			/* all were sent along with MAIL FROM */
+			smtp_session->cur_to = smtp_session->cur_to->next;
+			if (smtp_session->cur_to)
+				cont = TRUE;
+			else if (smtp_is_chunking(smtp_session))
+				ret = smtp_bdat(smtp_session);
+			else {
+				smtp_session->state = SMTP_DATA;
+				cont = TRUE;
+			}
+		} else if (smtp_session->cur_to)
 			ret = smtp_rcpt(smtp_session);
+		else if (smtp_is_chunking(smtp_session))
+			ret = smtp_bdat(smtp_session);
 		else
 			ret = smtp_data(smtp_session);
 		break;
@@ -720,5 +865,11 @@ static gint smtp_session_recv_msg(Session *session, const gchar *msg)
 
 static gint smtp_session_send_data_finished(Session *session, guint len)
 {
-	return smtp_eom(SMTP_SESSION(session));
+	SMTPSession *smtp_session = SMTP_SESSION(session);
+
+	/* the rest of the data, slice by slice */
+	if (smtp_session->send_data_next < smtp_session->send_data_len)
+		return smtp_send_slice(smtp_session);
+
+	return smtp_eom(smtp_session);
 }
@@ -46,7 +46,9 @@ typedef enum
 {
 	ESMTP_8BITMIME	= 1 << 0,
 	ESMTP_SIZE	= 1 << 1,
-	ESMTP_ETRN	= 1 << 2
+	ESMTP_ETRN	= 1 << 2,
+	ESMTP_PIPELINING = 1 << 3,
+	ESMTP_CHUNKING	= 1 << 4
 } ESMTPFlag;
 
 typedef enum
@@ -100,9 +102,13 @@ struct _SMTPSession
 	GSList *to_list;
 	GSList *cur_to;
 
-	guchar *send_data;
+	guchar *send_data;	/* not dot-stuffed */
 	guint send_data_len;
 
+	guint send_data_pos;	/* where the slice being written starts */
+	guint send_data_next;	/* where the next one starts */
+	gchar *send_cmd;	/* the BDAT command, written before the data */
+
 	guint max_message_size;
 
 	SMTPAuthType avail_auth_type;
@@ -74,3 +74,196 @@ gchar *string_remove_match(gchar *buf, gint buflen, gchar * txt, regex_t *preg)
 	return txt;
 }
 
+
+struct _StringMatchSet {
+	GPtrArray *patterns;	/* pattern strings, indexed by id */
+	GHashTable *ids;	/* pattern string -> id + 1 */
+	gint empty_id;		/* id of the empty pattern, or -1 */
+
+	/* compiled automaton, valid once compiled is set */
+	gboolean compiled;
+	guint8 byte_class[256];	/* byte -> input class, 0 for bytes
+				   not used by any pattern */
+	guint nclasses;
+	guint nstates;
+	gint *delta;		/* nstates * nclasses transitions */
+	gint *state_pattern;	/* id of the pattern ending in a state,
+				   or -1 */
+	gint *state_dict;	/* nearest state on the failure chain
+				   with a pattern, or 0 */
+};
+
+StringMatchSet *string_match_set_new(void)
+{
+	StringMatchSet *set = g_new0(StringMatchSet, 1);
+
+	set->patterns = g_ptr_array_new_with_free_func(g_free);
+	set->ids = g_hash_table_new(g_str_hash, g_str_equal);
+	set->empty_id = -1;
+
+	return set;
+}
+
+void string_match_set_free(StringMatchSet *set)
+{
+	if (!set)
+		return;
+
+	g_hash_table_destroy(set->ids);
+	g_ptr_array_free(set->patterns, TRUE);
+	g_free(set->delta);
+	g_free(set->state_pattern);
+	g_free(set->state_dict);
+	g_free(set);
+}
+
+/* identical patterns share the same id */
+guint string_match_set_add(StringMatchSet *set, const gchar *pattern)
+{
+	gchar *copy;
+	guint id;
+
+	cm_return_val_if_fail(set != NULL, 0);
+	cm_return_val_if_fail(pattern != NULL, 0);
+	cm_return_val_if_fail(!set->compiled, 0);
+
+	id = GPOINTER_TO_UINT(g_hash_table_lookup(set->ids, pattern));
+	if (id > 0)
+		return id - 1;
+
+	copy = g_strdup(pattern);
+	id = set->patterns->len;
+	g_ptr_array_add(set->patterns, copy);
+	g_hash_table_insert(set->ids, copy, GUINT_TO_POINTER(id + 1));
+	if (*copy == '\0')
+		set->empty_id = id;
+
+	return id;
+}
+
+guint string_match_set_get_size(StringMatchSet *set)
+{
+	cm_return_val_if_fail(set != NULL, 0);
+
+	return set->patterns->len;
+}
+
+void string_match_set_compile(StringMatchSet *set)
+{
+	guint i, c, nstates, alloc;
+	gint *queue;
+	guint head, tail;
+
+	cm_return_if_fail(set != NULL);
+	cm_return_if_fail(!set->compiled);
+
+	/* only the bytes used by the patterns need their own column */
+	memset(set->byte_class, 0, sizeof(set->byte_class));
+	set->nclasses = 1;
+	alloc = 1;
+	for (i = 0; i < set->patterns->len; i++) {
+		const guchar *p = g_ptr_array_index(set->patterns, i);
+
+		for (; *p; p++) {
+			if (set->byte_class[*p] == 0)
+				set->byte_class[*p] = set->nclasses++;
+			alloc++;
+		}
+	}
+
+	set->delta = g_new(gint, alloc * set->nclasses);
+	memset(set->delta, 0xff, alloc * set->nclasses * sizeof(gint));
+	set->state_pattern = g_new(gint, alloc);
+	set->state_dict = g_new0(gint, alloc);
+	set->state_pattern[0] = -1;
+	nstates = 1;
+
+	/* build the trie */
+	for (i = 0; i < set->patterns->len; i++) {
+		const guchar *p = g_ptr_array_index(set->patterns, i);
+		gint state = 0;
+
+		if (*p == '\0')
+			continue;
+		for (; *p; p++) {
+			gint *next = &set->delta[state * set->nclasses
+						 + set->byte_class[*p]];
+
+			if (*next < 0) {
+				*next = nstates;
+				set->state_pattern[nstates] = -1;
+				nstates++;
+			}
+			state = *next;
+		}
+		set->state_pattern[state] = i;
+	}
+	set->nstates = nstates;
+
+	/* breadth-first walk to turn the trie into a complete automaton;
+	 * the failure state of each state is kept in state_dict until
+	 * the state is dequeued */
+	queue = g_new(gint, nstates);
+	head = tail = 0;
+	for (c = 0; c < set->nclasses; c++) {
+		gint *next = &set->delta[c];
+
+		if (*next < 0) {
+			*next = 0;
+		} else {
+			set->state_dict[*next] = 0;
+			queue[tail++] = *next;
+		}
+	}
+	while (head < tail) {
+		gint state = queue[head++];
+		gint fail = set->state_dict[state];
+
+		/* report the nearest failure state that ends a pattern */
+		set->state_dict[state] = set->state_pattern[fail] >= 0
+			? fail : (fail > 0 ? set->state_dict[fail] : 0);
+
+		for (c = 0; c < set->nclasses; c++) {
+			gint *next = &set->delta[state * set->nclasses + c];
+			gint fail_next = set->delta[fail * set->nclasses + c];
+
+			if (*next < 0) {
+				*next = fail_next;
+			} else {
+				/* stored as the failure state, see above */
+				set->state_dict[*next] = fail_next;
+				queue[tail++] = *next;
+			}
+		}
+	}
+	g_free(queue);
+
+	set->compiled = TRUE;
+}
+
+void string_match_set_scan(StringMatchSet *set, const gchar *txt,
+			   gboolean *found)
+{
+	const guchar *p;
+	gint state = 0;
+
+	cm_return_if_fail(set != NULL && set->compiled);
+	cm_return_if_fail(found != NULL);
+
+	if (txt == NULL)
+		return;
+
+	if (set->empty_id >= 0)
+		found[set->empty_id] = TRUE;
+
+	for (p = (const guchar *)txt; *p; p++) {
+		gint s;
+
+		state = set->delta[state * set->nclasses
+				   + set->byte_class[*p]];
+		s = set->state_pattern[state] >= 0
+			? state : set->state_dict[state];
+		for (; s > 0; s = set->state_dict[s])
+			found[set->state_pattern[s]] = TRUE;
+	}
+}
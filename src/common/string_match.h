@@ -32,4 +32,19 @@
  */
 gchar *string_remove_match(gchar *buf, gint buflen, gchar * txt, regex_t *preg);
 
+/* set of literal patterns searched for in a single pass over a text
+ * (Aho-Corasick). Patterns are added, the set is compiled once, then
+ * string_match_set_scan() sets found[id] to TRUE for every pattern id
+ * occurring in txt, exactly as strstr(txt, pattern) != NULL would.
+ */
+typedef struct _StringMatchSet StringMatchSet;
+
+StringMatchSet *string_match_set_new(void);
+void string_match_set_free(StringMatchSet *set);
+guint string_match_set_add(StringMatchSet *set, const gchar *pattern);
+guint string_match_set_get_size(StringMatchSet *set);
+void string_match_set_compile(StringMatchSet *set);
+void string_match_set_scan(StringMatchSet *set, const gchar *txt,
+			   gboolean *found);
+
 #endif /* STRING_MATCH_H__ */
@@ -0,0 +1,108 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "utils.h"
+#include "file-utils.h"
+
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+
+static void
+touch(const gchar *dir, const gchar *name)
+{
+	gchar *path = g_build_filename(dir, name, NULL);
+
+	g_assert_true(g_file_set_contents(path, "", 0, NULL));
+	g_free(path);
+}
+
+static void
+test_file_utils_dir_scanner(void)
+{
+	gchar *dir = g_dir_make_tmp("dir_scanner_XXXXXX", NULL);
+	gchar *subdir, *path;
+	DirScanner *scanner;
+	const gchar *name;
+	guint n_files = 0, n_dirs = 0, n_links = 0;
+
+	g_assert_nonnull(dir);
+
+	touch(dir, "1");
+	touch(dir, "42");
+	touch(dir, ".mh_sequences");
+	touch(dir, "12abc");
+	subdir = g_build_filename(dir, "sub", NULL);
+	g_assert_cmpint(g_mkdir(subdir, 0700), ==, 0);
+#ifndef G_OS_WIN32
+	path = g_build_filename(dir, "7", NULL);
+	g_assert_cmpint(symlink("42", path), ==, 0);
+	g_free(path);
+#endif
+
+	scanner = dir_scanner_open(dir, NULL);
+	g_assert_nonnull(scanner);
+
+	while ((name = dir_scanner_next(scanner)) != NULL) {
+		g_assert_cmpstr(name, !=, ".");
+		g_assert_cmpstr(name, !=, "..");
+
+		if (!strcmp(name, "1") || !strcmp(name, "42")) {
+			g_assert_cmpint(dir_scanner_get_number(scanner), ==, atoi(name));
+			g_assert_cmpint(dir_scanner_get_type(scanner), ==, DIR_ENTRY_FILE);
+			n_files++;
+		} else if (!strcmp(name, "7")) {
+			/* symlinks are followed */
+			g_assert_cmpint(dir_scanner_get_number(scanner), ==, 7);
+			g_assert_cmpint(dir_scanner_get_type(scanner), ==, DIR_ENTRY_FILE);
+			n_links++;
+		} else if (!strcmp(name, "sub")) {
+			g_assert_cmpint(dir_scanner_get_number(scanner), ==, -1);
+			g_assert_cmpint(dir_scanner_get_type(scanner), ==, DIR_ENTRY_DIR);
+			n_dirs++;
+		} else {
+			g_assert_cmpint(dir_scanner_get_number(scanner), ==, -1);
+		}
+	}
+	dir_scanner_close(scanner);
+
+	g_assert_cmpuint(n_files, ==, 2);
+	g_assert_cmpuint(n_dirs, ==, 1);
+#ifndef G_OS_WIN32
+	g_assert_cmpuint(n_links, ==, 1);
+#endif
+
+	remove_dir_recursive(dir);
+	g_free(subdir);
+	g_free(dir);
+}
+
+static void
+test_file_utils_dir_scanner_missing(void)
+{
+	GError *error = NULL;
+	DirScanner *scanner;
+
+	scanner = dir_scanner_open("/nonexistent/dir_scanner", &error);
+	g_assert_null(scanner);
+	g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+	g_error_free(error);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/common/file_utils/dir_scanner/scan",
+			test_file_utils_dir_scanner);
+	g_test_add_func("/common/file_utils/dir_scanner/missing",
+			test_file_utils_dir_scanner_missing);
+
+	return g_test_run();
+}
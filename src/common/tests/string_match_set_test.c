@@ -0,0 +1,213 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "utils.h"
+#include "string_match.h"
+
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+
+#define PERF_RULES 150
+#define PERF_MESSAGES 20000
+
+static const gchar *words[] = {
+	"invoice", "meeting", "Re:", "Fwd:", "release", "ünïcödé", "build",
+	"failure", "lunch", "report", "weekly", "digest", "newsletter",
+	"claws", "mail", "patch", "bug", "urgent", "offer", "Straße"
+};
+
+static void
+assert_same_as_strstr(StringMatchSet *set, GPtrArray *patterns,
+		      const gchar *txt)
+{
+	gboolean *found = g_new0(gboolean, string_match_set_get_size(set));
+	guint i;
+
+	string_match_set_scan(set, txt, found);
+	for (i = 0; i < patterns->len; i++) {
+		const gchar *pattern = g_ptr_array_index(patterns, i);
+
+		if ((strstr(txt, pattern) != NULL) != found[i])
+			g_error("pattern '%s' in '%s': set says %d",
+				pattern, txt, found[i]);
+	}
+	g_free(found);
+}
+
+static void
+test_string_match_set_overlapping(void)
+{
+	const gchar *pats[] = { "he", "she", "his", "hers", "", "s", "hershe" };
+	GPtrArray *patterns = g_ptr_array_new();
+	StringMatchSet *set = string_match_set_new();
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(pats); i++) {
+		g_assert_cmpuint(string_match_set_add(set, pats[i]), ==, i);
+		g_ptr_array_add(patterns, (gpointer)pats[i]);
+	}
+	/* duplicates share the id */
+	g_assert_cmpuint(string_match_set_add(set, "his"), ==, 2);
+	g_assert_cmpuint(string_match_set_get_size(set), ==, G_N_ELEMENTS(pats));
+	string_match_set_compile(set);
+
+	assert_same_as_strstr(set, patterns, "ushers");
+	assert_same_as_strstr(set, patterns, "hershey");
+	assert_same_as_strstr(set, patterns, "xyz");
+	assert_same_as_strstr(set, patterns, "");
+	assert_same_as_strstr(set, patterns, "hhhhisss");
+
+	string_match_set_free(set);
+	g_ptr_array_free(patterns, TRUE);
+}
+
+static void
+test_string_match_set_random(void)
+{
+	GRand *rand = g_rand_new_with_seed(42);
+	GPtrArray *patterns = g_ptr_array_new_with_free_func(g_free);
+	StringMatchSet *set = string_match_set_new();
+	guint i, j;
+
+	/* small alphabet, so that patterns overlap a lot */
+	for (i = 0; i < 200; i++) {
+		gint len = g_rand_int_range(rand, 1, 6);
+		gchar *pattern = g_malloc(len + 1);
+
+		for (j = 0; j < len; j++)
+			pattern[j] = 'a' + g_rand_int_range(rand, 0, 4);
+		pattern[len] = '\0';
+		if (string_match_set_add(set, pattern) == patterns->len)
+			g_ptr_array_add(patterns, pattern);
+		else
+			g_free(pattern);
+	}
+	string_match_set_compile(set);
+
+	for (i = 0; i < 1000; i++) {
+		gchar txt[33];
+		gint len = g_rand_int_range(rand, 0, 32);
+
+		for (j = 0; j < len; j++)
+			txt[j] = 'a' + g_rand_int_range(rand, 0, 5);
+		txt[len] = '\0';
+		assert_same_as_strstr(set, patterns, txt);
+	}
+
+	string_match_set_free(set);
+	g_ptr_array_free(patterns, TRUE);
+	g_rand_free(rand);
+}
+
+static gchar *
+make_subject(GRand *rand)
+{
+	GString *str = g_string_new(NULL);
+	gint n = g_rand_int_range(rand, 3, 10);
+
+	while (n--)
+		g_string_append_printf(str, "%s%s ",
+			words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))],
+			g_rand_boolean(rand) ? "" : "X");
+
+	return g_string_free(str, FALSE);
+}
+
+static void
+test_string_match_set_perf(void)
+{
+	GRand *rand = g_rand_new_with_seed(7);
+	gchar **rules = g_new0(gchar *, PERF_RULES + 1);
+	gchar **subjects = g_new0(gchar *, PERF_MESSAGES + 1);
+	guint *ids = g_new(guint, PERF_RULES);
+	StringMatchSet *set = string_match_set_new();
+	gboolean *found;
+	guint i, j, old_hits = 0, new_hits = 0;
+	GTimer *timer;
+	gdouble old_time, new_time;
+
+	if (!g_test_perf()) {
+		g_test_skip("only run in perf mode");
+		return;
+	}
+
+	for (i = 0; i < PERF_RULES; i++) {
+		rules[i] = g_strdup_printf("%s%u",
+			words[i % G_N_ELEMENTS(words)], i % 7);
+		ids[i] = string_match_set_add(set, rules[i]);
+	}
+	for (i = 0; i < PERF_MESSAGES; i++)
+		subjects[i] = make_subject(rand);
+
+	/* old path: each "subject contains X (case insensitive)" rule
+	 * casefolds the subject and looks for its own pattern */
+	timer = g_timer_new();
+	for (i = 0; i < PERF_MESSAGES; i++) {
+		for (j = 0; j < PERF_RULES; j++) {
+			gchar *str = g_utf8_casefold(subjects[i], -1);
+			gchar *expr = g_utf8_casefold(rules[j], -1);
+
+			if (strstr(str, expr) != NULL)
+				old_hits++;
+			g_free(str);
+			g_free(expr);
+		}
+	}
+	old_time = g_timer_elapsed(timer, NULL);
+
+	/* new path: the set holds the casefolded patterns, each subject
+	 * is casefolded and scanned once */
+	string_match_set_free(set);
+	set = string_match_set_new();
+	for (i = 0; i < PERF_RULES; i++) {
+		gchar *expr = g_utf8_casefold(rules[i], -1);
+
+		ids[i] = string_match_set_add(set, expr);
+		g_free(expr);
+	}
+	string_match_set_compile(set);
+	found = g_new(gboolean, string_match_set_get_size(set));
+
+	g_timer_start(timer);
+	for (i = 0; i < PERF_MESSAGES; i++) {
+		gchar *str = g_utf8_casefold(subjects[i], -1);
+
+		memset(found, 0, string_match_set_get_size(set) * sizeof(gboolean));
+		string_match_set_scan(set, str, found);
+		for (j = 0; j < PERF_RULES; j++)
+			if (found[ids[j]])
+				new_hits++;
+		g_free(str);
+	}
+	new_time = g_timer_elapsed(timer, NULL);
+
+	g_assert_cmpuint(old_hits, ==, new_hits);
+	g_print("%d rules x %d messages: strstr %.3f s, set %.3f s\n",
+		PERF_RULES, PERF_MESSAGES, old_time, new_time);
+
+	g_timer_destroy(timer);
+	g_free(found);
+	g_free(ids);
+	g_strfreev(rules);
+	g_strfreev(subjects);
+	string_match_set_free(set);
+	g_rand_free(rand);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/common/string_match_set/overlapping",
+			test_string_match_set_overlapping);
+	g_test_add_func("/common/string_match_set/random",
+			test_string_match_set_random);
+	g_test_add_func("/common/string_match_set/perf",
+			test_string_match_set_perf);
+
+	return g_test_run();
+}
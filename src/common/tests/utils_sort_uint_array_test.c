@@ -0,0 +1,87 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "utils.h"
+
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+
+static gint
+cmp_uint(gconstpointer a, gconstpointer b)
+{
+	guint ua = *(const guint *)a;
+	guint ub = *(const guint *)b;
+
+	return (ua > ub) - (ua < ub);
+}
+
+static void
+check_sorted(guint *array, guint len)
+{
+	guint *expected = g_new(guint, len);
+	guint i;
+
+	memcpy(expected, array, len * sizeof(guint));
+	qsort(expected, len, sizeof(guint), cmp_uint);
+	sort_uint_array(array, len);
+
+	for (i = 0; i < len; i++)
+		g_assert_cmpuint(array[i], ==, expected[i]);
+
+	g_free(expected);
+}
+
+static void
+test_utils_sort_uint_array_small(void)
+{
+	guint empty[1] = { 7 };
+	guint one[1] = { 42 };
+	guint few[] = { 5, 3, 9, 1, 3, 0, 8 };
+
+	sort_uint_array(empty, 0);
+	g_assert_cmpuint(empty[0], ==, 7);
+	check_sorted(one, G_N_ELEMENTS(one));
+	check_sorted(few, G_N_ELEMENTS(few));
+}
+
+static void
+test_utils_sort_uint_array_large(gconstpointer user_data)
+{
+	guint mask = GPOINTER_TO_UINT(user_data);
+	guint len = 10000, i;
+	guint *array = g_new(guint, len);
+	GRand *rand = g_rand_new_with_seed(1234);
+
+	for (i = 0; i < len; i++)
+		array[i] = g_rand_int(rand) & mask;
+	check_sorted(array, len);
+
+	/* already sorted and reversed input */
+	check_sorted(array, len);
+	for (i = 0; i < len; i++)
+		array[i] = G_MAXUINT - i;
+	check_sorted(array, len);
+
+	g_rand_free(rand);
+	g_free(array);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/common/utils/sort_uint_array/small",
+			test_utils_sort_uint_array_small);
+	g_test_add_data_func("/common/utils/sort_uint_array/msgnums",
+			GUINT_TO_POINTER(0xfffff),
+			test_utils_sort_uint_array_large);
+	g_test_add_data_func("/common/utils/sort_uint_array/full_range",
+			GUINT_TO_POINTER(G_MAXUINT),
+			test_utils_sort_uint_array_large);
+
+	return g_test_run();
+}
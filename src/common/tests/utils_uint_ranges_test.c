@@ -0,0 +1,87 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "utils.h"
+
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+
+static void
+check_range(GArray *ranges, guint i, guint first, guint last)
+{
+	UIntRange *range = &g_array_index(ranges, UIntRange, i);
+
+	g_assert_cmpuint(range->first, ==, first);
+	g_assert_cmpuint(range->last, ==, last);
+}
+
+static void
+test_utils_uint_ranges_append(void)
+{
+	GArray *ranges = g_array_new(FALSE, FALSE, sizeof(UIntRange));
+
+	uint_ranges_append(ranges, 1, 3);
+	uint_ranges_append(ranges, 4, 4);	/* touches, merged */
+	uint_ranges_append(ranges, 10, 4000000);
+	uint_ranges_append(ranges, G_MAXUINT, G_MAXUINT);
+
+	g_assert_cmpuint(ranges->len, ==, 3);
+	check_range(ranges, 0, 1, 4);
+	check_range(ranges, 1, 10, 4000000);
+	check_range(ranges, 2, G_MAXUINT, G_MAXUINT);
+	g_assert_cmpuint(uint_ranges_count(ranges), ==, 4 + 3999991 + 1);
+
+	g_array_free(ranges, TRUE);
+}
+
+static void
+test_utils_uint_ranges_count(void)
+{
+	GArray *ranges = g_array_new(FALSE, FALSE, sizeof(UIntRange));
+
+	g_assert_cmpuint(uint_ranges_count(ranges), ==, 0);
+
+	/* one more than fits in a guint */
+	uint_ranges_append(ranges, 0, G_MAXUINT);
+	g_assert_cmpuint(uint_ranges_count(ranges), ==, (guint64)G_MAXUINT + 1);
+
+	g_array_free(ranges, TRUE);
+}
+
+static void
+test_utils_uint_ranges_append_array(void)
+{
+	GArray *ranges = g_array_new(FALSE, FALSE, sizeof(UIntRange));
+	guint nums[] = { 0, 1, 2, 2, 5, 7, 8, 9, 9, 20 };
+
+	uint_ranges_append_array(ranges, nums, 0);
+	g_assert_cmpuint(ranges->len, ==, 0);
+
+	uint_ranges_append_array(ranges, nums, G_N_ELEMENTS(nums));
+	g_assert_cmpuint(ranges->len, ==, 4);
+	check_range(ranges, 0, 0, 2);
+	check_range(ranges, 1, 5, 5);
+	check_range(ranges, 2, 7, 9);
+	check_range(ranges, 3, 20, 20);
+	g_assert_cmpuint(uint_ranges_count(ranges), ==, 8);
+
+	g_array_free(ranges, TRUE);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/common/utils/uint_ranges/append",
+			test_utils_uint_ranges_append);
+	g_test_add_func("/common/utils/uint_ranges/count",
+			test_utils_uint_ranges_count);
+	g_test_add_func("/common/utils/uint_ranges/append_array",
+			test_utils_uint_ranges_append_array);
+
+	return g_test_run();
+}
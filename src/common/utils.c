@@ -461,6 +461,27 @@ gint subject_compare_for_sort(const gchar *s1, const gchar *s2)
 	return g_utf8_collate(str1, str2);
 }
 
+/* returns a key that sorts with strcmp() the way subject_compare_for_sort()
+ * sorts the subject, or an empty key if the subject is not valid UTF-8 */
+gchar *subject_get_sort_key(const gchar *s)
+{
+	gchar *str, *key;
+
+	cm_return_val_if_fail(s != NULL, NULL);
+
+	str = g_strdup(s);
+	trim_subject_for_sort(str);
+
+	if (!g_utf8_validate(str, -1, NULL)) {
+		g_warning("message subject \"%s\" failed UTF-8 validation", str);
+		key = g_strdup("");
+	} else
+		key = g_utf8_collate_key(str, -1);
+
+	g_free(str);
+	return key;
+}
+
 void trim_subject(gchar *str)
 {
 	register gchar *srcp;
@@ -1913,10 +1934,12 @@ const gchar *get_tmp_dir(void)
 gchar *get_tmp_file(void)
 {
 	gchar *tmp_file;
-	static guint32 id = 0;
+	static gint id = 0;
 
+	/* may be called from search worker threads */
 	tmp_file = g_strdup_printf("%s%ctmpfile.%08x",
-				   get_tmp_dir(), G_DIR_SEPARATOR, id++);
+				   get_tmp_dir(), G_DIR_SEPARATOR,
+				   (guint32)g_atomic_int_add(&id, 1));
 
 	return tmp_file;
 }
@@ -2489,11 +2512,10 @@ gchar *get_outgoing_rfc2822_str(FILE *fp)
 		}
 	}
 
-	/* output body part */
+	/* output body part, the dots are stuffed by the SMTP session
+	 * if it has to */
 	while (claws_fgets(buf, sizeof(buf), fp) != NULL) {
 		strretchomp(buf);
-		if (buf[0] == '.')
-			g_string_append_c(str, '.');
 		g_string_append(str, buf);
 		g_string_append(str, "\r\n");
 	}
@@ -3135,6 +3157,117 @@ gint g_int_compare(gconstpointer a, gconstpointer b)
 	return GPOINTER_TO_INT(a) - GPOINTER_TO_INT(b);
 }
 
+/* sort an array of unsigned integers in ascending order, using an LSD
+   radix sort on bytes; passes over bytes which are the same for all
+   elements are skipped, so message numbers usually need two passes */
+void sort_uint_array(guint *array, guint len)
+{
+	guint *tmp, *src, *dst;
+	guint count[256];
+	guint shift, i;
+
+	if (len < 2)
+		return;
+
+	if (len < 32) {
+		for (i = 1; i < len; i++) {
+			guint val = array[i];
+			guint j = i;
+
+			while (j > 0 && array[j - 1] > val) {
+				array[j] = array[j - 1];
+				j--;
+			}
+			array[j] = val;
+		}
+		return;
+	}
+
+	tmp = g_new(guint, len);
+	src = array;
+	dst = tmp;
+
+	for (shift = 0; shift < sizeof(guint) * 8; shift += 8) {
+		guint pos = 0;
+
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < len; i++)
+			count[(src[i] >> shift) & 0xff]++;
+		if (count[(src[0] >> shift) & 0xff] == len)
+			continue;
+
+		for (i = 0; i < 256; i++) {
+			guint c = count[i];
+
+			count[i] = pos;
+			pos += c;
+		}
+		for (i = 0; i < len; i++)
+			dst[count[(src[i] >> shift) & 0xff]++] = src[i];
+
+		src = dst;
+		dst = (src == array) ? tmp : array;
+	}
+
+	if (src != array)
+		memcpy(array, src, len * sizeof(guint));
+	g_free(tmp);
+}
+
+/* add first..last to a range array; it must be above the last range,
+   and is merged into it if they touch */
+void uint_ranges_append(GArray *ranges, guint first, guint last)
+{
+	UIntRange range;
+
+	cm_return_if_fail(first <= last);
+
+	if (ranges->len > 0) {
+		UIntRange *prev = &g_array_index(ranges, UIntRange,
+						 ranges->len - 1);
+
+		cm_return_if_fail(first > prev->last);
+		if (first - 1 == prev->last) {
+			prev->last = last;
+			return;
+		}
+	}
+
+	range.first = first;
+	range.last = last;
+	g_array_append_val(ranges, range);
+}
+
+/* add the numbers of a sorted array, above the last range, to a range
+   array; duplicates are skipped */
+void uint_ranges_append_array(GArray *ranges, const guint *array, guint len)
+{
+	guint i = 0;
+
+	while (i < len) {
+		guint first = array[i], last = first;
+
+		for (i++; i < len && array[i] - last <= 1; i++)
+			last = array[i];
+		uint_ranges_append(ranges, first, last);
+	}
+}
+
+/* 64 bits, as 0..G_MAXUINT has one number more than a guint holds */
+guint64 uint_ranges_count(const GArray *ranges)
+{
+	guint64 count = 0;
+	guint i;
+
+	for (i = 0; i < ranges->len; i++) {
+		const UIntRange *range = &g_array_index(ranges, UIntRange, i);
+
+		count += (guint64)range->last - range->first + 1;
+	}
+
+	return count;
+}
+
 /*
    quote_cmd_argument()
 
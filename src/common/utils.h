@@ -320,6 +320,7 @@ gint subject_compare			(const gchar	*s1,
 					 const gchar	*s2);
 gint subject_compare_for_sort		(const gchar	*s1,
 					 const gchar	*s2);
+gchar *subject_get_sort_key		(const gchar	*s);
 void trim_subject			(gchar		*str);
 void eliminate_parenthesis		(gchar		*str,
 					 gchar		 op,
@@ -499,6 +500,23 @@ const gchar * line_has_quote_char	(const gchar *str,
 					 const gchar *quote_chars);
 
 gint g_int_compare	(gconstpointer a, gconstpointer b);
+void sort_uint_array	(guint *array, guint len);
+
+/* a set of unsigned integers, as a GArray of ascending, disjoint and
+   non-adjacent ranges */
+typedef struct _UIntRange UIntRange;
+struct _UIntRange {
+	guint first;
+	guint last;
+};
+
+void uint_ranges_append		(GArray		*ranges,
+				 guint		 first,
+				 guint		 last);
+void uint_ranges_append_array	(GArray		*ranges,
+				 const guint	*array,
+				 guint		 len);
+guint64 uint_ranges_count	(const GArray	*ranges);
 
 gchar *generate_mime_boundary	(const gchar *prefix);
 
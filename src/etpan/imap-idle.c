@@ -0,0 +1,139 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#include "claws-features.h"
+#endif
+
+#ifdef HAVE_LIBETPAN
+
+#include <glib.h>
+#ifndef G_OS_WIN32
+#include <poll.h>
+#endif
+#include <errno.h>
+
+#include "imap-idle.h"
+
+#ifndef G_OS_WIN32
+static IMAPIdleWakeup idle_poll(int fd, int interrupt_fd, int timeout,
+				gboolean * interrupted)
+{
+	struct pollfd fds[2];
+	int r;
+
+	fds[0].fd = fd;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	fds[1].fd = interrupt_fd;
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+
+	do {
+		r = poll(fds, interrupt_fd >= 0 ? 2 : 1, timeout);
+	} while (r < 0 && errno == EINTR);
+
+	if (r <= 0)
+		return IMAP_IDLE_TIMEOUT_EXPIRED;
+
+	* interrupted = interrupt_fd >= 0 && fds[1].revents != 0;
+
+	/* what the server sent is only parsed by DONE, report it
+	 * even if we are also being interrupted */
+	if (fds[0].revents != 0)
+		return IMAP_IDLE_ACTIVITY;
+
+	return IMAP_IDLE_INTERRUPTED;
+}
+
+/* Tells what the untagged responses parsed by DONE changed in the
+ * mailbox, keep-alives such as "* OK Still here" do not count */
+static IMAPIdleWakeup idle_changes(mailimap * imap, uint32_t exists,
+				   uint32_t recent, IMAPIdleWakeup unchanged)
+{
+	struct mailimap_response_info * info = imap->imap_response_info;
+	clistiter * cur;
+
+	if (imap->imap_selection_info != NULL &&
+	    (imap->imap_selection_info->sel_exists != exists ||
+	     imap->imap_selection_info->sel_recent != recent))
+		return IMAP_IDLE_ACTIVITY;
+	if (info == NULL)
+		return unchanged;
+
+	if (info->rsp_expunged != NULL && clist_count(info->rsp_expunged) > 0)
+		return IMAP_IDLE_ACTIVITY;
+	if (info->rsp_extension_list != NULL) {
+		for (cur = clist_begin(info->rsp_extension_list); cur != NULL;
+		     cur = clist_next(cur)) {
+			struct mailimap_extension_data * ext = clist_content(cur);
+
+			if (ext->ext_extension->ext_id == MAILIMAP_EXTENSION_QRESYNC &&
+			    ext->ext_type == MAILIMAP_QRESYNC_TYPE_VANISHED)
+				return IMAP_IDLE_ACTIVITY;
+		}
+	}
+	if (info->rsp_fetch_list != NULL && clist_count(info->rsp_fetch_list) > 0)
+		return IMAP_IDLE_FLAGS_CHANGED;
+
+	return unchanged;
+}
+#endif
+
+int imap_idle_wait(mailimap * imap, int interrupt_fd, int timeout,
+		   IMAPIdleWakeup * wakeup)
+{
+#ifndef G_OS_WIN32
+	uint32_t exists = 0, recent = 0;
+	gboolean interrupted = FALSE;
+	int r;
+
+	* wakeup = IMAP_IDLE_TIMEOUT_EXPIRED;
+
+	if (imap->imap_selection_info != NULL) {
+		exists = imap->imap_selection_info->sel_exists;
+		recent = imap->imap_selection_info->sel_recent;
+	}
+
+	r = mailimap_idle(imap);
+	if (r != MAILIMAP_NO_ERROR)
+		return r;
+
+	/* a notification may have come with the continuation */
+	if (imap->imap_stream->read_buffer_len > 0)
+		* wakeup = IMAP_IDLE_ACTIVITY;
+	else
+		* wakeup = idle_poll(mailimap_idle_get_fd(imap),
+				     interrupt_fd, timeout, &interrupted);
+
+	r = mailimap_idle_done(imap);
+	if (r == MAILIMAP_NO_ERROR && * wakeup == IMAP_IDLE_ACTIVITY)
+		* wakeup = idle_changes(imap, exists, recent,
+					interrupted ? IMAP_IDLE_INTERRUPTED :
+					IMAP_IDLE_TIMEOUT_EXPIRED);
+
+	return r;
+#else
+	* wakeup = IMAP_IDLE_TIMEOUT_EXPIRED;
+
+	return MAILIMAP_ERROR_EXTENSION;
+#endif
+}
+
+#endif /* HAVE_LIBETPAN */
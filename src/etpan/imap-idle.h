@@ -0,0 +1,47 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef IMAP_IDLE_H
+
+#define IMAP_IDLE_H
+
+#include <libetpan/libetpan.h>
+
+/* RFC 2177 asks clients to leave IDLE at least every 29 minutes */
+#define IMAP_IDLE_TIMEOUT	(28 * 60 * 1000)
+
+typedef enum
+{
+	IMAP_IDLE_TIMEOUT_EXPIRED,
+	IMAP_IDLE_ACTIVITY,		/* EXISTS, RECENT, EXPUNGE, VANISHED */
+	IMAP_IDLE_FLAGS_CHANGED,	/* FETCH */
+	IMAP_IDLE_INTERRUPTED
+} IMAPIdleWakeup;
+
+/* Sends IDLE on the selected mailbox and waits until the server sends
+ * something, interrupt_fd becomes readable or timeout (in milliseconds)
+ * expires, then ends it with DONE. The untagged responses received
+ * meanwhile are stored by libetpan as usual, and wakeup tells whether
+ * they changed the mailbox; when they did not, as with keep-alives,
+ * it is set as if the timeout expired, or to IMAP_IDLE_INTERRUPTED.
+ * Blocks, so it is meant to run in an etpan thread. */
+int imap_idle_wait(mailimap * imap, int interrupt_fd, int timeout,
+		   IMAPIdleWakeup * wakeup);
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#include "claws-features.h"
+#endif
+
+#ifdef HAVE_LIBETPAN
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imap-pipeline.h"
+
+/* libetpan tags its own commands with numbers, ours cannot clash */
+#define TAG_PREFIX 'P'
+
+static void append_set_number(GString *str, uint32_t number)
+{
+	if (number == 0)
+		g_string_append_c(str, '*');
+	else
+		g_string_append_printf(str, "%u", number);
+}
+
+static void append_set(GString *str, struct mailimap_set *set)
+{
+	clistiter *cur;
+
+	for (cur = clist_begin(set->set_list); cur != NULL;
+	     cur = clist_next(cur)) {
+		struct mailimap_set_item *item = clist_content(cur);
+
+		if (cur != clist_begin(set->set_list))
+			g_string_append_c(str, ',');
+		append_set_number(str, item->set_first);
+		if (item->set_last != item->set_first) {
+			g_string_append_c(str, ':');
+			append_set_number(str, item->set_last);
+		}
+	}
+}
+
+static void append_flag(GString *str, struct mailimap_flag *flag)
+{
+	switch (flag->fl_type) {
+	case MAILIMAP_FLAG_ANSWERED:
+		g_string_append(str, "\\Answered");
+		break;
+	case MAILIMAP_FLAG_FLAGGED:
+		g_string_append(str, "\\Flagged");
+		break;
+	case MAILIMAP_FLAG_DELETED:
+		g_string_append(str, "\\Deleted");
+		break;
+	case MAILIMAP_FLAG_SEEN:
+		g_string_append(str, "\\Seen");
+		break;
+	case MAILIMAP_FLAG_DRAFT:
+		g_string_append(str, "\\Draft");
+		break;
+	case MAILIMAP_FLAG_KEYWORD:
+		g_string_append(str, flag->fl_data.fl_keyword);
+		break;
+	case MAILIMAP_FLAG_EXTENSION:
+		g_string_append_c(str, '\\');
+		g_string_append(str, flag->fl_data.fl_extension);
+		break;
+	}
+}
+
+static gchar *store_command(int tag, IMAPPipelinedStore *store)
+{
+	struct mailimap_store_att_flags *att = store->store_att_flags;
+	GString *str = g_string_new(NULL);
+	clistiter *cur;
+
+	g_string_append_printf(str, "%c%d UID STORE ", TAG_PREFIX, tag);
+	append_set(str, store->set);
+	g_string_append_c(str, ' ');
+	if (att->fl_sign > 0)
+		g_string_append_c(str, '+');
+	else if (att->fl_sign < 0)
+		g_string_append_c(str, '-');
+	g_string_append(str, att->fl_silent ? "FLAGS.SILENT (" : "FLAGS (");
+	for (cur = clist_begin(att->fl_flag_list->fl_list); cur != NULL;
+	     cur = clist_next(cur)) {
+		if (cur != clist_begin(att->fl_flag_list->fl_list))
+			g_string_append_c(str, ' ');
+		append_flag(str, clist_content(cur));
+	}
+	g_string_append(str, ")\r\n");
+
+	return g_string_free(str, FALSE);
+}
+
+static int send_store(mailstream *stream, int tag, IMAPPipelinedStore *store)
+{
+	gchar *command = store_command(tag, store);
+	ssize_t r;
+
+	r = mailstream_write(stream, command, strlen(command));
+	g_free(command);
+
+	return r < 0 ? MAILIMAP_ERROR_STREAM : MAILIMAP_NO_ERROR;
+}
+
+/* Returns the size of the literal ending line, announced as {size} or
+ * {size+}, or -1 */
+static gssize literal_size(const char *line)
+{
+	const char *open;
+	char *end;
+	size_t len = strlen(line);
+	gssize size;
+
+	if (len < 3 || line[len - 1] != '}')
+		return -1;
+	open = strrchr(line, '{');
+	if (open == NULL || !g_ascii_isdigit(open[1]))
+		return -1;
+
+	size = g_ascii_strtoll(open + 1, &end, 10);
+	if (*end == '+')
+		end++;
+	if (end != line + len - 1)
+		return -1;
+
+	return size;
+}
+
+static int skip_literal(mailstream *stream, gssize size)
+{
+	char buf[4096];
+
+	while (size > 0) {
+		ssize_t r;
+
+		r = mailstream_read(stream, buf, MIN(size, (gssize)sizeof(buf)));
+
+		if (r <= 0)
+			return MAILIMAP_ERROR_STREAM;
+		size -= r;
+	}
+
+	return MAILIMAP_NO_ERROR;
+}
+
+/* Returns what an untagged response tells of the mailbox */
+static int untagged_changes(const char *line)
+{
+	const char *word;
+
+	if (line[0] != '*' || line[1] != ' ')
+		return 0;
+
+	/* "* VANISHED", or "* <number> <keyword>" */
+	word = line + 2;
+	if (g_ascii_strncasecmp(word, "VANISHED", 8) == 0)
+		return IMAP_PIPELINE_MESSAGES_CHANGED;
+	if (!g_ascii_isdigit(*word))
+		return 0;
+	while (g_ascii_isdigit(*word))
+		word++;
+	if (*word++ != ' ')
+		return 0;
+
+	if (g_ascii_strncasecmp(word, "EXISTS", 6) == 0 ||
+	    g_ascii_strncasecmp(word, "RECENT", 6) == 0 ||
+	    g_ascii_strncasecmp(word, "EXPUNGE", 7) == 0)
+		return IMAP_PIPELINE_MESSAGES_CHANGED;
+	/* a silent store only answers with the new MODSEQ, FLAGS come
+	 * from changes made elsewhere */
+	if (g_ascii_strncasecmp(word, "FETCH", 5) == 0 &&
+	    strstr(word, "FLAGS") != NULL)
+		return IMAP_PIPELINE_FLAGS_CHANGED;
+
+	return 0;
+}
+
+/* Reads a whole response, literals included, and returns the number
+ * of the command it completes with its status in ok, or -1 for
+ * untagged responses, adding what those tell to changes */
+static int read_response(mailstream *stream, MMAPString *buffer,
+			 int *tag, gboolean *ok, int *changes)
+{
+	char *line;
+	gssize size;
+
+	*tag = -1;
+	*ok = FALSE;
+
+	line = mailstream_read_line_remove_eol(stream, buffer);
+	if (line == NULL)
+		return MAILIMAP_ERROR_STREAM;
+
+	if (line[0] == TAG_PREFIX && g_ascii_isdigit(line[1])) {
+		char *status;
+
+		*tag = strtol(line + 1, &status, 10);
+		*ok = g_ascii_strncasecmp(status, " OK", 3) == 0;
+	} else {
+		*changes |= untagged_changes(line);
+	}
+
+	while ((size = literal_size(line)) >= 0) {
+		if (skip_literal(stream, size) != MAILIMAP_NO_ERROR)
+			return MAILIMAP_ERROR_STREAM;
+		line = mailstream_read_line_remove_eol(stream, buffer);
+		if (line == NULL)
+			return MAILIMAP_ERROR_STREAM;
+	}
+
+	return MAILIMAP_NO_ERROR;
+}
+
+int imap_pipeline_uid_store(mailimap * imap,
+			    IMAPPipelinedStore * stores, int count,
+			    int * changes)
+{
+	mailstream *stream = imap->imap_stream;
+	MMAPString *buffer;
+	int sent = 0, received = 0;
+	int i, r = MAILIMAP_NO_ERROR;
+
+	*changes = 0;
+	for (i = 0; i < count; i++)
+		stores[i].result = MAILIMAP_ERROR_STREAM;
+
+	if (stream == NULL)
+		return MAILIMAP_ERROR_BAD_STATE;
+
+	buffer = mmap_string_new("");
+	if (buffer == NULL)
+		return MAILIMAP_ERROR_MEMORY;
+
+	while (received < count) {
+		int tag;
+		gboolean ok;
+
+		/* keep the pipeline full */
+		if (sent < count && sent - received < IMAP_PIPELINE_DEPTH) {
+			do {
+				r = send_store(stream, sent, &stores[sent]);
+				if (r != MAILIMAP_NO_ERROR)
+					goto out;
+				sent++;
+			} while (sent < count &&
+				 sent - received < IMAP_PIPELINE_DEPTH);
+			if (mailstream_flush(stream) < 0) {
+				r = MAILIMAP_ERROR_STREAM;
+				goto out;
+			}
+		}
+
+		r = read_response(stream, buffer, &tag, &ok, changes);
+		if (r != MAILIMAP_NO_ERROR)
+			goto out;
+
+		if (tag < 0 || tag >= sent ||
+		    stores[tag].result != MAILIMAP_ERROR_STREAM)
+			continue;
+
+		stores[tag].result = ok ? MAILIMAP_NO_ERROR
+					: MAILIMAP_ERROR_UID_STORE;
+		received++;
+	}
+
+out:
+	mmap_string_free(buffer);
+	return r;
+}
+
+#endif /* HAVE_LIBETPAN */
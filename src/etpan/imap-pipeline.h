@@ -0,0 +1,54 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef IMAP_PIPELINE_H
+
+#define IMAP_PIPELINE_H
+
+#include <libetpan/libetpan.h>
+
+/* How many commands may wait for their tagged response at once */
+#define IMAP_PIPELINE_DEPTH	32
+
+/* What the untagged responses read while storing told of the mailbox */
+#define IMAP_PIPELINE_MESSAGES_CHANGED	(1 << 0) /* EXISTS, RECENT, EXPUNGE, VANISHED */
+#define IMAP_PIPELINE_FLAGS_CHANGED	(1 << 1) /* FETCH with FLAGS */
+
+typedef struct _IMAPPipelinedStore IMAPPipelinedStore;
+
+struct _IMAPPipelinedStore
+{
+	struct mailimap_set * set;
+	struct mailimap_store_att_flags * store_att_flags;
+	int result;
+};
+
+/* Sends a UID STORE for each of the count stores on the selected
+ * mailbox without waiting for the previous ones to complete, and sets
+ * their result from the tagged responses. Untagged responses are not
+ * passed on to libetpan, so the flags should be stored silently; the
+ * changes they announce are set in changes, telling that the mailbox
+ * should be selected and scanned again. Returns an error only if the
+ * connection failed. Blocks, so it is meant to run in an etpan
+ * thread. */
+int imap_pipeline_uid_store(mailimap * imap,
+			    IMAPPipelinedStore * stores, int count,
+			    int * changes);
+
+#endif
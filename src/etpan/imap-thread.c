@@ -27,10 +27,12 @@
 #include <glib/gi18n.h>
 #include "imap-thread.h"
 #include <imap.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #ifndef G_OS_WIN32
+#include <unistd.h>
 #include <sys/socket.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
@@ -55,6 +57,8 @@ static struct etpan_thread_manager * thread_manager = NULL;
 static chash * courier_workaround_hash = NULL;
 static chash * imap_hash = NULL;
 static chash * session_hash = NULL;
+static chash * idle_hash = NULL;
+static chash * connection_hash = NULL;
 static guint thread_manager_signal = 0;
 static GIOChannel * io_channel = NULL;
 
@@ -339,6 +343,8 @@ void imap_main_init(gboolean skip_ssl_cert_check)
 	
 	imap_hash = chash_new(CHASH_COPYKEY, CHASH_DEFAULTSIZE);
 	session_hash = chash_new(CHASH_COPYKEY, CHASH_DEFAULTSIZE);
+	idle_hash = chash_new(CHASH_COPYKEY, CHASH_DEFAULTSIZE);
+	connection_hash = chash_new(CHASH_COPYKEY, CHASH_DEFAULTSIZE);
 	courier_workaround_hash = chash_new(CHASH_COPYKEY, CHASH_DEFAULTSIZE);
 	
 	thread_manager = etpan_thread_manager_new();
@@ -377,20 +383,77 @@ void imap_main_done(gboolean have_connectivity)
 	etpan_thread_manager_free(thread_manager);
 	
 	chash_free(courier_workaround_hash);
+	chash_free(idle_hash);
+	chash_free(connection_hash);
 	chash_free(session_hash);
 	chash_free(imap_hash);
 }
 
+/* A folder may have several connections, told apart by a slot number.
+ * The threads, the mailimap and the IDLE state are looked up by
+ * (folder, slot); the imap_threaded_* functions use the connection
+ * made current with imap_threaded_use_connection(). */
+
+struct conn_key {
+	Folder * folder;
+	int slot;
+};
+
+static void conn_key_init(struct conn_key * ck, chashdatum * key,
+			  Folder * folder, int slot)
+{
+	/* the key is hashed as a whole, padding included */
+	memset(ck, 0, sizeof(* ck));
+	ck->folder = folder;
+	ck->slot = slot;
+	key->data = ck;
+	key->len = sizeof(* ck);
+}
+
+int imap_threaded_get_connection(Folder * folder)
+{
+	chashdatum key;
+	chashdatum value;
+	int r;
+
+	key.data = &folder;
+	key.len = sizeof(folder);
+
+	r = chash_get(connection_hash, &key, &value);
+	if (r < 0)
+		return 0;
+
+	return GPOINTER_TO_INT(value.data);
+}
+
+void imap_threaded_use_connection(Folder * folder, int slot)
+{
+	chashdatum key;
+	chashdatum value;
+
+	key.data = &folder;
+	key.len = sizeof(folder);
+
+	if (slot == 0) {
+		chash_delete(connection_hash, &key, NULL);
+		return;
+	}
+
+	value.data = GINT_TO_POINTER(slot);
+	value.len = 0;
+	chash_set(connection_hash, &key, &value, NULL);
+}
+
 void imap_init(Folder * folder)
 {
 	struct etpan_thread * thread;
+	struct conn_key ck;
 	chashdatum key;
 	chashdatum value;
 	
 	thread = etpan_thread_manager_get_thread(thread_manager);
 	
-	key.data = &folder;
-	key.len = sizeof(folder);
+	conn_key_init(&ck, &key, folder, imap_threaded_get_connection(folder));
 	value.data = thread;
 	value.len = 0;
 	
@@ -400,35 +463,42 @@ void imap_init(Folder * folder)
 void imap_done(Folder * folder)
 {
 	struct etpan_thread * thread;
+	struct conn_key ck;
 	chashdatum key;
 	chashdatum value;
+	int slot;
 	int r;
 	
+	for (slot = 0; slot < IMAP_MAX_CONNECTIONS; slot++) {
+		conn_key_init(&ck, &key, folder, slot);
+
+		r = chash_get(imap_hash, &key, &value);
+		if (r < 0)
+			continue;
+
+		thread = value.data;
+
+		etpan_thread_unbind(thread);
+
+		chash_delete(imap_hash, &key, NULL);
+
+		debug_print("remove thread\n");
+	}
+
 	key.data = &folder;
 	key.len = sizeof(folder);
-	
-	r = chash_get(imap_hash, &key, &value);
-	if (r < 0)
-		return;
-	
-	thread = value.data;
-	
-	etpan_thread_unbind(thread);
-	
-	chash_delete(imap_hash, &key, NULL);
-	
-	debug_print("remove thread\n");
+	chash_delete(connection_hash, &key, NULL);
 }
 
-static struct etpan_thread * get_thread(Folder * folder)
+static struct etpan_thread * get_thread(Folder * folder, int slot)
 {
 	struct etpan_thread * thread;
+	struct conn_key ck;
 	chashdatum key;
 	chashdatum value;
 	int r;
 
-	key.data = &folder;
-	key.len = sizeof(folder);
+	conn_key_init(&ck, &key, folder, slot);
 
 	r = chash_get(imap_hash, &key, &value);
 	if (r < 0)
@@ -439,15 +509,15 @@ static struct etpan_thread * get_thread(Folder * folder)
 	return thread;
 }
 
-static mailimap * get_imap(Folder * folder)
+static mailimap * get_connection_imap(Folder * folder, int slot)
 {
 	mailimap * imap;
+	struct conn_key ck;
 	chashdatum key;
 	chashdatum value;
 	int r;
 	
-	key.data = &folder;
-	key.len = sizeof(folder);
+	conn_key_init(&ck, &key, folder, slot);
 	
 	r = chash_get(session_hash, &key, &value);
 	if (r < 0)
@@ -458,6 +528,23 @@ static mailimap * get_imap(Folder * folder)
 	return imap;
 }
 
+static mailimap * get_imap(Folder * folder)
+{
+	return get_connection_imap(folder, imap_threaded_get_connection(folder));
+}
+
+static void set_imap(Folder * folder, mailimap * imap)
+{
+	struct conn_key ck;
+	chashdatum key;
+	chashdatum value;
+
+	conn_key_init(&ck, &key, folder, imap_threaded_get_connection(folder));
+	value.data = imap;
+	value.len = 0;
+	chash_set(session_hash, &key, &value, NULL);
+}
+
 static gboolean cb_show_error(gpointer data)
 {
 	mainwindow_show_error();
@@ -480,6 +567,70 @@ static void generic_cb(int cancelled, void * result, void * callback_data)
 	op->finished = 1;
 }
 
+/* idle */
+
+struct idle_param {
+	mailimap * imap;
+	int interrupt_fd;
+};
+
+struct idle_result {
+	int error;
+	IMAPIdleWakeup wakeup;
+};
+
+struct idle_state {
+	Folder * folder;
+	int slot;
+	int fds[2];
+	gboolean interrupted;
+	IMAPIdleFunc func;
+	gpointer data;
+	struct idle_param param;
+	struct idle_result result;
+};
+
+static struct idle_state * get_idle(Folder * folder, int slot)
+{
+	struct conn_key ck;
+	chashdatum key;
+	chashdatum value;
+	int r;
+
+	conn_key_init(&ck, &key, folder, slot);
+
+	r = chash_get(idle_hash, &key, &value);
+	if (r < 0)
+		return NULL;
+
+	return value.data;
+}
+
+static void idle_interrupt(struct idle_state * state)
+{
+	char ch = 1;
+
+	if (state->interrupted)
+		return;
+	state->interrupted = TRUE;
+	if (write(state->fds[1], &ch, 1) != 1)
+		g_warning("error interrupting imap idle");
+}
+
+/* Makes the IDLE running on folder, if any, return. The ops scheduled
+ * after it would otherwise wait for the server to say something */
+static void idle_stop(Folder * folder, int slot, gboolean wait)
+{
+	struct idle_state * state;
+
+	while ((state = get_idle(folder, slot)) != NULL) {
+		idle_interrupt(state);
+		if (!wait)
+			break;
+		gtk_main_iteration();
+	}
+}
+
 /* Please do *not* blindly use imap pointers after this function returns,
  * someone may have deleted it while this function was waiting for completion.
  * Check return value to see if imap is still valid.
@@ -490,7 +641,11 @@ static int threaded_run(Folder * folder, void * param, void * result,
 {
 	struct etpan_thread_op * op;
 	struct etpan_thread * thread;
-	struct mailimap * imap = get_imap(folder);
+	struct mailimap * imap;
+	int slot = imap_threaded_get_connection(folder);
+
+	idle_stop(folder, slot, TRUE);
+	imap = get_connection_imap(folder, slot);
 	
 	imap_folder_ref(folder);
 
@@ -504,13 +659,16 @@ static int threaded_run(Folder * folder, void * param, void * result,
 	op->callback = generic_cb;
 	op->callback_data = op;
 
-	thread = get_thread(folder);
+	thread = get_thread(folder, slot);
 	etpan_thread_op_schedule(thread, op);
 	
 	while (!op->finished) {
 		gtk_main_iteration();
 	}
 
+	/* what ran meanwhile may have used another connection */
+	imap_threaded_use_connection(folder, slot);
+
 	etpan_thread_op_free(op);
 
 	imap_folder_unref(folder);
@@ -569,17 +727,19 @@ static void threaded_delete_imap(Folder *folder, mailimap *imap)
 	op->run = delete_imap_run;
 	op->cleanup = etpan_thread_op_free;
 
-	etpan_thread_op_schedule(get_thread(folder), op);
+	etpan_thread_op_schedule(get_thread(folder,
+				 imap_threaded_get_connection(folder)), op);
 
 	debug_print("threaded delete imap posted\n");
 }
 
 static void delete_imap(Folder *folder, mailimap *imap)
 {
+	struct conn_key ck;
 	chashdatum key;
+	int slot = imap_threaded_get_connection(folder);
 
-	key.data = &folder;
-	key.len = sizeof(folder);
+	conn_key_init(&ck, &key, folder, slot);
 	chash_delete(session_hash, &key, NULL);
 
 	if (!imap)
@@ -587,6 +747,7 @@ static void delete_imap(Folder *folder, mailimap *imap)
 	key.data = &imap;
 	key.len = sizeof(imap);
 	chash_delete(courier_workaround_hash, &key, NULL);
+	idle_stop(folder, slot, FALSE);
 	/* We can't just free imap here as there may be ops on it pending
 	 * in the thread. Posting freeing as an op will synchronize against
 	 * existing jobs and as imap is already removed from session_hash
@@ -616,8 +777,6 @@ int imap_threaded_connect(Folder * folder, const char * server, int port, ProxyI
 {
 	struct connect_param param;
 	struct connect_result result;
-	chashdatum key;
-	chashdatum value;
 	mailimap * imap, * oldimap;
 	
 	oldimap = get_imap(folder);
@@ -629,11 +788,7 @@ int imap_threaded_connect(Folder * folder, const char * server, int port, ProxyI
 		delete_imap(folder, oldimap);
 	}
 	
-	key.data = &folder;
-	key.len = sizeof(folder);
-	value.data = imap;
-	value.len = 0;
-	chash_set(session_hash, &key, &value, NULL);
+	set_imap(folder, imap);
 
 	param.imap = imap;
 	param.server = server;
@@ -670,8 +825,6 @@ int imap_threaded_connect_ssl(Folder * folder, const char * server, int port, Pr
 {
 	struct connect_param param;
 	struct connect_result result;
-	chashdatum key;
-	chashdatum value;
 	mailimap * imap, * oldimap;
 	gboolean accept_if_valid = FALSE;
 
@@ -684,11 +837,7 @@ int imap_threaded_connect_ssl(Folder * folder, const char * server, int port, Pr
 		delete_imap(folder, oldimap);
 	}
 
-	key.data = &folder;
-	key.len = sizeof(folder);
-	value.data = imap;
-	value.len = 0;
-	chash_set(session_hash, &key, &value, NULL);
+	set_imap(folder, imap);
 
 	param.imap = imap;
 	param.server = server;
@@ -763,6 +912,283 @@ int imap_threaded_capability(Folder *folder, struct mailimap_capability_data **
 	
 }
 	
+struct enable_qresync_param {
+	mailimap * imap;
+};
+
+struct enable_qresync_result {
+	int error;
+	gboolean enabled;
+};
+
+static void enable_qresync_run(struct etpan_thread_op * op)
+{
+	struct enable_qresync_param * param;
+	struct enable_qresync_result * result;
+	struct mailimap_capability_data * caps;
+	struct mailimap_capability_data * enabled = NULL;
+	struct mailimap_capability * cap;
+	clist * cap_list;
+	clistiter * cur;
+	int r;
+
+	param = op->param;
+	result = op->result;
+
+	CHECK_IMAP();
+
+	result->enabled = FALSE;
+	/* capabilities may have changed after login */
+	r = mailimap_capability(param->imap, &caps);
+	if (r != MAILIMAP_NO_ERROR) {
+		result->error = r;
+		return;
+	}
+	mailimap_capability_data_free(caps);
+
+	if (!mailimap_has_qresync(param->imap)) {
+		result->error = MAILIMAP_NO_ERROR;
+		return;
+	}
+
+	cap_list = clist_new();
+	cap = mailimap_capability_new(MAILIMAP_CAPABILITY_NAME, NULL,
+				      strdup("QRESYNC"));
+	clist_append(cap_list, cap);
+	caps = mailimap_capability_data_new(cap_list);
+
+	r = mailimap_enable(param->imap, caps, &enabled);
+	mailimap_capability_data_free(caps);
+
+	if (r == MAILIMAP_NO_ERROR && enabled != NULL) {
+		for (cur = clist_begin(enabled->cap_list) ; cur != NULL ;
+		     cur = clist_next(cur)) {
+			cap = clist_content(cur);
+			if (cap->cap_type == MAILIMAP_CAPABILITY_NAME &&
+			    !strcasecmp(cap->cap_data.cap_name, "QRESYNC"))
+				result->enabled = TRUE;
+		}
+	}
+	if (enabled != NULL)
+		mailimap_capability_data_free(enabled);
+
+	result->error = r;
+	debug_print("imap enable qresync run - end %i\n", r);
+}
+
+/* RFC 7162: lets UID FETCH report the messages changed and expunged
+ * since a modification sequence */
+int imap_threaded_enable_qresync(Folder * folder, gboolean * enabled)
+{
+	struct enable_qresync_param param;
+	struct enable_qresync_result result;
+
+	debug_print("imap enable qresync - begin\n");
+
+	param.imap = get_imap(folder);
+
+	threaded_run(folder, &param, &result, enable_qresync_run);
+
+	* enabled = (result.error == MAILIMAP_NO_ERROR && result.enabled);
+
+	debug_print("imap enable qresync - end\n");
+
+	return result.error;
+}
+
+/* Counts the bytes going through a stream layer. Once COMPRESS is on,
+ * one sits below the zlib layer, counting what goes over the network,
+ * and one above it, counting the IMAP protocol data, which logs both
+ * when the connection goes away. */
+struct traffic_counter {
+	mailstream_low * low;
+	guint64 read;
+	guint64 written;
+	struct traffic_counter * wire;
+};
+
+static ssize_t traffic_counter_read(mailstream_low * s, void * buf,
+				    size_t count)
+{
+	struct traffic_counter * counter = s->data;
+	ssize_t r;
+
+	r = mailstream_low_read(counter->low, buf, count);
+	if (r > 0)
+		counter->read += r;
+	return r;
+}
+
+static ssize_t traffic_counter_write(mailstream_low * s, const void * buf,
+				     size_t count)
+{
+	struct traffic_counter * counter = s->data;
+	ssize_t r;
+
+	r = mailstream_low_write(counter->low, buf, count);
+	if (r > 0)
+		counter->written += r;
+	return r;
+}
+
+static int traffic_counter_close(mailstream_low * s)
+{
+	struct traffic_counter * counter = s->data;
+
+	return mailstream_low_close(counter->low);
+}
+
+static int traffic_counter_get_fd(mailstream_low * s)
+{
+	struct traffic_counter * counter = s->data;
+
+	return mailstream_low_get_fd(counter->low);
+}
+
+static void traffic_counter_log(struct traffic_counter * counter)
+{
+	log_print(LOG_PROTOCOL, "IMAP< [COMPRESS - %"G_GUINT64_FORMAT" bytes "
+		  "received as %"G_GUINT64_FORMAT" bytes]\n",
+		  counter->read, counter->wire->read);
+	log_print(LOG_PROTOCOL, "IMAP> [COMPRESS - %"G_GUINT64_FORMAT" bytes "
+		  "sent as %"G_GUINT64_FORMAT" bytes]\n",
+		  counter->written, counter->wire->written);
+}
+
+static void traffic_counter_free(mailstream_low * s)
+{
+	struct traffic_counter * counter = s->data;
+
+	if (counter->wire != NULL)
+		traffic_counter_log(counter);
+	mailstream_low_free(counter->low);
+	g_free(counter);
+	free(s);
+}
+
+static void traffic_counter_cancel(mailstream_low * s)
+{
+	struct traffic_counter * counter = s->data;
+
+	mailstream_low_cancel(counter->low);
+}
+
+static struct mailstream_cancel * traffic_counter_get_cancel(mailstream_low * s)
+{
+	struct traffic_counter * counter = s->data;
+
+	return mailstream_low_get_cancel(counter->low);
+}
+
+static carray * traffic_counter_get_certificate_chain(mailstream_low * s)
+{
+	struct traffic_counter * counter = s->data;
+
+	return mailstream_low_get_certificate_chain(counter->low);
+}
+
+static mailstream_low_driver traffic_counter_driver = {
+	.mailstream_read = traffic_counter_read,
+	.mailstream_write = traffic_counter_write,
+	.mailstream_close = traffic_counter_close,
+	.mailstream_get_fd = traffic_counter_get_fd,
+	.mailstream_free = traffic_counter_free,
+	.mailstream_cancel = traffic_counter_cancel,
+	.mailstream_get_cancel = traffic_counter_get_cancel,
+	.mailstream_get_certificate_chain = traffic_counter_get_certificate_chain,
+};
+
+/* Logs the traffic so far of a compressed connection */
+static void traffic_counter_log_imap(mailimap * imap)
+{
+	mailstream_low * low;
+	struct traffic_counter * counter;
+
+	if (imap->imap_stream == NULL)
+		return;
+	low = mailstream_get_low(imap->imap_stream);
+	if (low == NULL || low->driver != &traffic_counter_driver)
+		return;
+	counter = low->data;
+	if (counter->wire != NULL)
+		traffic_counter_log(counter);
+}
+
+/* Puts a counter on top of the stream, which takes over its logging */
+static struct traffic_counter * traffic_counter_push(mailstream * stream,
+						     struct traffic_counter * wire)
+{
+	struct traffic_counter * counter = g_new0(struct traffic_counter, 1);
+	mailstream_low * low;
+
+	counter->low = mailstream_get_low(stream);
+	counter->wire = wire;
+	low = mailstream_low_new(counter, &traffic_counter_driver);
+	mailstream_low_set_logger(counter->low, NULL, NULL);
+	mailstream_set_low(stream, low);
+
+	return counter;
+}
+
+struct compress_param {
+	mailimap * imap;
+};
+
+struct compress_result {
+	int error;
+	gboolean enabled;
+};
+
+static void compress_run(struct etpan_thread_op * op)
+{
+	struct compress_param * param;
+	struct compress_result * result;
+	struct traffic_counter * wire;
+	int r;
+
+	param = op->param;
+	result = op->result;
+
+	CHECK_IMAP();
+
+	result->enabled = FALSE;
+	result->error = MAILIMAP_NO_ERROR;
+	if (!mailimap_has_compress_deflate(param->imap))
+		return;
+
+	wire = traffic_counter_push(param->imap->imap_stream, NULL);
+	r = mailimap_compress(param->imap);
+	if (r == MAILIMAP_NO_ERROR) {
+		traffic_counter_push(param->imap->imap_stream, wire);
+		result->enabled = TRUE;
+	} else if (r == MAILIMAP_ERROR_STREAM) {
+		result->error = r;
+	}
+
+	debug_print("imap compress run - end %i\n", r);
+}
+
+/* RFC 4978: compresses the rest of the connection with DEFLATE, if the
+ * server offers it. Capabilities are expected to be up to date, see
+ * imap_threaded_enable_qresync() */
+int imap_threaded_compress(Folder * folder, gboolean * enabled)
+{
+	struct compress_param param;
+	struct compress_result result;
+
+	debug_print("imap compress - begin\n");
+
+	param.imap = get_imap(folder);
+
+	threaded_run(folder, &param, &result, compress_run);
+
+	* enabled = (result.error == MAILIMAP_NO_ERROR && result.enabled);
+
+	debug_print("imap compress - end\n");
+
+	return result.error;
+}
+
 struct disconnect_param {
 	mailimap * imap;
 };
@@ -1108,6 +1534,10 @@ int imap_threaded_status(Folder * folder, const char * mb,
 		mailimap_status_att_list_add(status_att_list,
 				     MAILIMAP_STATUS_ATT_UNSEEN);
 	}
+	if (mask & 1 << 5) {
+		mailimap_status_att_list_add(status_att_list,
+				     MAILIMAP_STATUS_ATT_HIGHESTMODSEQ);
+	}
 	param.imap = get_imap(folder);
 	param.mb = mb;
 	param.status_att_list = status_att_list;
@@ -1414,10 +1844,12 @@ int imap_threaded_delete(Folder * folder, const char * mb)
 struct select_param {
 	mailimap * imap;
 	const char * mb;
+	int condstore;
 };
 
 struct select_result {
 	int error;
+	uint64_t modseq;
 };
 
 static void select_run(struct etpan_thread_op * op)
@@ -1431,16 +1863,23 @@ static void select_run(struct etpan_thread_op * op)
 
 	CHECK_IMAP();
 
-	r = mailimap_select(param->imap, param->mb);
+	result->modseq = 0;
+	if (param->condstore)
+		r = mailimap_select_condstore(param->imap, param->mb,
+					      &result->modseq);
+	else
+		r = mailimap_select(param->imap, param->mb);
 	
 	result->error = r;
 	debug_print("imap select run - end %i\n", r);
 }
 
+/* highestmodseq: if not NULL, gets the HIGHESTMODSEQ of the mailbox
+ * (RFC 7162), 0 if the server doesn't keep one for it */
 int imap_threaded_select(Folder * folder, const char * mb,
 			 gint * exists, gint * recent, gint * unseen,
 			 guint32 * uid_validity,gint *can_create_flags,
-			 GSList **ok_flags)
+			 GSList **ok_flags, guint64 * highestmodseq)
 {
 	struct select_param param;
 	struct select_result result;
@@ -1451,6 +1890,7 @@ int imap_threaded_select(Folder * folder, const char * mb,
 	imap = get_imap(folder);
 	param.imap = imap;
 	param.mb = mb;
+	param.condstore = (highestmodseq != NULL);
 	
 	if (threaded_run(folder, &param, &result, select_run))
 		return MAILIMAP_ERROR_INVAL;
@@ -1458,6 +1898,9 @@ int imap_threaded_select(Folder * folder, const char * mb,
 	if (result.error != MAILIMAP_NO_ERROR)
 		return result.error;
 	
+	if (highestmodseq)
+		* highestmodseq = result.modseq;
+	
 	if (!imap || imap->imap_selection_info == NULL)
 		return MAILIMAP_ERROR_PARSE;
 	
@@ -2381,6 +2824,103 @@ void imap_fetch_uid_flags_list_free(carray * uid_flags_list)
 
 
 
+struct fetch_changed_param {
+	mailimap * imap;
+	uint64_t modseq;
+};
+
+struct fetch_changed_result {
+	int error;
+	carray * fetch_result;
+	struct mailimap_set * vanished;
+};
+
+static void fetch_changed_run(struct etpan_thread_op * op)
+{
+	struct fetch_changed_param * param;
+	struct fetch_changed_result * result;
+	struct mailimap_fetch_type * fetch_type;
+	struct mailimap_set * set;
+	struct mailimap_qresync_vanished * vanished = NULL;
+	clist * fetch_result = NULL;
+	int r;
+
+	param = op->param;
+	result = op->result;
+
+	CHECK_IMAP();
+
+	result->fetch_result = NULL;
+	result->vanished = NULL;
+
+	set = mailimap_set_new_interval(1, 0);
+	fetch_type = mailimap_fetch_type_new_fetch_att_list_empty();
+	mailimap_fetch_type_new_fetch_att_list_add(fetch_type,
+			mailimap_fetch_att_new_uid());
+	mailimap_fetch_type_new_fetch_att_list_add(fetch_type,
+			mailimap_fetch_att_new_flags());
+
+	mailstream_logger = imap_logger_fetch;
+
+	r = mailimap_uid_fetch_qresync(param->imap, set, fetch_type,
+				       param->modseq, &fetch_result, &vanished);
+
+	mailstream_logger = imap_logger_cmd;
+	mailimap_fetch_type_free(fetch_type);
+	mailimap_set_free(set);
+
+	if (r == MAILIMAP_NO_ERROR) {
+		r = result_to_uid_flags_list(fetch_result, &result->fetch_result);
+		if (vanished != NULL) {
+			result->vanished = vanished->qr_known_uids;
+			vanished->qr_known_uids = NULL;
+		}
+	}
+	if (fetch_result != NULL)
+		mailimap_fetch_list_free(fetch_result);
+	if (vanished != NULL)
+		mailimap_qresync_vanished_free(vanished);
+
+	result->error = r;
+	debug_print("imap fetch_changed run - end %i\n", r);
+}
+
+/* UID FETCH 1:* (UID FLAGS) (CHANGEDSINCE modseq VANISHED), once
+ * QRESYNC is enabled. fetch_result is laid out as with
+ * imap_threaded_fetch_uid_flags(), vanished gets the UIDs expunged
+ * since modseq, or NULL */
+int imap_threaded_fetch_uid_flags_changed(Folder * folder, guint64 modseq,
+					  carray ** fetch_result,
+					  struct mailimap_set ** vanished)
+{
+	struct fetch_changed_param param;
+	struct fetch_changed_result result;
+
+	debug_print("imap fetch_changed - begin\n");
+
+	param.imap = get_imap(folder);
+	param.modseq = modseq;
+
+	mailstream_logger = imap_logger_noop;
+	log_print(LOG_PROTOCOL, "IMAP- [fetching changes...]\n");
+
+	threaded_run(folder, &param, &result, fetch_changed_run);
+
+	mailstream_logger = imap_logger_cmd;
+
+	if (result.error != MAILIMAP_NO_ERROR)
+		return result.error;
+
+	debug_print("imap fetch_changed - end\n");
+
+	* fetch_result = result.fetch_result;
+	* vanished = result.vanished;
+
+	return result.error;
+}
+
+
+
 static int imap_fetch(mailimap * imap,
 		      uint32_t msg_index,
 		      char ** result,
@@ -2704,6 +3244,167 @@ int imap_threaded_fetch_content(Folder * folder, uint32_t msg_index,
 	return result.error;
 }
 
+/* Writes a message to its cache file, dropping the CRs of its CRLFs on
+ * the way */
+static int write_message_file(const char * filename,
+			      const char * content, size_t size)
+{
+	const char * cur = content;
+	const char * end = content + size;
+	FILE * f;
+
+	f = claws_fopen(filename, "wb");
+	if (f == NULL) {
+		FILE_OP_ERROR(filename, "claws_fopen");
+		return -1;
+	}
+
+	while (cur < end) {
+		const char * cr = memchr(cur, '\r', end - cur);
+		size_t len = (cr != NULL ? cr : end) - cur;
+
+		if (len > 0 && claws_fwrite(cur, 1, len, f) < len)
+			goto error;
+		if (cr == NULL)
+			break;
+		/* a lone CR is kept */
+		if (cr + 1 == end || cr[1] != '\n') {
+			if (claws_fputc('\r', f) == EOF)
+				goto error;
+		}
+		cur = cr + 1;
+	}
+
+	if (claws_safe_fclose(f) == EOF) {
+		claws_unlink(filename);
+		return -1;
+	}
+	return 0;
+
+error:
+	claws_fclose(f);
+	claws_unlink(filename);
+	return -1;
+}
+
+struct fetch_bodies_param {
+	mailimap * imap;
+	struct mailimap_set * set;
+	GHashTable * filenames;
+};
+
+struct fetch_bodies_result {
+	int error;
+	GSList * fetched;
+	guint64 size;
+};
+
+static void fetch_bodies_handler(struct mailimap_msg_att * msg_att,
+				 void * context)
+{
+	struct etpan_thread_op * op = context;
+	struct fetch_bodies_param * param = op->param;
+	struct fetch_bodies_result * result = op->result;
+	struct mailimap_msg_att_body_section * body = NULL;
+	const char * filename;
+	uint32_t uid = 0;
+	clistiter * cur;
+
+	for (cur = clist_begin(msg_att->att_list) ; cur != NULL ;
+	     cur = clist_next(cur)) {
+		struct mailimap_msg_att_item * item = clist_content(cur);
+
+		if (item->att_type != MAILIMAP_MSG_ATT_ITEM_STATIC)
+			continue;
+		switch (item->att_data.att_static->att_type) {
+		case MAILIMAP_MSG_ATT_UID:
+			uid = item->att_data.att_static->att_data.att_uid;
+			break;
+		case MAILIMAP_MSG_ATT_BODY_SECTION:
+			body = item->att_data.att_static->att_data.att_body_section;
+			break;
+		}
+	}
+
+	if (uid == 0 || body == NULL || body->sec_body_part == NULL)
+		return;
+	filename = g_hash_table_lookup(param->filenames, GUINT_TO_POINTER(uid));
+	if (filename == NULL)
+		return;
+
+	if (write_message_file(filename, body->sec_body_part,
+			       body->sec_length) < 0)
+		return;
+
+	result->fetched = g_slist_prepend(result->fetched, GUINT_TO_POINTER(uid));
+	result->size += body->sec_length;
+}
+
+static void fetch_bodies_run(struct etpan_thread_op * op)
+{
+	struct fetch_bodies_param * param;
+	struct fetch_bodies_result * result;
+	struct mailimap_fetch_type * fetch_type;
+	struct mailimap_fetch_att * fetch_att;
+	struct mailimap_section * section;
+	clist * fetch_result = NULL;
+	int r;
+
+	param = op->param;
+	result = op->result;
+
+	CHECK_IMAP();
+
+	fetch_type = mailimap_fetch_type_new_fetch_att_list_empty();
+	fetch_att = mailimap_fetch_att_new_uid();
+	mailimap_fetch_type_new_fetch_att_list_add(fetch_type, fetch_att);
+	section = mailimap_section_new(NULL);
+	fetch_att = mailimap_fetch_att_new_body_peek_section(section);
+	mailimap_fetch_type_new_fetch_att_list_add(fetch_type, fetch_att);
+
+	/* each message goes to its file once parsed, instead of them all
+	 * staying in memory until the end of the FETCH */
+	mailimap_set_msg_att_handler(param->imap, fetch_bodies_handler, op);
+	r = mailimap_uid_fetch(param->imap, param->set, fetch_type,
+			       &fetch_result);
+	mailimap_set_msg_att_handler(param->imap, NULL, NULL);
+
+	mailimap_fetch_type_free(fetch_type);
+	if (r == MAILIMAP_NO_ERROR)
+		mailimap_fetch_list_free(fetch_result);
+
+	result->error = r;
+	debug_print("imap fetch_bodies run - end %i\n", r);
+}
+
+/* Downloads whole messages, which filenames maps by UID to the files
+ * to write them to. Returns in fetched the UIDs written, and in size
+ * how many bytes they took on the wire. */
+int imap_threaded_fetch_bodies(Folder * folder, struct mailimap_set * set,
+			       GHashTable * filenames,
+			       GSList ** fetched, guint64 * size)
+{
+	struct fetch_bodies_param param;
+	struct fetch_bodies_result result;
+
+	debug_print("imap fetch_bodies - begin\n");
+
+	param.imap = get_imap(folder);
+	param.set = set;
+	param.filenames = filenames;
+	result.fetched = NULL;
+	result.size = 0;
+
+	threaded_run(folder, &param, &result, fetch_bodies_run);
+
+	* fetched = result.fetched;
+	* size = result.size;
+
+	debug_print("imap fetch_bodies - end\n");
+
+	return result.error;
+}
+
 
 
 static int imap_flags_to_flags(struct mailimap_msg_att_dynamic * att_dyn, GSList **s_tags)
@@ -3034,6 +3735,7 @@ static void fetch_env_run(struct etpan_thread_op * op)
 	env_list = NULL;
 	r = imap_get_envelopes_list(param->imap, param->set,
 				    &env_list);
+	traffic_counter_log_imap(param->imap);
 	
 	result->error = r;
 	result->fetch_env_result = env_list;
@@ -3378,6 +4080,59 @@ int imap_threaded_store(Folder * folder, struct mailimap_set * set,
 	return result.error;
 }
 
+struct store_pipelined_param {
+	mailimap * imap;
+	IMAPPipelinedStore * stores;
+	int count;
+};
+
+struct store_pipelined_result {
+	int error;
+	int changes;
+};
+
+static void store_pipelined_run(struct etpan_thread_op * op)
+{
+	struct store_pipelined_param * param;
+	struct store_pipelined_result * result;
+	int r;
+	
+	param = op->param;
+	result = op->result;
+
+	CHECK_IMAP();
+
+	r = imap_pipeline_uid_store(param->imap, param->stores, param->count,
+				    &result->changes);
+	
+	result->error = r;
+	
+	debug_print("imap store pipelined run - end %i\n", r);
+}
+
+int imap_threaded_store_pipelined(Folder * folder,
+				  IMAPPipelinedStore * stores, int count,
+				  int * changes)
+{
+	struct store_pipelined_param param;
+	struct store_pipelined_result result;
+	
+	debug_print("imap store pipelined - begin (%d commands)\n", count);
+	
+	param.imap = get_imap(folder);
+	param.stores = stores;
+	param.count = count;
+	result.changes = 0;
+	
+	threaded_run(folder, &param, &result, store_pipelined_run);
+	
+	debug_print("imap store pipelined - end\n");
+
+	*changes = result.changes;
+	
+	return result.error;
+}
+
 
 #ifndef G_OS_WIN32
 static void do_exec_command(int fd, const char * command,
@@ -3528,8 +4283,6 @@ int imap_threaded_connect_cmd(Folder * folder, const char * command,
 {
 	struct connect_cmd_param param;
 	struct connect_cmd_result result;
-	chashdatum key;
-	chashdatum value;
 	mailimap * imap, * oldimap;
 	
 	oldimap = get_imap(folder);
@@ -3541,11 +4294,7 @@ int imap_threaded_connect_cmd(Folder * folder, const char * command,
 		delete_imap(folder, oldimap);
 	}
 
-	key.data = &folder;
-	key.len = sizeof(folder);
-	value.data = imap;
-	value.len = 0;
-	chash_set(session_hash, &key, &value, NULL);
+	set_imap(folder, imap);
 	
 	param.imap = imap;
 	param.command = command;
@@ -3560,6 +4309,114 @@ int imap_threaded_connect_cmd(Folder * folder, const char * command,
 }
 #endif /* G_OS_WIN32 */
 
+static void idle_run(struct etpan_thread_op * op)
+{
+	struct idle_param * param;
+	struct idle_result * result;
+	int r;
+
+	param = op->param;
+	result = op->result;
+
+	CHECK_IMAP();
+
+	r = imap_idle_wait(param->imap, param->interrupt_fd,
+			   IMAP_IDLE_TIMEOUT, &result->wakeup);
+
+	result->error = r;
+	debug_print("imap idle run - end %i\n", r);
+}
+
+static void idle_cb(int cancelled, void * result, void * callback_data)
+{
+	struct idle_state * state = callback_data;
+	Folder * folder = state->folder;
+	struct conn_key ck;
+	chashdatum key;
+
+	conn_key_init(&ck, &key, folder, state->slot);
+	chash_delete(idle_hash, &key, NULL);
+
+	close(state->fds[0]);
+	close(state->fds[1]);
+
+	if (!cancelled && state->func != NULL)
+		state->func(folder, state->result.wakeup,
+			    state->result.error, state->data);
+
+	imap_folder_unref(folder);
+	g_free(state);
+}
+
+/* Unlike the other operations this one does not wait for completion:
+ * the selected mailbox is watched with IDLE in the background and func
+ * is called from the main loop when the server sent something, when
+ * IDLE had to be renewed, or when another operation was started on
+ * folder, which stops it first. */
+int imap_threaded_idle_start(Folder * folder, IMAPIdleFunc func, gpointer data)
+{
+#ifndef G_OS_WIN32
+	struct etpan_thread_op * op;
+	struct idle_state * state;
+	mailimap * imap;
+	struct conn_key ck;
+	chashdatum key;
+	chashdatum value;
+	int slot = imap_threaded_get_connection(folder);
+
+	imap = get_connection_imap(folder, slot);
+	if (imap == NULL)
+		return MAILIMAP_ERROR_BAD_STATE;
+
+	if (get_idle(folder, slot) != NULL)
+		return MAILIMAP_NO_ERROR;
+
+	if (!mailimap_has_idle(imap))
+		return MAILIMAP_ERROR_EXTENSION;
+
+	state = g_new0(struct idle_state, 1);
+	if (pipe(state->fds) < 0) {
+		g_free(state);
+		return MAILIMAP_ERROR_MEMORY;
+	}
+	state->folder = folder;
+	state->slot = slot;
+	state->func = func;
+	state->data = data;
+	state->param.imap = imap;
+	state->param.interrupt_fd = state->fds[0];
+
+	conn_key_init(&ck, &key, folder, slot);
+	value.data = state;
+	value.len = 0;
+	chash_set(idle_hash, &key, &value, NULL);
+
+	imap_folder_ref(folder);
+
+	op = etpan_thread_op_new();
+	op->imap = imap;
+	op->param = &state->param;
+	op->result = &state->result;
+	op->run = idle_run;
+	op->callback = idle_cb;
+	op->callback_data = state;
+	op->cleanup = etpan_thread_op_free;
+
+	etpan_thread_op_schedule(get_thread(folder, slot), op);
+
+	debug_print("imap idle started\n");
+
+	return MAILIMAP_NO_ERROR;
+#else
+	return MAILIMAP_ERROR_EXTENSION;
+#endif
+}
+
+void imap_threaded_idle_stop(Folder * folder)
+{
+	idle_stop(folder, imap_threaded_get_connection(folder), TRUE);
+}
+
 void imap_threaded_cancel(Folder * folder)
 {
 	mailimap * imap;
@@ -23,6 +23,8 @@
 
 #include <libetpan/libetpan.h>
 #include "folder.h"
+#include "imap-idle.h"
+#include "imap-pipeline.h"
 
 typedef enum
 {
@@ -46,6 +48,17 @@ void imap_done(Folder * folder);
 int imap_threaded_connect(Folder * folder, const char * server, int port, ProxyInfo *proxy_info);
 int imap_threaded_connect_ssl(Folder * folder, const char * server, int port, ProxyInfo *proxy_info);
 int imap_threaded_capability(Folder *folder, struct mailimap_capability_data ** caps);
+int imap_threaded_enable_qresync(Folder * folder, gboolean * enabled);
+int imap_threaded_compress(Folder * folder, gboolean * enabled);
+
+int imap_threaded_get_connection(Folder * folder);
+void imap_threaded_use_connection(Folder * folder, int slot);
+
+typedef void (* IMAPIdleFunc)(Folder * folder, IMAPIdleWakeup wakeup,
+			      int error, gpointer data);
+
+int imap_threaded_idle_start(Folder * folder, IMAPIdleFunc func, gpointer data);
+void imap_threaded_idle_stop(Folder * folder);
 
 #ifndef G_OS_WIN32
 int imap_threaded_connect_cmd(Folder * folder, const char * command,
@@ -81,7 +94,7 @@ int imap_threaded_delete(Folder * folder, const char * mb);
 int imap_threaded_select(Folder * folder, const char * mb,
 			 gint * exists, gint * recent, gint * unseen,
 			 guint32 * uid_validity, gint * can_create_flags,
-			 GSList **ok_flags);
+			 GSList **ok_flags, guint64 * highestmodseq);
 int imap_threaded_examine(Folder * folder, const char * mb,
 			  gint * exists, gint * recent, gint * unseen,
 			  guint32 * uid_validity);
@@ -147,9 +160,16 @@ int imap_threaded_fetch_uid_flags(Folder * folder, uint32_t first_index,
 
 void imap_fetch_uid_flags_list_free(carray * uid_flags_list);
 
+int imap_threaded_fetch_uid_flags_changed(Folder * folder, guint64 modseq,
+					  carray ** fetch_result,
+					  struct mailimap_set ** vanished);
+
 int imap_threaded_fetch_content(Folder * folder, uint32_t msg_index,
 				int with_body,
 				const char * filename);
+int imap_threaded_fetch_bodies(Folder * folder, struct mailimap_set * set,
+			       GHashTable * filenames,
+			       GSList ** fetched, guint64 * size);
 
 struct imap_fetch_env_info {
 	uint32_t uid;
@@ -176,6 +196,9 @@ int imap_threaded_copy(Folder * folder, struct mailimap_set * set,
 
 int imap_threaded_store(Folder * folder, struct mailimap_set * set,
 			struct mailimap_store_att_flags * store_att_flags);
+int imap_threaded_store_pipelined(Folder * folder,
+				  IMAPPipelinedStore * stores, int count,
+				  int * changes);
 
 void imap_threaded_cancel(Folder * folder);
 
@@ -0,0 +1,169 @@
+#include "config.h"
+
+#include <glib.h>
+#include <unistd.h>
+
+#include "imap-idle.h"
+#include "imap_stand_in.h"
+
+static void
+test_imap_idle_activity(void)
+{
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "IDLE", "+ idling\r\n", "* 4 EXISTS\r\n" },
+		{ "DONE", "%s OK IDLE terminated\r\n", NULL },
+		{ NULL, NULL, NULL }
+	};
+	StandIn stand_in;
+	IMAPIdleWakeup wakeup;
+	mailimap *imap;
+	int r;
+
+	imap = connect_stand_in(&stand_in, script);
+	g_assert_cmpuint(imap->imap_selection_info->sel_exists, ==, 3);
+
+	r = imap_idle_wait(imap, -1, 10 * 1000, &wakeup);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(wakeup, ==, IMAP_IDLE_ACTIVITY);
+	g_assert_cmpuint(imap->imap_selection_info->sel_exists, ==, 4);
+
+	disconnect_stand_in(&stand_in, imap);
+}
+
+static void
+test_imap_idle_flags(void)
+{
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "IDLE", "+ idling\r\n", "* 2 FETCH (FLAGS (\\Seen))\r\n" },
+		{ "DONE", "%s OK IDLE terminated\r\n", NULL },
+		{ NULL, NULL, NULL }
+	};
+	StandIn stand_in;
+	IMAPIdleWakeup wakeup;
+	mailimap *imap;
+	int r;
+
+	imap = connect_stand_in(&stand_in, script);
+
+	r = imap_idle_wait(imap, -1, 10 * 1000, &wakeup);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(wakeup, ==, IMAP_IDLE_FLAGS_CHANGED);
+	g_assert_cmpuint(imap->imap_selection_info->sel_exists, ==, 3);
+
+	disconnect_stand_in(&stand_in, imap);
+}
+
+static void
+test_imap_idle_keepalive(void)
+{
+	/* some servers say they are still there every few minutes */
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "IDLE", "+ idling\r\n", "* OK Still here\r\n" },
+		{ "DONE", "%s OK IDLE terminated\r\n", NULL },
+		{ NULL, NULL, NULL }
+	};
+	StandIn stand_in;
+	IMAPIdleWakeup wakeup;
+	mailimap *imap;
+	int r;
+
+	imap = connect_stand_in(&stand_in, script);
+
+	r = imap_idle_wait(imap, -1, 10 * 1000, &wakeup);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(wakeup, ==, IMAP_IDLE_TIMEOUT_EXPIRED);
+
+	disconnect_stand_in(&stand_in, imap);
+}
+
+static void
+test_imap_idle_interrupted(void)
+{
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "IDLE", "+ idling\r\n", NULL },
+		{ "DONE", "%s OK IDLE terminated\r\n", NULL },
+		{ NULL, NULL, NULL }
+	};
+	StandIn stand_in;
+	IMAPIdleWakeup wakeup;
+	mailimap *imap;
+	int fds[2];
+	int r;
+
+	imap = connect_stand_in(&stand_in, script);
+
+	g_assert_cmpint(pipe(fds), ==, 0);
+	g_assert_cmpint(write(fds[1], "x", 1), ==, 1);
+
+	r = imap_idle_wait(imap, fds[0], 10 * 1000, &wakeup);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(wakeup, ==, IMAP_IDLE_INTERRUPTED);
+	g_assert_cmpuint(imap->imap_selection_info->sel_exists, ==, 3);
+
+	close(fds[0]);
+	close(fds[1]);
+	disconnect_stand_in(&stand_in, imap);
+}
+
+static void
+test_imap_idle_timeout(void)
+{
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "IDLE", "+ idling\r\n", NULL },
+		{ "DONE", "%s OK IDLE terminated\r\n", NULL },
+		{ NULL, NULL, NULL }
+	};
+	StandIn stand_in;
+	IMAPIdleWakeup wakeup;
+	mailimap *imap;
+	int r;
+
+	imap = connect_stand_in(&stand_in, script);
+
+	r = imap_idle_wait(imap, -1, 200, &wakeup);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(wakeup, ==, IMAP_IDLE_TIMEOUT_EXPIRED);
+
+	disconnect_stand_in(&stand_in, imap);
+}
+
+static void
+test_imap_idle_refused(void)
+{
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "IDLE", "%s BAD unknown command\r\n", NULL },
+		{ NULL, NULL, NULL }
+	};
+	StandIn stand_in;
+	IMAPIdleWakeup wakeup;
+	mailimap *imap;
+	int r;
+
+	imap = connect_stand_in(&stand_in, script);
+
+	r = imap_idle_wait(imap, -1, 10 * 1000, &wakeup);
+	g_assert_cmpint(r, !=, MAILIMAP_NO_ERROR);
+
+	disconnect_stand_in(&stand_in, imap);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/etpan/imap_idle/activity", test_imap_idle_activity);
+	g_test_add_func("/etpan/imap_idle/flags", test_imap_idle_flags);
+	g_test_add_func("/etpan/imap_idle/keepalive", test_imap_idle_keepalive);
+	g_test_add_func("/etpan/imap_idle/interrupted", test_imap_idle_interrupted);
+	g_test_add_func("/etpan/imap_idle/timeout", test_imap_idle_timeout);
+	g_test_add_func("/etpan/imap_idle/refused", test_imap_idle_refused);
+
+	return g_test_run();
+}
@@ -0,0 +1,156 @@
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include "imap-pipeline.h"
+#include "imap_stand_in.h"
+
+static struct mailimap_store_att_flags *store_flags(gboolean add,
+						    struct mailimap_flag *flag,
+						    struct mailimap_flag *other)
+{
+	struct mailimap_flag_list *flag_list = mailimap_flag_list_new_empty();
+
+	mailimap_flag_list_add(flag_list, flag);
+	if (other != NULL)
+		mailimap_flag_list_add(flag_list, other);
+
+	if (add)
+		return mailimap_store_att_flags_new_add_flags_silent(flag_list);
+	else
+		return mailimap_store_att_flags_new_remove_flags_silent(flag_list);
+}
+
+static void free_stores(IMAPPipelinedStore *stores, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		mailimap_set_free(stores[i].set);
+		mailimap_store_att_flags_free(stores[i].store_att_flags);
+	}
+}
+
+static void
+test_imap_pipeline_store(void)
+{
+	/* nothing is answered before the last command is in, waiting for
+	 * each response would hang; the mailbox changes meanwhile */
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "UID STORE 1:3,7 +FLAGS.SILENT (\\Seen)",
+		  "%s OK STORE completed\r\n", NULL, TRUE },
+		{ "UID STORE 5 -FLAGS.SILENT (\\Flagged $Forwarded)",
+		  "* 5 FETCH (UID 5 MODSEQ (12))\r\n"
+		  "%s NO mailbox is read-only\r\n", NULL, TRUE },
+		{ "UID STORE 9:* +FLAGS.SILENT (Junk)",
+		  "* 8 FETCH (FLAGS (\\Seen) UID 8)\r\n"
+		  "* 12 EXISTS\r\n"
+		  "%s OK STORE completed\r\n", NULL, FALSE },
+		{ NULL, NULL, NULL, FALSE }
+	};
+	StandIn stand_in;
+	IMAPPipelinedStore stores[3];
+	mailimap *imap;
+	int r, changes;
+
+	stores[0].set = mailimap_set_new_empty();
+	mailimap_set_add_interval(stores[0].set, 1, 3);
+	mailimap_set_add_single(stores[0].set, 7);
+	stores[0].store_att_flags = store_flags(TRUE, mailimap_flag_new_seen(), NULL);
+
+	stores[1].set = mailimap_set_new_single(5);
+	stores[1].store_att_flags = store_flags(FALSE, mailimap_flag_new_flagged(),
+			mailimap_flag_new_flag_keyword(strdup("$Forwarded")));
+
+	stores[2].set = mailimap_set_new_interval(9, 0);
+	stores[2].store_att_flags = store_flags(TRUE,
+			mailimap_flag_new_flag_keyword(strdup("Junk")), NULL);
+
+	imap = connect_stand_in(&stand_in, script);
+
+	r = imap_pipeline_uid_store(imap, stores, 3, &changes);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(changes, ==, IMAP_PIPELINE_MESSAGES_CHANGED |
+					IMAP_PIPELINE_FLAGS_CHANGED);
+	g_assert_cmpint(stores[0].result, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(stores[1].result, ==, MAILIMAP_ERROR_UID_STORE);
+	g_assert_cmpint(stores[2].result, ==, MAILIMAP_NO_ERROR);
+
+	disconnect_stand_in(&stand_in, imap);
+	free_stores(stores, 3);
+}
+
+static void
+test_imap_pipeline_literal(void)
+{
+	/* the literal looks like a tagged response, it must be skipped */
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "UID STORE 4 +FLAGS.SILENT (\\Deleted)",
+		  "* 4 FETCH (UID 4 X-NOTE {10}\r\nP0 OK no\r\n)\r\n"
+		  "%s NO STORE failed\r\n", NULL, FALSE },
+		{ NULL, NULL, NULL, FALSE }
+	};
+	StandIn stand_in;
+	IMAPPipelinedStore store;
+	mailimap *imap;
+	int r, changes;
+
+	store.set = mailimap_set_new_single(4);
+	store.store_att_flags = store_flags(TRUE, mailimap_flag_new_deleted(), NULL);
+
+	imap = connect_stand_in(&stand_in, script);
+
+	r = imap_pipeline_uid_store(imap, &store, 1, &changes);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(changes, ==, 0);
+	g_assert_cmpint(store.result, ==, MAILIMAP_ERROR_UID_STORE);
+
+	disconnect_stand_in(&stand_in, imap);
+	free_stores(&store, 1);
+}
+
+static void
+test_imap_pipeline_not_literal(void)
+{
+	/* text ending in a brace announces no literal */
+	static const ScriptStep script[] = {
+		SELECT_STEP,
+		{ "UID STORE 4 +FLAGS.SILENT (\\Deleted)",
+		  "* OK [ALERT] quota {almost} full}\r\n"
+		  "* OK [ALERT] see {}\r\n"
+		  "%s NO STORE failed {12x}\r\n", NULL, FALSE },
+		{ NULL, NULL, NULL, FALSE }
+	};
+	StandIn stand_in;
+	IMAPPipelinedStore store;
+	mailimap *imap;
+	int r, changes;
+
+	store.set = mailimap_set_new_single(4);
+	store.store_att_flags = store_flags(TRUE, mailimap_flag_new_deleted(), NULL);
+
+	imap = connect_stand_in(&stand_in, script);
+
+	r = imap_pipeline_uid_store(imap, &store, 1, &changes);
+	g_assert_cmpint(r, ==, MAILIMAP_NO_ERROR);
+	g_assert_cmpint(store.result, ==, MAILIMAP_ERROR_UID_STORE);
+
+	disconnect_stand_in(&stand_in, imap);
+	free_stores(&store, 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/etpan/imap_pipeline/store", test_imap_pipeline_store);
+	g_test_add_func("/etpan/imap_pipeline/literal", test_imap_pipeline_literal);
+	g_test_add_func("/etpan/imap_pipeline/not_literal",
+			test_imap_pipeline_not_literal);
+
+	return g_test_run();
+}
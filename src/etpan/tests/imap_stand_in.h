@@ -0,0 +1,139 @@
+#ifndef IMAP_STAND_IN_H
+#define IMAP_STAND_IN_H
+
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <libetpan/libetpan.h>
+
+/* A scriptable stand-in for an IMAP server on the other end of a
+ * socketpair: for each step, it waits for a command and answers with
+ * reply, "%s" being replaced by the command's tag, then sends later
+ * after a short delay. A command with arguments is matched whole,
+ * otherwise only its name is. The reply to a batched step is held
+ * until the next command arrives. */
+
+typedef struct _ScriptStep {
+	const gchar *command;
+	const gchar *reply;
+	const gchar *later;
+	gboolean batched;
+} ScriptStep;
+
+typedef struct _StandIn {
+	int fd;
+	const ScriptStep *script;
+	GThread *thread;
+} StandIn;
+
+static gboolean stand_in_read_line(int fd, GString *line)
+{
+	gchar ch;
+
+	g_string_truncate(line, 0);
+	while (read(fd, &ch, 1) == 1) {
+		if (ch == '\n')
+			return TRUE;
+		if (ch != '\r')
+			g_string_append_c(line, ch);
+	}
+	return FALSE;
+}
+
+static void stand_in_send(int fd, const gchar *str)
+{
+	gsize len = strlen(str);
+
+	g_assert_cmpint(write(fd, str, len), ==, len);
+}
+
+static gpointer stand_in_run(gpointer data)
+{
+	StandIn *stand_in = data;
+	const ScriptStep *step;
+	GString *line = g_string_new(NULL);
+	GString *replies = g_string_new(NULL);
+	gchar *tag = g_strdup("*");
+
+	stand_in_send(stand_in->fd, "* PREAUTH stand-in ready\r\n");
+
+	for (step = stand_in->script; step->command != NULL; step++) {
+		gchar **words;
+		gchar *reply;
+
+		if (!stand_in_read_line(stand_in->fd, line))
+			break;
+		if (g_test_verbose())
+			g_printerr("C: %s\n", line->str);
+
+		/* DONE is the only untagged command */
+		if (strcmp(line->str, "DONE") != 0) {
+			words = g_strsplit(line->str, " ",
+					   strchr(step->command, ' ') ? 2 : 3);
+			g_free(tag);
+			tag = g_strdup(words[0]);
+			g_assert_cmpstr(words[1], ==, step->command);
+			g_strfreev(words);
+		} else {
+			g_assert_cmpstr(line->str, ==, step->command);
+		}
+
+		reply = g_strdup_printf(step->reply, tag);
+		g_string_append(replies, reply);
+		g_free(reply);
+		if (step->batched)
+			continue;
+		stand_in_send(stand_in->fd, replies->str);
+		g_string_truncate(replies, 0);
+
+		if (step->later != NULL) {
+			g_usleep(G_USEC_PER_SEC / 10);
+			stand_in_send(stand_in->fd, step->later);
+		}
+	}
+
+	g_free(tag);
+	g_string_free(replies, TRUE);
+	g_string_free(line, TRUE);
+	return NULL;
+}
+
+static mailimap *connect_stand_in(StandIn *stand_in, const ScriptStep *script)
+{
+	mailimap *imap;
+	mailstream *stream;
+	int fds[2];
+
+	g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+	stand_in->fd = fds[1];
+	stand_in->script = script;
+	stand_in->thread = g_thread_new("imap stand-in", stand_in_run, stand_in);
+
+	stream = mailstream_socket_open(fds[0]);
+	g_assert_nonnull(stream);
+	imap = mailimap_new(0, NULL);
+	g_assert_cmpint(mailimap_connect(imap, stream), ==,
+			MAILIMAP_NO_ERROR_AUTHENTICATED);
+	g_assert_cmpint(mailimap_select(imap, "INBOX"), ==, MAILIMAP_NO_ERROR);
+
+	return imap;
+}
+
+static void disconnect_stand_in(StandIn *stand_in, mailimap *imap)
+{
+	mailstream_close(imap->imap_stream);
+	imap->imap_stream = NULL;
+	mailimap_free(imap);
+
+	g_thread_join(stand_in->thread);
+	close(stand_in->fd);
+}
+
+#define SELECT_STEP \
+	{ "SELECT", "* 3 EXISTS\r\n* OK [UIDVALIDITY 1] ok\r\n" \
+		    "%s OK [READ-WRITE] SELECT completed\r\n", NULL, FALSE }
+
+#endif
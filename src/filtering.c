@@ -569,7 +569,7 @@ gboolean filteringaction_apply_action_list(GSList *action_list, MsgInfo *info)
 }
 
 static gboolean filtering_match_condition(FilteringProp *filtering, MsgInfo *info,
-							PrefsAccount *ac_prefs)
+							PrefsAccount *ac_prefs, MatcherMsgCache *cache)
 
 /* this function returns true if a filtering rule applies regarding to its account
    data and if it does, if the conditions list match.
@@ -764,7 +764,7 @@ static gboolean filtering_match_condition(FilteringProp *filtering, MsgInfo *inf
 		}
 	}
 
-	return matches && matcherlist_match(filtering->matchers, info);
+	return matches && matcherlist_match_cached(filtering->matchers, info, cache);
 }
 
 /*!
@@ -844,13 +844,89 @@ gboolean processing_enabled(GSList *filtering_list)
 	return FALSE;
 }
 
+/* compiled "contains" conditions of the rule lists, by list; built when
+ * the lists are loaded or edited, see filtering_rules_changed() */
+static GHashTable *filtering_literals = NULL;
+
+static void filtering_literals_add(GSList *filtering_list)
+{
+	GSList *matcher_lists = NULL, *l;
+
+	if (filtering_list == NULL)
+		return;
+
+	for (l = filtering_list; l != NULL; l = g_slist_next(l)) {
+		FilteringProp *filtering = (FilteringProp *) l->data;
+
+		matcher_lists = g_slist_prepend(matcher_lists, filtering->matchers);
+	}
+	matcher_lists = g_slist_reverse(matcher_lists);
+
+	g_hash_table_replace(filtering_literals, filtering_list,
+			     matcher_literals_new(matcher_lists));
+	g_slist_free(matcher_lists);
+}
+
+static gboolean filtering_literals_add_func(GNode *node, gpointer data)
+{
+	FolderItem *item = node->data;
+
+	if (item && item->prefs)
+		filtering_literals_add(item->prefs->processing);
+
+	return FALSE;
+}
+
+/*!
+ *rief	Compile the "contains" conditions of the global and folder
+ *		rule lists again. Must be called whenever a rule list is
+ *		loaded, replaced, or has rules added or removed.
+ */
+void filtering_rules_changed(void)
+{
+	GList *cur;
+
+	if (filtering_literals)
+		g_hash_table_destroy(filtering_literals);
+	filtering_literals = g_hash_table_new_full(g_direct_hash,
+			g_direct_equal, NULL,
+			(GDestroyNotify) matcher_literals_free);
+
+	filtering_literals_add(pre_global_processing);
+	filtering_literals_add(post_global_processing);
+	filtering_literals_add(filtering_rules);
+	for (cur = folder_get_list(); cur != NULL; cur = g_list_next(cur)) {
+		Folder *folder = (Folder *) cur->data;
+
+		g_node_traverse(folder->node, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
+				filtering_literals_add_func, NULL);
+	}
+}
+
+/* NULL for lists that are not kept with the rules, whose conditions
+ * are then tested one by one */
+static MatcherLiterals *filtering_get_literals(GSList *filtering_list)
+{
+	if (!filtering_literals || !filtering_list)
+		return NULL;
+
+	return g_hash_table_lookup(filtering_literals, filtering_list);
+}
+
 static gboolean filter_msginfo(GSList * filtering_list, MsgInfo * info, PrefsAccount* ac_prefs)
 {
 	GSList	*l;
 	gboolean final;
 	gboolean apply_next;
+	MatcherMsgCache *cache;
 	
 	cm_return_val_if_fail(info != NULL, TRUE);
+
+	/* rules are still tested one by one and in order, as their
+	 * actions can change what the next ones see, but the message
+	 * file is only read and parsed once for all of them */
+	cache = matcher_msg_cache_new(info);
+	matcher_msg_cache_set_literals(cache, filtering_get_literals(filtering_list));
 	
 	for (l = filtering_list, final = FALSE, apply_next = FALSE; l != NULL; l = g_slist_next(l)) {
 		FilteringProp * filtering = (FilteringProp *) l->data;
@@ -870,7 +946,7 @@ static gboolean filter_msginfo(GSList * filtering_list, MsgInfo * info, PrefsAcc
 				g_free(buf);
 			}
 
-			if (filtering_match_condition(filtering, info, ac_prefs)) {
+			if (filtering_match_condition(filtering, info, ac_prefs, cache)) {
 				apply_next = filtering_apply_rule(filtering, info, &final);
 				if (final)
 					break;
@@ -894,6 +970,7 @@ static gboolean filter_msginfo(GSList * filtering_list, MsgInfo * info, PrefsAcc
 			}
 		}
 	}
+	matcher_msg_cache_free(cache);
 
     /* put in inbox if the last rule was not a final one, or
      * a final rule could not be applied.
@@ -984,6 +1061,87 @@ gboolean filter_message_by_msginfo(GSList *flist, MsgInfo *info, PrefsAccount* a
 	return ret;
 }
 
+/* whether applying the rule can change what the following rules see:
+ * only copying, forwarding and collecting addresses leave the message
+ * as it is */
+static gboolean filtering_may_change_msg(FilteringProp *filtering)
+{
+	GSList *l;
+
+	for (l = filtering->action_list; l != NULL; l = l->next) {
+		switch (((FilteringAction *) l->data)->type) {
+		case MATCHACTION_COPY:
+		case MATCHACTION_FORWARD:
+		case MATCHACTION_FORWARD_AS_ATTACHMENT:
+		case MATCHACTION_REDIRECT:
+		case MATCHACTION_ADD_TO_ADDRESSBOOK:
+			break;
+		default:
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/*!
+ *\brief	Start the "test" commands of the rules on a batch of
+ *		messages, so that they run in parallel. The rules pick
+ *		up the results as they get to them. Only the tests the
+ *		rules will run are started: those of rules whose other
+ *		conditions leave the result to them, up to the first
+ *		rule that may match and change the message. Only has an
+ *		effect between \ref matcher_tests_begin and
+ *		\ref matcher_tests_end.
+ *
+ *\param	flist List of filter rules.
+ *\param	msglist Messages about to be filtered.
+ *\param	ac_prefs Account the messages are retrieved for, or NULL.
+ */
+void filtering_start_tests(GSList *flist, GSList *msglist, PrefsAccount *ac_prefs)
+{
+	GSList *cur, *l;
+	MatcherMsgCache *cache;
+
+	/* the log would show the conditions checked twice */
+	if (debug_filtering_session)
+		return;
+
+	for (l = flist; l != NULL; l = g_slist_next(l)) {
+		FilteringProp *filtering = (FilteringProp *) l->data;
+
+		if (filtering->enabled
+		    && matcherlist_has_test(filtering->matchers))
+			break;
+	}
+	if (l == NULL)
+		return;
+
+	for (cur = msglist; cur != NULL; cur = cur->next) {
+		MsgInfo *info = (MsgInfo *)cur->data;
+
+		cache = matcher_msg_cache_new(info);
+		matcher_msg_cache_set_literals(cache, filtering_get_literals(flist));
+
+		for (l = flist; l != NULL; l = g_slist_next(l)) {
+			FilteringProp *filtering = (FilteringProp *) l->data;
+
+			if (!filtering->enabled)
+				continue;
+			if (ac_prefs != NULL && filtering->account_id != 0
+			    && filtering->account_id != ac_prefs->account_id)
+				continue;
+			/* rules without tests are not evaluated ahead,
+			 * so they count as matching here */
+			if (matcherlist_has_test(filtering->matchers) &&
+			    !matcherlist_start_tests(filtering->matchers, info, cache))
+				continue;
+			if (filtering_may_change_msg(filtering))
+				break;
+		}
+		matcher_msg_cache_free(cache);
+	}
+}
+
 gchar *filteringaction_to_string(FilteringAction *action)
 {
 	const gchar *command_str;
@@ -1156,6 +1314,8 @@ void prefs_filtering_clear(void)
 	pre_global_processing = NULL;
 	prefs_filtering_free(post_global_processing);
 	post_global_processing = NULL;
+
+	filtering_rules_changed();
 }
 
 void prefs_filtering_clear_folder(Folder *folder)
@@ -1165,6 +1325,7 @@ void prefs_filtering_clear_folder(Folder *folder)
 
 	g_node_traverse(folder->node, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
 			prefs_filtering_free_func, NULL);
+	filtering_rules_changed();
 	/* FIXME: Note folder settings were changed, where the updates? */
 }
 
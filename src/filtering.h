@@ -89,6 +89,8 @@ void filter_msginfo_move_or_delete(GSList *filtering_list, MsgInfo *info);
 gboolean processing_enabled(GSList *filtering_list);
 gboolean filter_message_by_msginfo(GSList *flist, MsgInfo *info, PrefsAccount *ac_prefs,
 								   FilteringInvocationType context, gchar *extra_info);
+void filtering_start_tests(GSList *flist, GSList *msglist, PrefsAccount *ac_prefs);
+void filtering_rules_changed(void);
 
 gchar * filteringaction_to_string(FilteringAction *action);
 void prefs_filtering_write_config(void);
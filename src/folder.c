@@ -61,6 +61,7 @@
 #include "prefs_common.h"
 #include "prefs_migration.h"
 #include "file-utils.h"
+#include "bodyindex.h"
 
 /* Dependecies to be removed ?! */
 #include "prefs_account.h"
@@ -509,6 +510,7 @@ void folder_item_destroy(FolderItem *item)
 
 	if (item->cache)
 		folder_item_free_cache(item, TRUE);
+	body_index_forget(item);
 	if (item->prefs)
 		folder_item_prefs_free(item->prefs);
 	g_free(item->name);
@@ -1928,22 +1930,6 @@ gchar *folder_item_get_path(FolderItem *item)
 	return folder->klass->item_get_path(folder, item);
 }
 
-static gint folder_sort_cache_list_by_msgnum(gconstpointer a, gconstpointer b)
-{
-	MsgInfo *msginfo_a = (MsgInfo *) a;
-	MsgInfo *msginfo_b = (MsgInfo *) b;
-
-	return (msginfo_a->msgnum - msginfo_b->msgnum);
-}
-
-static gint folder_sort_folder_list(gconstpointer a, gconstpointer b)
-{
-	guint gint_a = GPOINTER_TO_INT(a);
-	guint gint_b = GPOINTER_TO_INT(b);
-	
-	return (gint_a - gint_b);
-}
-
 static gint syncronize_flags(FolderItem *item, MsgInfoList *msglist)
 {
 	GHashTable *relation;
@@ -2151,11 +2137,180 @@ static MsgInfo *get_msginfo(FolderItem *item, guint num)
 	return msginfo;
 }
 
+/* Checks the sorted message numbers of the folder against the msgnum
+ * column of the on-disk cache, and for folders which can tell whether
+ * a message changed, the size and mtime columns, so that an unchanged
+ * folder doesn't need its cache loaded. The messages are only checked
+ * one by one if the folder changed since it was last scanned. */
+static gboolean folder_item_disk_cache_uptodate(FolderItem *item,
+						GArray *folder_ranges,
+						guint64 folder_len,
+						gboolean folder_changed)
+{
+	Folder *folder = item->folder;
+	gchar *cache_file;
+	guint32 *nums, *sizes = NULL, *mtimes = NULL;
+	guint count, size_count = 0, mtime_count = 0, i, r;
+	gboolean uptodate;
+
+	/* flags may have changed on the server */
+	if (folder->klass->get_flags != NULL)
+		return FALSE;
+
+	cache_file = folder_item_get_cache_file(item);
+	nums = msgcache_read_cache_column(cache_file, MSGCACHE_COL_MSGNUM, &count);
+	if (nums == NULL || count != item->total_msgs || count != folder_len) {
+		g_free(nums);
+		g_free(cache_file);
+		return FALSE;
+	}
+
+	i = 0;
+	for (r = 0; r < folder_ranges->len && i < count; r++) {
+		UIntRange *range = &g_array_index(folder_ranges, UIntRange, r);
+		guint num = range->first;
+
+		while (i < count && nums[i] == num) {
+			i++;
+			if (num++ == range->last)
+				break;
+		}
+		if (num <= range->last)
+			break;
+	}
+	uptodate = (i == count && r == folder_ranges->len);
+
+	if (uptodate && folder_changed &&
+	    folder->klass->is_msg_changed != NULL) {
+		sizes = msgcache_read_cache_column(cache_file, MSGCACHE_COL_SIZE, &size_count);
+		mtimes = msgcache_read_cache_column(cache_file, MSGCACHE_COL_MTIME, &mtime_count);
+		uptodate = (sizes != NULL && mtimes != NULL &&
+			    size_count == count && mtime_count == count);
+
+		for (i = 0; uptodate && i < count; i++) {
+			MsgInfo *msginfo = procmsg_msginfo_new();
+
+			msginfo->msgnum = nums[i];
+			msginfo->size = sizes[i];
+			msginfo->mtime = mtimes[i];
+			msginfo->folder = item;
+			if (folder->klass->is_msg_changed(folder, item, msginfo))
+				uptodate = FALSE;
+			procmsg_msginfo_free(&msginfo);
+		}
+	}
+
+	g_free(nums);
+	g_free(sizes);
+	g_free(mtimes);
+	g_free(cache_file);
+
+	return uptodate;
+}
+
+/* Fills the range array with the folder's message numbers, through
+ * the folder class' get_num_ranges, get_num_array or get_num_list,
+ * whichever it has. */
+static gint folder_item_get_num_ranges(FolderItem *item, GArray *ranges,
+				       gboolean *old_uids_valid)
+{
+	Folder *folder = item->folder;
+	GArray *array;
+	GSList *list = NULL, *cur;
+	gint ret;
+
+	if (folder->klass->get_num_ranges != NULL)
+		return folder->klass->get_num_ranges(folder, item, ranges,
+						     old_uids_valid);
+
+	array = g_array_sized_new(FALSE, FALSE, sizeof(guint), item->total_msgs);
+	if (folder->klass->get_num_array != NULL) {
+		ret = folder->klass->get_num_array(folder, item, array,
+						   old_uids_valid);
+	} else {
+		ret = folder->klass->get_num_list(folder, item, &list,
+						  old_uids_valid);
+		for (cur = list; cur != NULL; cur = cur->next) {
+			guint num = GPOINTER_TO_UINT(cur->data);
+
+			g_array_append_val(array, num);
+		}
+		g_slist_free(list);
+	}
+
+	if (ret >= 0) {
+		sort_uint_array((guint *) array->data, array->len);
+		uint_ranges_append_array(ranges, (guint *) array->data,
+					 array->len);
+	}
+	g_array_free(array, TRUE);
+
+	return ret;
+}
+
+static MsgInfoList *get_msginfos_for_ranges(FolderItem *item, GArray *ranges)
+{
+	Folder *folder = item->folder;
+	MsgNumberList *numlist = NULL;
+	MsgInfoList *msglist;
+	guint i;
+
+	if (item->no_select)
+		return NULL;
+
+	if (folder->klass->get_msginfos_for_ranges != NULL)
+		return folder->klass->get_msginfos_for_ranges(folder, item,
+							      ranges);
+
+	for (i = ranges->len; i > 0; i--) {
+		UIntRange *range = &g_array_index(ranges, UIntRange, i - 1);
+		guint num = range->last;
+
+		for (;;) {
+			numlist = g_slist_prepend(numlist, GUINT_TO_POINTER(num));
+			if (num-- == range->first)
+				break;
+		}
+	}
+	msglist = get_msginfos(item, numlist);
+	g_slist_free(numlist);
+
+	return msglist;
+}
+
+/* Remembers the numbers first..last, which are in the folder but not in
+ * the cache, for fetching */
+static void folder_item_scan_add_new(FolderItem *item, GArray *new_ranges,
+				     guint first, guint last,
+				     guint cache_max_num, guint folder_max_num)
+{
+	Folder *folder = item->folder;
+
+	if (FOLDER_TYPE(folder) == F_NEWS) {
+		guint max_articles = folder->account->max_articles;
+
+		/* only articles newer than the cached ones, and only the
+		 * last max_articles of them */
+		if (first < cache_max_num)
+			first = cache_max_num;
+		if (max_articles > 0 && folder_max_num > max_articles &&
+		    first <= folder_max_num - max_articles)
+			first = folder_max_num - max_articles + 1;
+		if (first > last)
+			return;
+	}
+
+	uint_ranges_append(new_ranges, first, last);
+	debug_print("Remembered messages %u to %u for fetching\n", first, last);
+}
+
 gint folder_item_scan_full(FolderItem *item, gboolean filtering)
 {
 	Folder *folder;
-	GSList *folder_list = NULL, *cache_list = NULL;
-	GSList *folder_list_cur, *cache_list_cur, *new_list = NULL;
+	GArray *folder_ranges, *cache_array = NULL, *removed_array, *new_ranges;
+	guint *cache_nums = NULL;
+	guint64 folder_len;
+	guint cache_len = 0, cache_pos = 0, r;
 	GSList *exists_list = NULL, *elem;
 	GSList *newmsg_list = NULL;
 	guint newcnt = 0, unreadcnt = 0, totalcnt = 0;
@@ -2163,8 +2318,9 @@ gint folder_item_scan_full(FolderItem *item, gboolean filtering)
 	guint repliedcnt = 0, forwardedcnt = 0;
 	guint lockedcnt = 0, ignoredcnt = 0, watchedcnt = 0;
 
-	guint cache_max_num, folder_max_num, cache_cur_num, folder_cur_num;
+	guint cache_max_num, folder_max_num;
 	gboolean update_flags = 0, old_uids_valid = FALSE;
+	gboolean folder_changed = TRUE;
 	GHashTable *subject_table = NULL;
 	
 	cm_return_val_if_fail(item != NULL, -1);
@@ -2173,19 +2329,43 @@ gint folder_item_scan_full(FolderItem *item, gboolean filtering)
 	folder = item->folder;
 
 	cm_return_val_if_fail(folder != NULL, -1);
-	cm_return_val_if_fail(folder->klass->get_num_list != NULL, -1);
+	cm_return_val_if_fail(folder->klass->get_num_list != NULL ||
+			      folder->klass->get_num_array != NULL ||
+			      folder->klass->get_num_ranges != NULL, -1);
 
 	item->scanning = ITEM_SCANNING_WITH_FLAGS;
 
 	debug_print("Scanning folder %s for cache changes.\n", item->path ? item->path : "(null)");
+
+	/* spares checking each message against the cache on disk; asked
+	 * before listing the folder, which records its mtime */
+	if (item->cache == NULL && folder->klass->get_flags == NULL &&
+	    folder->klass->is_msg_changed != NULL &&
+	    folder->klass->scan_required != NULL)
+		folder_changed = folder->klass->scan_required(folder, item);
 	
 	/* Get list of messages for folder and cache */
-	if (folder->klass->get_num_list(item->folder, item, &folder_list, &old_uids_valid) < 0) {
+	folder_ranges = g_array_new(FALSE, FALSE, sizeof(UIntRange));
+	if (folder_item_get_num_ranges(item, folder_ranges, &old_uids_valid) < 0) {
 		debug_print("Error fetching list of message numbers\n");
+		g_array_free(folder_ranges, TRUE);
 		item->scanning = ITEM_NOT_SCANNING;
 		return(-1);
 	}
 
+	folder_len = uint_ranges_count(folder_ranges);
+
+	if (old_uids_valid && item->cache == NULL) {
+		if (folder_item_disk_cache_uptodate(item, folder_ranges,
+						    folder_len, folder_changed)) {
+			debug_print("Cache of %s is up to date, not loading it.\n",
+				    item->path);
+			g_array_free(folder_ranges, TRUE);
+			item->scanning = ITEM_NOT_SCANNING;
+			return 0;
+		}
+	}
+
 	if(prefs_common.thread_by_subject) {
 		subject_table = g_hash_table_new(g_str_hash, g_str_equal);
 	}
@@ -2193,7 +2373,10 @@ gint folder_item_scan_full(FolderItem *item, gboolean filtering)
 	if (old_uids_valid) {
 		if (!item->cache)
 			folder_item_read_cache(item);
-		cache_list = msgcache_get_msg_list(item->cache);
+		cache_array = msgcache_get_msg_num_array(item->cache);
+		cache_nums = (guint *) cache_array->data;
+		cache_len = cache_array->len;
+		sort_uint_array(cache_nums, cache_len);
 	} else {
 		if (item->cache)
 			msgcache_destroy(item->cache);
@@ -2201,166 +2384,109 @@ gint folder_item_scan_full(FolderItem *item, gboolean filtering)
 		item->cache_dirty = TRUE;
 		item->mark_dirty = TRUE;
 		item->tags_dirty = TRUE;
-		cache_list = NULL;
 	}
 
-	/* Sort both lists */
-    	cache_list = g_slist_sort(cache_list, folder_sort_cache_list_by_msgnum);
-	folder_list = g_slist_sort(folder_list, folder_sort_folder_list);
-
-	cache_list_cur = cache_list;
-	folder_list_cur = folder_list;
+	removed_array = g_array_new(FALSE, FALSE, sizeof(guint));
+	new_ranges = g_array_new(FALSE, FALSE, sizeof(UIntRange));
 
-	if (cache_list_cur != NULL) {
-		GSList *cache_list_last;
-	
-		cache_cur_num = ((MsgInfo *)cache_list_cur->data)->msgnum;
-		cache_list_last = g_slist_last(cache_list);
-		cache_max_num = ((MsgInfo *)cache_list_last->data)->msgnum;
-	} else {
-		cache_cur_num = G_MAXUINT;
-		cache_max_num = 0;
-	}
+	cache_max_num = cache_len > 0 ? cache_nums[cache_len - 1] : 0;
+	folder_max_num = folder_ranges->len > 0 ?
+		g_array_index(folder_ranges, UIntRange, folder_ranges->len - 1).last : 0;
 
-	if (folder_list_cur != NULL) {
-		GSList *folder_list_last;
-	
-		folder_cur_num = GPOINTER_TO_UINT(folder_list_cur->data);
-		folder_list_last = g_slist_last(folder_list);
-		folder_max_num = GPOINTER_TO_UINT(folder_list_last->data);
-	} else {
-		folder_cur_num = G_MAXUINT;
-		folder_max_num = 0;
-	}
+	/* walk the folder ranges along the cache numbers, so that the
+	 * numbers only in the folder are handled a range at a time */
+	for (r = 0; r < folder_ranges->len; r++) {
+		UIntRange *range = &g_array_index(folder_ranges, UIntRange, r);
+		guint num = range->first;
 
-	while ((cache_cur_num != G_MAXUINT) || (folder_cur_num != G_MAXUINT)) {
-		/*
-		 *  Message only exists in the folder
-		 *  Remember message for fetching
-		 */
-		if (folder_cur_num < cache_cur_num) {
-			gboolean add = FALSE;
-
-			switch(FOLDER_TYPE(folder)) {
-				case F_NEWS:
-					if (folder_cur_num < cache_max_num)
-						break;
-					
-					if (folder->account->max_articles == 0) {
-						add = TRUE;
-					}
+		for (;;) {
+			guint cache_cur_num, gap_last;
 
-					if (folder_max_num <= folder->account->max_articles) {
-						add = TRUE;
-					} else if (folder_cur_num > (folder_max_num - folder->account->max_articles)) {
-						add = TRUE;
-					}
-					break;
-				default:
-					add = TRUE;
-					break;
-			}
-			
-			if (add) {
-				new_list = g_slist_prepend(new_list, GUINT_TO_POINTER(folder_cur_num));
-				debug_print("Remembered message %u for fetching\n", folder_cur_num);
+			/*
+			 *  Messages only in the cache
+			 *  Remove them from the cache
+			 */
+			while (cache_pos < cache_len && cache_nums[cache_pos] < num) {
+				g_array_append_val(removed_array, cache_nums[cache_pos]);
+				debug_print("Removing message %u from cache.\n", cache_nums[cache_pos]);
+				cache_pos++;
+				update_flags |= F_ITEM_UPDATE_MSGCNT | F_ITEM_UPDATE_CONTENT;
 			}
+			cache_cur_num = cache_pos < cache_len ? cache_nums[cache_pos] : G_MAXUINT;
+
+			/*
+			 *  Message number exists in folder and cache!
+			 *  Check if the message has been modified
+			 */
+			if (cache_cur_num == num) {
+				MsgInfo *msginfo;
+
+				msginfo = msgcache_get_msg(item->cache, num);
+				if (msginfo && folder->klass->is_msg_changed && folder->klass->is_msg_changed(folder, item, msginfo)) {
+					g_array_append_val(removed_array, msginfo->msgnum);
+					uint_ranges_append(new_ranges, num, num);
+					procmsg_msginfo_free(&msginfo);
 
-			/* Move to next folder number */
-			if (folder_list_cur)
-				folder_list_cur = folder_list_cur->next;
-
-			if (folder_list_cur != NULL)
-				folder_cur_num = GPOINTER_TO_UINT(folder_list_cur->data);
-			else
-				folder_cur_num = G_MAXUINT;
-
-			continue;
-		}
-
-		/*
-		 *  Message only exists in the cache
-		 *  Remove the message from the cache
-		 */
-		if (cache_cur_num < folder_cur_num) {
-			msgcache_remove_msg(item->cache, cache_cur_num);
-			debug_print("Removed message %u from cache.\n", cache_cur_num);
-
-			/* Move to next cache number */
-			if (cache_list_cur)
-				cache_list_cur = cache_list_cur->next;
-
-			if (cache_list_cur != NULL)
-				cache_cur_num = ((MsgInfo *)cache_list_cur->data)->msgnum;
-			else
-				cache_cur_num = G_MAXUINT;
-
-			update_flags |= F_ITEM_UPDATE_MSGCNT | F_ITEM_UPDATE_CONTENT;
-
-			continue;
-		}
-
-		/*
-		 *  Message number exists in folder and cache!
-		 *  Check if the message has been modified
-		 */
-		if (cache_cur_num == folder_cur_num) {
-			MsgInfo *msginfo;
-
-			msginfo = msgcache_get_msg(item->cache, folder_cur_num);
-			if (msginfo && folder->klass->is_msg_changed && folder->klass->is_msg_changed(folder, item, msginfo)) {
-				msgcache_remove_msg(item->cache, msginfo->msgnum);
-				new_list = g_slist_prepend(new_list, GINT_TO_POINTER(msginfo->msgnum));
-				procmsg_msginfo_free(&msginfo);
-
-				debug_print("Remembering message %u to update...\n", folder_cur_num);
-			} else if (msginfo) {
-				exists_list = g_slist_prepend(exists_list, msginfo);
+					debug_print("Remembering message %u to update...\n", num);
+				} else if (msginfo) {
+					exists_list = g_slist_prepend(exists_list, msginfo);
 
-				if(prefs_common.thread_by_subject &&
-					MSG_IS_IGNORE_THREAD(msginfo->flags) &&
-					!subject_table_lookup(subject_table, msginfo->subject)) {
-					subject_table_insert(subject_table, msginfo->subject, msginfo);
+					if(prefs_common.thread_by_subject &&
+						MSG_IS_IGNORE_THREAD(msginfo->flags) &&
+						!subject_table_lookup(subject_table, msginfo->subject)) {
+						subject_table_insert(subject_table, msginfo->subject, msginfo);
+					}
 				}
-			}
-			
-			/* Move to next folder and cache number */
-			if (cache_list_cur)
-				cache_list_cur = cache_list_cur->next;
-			
-			if (folder_list_cur)
-				folder_list_cur = folder_list_cur->next;
-
-			if (cache_list_cur != NULL)
-				cache_cur_num = ((MsgInfo *)cache_list_cur->data)->msgnum;
-			else
-				cache_cur_num = G_MAXUINT;
 
-			if (folder_list_cur != NULL)
-				folder_cur_num = GPOINTER_TO_UINT(folder_list_cur->data);
-			else
-				folder_cur_num = G_MAXUINT;
+				cache_pos++;
+				if (num == range->last)
+					break;
+				num++;
+				continue;
+			}
 
-			continue;
+			/*
+			 *  Messages only in the folder, up to the next cached one
+			 *  Remember them for fetching
+			 */
+			gap_last = MIN(range->last, cache_cur_num - 1);
+			folder_item_scan_add_new(item, new_ranges, num, gap_last,
+						 cache_max_num, folder_max_num);
+			if (gap_last == range->last)
+				break;
+			num = gap_last + 1;
 		}
 	}
-	
-	for(cache_list_cur = cache_list; cache_list_cur != NULL; cache_list_cur = g_slist_next(cache_list_cur))
-		procmsg_msginfo_free((MsgInfo **)&(cache_list_cur->data));
 
-	g_slist_free(cache_list);
-	g_slist_free(folder_list);
+	/* what is left of the cache is gone from the folder */
+	for (; cache_pos < cache_len; cache_pos++) {
+		g_array_append_val(removed_array, cache_nums[cache_pos]);
+		debug_print("Removing message %u from cache.\n", cache_nums[cache_pos]);
+		update_flags |= F_ITEM_UPDATE_MSGCNT | F_ITEM_UPDATE_CONTENT;
+	}
+
+	msgcache_remove_msgs(item->cache, (guint *) removed_array->data,
+			     removed_array->len);
+	body_index_remove_msgs(item, (guint *) removed_array->data,
+			       removed_array->len);
+	if (new_ranges->len > 0)
+		body_index_schedule(item);
+
+	g_array_free(removed_array, TRUE);
+	if (cache_array != NULL)
+		g_array_free(cache_array, TRUE);
+	g_array_free(folder_ranges, TRUE);
 
-	if (new_list != NULL) {
+	if (new_ranges->len > 0) {
 		GSList *tmp_list = NULL;
-		newmsg_list = get_msginfos(item, new_list);
-		g_slist_free(new_list);
+		newmsg_list = get_msginfos_for_ranges(item, new_ranges);
 		tmp_list = g_slist_concat(g_slist_copy(exists_list), g_slist_copy(newmsg_list));
 		syncronize_flags(item, tmp_list);
 		g_slist_free(tmp_list);
 	} else {
 		syncronize_flags(item, exists_list);
 	}
+	g_array_free(new_ranges, TRUE);
 
 	folder_item_update_freeze();
 	
@@ -2667,7 +2793,9 @@ static void folder_item_read_cache(FolderItem *item)
 		mark_file = folder_item_get_mark_file(item);
 		tags_file = folder_item_get_tags_file(item);
 		item->cache = msgcache_read_cache(item, cache_file);
-		item->cache_dirty = FALSE;
+		/* rewrite caches in the old format at the next occasion */
+		item->cache_dirty = item->cache != NULL &&
+				    msgcache_is_outdated(item->cache);
 		item->mark_dirty = FALSE;
 		item->tags_dirty = FALSE;
 		if (!item->cache) {
@@ -2856,6 +2984,16 @@ GSList *folder_item_get_msg_list(FolderItem *item)
 	return msgcache_get_msg_list(item->cache);
 }
 
+ThreadIndex *folder_item_get_thread_index(FolderItem *item)
+{
+	cm_return_val_if_fail(item != NULL, NULL);
+
+	if (item->cache == NULL)
+		return NULL;
+
+	return msgcache_get_thread_index(item->cache);
+}
+
 static void msginfo_set_mime_flags(GNode *node, gpointer data)
 {
 	MsgInfo *msginfo = data;
@@ -4811,6 +4949,213 @@ MsgNumberList *folder_item_get_number_list(FolderItem *item)
 	return nums;
 }
 
+/* messages handed to a search worker at once */
+#define SEARCH_CHUNK_SIZE	64
+
+enum {
+	SEARCH_PENDING = 0,
+	SEARCH_NO_MATCH,
+	SEARCH_MATCH
+};
+
+typedef struct _SearchJob {
+	MatcherList *predicate;
+	MsgInfo **msginfos;	/* snapshots made by the main thread */
+	gchar **files;		/* idem, NULL if a file could not be fetched */
+	guint8 *state;		/* SEARCH_*, set by the workers */
+	gint cancelled;		/* atomic */
+
+	GMutex mutex;
+	GCond cond;
+	GQueue done;		/* finished SearchChunks */
+} SearchJob;
+
+typedef struct _SearchChunk {
+	guint start;
+	guint end;
+} SearchChunk;
+
+/* The cached MsgInfos can change or go away while the main loop runs
+ * in the progress callback, so the workers get their own copy of what
+ * the matcher looks at. */
+static MsgInfo *folder_item_search_snapshot(MsgInfo *msginfo)
+{
+	MsgInfo *snapshot = procmsg_msginfo_copy(msginfo);
+
+	/* not counted in the destination's op_count */
+	snapshot->to_folder = NULL;
+	snapshot->tags = g_slist_copy(msginfo->tags);
+	snapshot->total_size = msginfo->total_size;
+	snapshot->planned_download = msginfo->planned_download;
+
+	return snapshot;
+}
+
+static void folder_item_search_worker(gpointer data, gpointer user_data)
+{
+	SearchChunk *chunk = (SearchChunk *)data;
+	SearchJob *job = (SearchJob *)user_data;
+	/* matchers keep per-message state and compiled regexps */
+	MatcherList *predicate = matcherlist_copy(job->predicate);
+	guint i;
+
+	for (i = chunk->start; i < chunk->end; i++) {
+		MatcherMsgCache *cache;
+		gboolean match;
+
+		if (g_atomic_int_get(&job->cancelled))
+			break;
+		/* ruled out by the body index */
+		if (job->state[i] != SEARCH_PENDING)
+			continue;
+
+		cache = matcher_msg_cache_new(job->msginfos[i]);
+		matcher_msg_cache_set_file(cache, job->files[i]);
+		match = matcherlist_match_cached(predicate, job->msginfos[i], cache);
+		matcher_msg_cache_free(cache);
+
+		job->state[i] = match ? SEARCH_MATCH : SEARCH_NO_MATCH;
+	}
+	matcherlist_free(predicate);
+
+	g_mutex_lock(&job->mutex);
+	g_queue_push_tail(&job->done, chunk);
+	g_cond_signal(&job->cond);
+	g_mutex_unlock(&job->mutex);
+}
+
+/* Same as the loop of folder_item_search_msgs_local(), with the
+ * predicate tested by a pool of worker threads. Fetching messages
+ * goes through the folder cache and is left to the main thread, which
+ * also reports progress and collects the matches in list order. */
+static gint folder_item_search_msgs_threaded(FolderItem *container,
+					     GSList *nums, guint msgcount,
+					     MatcherList *predicate,
+					     BodyIndexQuery *query,
+					     SearchProgressNotify progress_cb,
+					     gpointer progress_data,
+					     GSList **result)
+{
+	SearchJob job;
+	GThreadPool *pool;
+	guint *msgnums;
+	guint nthreads = g_get_num_processors();
+	guint next = 0, in_flight = 0, processed_count = 0, i;
+	gint matched_count = 0;
+	gboolean stop = FALSE, error = FALSE;
+	GSList *cur;
+
+	memset(&job, 0, sizeof(job));
+	job.predicate = predicate;
+	job.msginfos = g_new0(MsgInfo *, msgcount);
+	job.files = g_new0(gchar *, msgcount);
+	job.state = g_new0(guint8, msgcount);
+	g_mutex_init(&job.mutex);
+	g_cond_init(&job.cond);
+	g_queue_init(&job.done);
+
+	msgnums = g_new(guint, msgcount);
+	for (cur = nums, i = 0; cur != NULL; cur = cur->next, i++)
+		msgnums[i] = GPOINTER_TO_UINT(cur->data);
+
+	/* the matchers decode headers and bodies in the workers */
+	conv_init_locale_tables();
+
+	pool = g_thread_pool_new(folder_item_search_worker, &job,
+				 nthreads, FALSE, NULL);
+
+	while (TRUE) {
+		SearchChunk *chunk;
+
+		/* keep the workers busy, without fetching too far ahead */
+		while (!stop && next < msgcount && in_flight < nthreads * 2) {
+			chunk = g_new(SearchChunk, 1);
+			chunk->start = next;
+			chunk->end = MIN(next + SEARCH_CHUNK_SIZE, msgcount);
+
+			for (i = chunk->start; i < chunk->end; i++) {
+				MsgInfo *msginfo = folder_item_get_msginfo(container,
+									   msgnums[i]);
+
+				if (msginfo == NULL)
+					break;
+				if (query != NULL &&
+				    body_index_query_excludes(query, msginfo)) {
+					job.state[i] = SEARCH_NO_MATCH;
+					procmsg_msginfo_free(&msginfo);
+					continue;
+				}
+				job.files[i] = procmsg_get_message_file_full(msginfo,
+									     TRUE, TRUE);
+				job.msginfos[i] = folder_item_search_snapshot(msginfo);
+				procmsg_msginfo_free(&msginfo);
+			}
+			if (i < chunk->end) {
+				/* not handed out, free it with the others */
+				chunk->end = i;
+				g_mutex_lock(&job.mutex);
+				g_queue_push_tail(&job.done, chunk);
+				g_mutex_unlock(&job.mutex);
+				in_flight++;
+				stop = error = TRUE;
+				g_atomic_int_set(&job.cancelled, 1);
+				break;
+			}
+			g_thread_pool_push(pool, chunk, NULL);
+			in_flight++;
+			next = chunk->end;
+		}
+
+		if (in_flight == 0)
+			break;
+
+		g_mutex_lock(&job.mutex);
+		while (g_queue_is_empty(&job.done))
+			g_cond_wait(&job.cond, &job.mutex);
+		while ((chunk = g_queue_pop_head(&job.done)) != NULL) {
+			for (i = chunk->start; i < chunk->end; i++) {
+				if (job.state[i] != SEARCH_PENDING) {
+					processed_count++;
+					if (job.state[i] == SEARCH_MATCH)
+						matched_count++;
+				}
+				procmsg_msginfo_free(&job.msginfos[i]);
+				g_free(job.files[i]);
+				job.files[i] = NULL;
+			}
+			in_flight--;
+			g_free(chunk);
+		}
+		g_mutex_unlock(&job.mutex);
+
+		if (!stop && progress_cb != NULL
+		    && !progress_cb(progress_data, FALSE, processed_count,
+				    matched_count, msgcount)) {
+			stop = TRUE;
+			g_atomic_int_set(&job.cancelled, 1);
+		}
+	}
+
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	*result = NULL;
+	if (!error) {
+		for (i = msgcount; i > 0; i--)
+			if (job.state[i - 1] == SEARCH_MATCH)
+				*result = g_slist_prepend(*result,
+						GUINT_TO_POINTER(msgnums[i - 1]));
+	}
+
+	g_free(msgnums);
+	g_free(job.msginfos);
+	g_free(job.files);
+	g_free(job.state);
+	g_mutex_clear(&job.mutex);
+	g_cond_clear(&job.cond);
+
+	return error ? -1 : matched_count;
+}
+
 gint folder_item_search_msgs_local	(Folder			*folder,
 					 FolderItem		*container,
 					 MsgNumberList		**msgs,
@@ -4825,6 +5170,7 @@ gint folder_item_search_msgs_local	(Folder			*folder,
 	guint processed_count = 0;
 	gint msgcount;
 	GSList *nums = NULL;
+	BodyIndexQuery *query;
 
 	if (*msgs == NULL) {
 		nums = folder_item_get_number_list(container);
@@ -4837,16 +5183,40 @@ gint folder_item_search_msgs_local	(Folder			*folder,
 	if (msgcount < 0)
 		return -1;
 
+	/* rules out messages for "body contains" conditions, if the
+	 * folder has a body index */
+	query = body_index_query_new(container, predicate);
+
+	/* reading and decoding the files dominates, spread it over
+	 * the cores when the folder is local and the predicate allows */
+	if (FOLDER_IS_LOCAL(folder) && predicate != NULL
+	    && msgcount > SEARCH_CHUNK_SIZE && g_get_num_processors() > 1
+	    && matcherlist_can_match_in_thread(predicate)) {
+		matched_count = folder_item_search_msgs_threaded(container,
+				nums, msgcount, predicate, query,
+				progress_cb, progress_data, &result);
+		body_index_query_free(query);
+		if (matched_count < 0)
+			return -1;
+
+		g_slist_free(nums);
+		*msgs = result;
+
+		return matched_count;
+	}
+
 	for (cur = nums; cur != NULL; cur = cur->next) {
 		guint msgnum = GPOINTER_TO_UINT(cur->data);
 		MsgInfo *msg = folder_item_get_msginfo(container, msgnum);
 
 		if (msg == NULL) {
 			g_slist_free(result);
+			body_index_query_free(query);
 			return -1;
 		}
 
-		if (matcherlist_match(predicate, msg)) {
+		if ((query == NULL || !body_index_query_excludes(query, msg))
+		    && matcherlist_match(predicate, msg)) {
 			result = g_slist_prepend(result, GUINT_TO_POINTER(msg->msgnum));
 			matched_count++;
 		}
@@ -4860,6 +5230,7 @@ gint folder_item_search_msgs_local	(Folder			*folder,
 			break;
 	}
 
+	body_index_query_free(query);
 	g_slist_free(nums);
 	*msgs = g_slist_reverse(result);
 
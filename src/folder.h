@@ -134,6 +134,7 @@ typedef void (*FolderItemFunc)	(FolderItem	*item,
 #include "xml.h"
 #include "prefs_account.h"
 #include "matchertypes.h"
+#include "threadindex.h"
 
 struct _MsgCache;
 
@@ -406,6 +407,44 @@ struct _FolderClass
 						 FolderItem	*item,
 						 GSList	       **list,
 						 gboolean	*old_uids_valid);
+	/**
+	 * Get the message numbers for the messages in the \c FolderItem
+	 * as an array. This is the same as get_num_list, but avoids
+	 * building a GSList for large folders. If it is NULL the folder
+	 * system uses get_num_list instead.
+	 *
+	 * \param folder The \c Folder that contains the \c FolderItem
+	 * \param item The \c FolderItem for which the message numbers should
+	 *             be fetched
+	 * \param array A GArray of guint to which the message numbers have
+	 *              to be appended, in any order
+	 * \param old_uids_valid See get_num_list
+	 * \return The number of message numbers added to the array on
+	 *         success, a negative number otherwise.
+	 */
+	gint		 (*get_num_array)	(Folder		*folder,
+						 FolderItem	*item,
+						 GArray		*array,
+						 gboolean	*old_uids_valid);
+	/**
+	 * Get the message numbers for the messages in the \c FolderItem
+	 * as ranges, for folders whose numbers are mostly contiguous like
+	 * news groups. If it is NULL the folder system uses get_num_array
+	 * or get_num_list instead.
+	 *
+	 * \param folder The \c Folder that contains the \c FolderItem
+	 * \param item The \c FolderItem for which the message numbers should
+	 *             be fetched
+	 * \param ranges A GArray of UIntRange to which the ranges have to
+	 *               be added with \c uint_ranges_append()
+	 * \param old_uids_valid See get_num_list
+	 * \return The number of message numbers in the ranges on success,
+	 *         a negative number otherwise.
+	 */
+	gint		 (*get_num_ranges)	(Folder		*folder,
+						 FolderItem	*item,
+						 GArray		*ranges,
+						 gboolean	*old_uids_valid);
 	/**
 	 * Tell the folder system if a \c FolderItem should be scanned
 	 * (cache data syncronized with the folder content) when it is required
@@ -452,6 +491,19 @@ struct _FolderClass
 	MsgInfoList  	*(*get_msginfos)	(Folder		*folder,
 						 FolderItem	*item,
 						 MsgNumberList	*msgnum_list);
+	/**
+	 * Get \c MsgInfos for ranges of message numbers. If it is NULL
+	 * the folder system uses get_msginfos instead.
+	 *
+	 * \param folder The \c Folder containing the messages
+	 * \param item The \c FolderItem containing the messages
+	 * \param ranges A GArray of UIntRange
+	 * \return A list of \c MsgInfos for the messages in the ranges
+	 *         that really exist.
+	 */
+	MsgInfoList	*(*get_msginfos_for_ranges)	(Folder		*folder,
+							 FolderItem	*item,
+							 GArray		*ranges);
 	/**
 	 * Get the filename for a message. This can either be the real message
 	 * file for local folders or a temporary file for remote folders.
@@ -915,6 +967,7 @@ MsgInfo *folder_item_get_msginfo	(FolderItem 	*item,
 MsgInfo *folder_item_get_msginfo_by_msgid(FolderItem 	*item,
 					 const gchar 	*msgid);
 GSList *folder_item_get_msg_list	(FolderItem 	*item);
+ThreadIndex *folder_item_get_thread_index(FolderItem *item);
 MsgNumberList *folder_item_get_number_list(FolderItem *item);
 
 /* return value is locale charset */
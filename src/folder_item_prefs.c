@@ -359,6 +359,7 @@ void folder_item_prefs_copy_prefs(FolderItem * src, FolderItem * dest)
 	tmp_prefs.forward_override_from_format = g_strdup(src->prefs->forward_override_from_format);
 
 	*dest->prefs = tmp_prefs;
+	filtering_rules_changed();
 	folder_item_prefs_save_config(dest);
 	prefs_matcher_write_config();
 
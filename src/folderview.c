@@ -1808,7 +1808,7 @@ static gboolean folderview_update_item_claws(gpointer source, gpointer data)
 		     update_info->item == folderview->summaryview->folder_item &&
 		     update_info->item != NULL)
 			if (!quicksearch_has_sat_predicate(folderview->summaryview->quicksearch))
-				summary_show(folderview->summaryview, update_info->item, FALSE);
+				summary_show_updated(folderview->summaryview);
 	}
 	
 	return FALSE;
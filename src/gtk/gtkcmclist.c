@@ -1751,6 +1751,7 @@ gtk_cmclist_optimal_column_width (GtkCMCList *clist,
   GtkRequisition requisition;
   GList *list;
   gint width;
+  guint filled = 0;
 
   cm_return_val_if_fail (GTK_CMCLIST (clist), 0);
 
@@ -1771,6 +1772,16 @@ gtk_cmclist_optimal_column_width (GtkCMCList *clist,
 
   for (list = clist->row_list; list; list = list->next)
     {
+      /* filling more rows than are kept filled would only empty
+       * them again, leave the others out of the measure */
+      if (GTK_CMCLIST_ROW (list)->unfilled && clist->fill_func)
+	{
+	  if (clist->max_filled_rows > 0 &&
+	      filled >= clist->max_filled_rows)
+	    continue;
+	  gtk_cmclist_fill_row (clist, list);
+	  filled++;
+	}
   GTK_CMCLIST_GET_CLASS (clist)->cell_size_request
 	(clist, GTK_CMCLIST_ROW (list), column, &requisition);
       width = MAX (width, requisition.width);
@@ -5946,11 +5957,13 @@ draw_rows (GtkCMCList     *clist,
   while (list)
     {
       clist_row = list->data;
-      list = list->next;
 
       if (i > last_row)
 	return;
 
+      gtk_cmclist_fill_row (clist, list);
+      list = list->next;
+
       GTK_CMCLIST_GET_CLASS (clist)->draw_row (clist, NULL, i, clist_row);
       i++;
     }
@@ -6375,6 +6388,8 @@ row_new (GtkCMCList *clist)
   clist_row->state = GTK_STATE_NORMAL;
   clist_row->data = NULL;
   clist_row->destroy = NULL;
+  clist_row->filled_link = NULL;
+  clist_row->unfilled = FALSE;
 
   return clist_row;
 }
@@ -6385,6 +6400,8 @@ row_delete (GtkCMCList    *clist,
 {
   gint i;
 
+  _gtk_cmclist_forget_filled_row (clist, clist_row);
+
   for (i = 0; i < clist->columns; i++)
     {
       GTK_CMCLIST_GET_CLASS (clist)->set_cell_contents
@@ -7173,6 +7190,79 @@ gtk_cmclist_set_compare_func (GtkCMCList            *clist,
   clist->compare = (cmp_func) ? cmp_func : default_compare;
 }
 
+void
+gtk_cmclist_set_fill_func (GtkCMCList          *clist,
+			 GtkCMCListFillFunc   fill_func,
+			 gpointer             data,
+			 guint                max_filled)
+{
+  cm_return_if_fail (GTK_IS_CMCLIST (clist));
+
+  clist->fill_func = fill_func;
+  clist->fill_data = data;
+  clist->max_filled_rows = max_filled;
+}
+
+void
+_gtk_cmclist_forget_filled_row (GtkCMCList    *clist,
+				GtkCMCListRow *clist_row)
+{
+  if (clist_row->filled_link)
+    {
+      g_queue_delete_link (&clist->filled_rows, clist_row->filled_link);
+      clist_row->filled_link = NULL;
+    }
+}
+
+static void
+empty_filled_row (GtkCMCList    *clist,
+		  GtkCMCListRow *clist_row)
+{
+  gint i;
+
+  for (i = 0; i < clist->columns; i++)
+    GTK_CMCLIST_GET_CLASS (clist)->set_cell_contents
+      (clist, clist_row, i, GTK_CMCELL_EMPTY, NULL, 0, NULL);
+  clist_row->unfilled = TRUE;
+}
+
+void
+gtk_cmclist_fill_row (GtkCMCList *clist,
+		    GList      *row)
+{
+  GtkCMCListRow *clist_row;
+
+  cm_return_if_fail (GTK_IS_CMCLIST (clist));
+  cm_return_if_fail (row != NULL);
+
+  clist_row = row->data;
+  if (!clist_row->unfilled || !clist->fill_func)
+    return;
+
+  /* the row is about to be drawn, or is measured, setting its
+   * cells must not queue another draw */
+  clist->freeze_count++;
+
+  clist_row->unfilled = FALSE;
+  clist->fill_func (clist, row, clist->fill_data);
+
+  if (clist->max_filled_rows > 0)
+    {
+      g_queue_push_tail (&clist->filled_rows, row);
+      clist_row->filled_link = clist->filled_rows.tail;
+
+      while (clist->filled_rows.length > clist->max_filled_rows)
+	{
+	  GList *oldest = g_queue_pop_head (&clist->filled_rows);
+
+	  GTK_CMCLIST_ROW (oldest)->filled_link = NULL;
+	  empty_filled_row (clist, GTK_CMCLIST_ROW (oldest));
+	}
+    }
+
+  clist->freeze_count--;
+}
+
 void       
 gtk_cmclist_set_auto_sort (GtkCMCList *clist,
 			 gboolean  auto_sort)
@@ -129,6 +129,9 @@ typedef struct _GtkCMCellWidget GtkCMCellWidget;
 typedef gint (*GtkCMCListCompareFunc) (GtkCMCList     *clist,
 				     gconstpointer ptr1,
 				     gconstpointer ptr2);
+typedef void (*GtkCMCListFillFunc) (GtkCMCList     *clist,
+				  GList          *row,
+				  gpointer        data);
 
 typedef struct _GtkCMCListCellInfo GtkCMCListCellInfo;
 typedef struct _GtkCMCListDestInfo GtkCMCListDestInfo;
@@ -236,6 +239,12 @@ struct _GtkCMCList
   gint drag_highlight_row;
   GtkCMCListDragPos drag_highlight_pos;
   int draw_now;
+
+  /* rows filled when they are first drawn */
+  GtkCMCListFillFunc fill_func;
+  gpointer fill_data;
+  GQueue filled_rows;
+  guint max_filled_rows;
 };
 
 struct _GtkCMCListClass
@@ -341,10 +350,14 @@ struct _GtkCMCListRow
 
   gpointer data;
   GDestroyNotify destroy;
+
+  /* the link of the row in filled_rows */
+  GList *filled_link;
   
   guint fg_set     : 1;
   guint bg_set     : 1;
   guint selectable : 1;
+  guint unfilled   : 1;
 };
 
 /* Cell Structures */
@@ -748,6 +761,19 @@ void gtk_cmclist_row_move (GtkCMCList *clist,
 void gtk_cmclist_set_compare_func (GtkCMCList            *clist,
 				 GtkCMCListCompareFunc  cmp_func);
 
+/* rows marked unfilled get their cells from fill_func when they are
+ * first drawn; past max_filled rows filled that way, the cells of the
+ * oldest ones are emptied and the rows marked unfilled again (0 keeps
+ * them all) */
+void gtk_cmclist_set_fill_func (GtkCMCList          *clist,
+			      GtkCMCListFillFunc   fill_func,
+			      gpointer             data,
+			      guint                max_filled);
+
+/* fills row now if it is still unfilled */
+void gtk_cmclist_fill_row (GtkCMCList *clist,
+			 GList      *row);
+
 /* the column to sort by */
 void gtk_cmclist_set_sort_column (GtkCMCList *clist,
 				gint      column);
@@ -768,6 +794,8 @@ void gtk_cmclist_set_auto_sort (GtkCMCList *clist,
 PangoLayout *_gtk_cmclist_create_cell_layout (GtkCMCList       *clist,
 					    GtkCMCListRow    *clist_row,
 					    gint            column);
+void _gtk_cmclist_forget_filled_row (GtkCMCList    *clist,
+				     GtkCMCListRow *clist_row);
 
 
 G_END_DECLS
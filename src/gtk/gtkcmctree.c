@@ -34,6 +34,7 @@
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
 #include "gtkcmctree.h"
+#include "gtkcmctreesort.h"
 #include "claws-marshal.h"
 #include "utils.h"
 #include "gtkutils.c"
@@ -2566,6 +2567,8 @@ row_new (GtkCMCTree *ctree)
   ctree_row->row.state      = GTK_STATE_NORMAL;
   ctree_row->row.data       = NULL;
   ctree_row->row.destroy    = NULL;
+  ctree_row->row.filled_link = NULL;
+  ctree_row->row.unfilled   = FALSE;
 
   ctree_row->level         = 0;
   ctree_row->expanded      = FALSE;
@@ -2587,6 +2590,8 @@ row_delete (GtkCMCTree    *ctree,
 
   clist = GTK_CMCLIST (ctree);
 
+  _gtk_cmclist_forget_filled_row (clist, &ctree_row->row);
+
   for (i = 0; i < clist->columns; i++)
     {
       GTK_CMCLIST_GET_CLASS (clist)->set_cell_contents
@@ -4692,14 +4697,30 @@ gtk_cmctree_set_expander_style (GtkCMCTree              *ctree,
  ***********************************************************/
 
 
+static gint
+tree_sort_compare (gconstpointer a,
+		   gconstpointer b,
+		   gpointer      data)
+{
+  GtkCMCList *clist = data;
+  gint cmp;
+
+  cmp = clist->compare (clist,
+			GTK_CMCTREE_ROW (*(GtkCMCTreeNode **)a),
+			GTK_CMCTREE_ROW (*(GtkCMCTreeNode **)b));
+
+  if (clist->sort_type == GTK_SORT_ASCENDING)
+    return cmp;
+  else
+    return (cmp < 0) - (cmp > 0);
+}
+
 static void
 tree_sort (GtkCMCTree     *ctree,
 	   GtkCMCTreeNode *node,
 	   gpointer      data)
 {
   GtkCMCTreeNode *list_start;
-  GtkCMCTreeNode *cmp;
-  GtkCMCTreeNode *work;
   GtkCMCList *clist;
 
   clist = GTK_CMCLIST (ctree);
@@ -4709,34 +4730,13 @@ tree_sort (GtkCMCTree     *ctree,
   else
     list_start = GTK_CMCTREE_NODE (clist->row_list);
 
-  while (list_start)
-    {
-      cmp = list_start;
-      work = GTK_CMCTREE_ROW (cmp)->sibling;
-      while (work)
-	{
-	  if (clist->sort_type == GTK_SORT_ASCENDING)
-	    {
-	      if (clist->compare 
-		  (clist, GTK_CMCTREE_ROW (work), GTK_CMCTREE_ROW (cmp)) < 0)
-		cmp = work;
-	    }
-	  else
-	    {
-	      if (clist->compare 
-		  (clist, GTK_CMCTREE_ROW (work), GTK_CMCTREE_ROW (cmp)) > 0)
-		cmp = work;
-	    }
-	  work = GTK_CMCTREE_ROW (work)->sibling;
-	}
-      if (cmp == list_start)
-	list_start = GTK_CMCTREE_ROW (cmp)->sibling;
-      else
-	{
-	  gtk_cmctree_unlink (ctree, cmp, FALSE);
-	  gtk_cmctree_link (ctree, cmp, node, list_start, FALSE);
-	}
-    }
+  list_start = gtk_cmctree_sort_siblings (list_start, tree_sort_compare,
+					  clist, &clist->row_list_end);
+
+  if (node)
+    GTK_CMCTREE_ROW (node)->children = list_start;
+  else
+    clist->row_list = (GList *)list_start;
 }
 
 void
@@ -0,0 +1,97 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#include "claws-features.h"
+#endif
+
+#include <glib.h>
+
+#include "gtkcmctreesort.h"
+
+static GList *last_visible (GtkCMCTreeNode *node)
+{
+  GtkCMCTreeNode *work;
+
+  while ((work = GTK_CMCTREE_ROW (node)->children) &&
+	 GTK_CMCTREE_ROW (node)->expanded)
+    {
+      while (GTK_CMCTREE_ROW (work)->sibling)
+	work = GTK_CMCTREE_ROW (work)->sibling;
+      node = work;
+    }
+
+  return (GList *)node;
+}
+
+GtkCMCTreeNode *gtk_cmctree_sort_siblings (GtkCMCTreeNode   *first,
+					   GCompareDataFunc  compare,
+					   gpointer          data,
+					   GList           **row_list_end)
+{
+  GtkCMCTreeNode *work;
+  GPtrArray *siblings;
+  GList *before;
+  GList *after;
+  GList *old_end;
+  GList *prev;
+  guint i;
+
+  if (!first || !GTK_CMCTREE_ROW (first)->sibling)
+    return first;
+
+  siblings = g_ptr_array_new ();
+  for (work = first; work; work = GTK_CMCTREE_ROW (work)->sibling)
+    g_ptr_array_add (siblings, work);
+
+  before = ((GList *)first)->prev;
+  old_end = last_visible (g_ptr_array_index (siblings, siblings->len - 1));
+  after = old_end->next;
+
+  /* a merge sort, stable since GLib 2.32 */
+  g_ptr_array_sort_with_data (siblings, compare, data);
+
+  prev = before;
+  for (i = 0; i < siblings->len; i++)
+    {
+      GList *list = g_ptr_array_index (siblings, i);
+
+      GTK_CMCTREE_ROW (list)->sibling = i + 1 < siblings->len ?
+	g_ptr_array_index (siblings, i + 1) : NULL;
+
+      /* the children of a collapsed parent are not linked from it */
+      if (prev && (i > 0 || prev->next == (GList *)first))
+	prev->next = list;
+      list->prev = prev;
+
+      prev = last_visible (GTK_CMCTREE_NODE (list));
+    }
+
+  prev->next = after;
+  if (after && after->prev == old_end)
+    after->prev = prev;
+  if (*row_list_end == old_end)
+    *row_list_end = prev;
+
+  work = g_ptr_array_index (siblings, 0);
+  g_ptr_array_free (siblings, TRUE);
+
+  return work;
+}
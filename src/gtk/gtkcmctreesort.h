@@ -0,0 +1,39 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GTKCMCTREESORT_H
+#define GTKCMCTREESORT_H
+
+#include <glib.h>
+
+#include "gtkcmctree.h"
+
+/* Sorts the siblings chained from first with a stable merge sort, so
+ * that rows comparing equal keep their order, then links them again
+ * in the row list in a single pass, each followed by its visible
+ * descendants. compare is given pointers to two GtkCMCTreeNode
+ * pointers. Moves *row_list_end if the chain ended the row list, and
+ * returns the new first sibling, to be stored as the children of the
+ * parent or as the row list. */
+GtkCMCTreeNode *gtk_cmctree_sort_siblings (GtkCMCTreeNode   *first,
+					   GCompareDataFunc  compare,
+					   gpointer          data,
+					   GList           **row_list_end);
+
+#endif /* GTKCMCTREESORT_H */
@@ -1609,6 +1609,8 @@ srow_new (GtkCMCTree *ctree)
   ctree_row->row.state      = GTK_STATE_NORMAL;
   ctree_row->row.data       = NULL;
   ctree_row->row.destroy    = NULL;
+  ctree_row->row.filled_link = NULL;
+  ctree_row->row.unfilled   = FALSE;
 
   ctree_row->level         = 0;
   ctree_row->expanded      = FALSE;
@@ -1630,6 +1632,8 @@ srow_delete (GtkCMCTree    *ctree,
 
   clist = GTK_CMCLIST (ctree);
 
+  _gtk_cmclist_forget_filled_row (clist, &ctree_row->row);
+
   for (i = 0; i < clist->columns; i++)
     {
       GTK_CMCLIST_GET_CLASS (clist)->set_cell_contents
@@ -0,0 +1,239 @@
+#include "config.h"
+
+#include <glib.h>
+
+#include "gtkcmctreesort.h"
+
+#define CHILDREN	3
+#define INDEX_BITS	20
+#define KEY(node)	(GPOINTER_TO_UINT(GTK_CMCTREE_ROW(node)->row.data) >> INDEX_BITS)
+#define INDEX(node)	(GPOINTER_TO_UINT(GTK_CMCTREE_ROW(node)->row.data) & ((1 << INDEX_BITS) - 1))
+
+typedef struct _Tree Tree;
+
+struct _Tree
+{
+	GtkCMCTreeNode *nodes;
+	GtkCMCTreeRow *rows;
+	guint count;
+	GList *row_list;
+	GList *row_list_end;
+};
+
+static gint
+compare_nodes(gconstpointer a, gconstpointer b, gpointer data)
+{
+	guint ka = KEY(*(GtkCMCTreeNode **)a);
+	guint kb = KEY(*(GtkCMCTreeNode **)b);
+
+	return (ka > kb) - (ka < kb);
+}
+
+static void
+append_row(GList **prev, GtkCMCTreeNode *node, gboolean linked)
+{
+	GList *list = (GList *)node;
+
+	list->prev = *prev;
+	if (*prev != NULL && linked)
+		(*prev)->next = list;
+	*prev = list;
+}
+
+/* Every top level row has CHILDREN children, only every other one is
+ * expanded; keys repeat so that stability shows */
+static void
+tree_build(Tree *tree, guint top, GRand *rand)
+{
+	GtkCMCTreeNode *last_top = NULL;
+	GList *prev = NULL;
+	guint i, j, n = 0;
+
+	tree->count = top * (CHILDREN + 1);
+	tree->nodes = g_new0(GtkCMCTreeNode, tree->count);
+	tree->rows = g_new0(GtkCMCTreeRow, tree->count);
+
+	for (i = 0; i < tree->count; i++) {
+		tree->nodes[i].list.data = &tree->rows[i];
+		tree->rows[i].row.data = GUINT_TO_POINTER(
+			(g_rand_int_range(rand, 0, 1000) << INDEX_BITS) | i);
+	}
+
+	for (i = 0; i < top; i++) {
+		GtkCMCTreeNode *parent = &tree->nodes[n++];
+		GtkCMCTreeNode *last_child = NULL;
+		GList *child_prev = (GList *)parent;
+
+		if (last_top != NULL)
+			GTK_CMCTREE_ROW(last_top)->sibling = parent;
+		last_top = parent;
+		append_row(&prev, parent, TRUE);
+
+		GTK_CMCTREE_ROW(parent)->expanded = (i % 2 == 0);
+		for (j = 0; j < CHILDREN; j++) {
+			GtkCMCTreeNode *child = &tree->nodes[n++];
+
+			GTK_CMCTREE_ROW(child)->parent = parent;
+			GTK_CMCTREE_ROW(child)->is_leaf = TRUE;
+			if (last_child != NULL)
+				GTK_CMCTREE_ROW(last_child)->sibling = child;
+			else
+				GTK_CMCTREE_ROW(parent)->children = child;
+			last_child = child;
+
+			if (GTK_CMCTREE_ROW(parent)->expanded)
+				append_row(&prev, child, TRUE);
+			else
+				append_row(&child_prev, child, j > 0);
+		}
+	}
+
+	tree->row_list = (GList *)tree->nodes;
+	tree->row_list_end = prev;
+}
+
+static void
+tree_free(Tree *tree)
+{
+	g_free(tree->nodes);
+	g_free(tree->rows);
+}
+
+/* Same order as the ctree: children first, then the top level */
+static void
+tree_sort(Tree *tree)
+{
+	GtkCMCTreeNode *node;
+
+	for (node = GTK_CMCTREE_NODE(tree->row_list); node != NULL;
+	     node = GTK_CMCTREE_ROW(node)->sibling)
+		GTK_CMCTREE_ROW(node)->children = gtk_cmctree_sort_siblings(
+			GTK_CMCTREE_ROW(node)->children, compare_nodes, NULL,
+			&tree->row_list_end);
+
+	tree->row_list = (GList *)gtk_cmctree_sort_siblings(
+		GTK_CMCTREE_NODE(tree->row_list), compare_nodes, NULL,
+		&tree->row_list_end);
+}
+
+static void
+check_siblings(GtkCMCTreeNode *first, guint expected)
+{
+	GtkCMCTreeNode *node;
+	guint count = 1;
+
+	for (node = first; GTK_CMCTREE_ROW(node)->sibling != NULL;
+	     node = GTK_CMCTREE_ROW(node)->sibling, count++) {
+		GtkCMCTreeNode *next = GTK_CMCTREE_ROW(node)->sibling;
+
+		g_assert_cmpuint(KEY(node), <=, KEY(next));
+		if (KEY(node) == KEY(next))
+			g_assert_cmpuint(INDEX(node), <, INDEX(next));
+	}
+	g_assert_cmpuint(count, ==, expected);
+}
+
+static void
+check_tree(Tree *tree, guint top)
+{
+	GtkCMCTreeNode *node;
+	GList *list, *prev = NULL;
+	guint visible = 0;
+
+	check_siblings(GTK_CMCTREE_NODE(tree->row_list), top);
+
+	/* the row list holds each top level row followed by its
+	 * children when expanded, in sibling order */
+	list = tree->row_list;
+	for (node = GTK_CMCTREE_NODE(tree->row_list); node != NULL;
+	     node = GTK_CMCTREE_ROW(node)->sibling) {
+		GtkCMCTreeNode *child = GTK_CMCTREE_ROW(node)->children;
+		GList *child_prev = (GList *)node;
+
+		check_siblings(child, CHILDREN);
+
+		g_assert_true(list == (GList *)node);
+		g_assert_true(list->prev == prev);
+		prev = list;
+		list = list->next;
+		visible++;
+
+		for (; child != NULL; child = GTK_CMCTREE_ROW(child)->sibling) {
+			g_assert_true(((GList *)child)->prev == child_prev);
+			if (GTK_CMCTREE_ROW(node)->expanded) {
+				g_assert_true(list == (GList *)child);
+				prev = list;
+				list = list->next;
+				visible++;
+			} else if (GTK_CMCTREE_ROW(child)->sibling == NULL) {
+				g_assert_null(((GList *)child)->next);
+			}
+			child_prev = (GList *)child;
+		}
+	}
+
+	g_assert_null(list);
+	g_assert_true(tree->row_list_end == prev);
+	g_assert_cmpuint(visible, ==, top + (top + 1) / 2 * CHILDREN);
+}
+
+static void
+test_gtkcmctree_sort_small(void)
+{
+	GRand *rand = g_rand_new_with_seed(42);
+	Tree tree;
+	guint top;
+
+	for (top = 1; top <= 9; top++) {
+		tree_build(&tree, top, rand);
+		tree_sort(&tree);
+		check_tree(&tree, top);
+
+		/* sorting again changes nothing */
+		tree_sort(&tree);
+		check_tree(&tree, top);
+		tree_free(&tree);
+	}
+
+	g_rand_free(rand);
+}
+
+static void
+test_gtkcmctree_sort_perf(void)
+{
+	GRand *rand;
+	Tree tree;
+	GTimer *timer;
+	guint top = 100000 / (CHILDREN + 1);
+
+	if (!g_test_perf()) {
+		g_test_skip("only run in perf mode");
+		return;
+	}
+
+	rand = g_rand_new_with_seed(7);
+	tree_build(&tree, top, rand);
+
+	timer = g_timer_new();
+	tree_sort(&tree);
+	g_test_minimized_result(g_timer_elapsed(timer, NULL),
+			"sorted %u rows in %.3f s", tree.count,
+			g_timer_elapsed(timer, NULL));
+
+	check_tree(&tree, top);
+
+	g_timer_destroy(timer);
+	tree_free(&tree);
+	g_rand_free(rand);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/gtk/gtkcmctree/sort/small", test_gtkcmctree_sort_small);
+	g_test_add_func("/gtk/gtkcmctree/sort/perf", test_gtkcmctree_sort_perf);
+
+	return g_test_run();
+}
@@ -97,6 +97,13 @@ struct _IMAPFolder
 	guint max_set_size;
 	gchar *search_charset;
 	gboolean search_charset_supported;
+
+	/* more sessions, beside rfolder.session, when the account
+	 * allows several connections */
+	GSList *pool;
+
+	/* IMAPFolderItems with flag or tag changes to send */
+	GSList *pending_items;
 };
 
 struct _IMAPSession
@@ -119,6 +126,13 @@ struct _IMAPSession
 	guint unseen;
 	guint uid_validity;
 	guint uid_next;
+	gboolean qresync;	/* RFC 7162, enabled after login */
+	gboolean qresync_checked;
+	gboolean compressed;	/* RFC 4978, likewise */
+	guint64 highestmodseq;	/* of the selected mailbox, 0 if unknown */
+	gboolean idling;	/* RFC 2177, on the Inbox while unused */
+	gboolean idle_failed;
+	gint slot;		/* connection, 0 for rfolder.session */
 
 	Folder * folder;
 	gboolean busy;
@@ -169,8 +183,13 @@ struct _IMAPFolderItem
 	GSList *uid_list;
 	gboolean batching;
 
+	/* flag and tag changes waiting to be stored on the server:
+	 * uid -> IMAPFlags to add or remove, and tag -> set of uids to
+	 * add it to or remove it from. They are sent after a short delay,
+	 * when leaving batch mode or before the mailbox is left */
 	GHashTable *flags_set_table;
 	GHashTable *flags_unset_table;
+	guint flush_timer;
 	time_t last_change;
 	time_t last_sync;
 	gboolean should_update;
@@ -181,6 +200,13 @@ struct _IMAPFolderItem
 	GHashTable *tags_unset_table;
 	GSList *ok_flags;
 
+	/* RFC 7162: flags and UIDs are in sync with the server as of
+	 * modseq; a scan fetches what changed since, and the flags
+	 * changes wait in changed_flags for imap_get_flags() */
+	guint64 modseq;
+	guint64 pending_modseq;
+	GHashTable *changed_flags;
+	GHashTable *changed_tags;
 };
 
 static XMLTag *imap_item_get_xml(Folder *folder, FolderItem *item);
@@ -269,10 +295,17 @@ static gint 	imap_remove_folder	(Folder 	*folder,
 					 FolderItem 	*item);
 
 static FolderItem *imap_folder_item_new	(Folder		*folder);
+static void imap_forget_changed_flags	(IMAPFolderItem	*item);
+static void imap_forget_pending		(IMAPFolderItem	*item);
 static void imap_folder_item_destroy	(Folder		*folder,
 					 FolderItem	*item);
 
 static IMAPSession *imap_session_get	(Folder		*folder);
+static IMAPSession *imap_session_get_for(Folder		*folder,
+					 FolderItem	*item);
+static IMAPSession *imap_main_session_get(Folder	*folder);
+static IMAPSession *imap_pool_session_open(Folder	*folder,
+					 gint		 slot);
 
 static gint imap_auth			(IMAPSession	*session,
 					 const gchar	*user,
@@ -313,6 +346,18 @@ static gint imap_set_message_flags	(IMAPSession	*session,
 					 IMAPFlags	 flags,
 					 GSList		*tags,
 					 gboolean	 is_set);
+static void imap_pending_flags		(IMAPFolderItem	*item,
+					 gint		 uid,
+					 IMAPFlags	 flags,
+					 gboolean	 is_set);
+static void imap_pending_tag		(IMAPFolderItem	*item,
+					 gint		 uid,
+					 const gchar	*tag,
+					 gboolean	 is_set);
+static gint imap_store_pending		(IMAPSession	*session,
+					 IMAPFolderItem	*item);
+static gint imap_store_pending_selected	(IMAPSession	*session);
+static void imap_flush_pending		(IMAPFolderItem	*item);
 static gint imap_select			(IMAPSession	*session,
 					 IMAPFolder	*folder,
 					 FolderItem	*item,
@@ -330,6 +375,7 @@ static gint imap_status			(IMAPSession	*session,
 					 guint32	*uid_next,
 					 guint32	*uid_validity,
 					 gint		*unseen,
+					 guint64	*highestmodseq,
 					 gboolean	 block);
 static void	imap_commit_tags	(FolderItem 	*item, 
 					 MsgInfo	*msginfo,
@@ -417,6 +463,10 @@ static gint imap_get_num_list			(Folder 	*folder,
 						 FolderItem 	*item,
 						 GSList	       **list,
 						 gboolean	*old_uids_valid);
+static gint imap_get_num_array			(Folder 	*folder,
+						 FolderItem 	*item,
+						 GArray		*array,
+						 gboolean	*old_uids_valid);
 static GSList *imap_get_msginfos		(Folder		*folder,
 						 FolderItem	*item,
 						 GSList		*msgnum_list);
@@ -453,11 +503,6 @@ static MsgInfo *imap_envelope_from_lep(struct imap_fetch_env_info * info,
 static void imap_lep_set_free(GSList *seq_list);
 static struct mailimap_flag_list * imap_flag_to_lep(IMAPFolderItem *item, IMAPFlags flags, GSList *tags);
 
-typedef struct _hashtable_data {
-	GSList *msglist;
-	IMAPFolderItem *item;
-} hashtable_data;
-
 static FolderClass imap_class;
 
 FolderClass *imap_get_class(void)
@@ -483,6 +528,7 @@ FolderClass *imap_get_class(void)
 		imap_class.remove_folder = imap_remove_folder;
 		imap_class.close = imap_close;
 		imap_class.get_num_list = imap_get_num_list;
+		imap_class.get_num_array = imap_get_num_array;
 		imap_class.scan_required = imap_scan_required;
 		imap_class.set_xml = folder_set_xml;
 		imap_class.get_xml = folder_get_xml;
@@ -528,6 +574,13 @@ static void imap_refresh_sensitivity (IMAPSession *session)
 	}
 }
 
+/* Makes the following imap_threaded_* calls on the folder go through
+ * this session's connection */
+static void imap_session_use(IMAPSession *session)
+{
+	imap_threaded_use_connection(session->folder, session->slot);
+}
+
 static void lock_session(IMAPSession *session)
 {
 	if (session) {
@@ -535,6 +588,7 @@ static void lock_session(IMAPSession *session)
 		if (session->busy)
 			debug_print("         SESSION WAS LOCKED !!      \n");
                 session->busy = TRUE;
+		imap_session_use(session);
 		imap_refresh_sensitivity(session);
 	} else {
 		debug_print("can't lock null session\n");
@@ -552,6 +606,136 @@ static void unlock_session(IMAPSession *session)
 	}
 }
 
+static void imap_idle_cb(Folder *folder, IMAPIdleWakeup wakeup,
+			 int error, gpointer data);
+
+/* Leaves the session in IDLE on the Inbox, so that new mail is noticed
+ * as soon as it arrives; any other command ends it. Returns FALSE if
+ * the server or the account does not want it */
+static gboolean imap_idle_start(IMAPSession *session)
+{
+	Folder *folder = session->folder;
+	FolderItem *inbox = folder->inbox;
+	gint r;
+
+	if (session->idling)
+		return TRUE;
+	if (!folder->account->imap_idle || session->idle_failed ||
+	    session->slot != 0)
+		return FALSE;
+	if (inbox == NULL || inbox->path == NULL || inbox->no_select)
+		return FALSE;
+
+	lock_session(session);
+	r = imap_select(session, IMAP_FOLDER(folder), inbox,
+			NULL, NULL, NULL, NULL, NULL, FALSE);
+	if (r == MAILIMAP_NO_ERROR)
+		r = imap_threaded_idle_start(folder, imap_idle_cb,
+				GINT_TO_POINTER(folder->account->account_id));
+	unlock_session(session);
+
+	if (r != MAILIMAP_NO_ERROR) {
+		debug_print("IMAP IDLE not available (%d)\n", r);
+		session->idle_failed = TRUE;
+		return FALSE;
+	}
+	session->idling = TRUE;
+	return TRUE;
+}
+
+static IMAPSession *imap_idle_get_session(gint account_id)
+{
+	PrefsAccount *account = account_find_from_id(account_id);
+	RemoteFolder *rfolder;
+
+	if (account == NULL || account->folder == NULL)
+		return NULL;
+	rfolder = REMOTE_FOLDER(account->folder);
+	if (rfolder->session == NULL ||
+	    rfolder->session->state != SESSION_READY)
+		return NULL;
+
+	return IMAP_SESSION(rfolder->session);
+}
+
+static gboolean imap_idle_restart(gpointer data)
+{
+	IMAPSession *session = imap_idle_get_session(GPOINTER_TO_INT(data));
+
+	if (session != NULL && !session->busy && session->authenticated)
+		imap_idle_start(session);
+
+	return FALSE;
+}
+
+static gboolean imap_idle_scan_inbox(gpointer data)
+{
+	IMAPSession *session = imap_idle_get_session(GPOINTER_TO_INT(data));
+	FolderItem *inbox;
+
+	if (session == NULL)
+		return FALSE;
+	inbox = session->folder->inbox;
+	if (inbox == NULL)
+		return FALSE;
+
+	/* try again once the current operation is over */
+	if (session->busy || inc_is_active() ||
+	    inbox->scanning != ITEM_NOT_SCANNING)
+		return TRUE;
+
+	/* the changes seen in IDLE may already be known, the NOOP or
+	 * STATUS of imap_scan_required() tells */
+	if (imap_scan_required(session->folder, inbox)) {
+		debug_print("IMAP IDLE: rescanning %s\n", inbox->path);
+		folder_item_scan_full(inbox, TRUE);
+	}
+
+	imap_idle_restart(data);
+	return FALSE;
+}
+
+static void imap_idle_cb(Folder *folder, IMAPIdleWakeup wakeup,
+			 int error, gpointer data)
+{
+	RemoteFolder *rfolder = REMOTE_FOLDER(folder);
+	IMAPSession *session = NULL;
+
+	if (rfolder->session != NULL)
+		session = IMAP_SESSION(rfolder->session);
+	if (session != NULL)
+		session->idling = FALSE;
+
+	if (error != MAILIMAP_NO_ERROR) {
+		debug_print("IMAP IDLE ended with error %d\n", error);
+		/* the pings go back to NOOP, they will notice a broken
+		 * connection */
+		if (session != NULL)
+			session->idle_failed = TRUE;
+		return;
+	}
+	if (session != NULL)
+		SESSION(session)->last_access_time = time(NULL);
+
+	/* do not reenter the thread manager from its callback */
+	switch (wakeup) {
+	case IMAP_IDLE_FLAGS_CHANGED:
+		/* the message counts do not show those */
+		if (folder->inbox != NULL)
+			IMAP_FOLDER_ITEM(folder->inbox)->should_update = TRUE;
+		/* fall through */
+	case IMAP_IDLE_ACTIVITY:
+		g_timeout_add_seconds(1, imap_idle_scan_inbox, data);
+		break;
+	case IMAP_IDLE_TIMEOUT_EXPIRED:
+		g_idle_add(imap_idle_restart, data);
+		break;
+	case IMAP_IDLE_INTERRUPTED:
+		/* the next ping will restart it */
+		break;
+	}
+}
+
 static gboolean imap_ping(gpointer data)
 {
 	Session *session = (Session *)data;
@@ -562,6 +746,9 @@ static gboolean imap_ping(gpointer data)
 		return FALSE;
 	if (imap_session->busy || !imap_session->authenticated)
 		return TRUE;
+	/* IDLE keeps the connection alive itself */
+	if (imap_idle_start(imap_session))
+		return TRUE;
 	
 	lock_session(imap_session);
 	r = imap_cmd_noop(imap_session);
@@ -784,6 +971,9 @@ static void imap_folder_destroy(Folder *folder)
 	while (imap_folder_get_refcnt(folder) > 0)
 		gtk_main_iteration();
 
+	while (IMAP_FOLDER(folder)->pool != NULL)
+		session_destroy(SESSION(IMAP_FOLDER(folder)->pool->data));
+
 	g_free(IMAP_FOLDER(folder)->search_charset);
 
 	folder_remote_folder_destroy(REMOTE_FOLDER(folder));
@@ -810,12 +1000,31 @@ static FolderItem *imap_folder_item_new(Folder *folder)
 	return (FolderItem *)item;
 }
 
+static void imap_forget_changed_flags(IMAPFolderItem *item)
+{
+	if (item->changed_flags)
+		g_hash_table_destroy(item->changed_flags);
+	if (item->changed_tags) {
+		GHashTableIter iter;
+		gpointer tags;
+
+		g_hash_table_iter_init(&iter, item->changed_tags);
+		while (g_hash_table_iter_next(&iter, NULL, &tags))
+			slist_free_strings_full((GSList *)tags);
+		g_hash_table_destroy(item->changed_tags);
+	}
+	item->changed_flags = NULL;
+	item->changed_tags = NULL;
+}
+
 static void imap_folder_item_destroy(Folder *folder, FolderItem *_item)
 {
 	IMAPFolderItem *item = (IMAPFolderItem *)_item;
 
 	g_return_if_fail(item != NULL);
 	g_slist_free(item->uid_list);
+	imap_forget_changed_flags(item);
+	imap_forget_pending(item);
 
 	g_free(_item);
 }
@@ -1082,7 +1291,22 @@ static IMAPSession *imap_reconnect_if_possible(Folder *folder, IMAPSession *sess
 	/* Check if this is the first try to establish a
 	   connection, if yes we don't try to reconnect */
 	debug_print("reconnecting\n");
-	if (rfolder->session == NULL) {
+	if (session->slot != 0) {
+		/* a pool connection: only its own slot is replaced */
+		gint slot = session->slot;
+
+		IMAP_FOLDER(folder)->pool =
+			g_slist_remove(IMAP_FOLDER(folder)->pool, session);
+		log_warning(LOG_PROTOCOL, _("IMAP connection to %s has been"
+			    " disconnected. Reconnecting...\n"),
+			    folder->account->recv_server);
+		SESSION(session)->state = SESSION_DISCONNECTED;
+		SESSION(session)->sock = NULL;
+		/* out of the pool, nobody else can be using it */
+		session->busy = FALSE;
+		imap_safe_destroy(session);
+		session = imap_pool_session_open(folder, slot);
+	} else if (rfolder->session == NULL) {
 		log_warning(LOG_PROTOCOL, _("Connecting to %s failed"),
 			    folder->account->recv_server);
 		SESSION(session)->sock = NULL;
@@ -1104,14 +1328,37 @@ static IMAPSession *imap_reconnect_if_possible(Folder *folder, IMAPSession *sess
 		   it will not try to reconnect again and so avoid an
 		   endless loop */
 		debug_print("getting session...\n");
-		session = imap_session_get(folder);
-		rfolder->session = SESSION(session);
+		session = imap_main_session_get(folder);
 		statusbar_pop_all();
 	}
 	return session;
 }
 
-static IMAPSession *imap_session_get(Folder *folder)
+/* Turns on the extensions the server offers once logged in */
+static gint imap_session_enable_extensions(IMAPSession *session)
+{
+	gboolean enabled = FALSE;
+	gint r;
+
+	/* RFC 7162: scans then only fetch what changed since the last one */
+	session->qresync_checked = TRUE;
+	r = imap_threaded_enable_qresync(session->folder, &enabled);
+	if (is_fatal(r))
+		return r;
+	session->qresync = enabled;
+	debug_print("QRESYNC %s\n", enabled ? "enabled" : "not available");
+
+	/* RFC 4978: envelopes and bodies are mostly text */
+	r = imap_threaded_compress(session->folder, &enabled);
+	if (is_fatal(r))
+		return r;
+	session->compressed = enabled;
+	debug_print("COMPRESS=DEFLATE %s\n", enabled ? "enabled" : "not available");
+
+	return MAILIMAP_NO_ERROR;
+}
+
+static IMAPSession *imap_main_session_get(Folder *folder)
 {
 	RemoteFolder *rfolder = REMOTE_FOLDER(folder);
 	IMAPSession *session = NULL;
@@ -1121,6 +1368,8 @@ static IMAPSession *imap_session_get(Folder *folder)
 	g_return_val_if_fail(FOLDER_CLASS(folder) == &imap_class, NULL);
 	g_return_val_if_fail(folder->account != NULL, NULL);
 	
+	imap_threaded_use_connection(folder, 0);
+
 	if (prefs_common.work_offline && 
 	    !inc_offline_should_override(FALSE,
 		_("Claws Mail needs network access in order "
@@ -1165,6 +1414,7 @@ new_conn:
 	/* Make sure session is authenticated */
 	if (!IMAP_SESSION(session)->authenticated)
 		r = imap_session_authenticate(IMAP_SESSION(session), folder->account);
+	imap_threaded_use_connection(folder, 0);
 	
 	if (r != MAILIMAP_NO_ERROR || (!is_fatal(r) && !IMAP_SESSION(session)->authenticated)) {
 		rfolder->session = NULL;
@@ -1179,6 +1429,20 @@ new_conn:
 		return NULL;
 	}
 
+	if (!IMAP_SESSION(session)->qresync_checked) {
+		r = imap_session_enable_extensions(IMAP_SESSION(session));
+		if (is_fatal(r)) {
+			imap_handle_error(SESSION(session), NULL, r);
+			rfolder->session = NULL;
+			SESSION(session)->state = SESSION_DISCONNECTED;
+			SESSION(session)->sock = NULL;
+			imap_safe_destroy(session);
+			rfolder->last_failure = time(NULL);
+			rfolder->connecting = FALSE;
+			return NULL;
+		}
+	}
+
 	/* I think the point of this code is to avoid sending a
 	 * keepalive if we've used the session recently and therefore
 	 * think it's still alive.  Unfortunately, most of the code
@@ -1201,7 +1465,7 @@ new_conn:
 				SESSION(session)->state = SESSION_DISCONNECTED;
 				SESSION(session)->sock = NULL;
 				imap_safe_destroy(session);
-				session = imap_session_get(folder);
+				session = imap_main_session_get(folder);
 			}
 		}
 		if (session)
@@ -1214,6 +1478,137 @@ new_conn:
 	return IMAP_SESSION(session);
 }
 
+/* Opens the pool connection of a free slot, or returns NULL */
+static IMAPSession *imap_pool_session_open(Folder *folder, gint slot)
+{
+	IMAPFolder *ifolder = IMAP_FOLDER(folder);
+	IMAPSession *session;
+	gint r;
+
+	debug_print("opening IMAP connection %d\n", slot);
+	imap_threaded_use_connection(folder, slot);
+	session = imap_session_new(folder, folder->account);
+	if (session == NULL)
+		return NULL;
+	session->slot = slot;
+
+	r = MAILIMAP_NO_ERROR;
+	if (!session->authenticated)
+		r = imap_session_authenticate(session, folder->account);
+	imap_session_use(session);
+	if (r == MAILIMAP_NO_ERROR && session->authenticated)
+		r = imap_session_enable_extensions(session);
+	if (is_fatal(r) || !session->authenticated) {
+		if (!is_fatal(r))
+			imap_threaded_disconnect(folder);
+		SESSION(session)->state = SESSION_DISCONNECTED;
+		SESSION(session)->sock = NULL;
+		imap_safe_destroy(session);
+		return NULL;
+	}
+
+	ifolder->pool = g_slist_prepend(ifolder->pool, session);
+	return session;
+}
+
+/* Opens one more connection for the pool, or returns NULL */
+static IMAPSession *imap_pool_session_new(Folder *folder)
+{
+	IMAPFolder *ifolder = IMAP_FOLDER(folder);
+	gboolean used[IMAP_MAX_CONNECTIONS] = { FALSE };
+	GSList *cur;
+	gint slot;
+
+	for (cur = ifolder->pool; cur != NULL; cur = cur->next)
+		used[IMAP_SESSION(cur->data)->slot] = TRUE;
+	for (slot = 1; slot < IMAP_MAX_CONNECTIONS && used[slot]; slot++)
+		;
+	if (slot == IMAP_MAX_CONNECTIONS)
+		return NULL;
+
+	return imap_pool_session_open(folder, slot);
+}
+
+static gboolean imap_session_has_selected(IMAPSession *session,
+					  FolderItem *item)
+{
+	return item != NULL && item->path != NULL && session->mbox != NULL &&
+		!strcmp(session->mbox, item->path);
+}
+
+/* Picks the session for an operation on item (if not NULL). With a
+ * single connection allowed this is always the folder's session;
+ * otherwise a session which is not in use is preferred, one that has
+ * item selected first, and a new connection is opened if they are
+ * all in use and the account allows more. Background work stays off
+ * the folder's session when it can, so as not to delay the user. */
+static IMAPSession *imap_session_pick(Folder *folder, FolderItem *item,
+				      gboolean background)
+{
+	IMAPFolder *ifolder = IMAP_FOLDER(folder);
+	IMAPSession *main_session;
+	IMAPSession *selected = NULL, *unused = NULL;
+	GSList *cur, *next;
+	gint max;
+
+	g_return_val_if_fail(folder != NULL, NULL);
+	g_return_val_if_fail(folder->account != NULL, NULL);
+
+	max = MIN(folder->account->imap_max_connections, IMAP_MAX_CONNECTIONS);
+	main_session = IMAP_SESSION(REMOTE_FOLDER(folder)->session);
+
+	if (max <= 1 || main_session == NULL || prefs_common.work_offline ||
+	    SESSION(main_session)->state == SESSION_DISCONNECTED)
+		return imap_main_session_get(folder);
+
+	for (cur = ifolder->pool; cur != NULL; cur = next) {
+		IMAPSession *pooled = IMAP_SESSION(cur->data);
+
+		next = cur->next;
+		if (pooled->busy)
+			continue;
+		/* broken, or beyond a lowered limit */
+		if (pooled->do_destroy ||
+		    SESSION(pooled)->state == SESSION_DISCONNECTED ||
+		    g_slist_length(ifolder->pool) >= max) {
+			ifolder->pool = g_slist_delete_link(ifolder->pool, cur);
+			imap_safe_destroy(pooled);
+			continue;
+		}
+		if (unused == NULL)
+			unused = pooled;
+		if (imap_session_has_selected(pooled, item))
+			selected = pooled;
+	}
+
+	if (!background && !main_session->busy &&
+	    (selected == NULL || imap_session_has_selected(main_session, item)))
+		return imap_main_session_get(folder);
+
+	if (selected == NULL)
+		selected = unused;
+	if (selected == NULL && g_slist_length(ifolder->pool) < max - 1)
+		selected = imap_pool_session_new(folder);
+
+	/* all in use: queue behind the folder's session, as with a
+	 * single connection */
+	if (selected == NULL)
+		return imap_main_session_get(folder);
+
+	imap_session_use(selected);
+	return selected;
+}
+
+static IMAPSession *imap_session_get_for(Folder *folder, FolderItem *item)
+{
+	return imap_session_pick(folder, item, FALSE);
+}
+
+static IMAPSession *imap_session_get(Folder *folder)
+{
+	return imap_session_get_for(folder, NULL);
+}
+
 static IMAPSession *imap_session_new(Folder * folder,
 				     const PrefsAccount *account)
 {
@@ -1448,8 +1843,17 @@ try_again:
 
 static void imap_session_destroy(Session *session)
 {
-	if (session->state != SESSION_DISCONNECTED)
-		imap_threaded_disconnect(IMAP_SESSION(session)->folder);
+	Folder *folder = IMAP_SESSION(session)->folder;
+
+	if (session->state != SESSION_DISCONNECTED) {
+		gint slot = imap_threaded_get_connection(folder);
+
+		imap_session_use(IMAP_SESSION(session));
+		imap_threaded_disconnect(folder);
+		imap_threaded_use_connection(folder, slot);
+	}
+	IMAP_FOLDER(folder)->pool = g_slist_remove(IMAP_FOLDER(folder)->pool,
+						   session);
 	
 	imap_free_capabilities(IMAP_SESSION(session));
 	g_free(IMAP_SESSION(session)->mbox);
@@ -1521,118 +1925,43 @@ static void imap_remove_cached_msg(Folder *folder, FolderItem *item, MsgInfo *ms
 	g_free(filename);
 }
 
-typedef struct _TagsData {
-	gchar *str;
-	GSList *msglist;
-	IMAPFolderItem *item;
-} TagsData;
-
 static void imap_commit_tags(FolderItem *item, MsgInfo *msginfo, GSList *tags_set, GSList *tags_unset)
 {
 	IMAPSession *session;
-	gint ok, can_create_tags;
-	Folder *folder = NULL;
-	TagsData *ht_data = NULL;
 	GSList *cur;
 
 	g_return_if_fail(item != NULL);
 	g_return_if_fail(msginfo != NULL);
 
-	folder = item->folder;
 	debug_print("getting session...\n");
-	session = imap_session_get(folder);
+	session = imap_session_get_for(item->folder, item);
 	
 	if (!session) {
 		debug_print("can't get session\n");
 		return;
 	}
 
-	ok = imap_select(session, IMAP_FOLDER(folder), item,
-			 NULL, NULL, NULL, NULL, &can_create_tags, FALSE);
-
-	if (ok != MAILIMAP_NO_ERROR) {
-		return;
-	}
-
-	
-	if (IMAP_FOLDER_ITEM(item)->can_create_flags != ITEM_CAN_CREATE_FLAGS)
+	if (IMAP_FOLDER_ITEM(item)->can_create_flags == ITEM_CANNOT_CREATE_FLAGS)
 		return;
 	
-	if (IMAP_FOLDER_ITEM(item)->batching) {
-		/* instead of performing an UID STORE command for each message change,
-		 * as a lot of them can change "together", we just fill in hashtables
-		 * and defer the treatment so that we're able to send only one
-		 * command.
-		 */
-		debug_print("IMAP batch mode on, deferring tags change\n");
-		for (cur = tags_set; cur; cur = cur->next) {
-			gint cur_tag = GPOINTER_TO_INT(cur->data);
-			if (cur_tag) {
-				ht_data = g_hash_table_lookup(IMAP_FOLDER_ITEM(item)->tags_set_table, 
-					GINT_TO_POINTER(cur_tag));
-				if (ht_data == NULL) {
-					ht_data = g_new0(TagsData, 1);
-					ht_data->str = g_strdup(tags_get_tag(cur_tag));
-					ht_data->item = IMAP_FOLDER_ITEM(item);
-					g_hash_table_insert(IMAP_FOLDER_ITEM(item)->tags_set_table, 
-						GINT_TO_POINTER(cur_tag), ht_data);
-				}
-				ht_data->msglist = g_slist_prepend(ht_data->msglist, GINT_TO_POINTER(msginfo->msgnum));
-			} 
-		}
-		for (cur = tags_unset; cur; cur = cur->next) {
-			gint cur_tag = GPOINTER_TO_INT(cur->data);
-			if (cur_tag) {
-				ht_data = g_hash_table_lookup(IMAP_FOLDER_ITEM(item)->tags_unset_table, 
-					GINT_TO_POINTER(cur_tag));
-				if (ht_data == NULL) {
-					ht_data = g_new0(TagsData, 1);
-					ht_data->str = g_strdup(tags_get_tag(cur_tag));
-					ht_data->item = IMAP_FOLDER_ITEM(item);
-					g_hash_table_insert(IMAP_FOLDER_ITEM(item)->tags_unset_table, 
-						GINT_TO_POINTER(cur_tag), ht_data);
-				}
-				ht_data->msglist = g_slist_prepend(ht_data->msglist, GINT_TO_POINTER(msginfo->msgnum));
-			}
-		}
-	} else {
-		GSList *list_set = NULL;
-		GSList *list_unset = NULL;
-		GSList numlist;
-		
-		numlist.data = GINT_TO_POINTER(msginfo->msgnum);
-		numlist.next = NULL;
-	
-		debug_print("IMAP changing tags NOW\n");
-		for (cur = tags_set; cur; cur = cur->next) {
-			gint cur_tag = GPOINTER_TO_INT(cur->data);
-			const gchar *str = tags_get_tag(cur_tag);
-			if (IS_NOT_RESERVED_TAG(str))
-				list_set = g_slist_prepend(list_set, g_strdup(str));
-		}
-		if (list_set) {
-			ok = imap_set_message_flags(session, 
-				IMAP_FOLDER_ITEM(item), &numlist, 0, list_set, TRUE);
-			slist_free_strings_full(list_set);
-			if (ok != MAILIMAP_NO_ERROR) {
-				return;
-			}
-		}
-
-		for (cur = tags_unset; cur; cur = cur->next) {
-			gint cur_tag = GPOINTER_TO_INT(cur->data);
-			const gchar *str = tags_get_tag(cur_tag);
-			if (IS_NOT_RESERVED_TAG(str))
-				list_unset = g_slist_prepend(list_unset, g_strdup(str));
-		}
-		if (list_unset) {
-			ok = imap_set_message_flags(session, 
-				IMAP_FOLDER_ITEM(item), &numlist, 0, list_unset, FALSE);
-			slist_free_strings_full(list_unset);
-			if (ok != MAILIMAP_NO_ERROR) {
-				return;
-			}
-		}
+	/* instead of performing an UID STORE command for each message change,
+	 * as a lot of them can change "together", we just queue them and
+	 * send them later in as few commands as possible. */
+	debug_print("IMAP %s, deferring tags change\n",
+		    IMAP_FOLDER_ITEM(item)->batching ? "batch mode on" : "queueing");
+	for (cur = tags_set; cur; cur = cur->next) {
+		gint cur_tag = GPOINTER_TO_INT(cur->data);
+		const gchar *str = tags_get_tag(cur_tag);
+		if (cur_tag && str && IS_NOT_RESERVED_TAG(str))
+			imap_pending_tag(IMAP_FOLDER_ITEM(item),
+					 msginfo->msgnum, str, TRUE);
+	}
+	for (cur = tags_unset; cur; cur = cur->next) {
+		gint cur_tag = GPOINTER_TO_INT(cur->data);
+		const gchar *str = tags_get_tag(cur_tag);
+		if (cur_tag && str && IS_NOT_RESERVED_TAG(str))
+			imap_pending_tag(IMAP_FOLDER_ITEM(item),
+					 msginfo->msgnum, str, FALSE);
 	}
 }
 
@@ -1705,7 +2034,7 @@ static gchar *imap_fetch_msg_full(Folder *folder, FolderItem *item, gint uid,
 	}
 
 	debug_print("getting session...\n");
-	session = imap_session_get(folder);
+	session = imap_session_get_for(folder, item);
 	
 	if (!session) {
 		g_free(filename);
@@ -1808,6 +2137,214 @@ void imap_cache_msg(FolderItem *item, gint msgnum)
 	}
 }
 
+/* A prefetch batch is capped in messages and in bytes, so that a
+ * cancellation or the bandwidth limit is not waited for too long */
+#define IMAP_PREFETCH_BATCH		100
+#define IMAP_PREFETCH_BATCH_SIZE	(4 * 1024 * 1024)
+
+static gint imap_prefetch_compare(gconstpointer a, gconstpointer b)
+{
+	const MsgInfo *msginfo_a = a, *msginfo_b = b;
+
+	return msginfo_a->msgnum - msginfo_b->msgnum;
+}
+
+static gboolean imap_prefetch_wait_cb(gpointer data)
+{
+	*(gboolean *)data = TRUE;
+	return FALSE;
+}
+
+/* Sleeps as long as needed for bytes to have taken at least the rate
+ * of the account since start, while still serving the user */
+static void imap_prefetch_throttle(PrefsAccount *account, gint64 start,
+				   guint64 bytes)
+{
+	gint64 due, now;
+	gboolean done = FALSE;
+
+	if (account->imap_sync_rate <= 0)
+		return;
+
+	due = start + (gint64)(bytes * G_USEC_PER_SEC /
+			       ((guint64)account->imap_sync_rate * 1024));
+	now = g_get_monotonic_time();
+	if (due <= now)
+		return;
+
+	g_timeout_add((due - now) / 1000, imap_prefetch_wait_cb, &done);
+	while (!done)
+		gtk_main_iteration();
+}
+
+/* Adds the numbers of list to set, as ranges where they follow */
+static struct mailimap_set *imap_prefetch_set(GSList *list)
+{
+	struct mailimap_set *set = mailimap_set_new_empty();
+	guint32 first = 0, last = 0;
+	GSList *cur;
+
+	for (cur = list; cur != NULL; cur = cur->next) {
+		guint32 uid = ((MsgInfo *)cur->data)->msgnum;
+
+		if (first != 0 && uid == last + 1) {
+			last = uid;
+			continue;
+		}
+		if (first != 0)
+			mailimap_set_add_interval(set, first, last);
+		first = last = uid;
+	}
+	if (first != 0)
+		mailimap_set_add_interval(set, first, last);
+
+	return set;
+}
+
+/* Fetches the messages of list in one command, and marks those
+ * written as fully cached */
+static gint imap_prefetch_batch(IMAPSession *session, FolderItem *item,
+				GSList *list, guint64 *size)
+{
+	struct mailimap_set *set;
+	GHashTable *filenames;
+	GSList *fetched = NULL, *cur;
+	gint ok;
+
+	filenames = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					  NULL, g_free);
+	for (cur = list; cur != NULL; cur = cur->next) {
+		MsgInfo *msginfo = (MsgInfo *)cur->data;
+
+		g_hash_table_insert(filenames, GUINT_TO_POINTER(msginfo->msgnum),
+				    imap_get_cached_filename(item, msginfo->msgnum));
+	}
+
+	set = imap_prefetch_set(list);
+	ok = imap_threaded_fetch_bodies(session->folder, set, filenames,
+					&fetched, size);
+	mailimap_set_free(set);
+	g_hash_table_destroy(filenames);
+	if (ok != MAILIMAP_NO_ERROR)
+		imap_handle_error(SESSION(session), NULL, ok);
+
+	for (cur = fetched; cur != NULL; cur = cur->next) {
+		MsgInfo *cached = msgcache_get_msg(item->cache,
+						   GPOINTER_TO_UINT(cur->data));
+		if (cached) {
+			procmsg_msginfo_set_flags(cached, MSG_FULLY_CACHED, 0);
+			procmsg_msginfo_free(&cached);
+		}
+	}
+	debug_print("prefetched %d messages of %d\n",
+		    g_slist_length(fetched), g_slist_length(list));
+	g_slist_free(fetched);
+
+	return ok;
+}
+
+/* Downloads the bodies of the messages of item not older than days (if
+ * not 0) which are not fully cached yet, many at a time, on a session
+ * other than the folder's one if the account allows it. */
+void imap_prefetch(FolderItem *item, gint days)
+{
+	Folder *folder;
+	IMAPSession *session;
+	GSList *mlist, *todo = NULL, *cur;
+	gchar *path;
+	time_t t = time(NULL);
+	gint64 start;
+	guint64 received = 0;
+	gint total, done = 0;
+	gint ok = MAILIMAP_NO_ERROR;
+
+	g_return_if_fail(item != NULL);
+	g_return_if_fail(item->folder != NULL);
+
+	folder = item->folder;
+	if (item->no_select)
+		return;
+
+	mlist = folder_item_get_msg_list(item);
+	for (cur = mlist; cur != NULL; cur = cur->next) {
+		MsgInfo *msginfo = (MsgInfo *)cur->data;
+		gint age = (t - msginfo->date_t) / (60*60*24);
+
+		if ((days == 0 || age <= days) &&
+		    !imap_is_msg_fully_cached(folder, item, msginfo->msgnum))
+			todo = g_slist_prepend(todo, msginfo);
+	}
+	if (todo == NULL) {
+		procmsg_msg_list_free(mlist);
+		return;
+	}
+	todo = g_slist_sort(todo, imap_prefetch_compare);
+	total = g_slist_length(todo);
+
+	path = folder_item_get_path(item);
+	if (!is_dir_exist(path)) {
+		if (is_file_exist(path))
+			claws_unlink(path);
+		make_dir_hier(path);
+	}
+	g_free(path);
+
+	session = imap_session_pick(folder, item, TRUE);
+	if (!session) {
+		g_slist_free(todo);
+		procmsg_msg_list_free(mlist);
+		return;
+	}
+	lock_session(session);
+
+	start = g_get_monotonic_time();
+	cur = todo;
+	while (cur != NULL) {
+		GSList *batch = cur, *last = cur;
+		goffset batch_size = 0;
+		gint count = 0;
+		guint64 size = 0;
+
+		do {
+			batch_size += ((MsgInfo *)cur->data)->size;
+			count++;
+			last = cur;
+			cur = cur->next;
+		} while (cur != NULL && count < IMAP_PREFETCH_BATCH &&
+			 batch_size + ((MsgInfo *)cur->data)->size <=
+			 IMAP_PREFETCH_BATCH_SIZE);
+		last->next = NULL;
+
+		/* a no-op unless the mailbox was lost between batches */
+		session_set_access_time(SESSION(session));
+		ok = imap_select(session, IMAP_FOLDER(folder), item,
+				 NULL, NULL, NULL, NULL, NULL, FALSE);
+		if (ok == MAILIMAP_NO_ERROR)
+			ok = imap_prefetch_batch(session, item, batch, &size);
+		last->next = cur;
+
+		/* the error unlocked the session, or destroyed it */
+		if (ok != MAILIMAP_NO_ERROR)
+			break;
+
+		done += count;
+		received += size;
+		statusbar_progress_all(done, total, 1);
+
+		if (cur != NULL)
+			imap_prefetch_throttle(folder->account, start, received);
+	}
+	statusbar_progress_all(0, 0, 0);
+
+	if (ok == MAILIMAP_NO_ERROR) {
+		session_set_access_time(SESSION(session));
+		unlock_session(session);
+	}
+
+	g_slist_free(todo);
+	procmsg_msg_list_free(mlist);
+}
+
 static gint imap_add_msg(Folder *folder, FolderItem *dest, 
 			 const gchar *file, MsgFlags *flags)
 {
@@ -3981,28 +4518,477 @@ static gint imap_set_message_flags(IMAPSession *session,
 		if (set_item == NULL)
 			continue;
 
-		statusbar_progress_all(set_item->set_first, total, 1);
+		statusbar_progress_all(set_item->set_first, total, 1);
+
+		ok = imap_cmd_store(session, item, imapset,
+				    flags, tags, is_set);
+		statusbar_progress_all(set_item->set_last, total, 1);
+		if (ok != MAILIMAP_NO_ERROR && folder->max_set_size > 20) {
+			/* reduce max set size */
+			folder->max_set_size /= 2;
+		}
+		if (ok != MAILIMAP_NO_ERROR && is_fatal(ok)) {
+			break;
+		}
+	}
+	
+	g_slist_free(sorted_list);
+
+	statusbar_progress_all(0,0,0);
+	statusbar_pop_all();
+
+	imap_lep_set_free(seq_list);
+	
+	return ok;
+}
+
+/* Delay before sending flag and tag changes made outside batch mode,
+ * so that the changes made together go out together */
+#define IMAP_FLUSH_DELAY	200
+
+static const IMAPFlags imap_stored_flags[] = {
+	IMAP_FLAG_SEEN, IMAP_FLAG_ANSWERED, IMAP_FLAG_FLAGGED,
+	IMAP_FLAG_DELETED, IMAP_FLAG_DRAFT, IMAP_FLAG_FORWARDED,
+	IMAP_FLAG_SPAM, IMAP_FLAG_HAM
+};
+
+static gboolean imap_flush_pending_cb(gpointer data)
+{
+	IMAPFolderItem *item = (IMAPFolderItem *)data;
+	RemoteFolder *rfolder = REMOTE_FOLDER(item->item.folder);
+
+	/* try again once the current operation is over */
+	if (rfolder->session && IMAP_SESSION(rfolder->session)->busy)
+		return TRUE;
+
+	item->flush_timer = 0;
+	imap_flush_pending(item);
+	return FALSE;
+}
+
+/* Sets up the pending changes tables of item, and schedules their
+ * sending unless in batch mode */
+static void imap_pending_prepare(IMAPFolderItem *item)
+{
+	IMAPFolder *folder = IMAP_FOLDER(item->item.folder);
+
+	if (!item->flags_set_table) {
+		item->flags_set_table = g_hash_table_new(NULL, g_direct_equal);
+		item->flags_unset_table = g_hash_table_new(NULL, g_direct_equal);
+		item->tags_set_table = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+		item->tags_unset_table = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+		folder->pending_items = g_slist_prepend(folder->pending_items, item);
+	}
+
+	if (!item->batching && item->flush_timer == 0)
+		item->flush_timer = g_timeout_add(IMAP_FLUSH_DELAY,
+						  imap_flush_pending_cb, item);
+}
+
+static void imap_pending_flags(IMAPFolderItem *item, gint uid,
+			       IMAPFlags flags, gboolean is_set)
+{
+	GHashTable *add, *remove;
+	gpointer key = GINT_TO_POINTER(uid);
+	IMAPFlags cur;
+
+	imap_pending_prepare(item);
+	add = is_set ? item->flags_set_table : item->flags_unset_table;
+	remove = is_set ? item->flags_unset_table : item->flags_set_table;
+
+	/* only the last change of each flag counts */
+	cur = GPOINTER_TO_INT(g_hash_table_lookup(add, key));
+	g_hash_table_insert(add, key, GINT_TO_POINTER(cur | flags));
+
+	cur = GPOINTER_TO_INT(g_hash_table_lookup(remove, key)) & ~flags;
+	if (cur)
+		g_hash_table_insert(remove, key, GINT_TO_POINTER(cur));
+	else
+		g_hash_table_remove(remove, key);
+}
+
+static void imap_pending_tag(IMAPFolderItem *item, gint uid,
+			     const gchar *tag, gboolean is_set)
+{
+	GHashTable *add, *remove, *uids;
+	gpointer key = GINT_TO_POINTER(uid);
+
+	imap_pending_prepare(item);
+	add = is_set ? item->tags_set_table : item->tags_unset_table;
+	remove = is_set ? item->tags_unset_table : item->tags_set_table;
+
+	uids = g_hash_table_lookup(add, tag);
+	if (uids == NULL) {
+		uids = g_hash_table_new(NULL, g_direct_equal);
+		g_hash_table_insert(add, g_strdup(tag), uids);
+	}
+	g_hash_table_add(uids, key);
+
+	uids = g_hash_table_lookup(remove, tag);
+	if (uids != NULL)
+		g_hash_table_remove(uids, key);
+}
+
+static void imap_forget_pending(IMAPFolderItem *item)
+{
+	if (item->flush_timer != 0) {
+		g_source_remove(item->flush_timer);
+		item->flush_timer = 0;
+	}
+	if (item->flags_set_table == NULL)
+		return;
+
+	if (item->item.folder)
+		IMAP_FOLDER(item->item.folder)->pending_items = g_slist_remove(
+			IMAP_FOLDER(item->item.folder)->pending_items, item);
+	g_hash_table_destroy(item->flags_set_table);
+	g_hash_table_destroy(item->flags_unset_table);
+	g_hash_table_destroy(item->tags_set_table);
+	g_hash_table_destroy(item->tags_unset_table);
+	item->flags_set_table = NULL;
+	item->flags_unset_table = NULL;
+	item->tags_set_table = NULL;
+	item->tags_unset_table = NULL;
+}
+
+static void imap_replay_pending(IMAPFolderItem *item,
+				GHashTable **flags_tables,
+				GHashTable **tags_tables)
+{
+	GHashTableIter iter, uids_iter;
+	gpointer key, value, uid;
+	gint i;
+
+	for (i = 0; i < 2; i++) {
+		g_hash_table_iter_init(&iter, flags_tables[i]);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+			imap_pending_flags(item, GPOINTER_TO_INT(key),
+					   GPOINTER_TO_INT(value), i);
+
+		g_hash_table_iter_init(&iter, tags_tables[i]);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			g_hash_table_iter_init(&uids_iter, (GHashTable *)value);
+			while (g_hash_table_iter_next(&uids_iter, &uid, NULL))
+				imap_pending_tag(item, GPOINTER_TO_INT(uid),
+						 (const gchar *)key, i);
+		}
+	}
+}
+
+/* Queues again the changes a failed connection did not send, before
+ * the ones made since, which supersede them */
+static void imap_requeue_pending(IMAPFolderItem *item,
+				 GHashTable **flags_tables,
+				 GHashTable **tags_tables)
+{
+	GHashTable *newer_flags[2], *newer_tags[2];
+	gint i;
+
+	newer_flags[0] = item->flags_unset_table;
+	newer_flags[1] = item->flags_set_table;
+	newer_tags[0] = item->tags_unset_table;
+	newer_tags[1] = item->tags_set_table;
+	item->flags_set_table = NULL;
+	item->flags_unset_table = NULL;
+	item->tags_set_table = NULL;
+	item->tags_unset_table = NULL;
+	IMAP_FOLDER(item->item.folder)->pending_items = g_slist_remove(
+		IMAP_FOLDER(item->item.folder)->pending_items, item);
+
+	imap_replay_pending(item, flags_tables, tags_tables);
+	if (newer_flags[1] == NULL)
+		return;
+
+	imap_replay_pending(item, newer_flags, newer_tags);
+	for (i = 0; i < 2; i++) {
+		g_hash_table_destroy(newer_flags[i]);
+		g_hash_table_destroy(newer_tags[i]);
+	}
+}
+
+/* The change a pipelined UID STORE makes */
+typedef struct _IMAPStoreChange {
+	IMAPFlags flags;
+	const gchar *tag;
+	gboolean is_set;
+} IMAPStoreChange;
+
+static void imap_add_store(IMAPFolderItem *item, GArray *stores,
+			   GArray *changes, struct mailimap_set *set,
+			   IMAPStoreChange *change)
+{
+	IMAPPipelinedStore store;
+	struct mailimap_flag_list *flag_list;
+	GSList tags;
+
+	tags.data = (gpointer)change->tag;
+	tags.next = NULL;
+	flag_list = imap_flag_to_lep(item, change->flags,
+				     change->tag ? &tags : NULL);
+	if (clist_count(flag_list->fl_list) == 0) {
+		/* a keyword the mailbox does not take */
+		mailimap_flag_list_free(flag_list);
+		return;
+	}
+
+	store.set = set;
+	if (change->is_set)
+		store.store_att_flags =
+			mailimap_store_att_flags_new_add_flags_silent(flag_list);
+	else
+		store.store_att_flags =
+			mailimap_store_att_flags_new_remove_flags_silent(flag_list);
+	store.result = MAILIMAP_NO_ERROR;
+	g_array_append_val(stores, store);
+	g_array_append_val(changes, *change);
+}
+
+/* Adds to stores the UID STOREs changing flags and tags on the
+ * messages of numlist, as many as the maximum set size requires */
+static void imap_queue_stores(IMAPFolderItem *item, GArray *stores,
+			      GArray *changes, GSList **seq_lists,
+			      GSList *numlist, IMAPFlags flags,
+			      const gchar *tag, gboolean is_set)
+{
+	GSList *seq_list, *cur;
+	IMAPStoreChange change;
+
+	numlist = g_slist_sort(numlist, g_int_compare);
+	seq_list = imap_get_lep_set_from_numlist(
+		IMAP_FOLDER(item->item.folder), numlist);
+	*seq_lists = g_slist_prepend(*seq_lists, seq_list);
+	g_slist_free(numlist);
+
+	change.flags = flags;
+	change.tag = tag;
+	change.is_set = is_set;
+	for (cur = seq_list; cur != NULL; cur = cur->next)
+		imap_add_store(item, stores, changes,
+			       (struct mailimap_set *)cur->data, &change);
+}
+
+/* Sends the UID STOREs of stores without waiting for each one, and
+ * takes note of the changes the server announced meanwhile */
+static gint imap_send_stores(IMAPSession *session, IMAPFolderItem *item,
+			     GArray *stores)
+{
+	gint ok;
+	int changes = 0;
+
+	if (stores->len == 0)
+		return MAILIMAP_NO_ERROR;
+
+	statusbar_print_all(_("Flagging messages..."));
+	ok = imap_threaded_store_pipelined(session->folder,
+			(IMAPPipelinedStore *)stores->data, stores->len,
+			&changes);
+	statusbar_pop_all();
+	if (ok != MAILIMAP_NO_ERROR)
+		imap_handle_error(SESSION(session), NULL, ok);
+
+	if (changes != 0) {
+		/* libetpan did not see those responses: scan the mailbox,
+		 * and select it again to learn its current state */
+		debug_print("IMAP %s changed while storing flags\n",
+			    item->item.path);
+		item->should_update = TRUE;
+		item->last_change = time(NULL);
+		g_free(session->mbox);
+		session->mbox = NULL;
+	}
+
+	return ok;
+}
+
+static void imap_free_stores(GArray *stores)
+{
+	guint i;
+
+	for (i = 0; i < stores->len; i++)
+		mailimap_store_att_flags_free(g_array_index(stores,
+				IMAPPipelinedStore, i).store_att_flags);
+	g_array_free(stores, TRUE);
+}
+
+/* Sends the pending changes of item, which must be the mailbox
+ * selected in session, in as few UID STOREs as possible, without
+ * waiting for each one to complete */
+static gint imap_store_pending(IMAPSession *session, IMAPFolderItem *item)
+{
+	IMAPFolder *folder = IMAP_FOLDER(session->folder);
+	GHashTable *flags_tables[2], *tags_tables[2];
+	GArray *stores, *changes, *retries, *retry_changes;
+	GSList *seq_lists = NULL, *cur;
+	gint ok = MAILIMAP_NO_ERROR, refused = MAILIMAP_NO_ERROR;
+	guint i, j;
+
+	if (item->flags_set_table == NULL)
+		return MAILIMAP_NO_ERROR;
+
+	/* take the changes, the ones made while sending wait for the
+	 * next round */
+	flags_tables[0] = item->flags_unset_table;
+	flags_tables[1] = item->flags_set_table;
+	tags_tables[0] = item->tags_unset_table;
+	tags_tables[1] = item->tags_set_table;
+	item->flags_set_table = NULL;
+	item->flags_unset_table = NULL;
+	item->tags_set_table = NULL;
+	item->tags_unset_table = NULL;
+	folder->pending_items = g_slist_remove(folder->pending_items, item);
+	if (item->flush_timer != 0) {
+		g_source_remove(item->flush_timer);
+		item->flush_timer = 0;
+	}
+
+	stores = g_array_new(FALSE, FALSE, sizeof(IMAPPipelinedStore));
+	changes = g_array_new(FALSE, FALSE, sizeof(IMAPStoreChange));
+
+	for (i = 0; i < 2; i++) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		for (j = 0; j < G_N_ELEMENTS(imap_stored_flags); j++) {
+			GSList *numlist = NULL;
+
+			g_hash_table_iter_init(&iter, flags_tables[i]);
+			while (g_hash_table_iter_next(&iter, &key, &value)) {
+				if (GPOINTER_TO_INT(value) & imap_stored_flags[j])
+					numlist = g_slist_prepend(numlist, key);
+			}
+			if (numlist)
+				imap_queue_stores(item, stores, changes,
+						  &seq_lists, numlist,
+						  imap_stored_flags[j], NULL, i);
+		}
+
+		if (item->can_create_flags != ITEM_CAN_CREATE_FLAGS)
+			continue;
+
+		g_hash_table_iter_init(&iter, tags_tables[i]);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			if (g_hash_table_size((GHashTable *)value) == 0)
+				continue;
+			imap_queue_stores(item, stores, changes, &seq_lists,
+					  g_hash_table_get_keys((GHashTable *)value),
+					  0, (const gchar *)key, i);
+		}
+	}
+
+	debug_print("IMAP storing pending changes of %s in %d commands\n",
+		    item->item.path, stores->len);
+	ok = imap_send_stores(session, item, stores);
+
+	/* the server may refuse a whole set for one of its messages:
+	 * send the refused changes again one message at a time, as they
+	 * were before they were grouped */
+	retries = g_array_new(FALSE, FALSE, sizeof(IMAPPipelinedStore));
+	retry_changes = g_array_new(FALSE, FALSE, sizeof(IMAPStoreChange));
+	for (i = 0; ok == MAILIMAP_NO_ERROR && i < stores->len; i++) {
+		IMAPPipelinedStore *store =
+			&g_array_index(stores, IMAPPipelinedStore, i);
+		clistiter *iter;
+
+		if (store->result == MAILIMAP_NO_ERROR)
+			continue;
+
+		/* reduce max set size */
+		if (folder->max_set_size > 20)
+			folder->max_set_size /= 2;
+
+		for (iter = clist_begin(store->set->set_list); iter != NULL;
+		     iter = clist_next(iter)) {
+			struct mailimap_set_item *set_item = clist_content(iter);
+			uint32_t uid;
+
+			for (uid = set_item->set_first;
+			     uid != 0 && uid <= set_item->set_last; uid++)
+				imap_add_store(item, retries, retry_changes,
+					       mailimap_set_new_single(uid),
+					       &g_array_index(changes,
+						       IMAPStoreChange, i));
+		}
+	}
+	if (retries->len > 0) {
+		debug_print("IMAP storing %d refused changes of %s one by one\n",
+			    retries->len, item->item.path);
+		ok = imap_send_stores(session, item, retries);
+		for (i = 0; i < retries->len; i++)
+			if (g_array_index(retries, IMAPPipelinedStore, i).result
+			    != MAILIMAP_NO_ERROR)
+				refused = g_array_index(retries,
+					IMAPPipelinedStore, i).result;
+	}
+	for (i = 0; i < retries->len; i++)
+		mailimap_set_free(g_array_index(retries, IMAPPipelinedStore, i).set);
+
+	imap_free_stores(retries);
+	g_array_free(retry_changes, TRUE);
+	imap_free_stores(stores);
+	g_array_free(changes, TRUE);
+	for (cur = seq_lists; cur != NULL; cur = cur->next)
+		imap_lep_set_free((GSList *)cur->data);
+	g_slist_free(seq_lists);
+
+	/* the server did not get the changes: keep them for the next
+	 * session; the ones it refused message by message are lost */
+	if (ok != MAILIMAP_NO_ERROR)
+		imap_requeue_pending(item, flags_tables, tags_tables);
+
+	for (i = 0; i < 2; i++) {
+		g_hash_table_destroy(flags_tables[i]);
+		g_hash_table_destroy(tags_tables[i]);
+	}
+
+	return ok != MAILIMAP_NO_ERROR ? ok : refused;
+}
+
+/* Sends the pending changes of the mailbox selected in session, before
+ * it is left or expunged */
+static gint imap_store_pending_selected(IMAPSession *session)
+{
+	GSList *cur;
+
+	if (session->mbox == NULL)
+		return MAILIMAP_NO_ERROR;
+
+	for (cur = IMAP_FOLDER(session->folder)->pending_items; cur != NULL;
+	     cur = cur->next) {
+		IMAPFolderItem *item = (IMAPFolderItem *)cur->data;
+
+		if (!strcmp(item->item.path, session->mbox))
+			return imap_store_pending(session, item);
+	}
+
+	return MAILIMAP_NO_ERROR;
+}
+
+static void imap_flush_pending(IMAPFolderItem *item)
+{
+	FolderItem *_item = (FolderItem *)item;
+	IMAPSession *session;
+	gint ok;
+
+	if (item->flags_set_table == NULL)
+		return;
 
-		ok = imap_cmd_store(session, item, imapset,
-				    flags, tags, is_set);
-		statusbar_progress_all(set_item->set_last, total, 1);
-		if (ok != MAILIMAP_NO_ERROR && folder->max_set_size > 20) {
-			/* reduce max set size */
-			folder->max_set_size /= 2;
-		}
-		if (ok != MAILIMAP_NO_ERROR && is_fatal(ok)) {
-			break;
-		}
-	}
-	
-	g_slist_free(sorted_list);
+	debug_print("getting session...\n");
+	session = imap_session_get_for(_item->folder, _item);
+	if (!session)
+		return;
 
-	statusbar_progress_all(0,0,0);
-	statusbar_pop_all();
+	lock_session(session);
+	ok = imap_select(session, IMAP_FOLDER(_item->folder), _item,
+			 NULL, NULL, NULL, NULL, NULL, FALSE);
+	if (ok == MAILIMAP_NO_ERROR)
+		ok = imap_store_pending(session, item);
+	else
+		g_warning("can't select mailbox %s", _item->path);
 
-	imap_lep_set_free(seq_list);
-	
-	return ok;
+	if (!is_fatal(ok))
+		unlock_session(session);
 }
 
 typedef struct _select_data {
@@ -4032,14 +5018,21 @@ static gint imap_select(IMAPSession *session, IMAPFolder *folder,
 		return MAILIMAP_ERROR_BAD_STATE;
 	}
 
+	/* already selected: the changes queued on the mailbox still go
+	 * out first, the COPY, MOVE or EXPUNGE that follows may depend
+	 * on them */
 	if (!exists && !recent && !unseen && !uid_validity && !can_create_flags) {
-		if (session->mbox && strcmp(session->mbox, path) == 0)
-			return MAILIMAP_NO_ERROR;
+		if (session->mbox && strcmp(session->mbox, path) == 0) {
+			ok = imap_store_pending_selected(session);
+			return is_fatal(ok) ? ok : MAILIMAP_NO_ERROR;
+		}
 	}
 	if (!exists && !recent && !unseen && !uid_validity && can_create_flags) {
 		if (session->mbox && strcmp(session->mbox, path) == 0) {
-			if (IMAP_FOLDER_ITEM(item)->can_create_flags != ITEM_CAN_CREATE_FLAGS_UNKNOWN)
-				return MAILIMAP_NO_ERROR;
+			if (IMAP_FOLDER_ITEM(item)->can_create_flags != ITEM_CAN_CREATE_FLAGS_UNKNOWN) {
+				ok = imap_store_pending_selected(session);
+				return is_fatal(ok) ? ok : MAILIMAP_NO_ERROR;
+			}
 		}
 	}
 	if (!exists)
@@ -4053,11 +5046,18 @@ static gint imap_select(IMAPSession *session, IMAPFolder *folder,
 	if (!can_create_flags)
 		can_create_flags = &can_create_flags_;
 
+	/* the changes queued on the mailbox we leave go out first */
+	ok = imap_store_pending_selected(session);
+	if (is_fatal(ok))
+		return ok;
+	ok = MAILIMAP_NO_ERROR;
+
 	g_free(session->mbox);
 	session->mbox = NULL;
 	session->exists = 0;
 	session->recent = 0;
 	session->expunge = 0;
+	session->highestmodseq = 0;
 
 	real_path = imap_get_real_path(session, folder, path, &ok);
 	if (is_fatal(ok)) {
@@ -4079,9 +5079,10 @@ static gint imap_select(IMAPSession *session, IMAPFolder *folder,
 		session->expunge = 0;
 		session->unseen = *unseen;
 		session->uid_validity = *uid_validity;
-		debug_print("select: exists %d recent %d expunge %d uid_validity %d can_create_flags %d\n", 
+		debug_print("select: exists %d recent %d expunge %d uid_validity %d can_create_flags %d "
+			"highestmodseq %" G_GUINT64_FORMAT "\n",
 			session->exists, session->recent, session->expunge,
-			session->uid_validity, *can_create_flags);
+			session->uid_validity, *can_create_flags, session->highestmodseq);
 	}
 	if (*can_create_flags) {
 		IMAP_FOLDER_ITEM(item)->can_create_flags = ITEM_CAN_CREATE_FLAGS;
@@ -4097,7 +5098,7 @@ static gint imap_status(IMAPSession *session, IMAPFolder *folder,
 			const gchar *path, IMAPFolderItem *item,
 			gint *messages,
 			guint32 *uid_next, guint32 *uid_validity,
-			gint *unseen, gboolean block)
+			gint *unseen, guint64 *highestmodseq, gboolean block)
 {
 	int r = MAILIMAP_NO_ERROR;
 	clistiter * iter;
@@ -4127,6 +5128,10 @@ static gint imap_status(IMAPSession *session, IMAPFolder *folder,
 		mask |= 1 << 4;
 		*unseen = 0;
 	}
+	if (highestmodseq) {
+		mask |= 1 << 5;
+		*highestmodseq = 0;
+	}
 	
 	if (session->mbox != NULL &&
 	    !strcmp(session->mbox, item->item.path)) {
@@ -4192,6 +5197,18 @@ static gint imap_status(IMAPSession *session, IMAPFolder *folder,
 					got_values |= 1 << 4;
 				}
 				break;
+
+			case MAILIMAP_STATUS_ATT_HIGHESTMODSEQ:
+				if (highestmodseq && info->st_ext_data != NULL &&
+				    info->st_ext_data->ext_extension == &mailimap_extension_condstore &&
+				    info->st_ext_data->ext_type == MAILIMAP_CONDSTORE_TYPE_STATUS_INFO) {
+					struct mailimap_condstore_status_info *status_info =
+						info->st_ext_data->ext_data;
+
+					* highestmodseq = status_info->cs_highestmodseq_value;
+					got_values |= 1 << 5;
+				}
+				break;
 			}
 		}
 	}
@@ -4218,6 +5235,9 @@ static gint imap_cmd_login(IMAPSession *session,
 	int r;
 	gint ok;
 
+	/* the password prompt may have let another connection run */
+	imap_session_use(session);
+
 	if (!strcmp(type, "plaintext") && imap_has_capability(session, "LOGINDISABLED")) {
 		ok = MAILIMAP_ERROR_BAD_STATE;
 		if (imap_has_capability(session, "STARTTLS")) {
@@ -4329,7 +5349,8 @@ static gint imap_cmd_select(IMAPSession *session, const gchar *folder,
 	int r;
 
 	r = imap_threaded_select(session->folder, folder,
-				 exists, recent, unseen, uid_validity, can_create_flags, ok_flags);
+				 exists, recent, unseen, uid_validity, can_create_flags, ok_flags,
+				 session->qresync ? &session->highestmodseq : NULL);
 	if (r != MAILIMAP_NO_ERROR) {
 		imap_handle_error(SESSION(session), NULL, r);
 		debug_print("select err %d\n", r);
@@ -4342,6 +5363,7 @@ static gint imap_cmd_close(IMAPSession *session)
 {
 	int r;
 
+	imap_store_pending_selected(session);
 	r = imap_threaded_close(session->folder);
 	if (r != MAILIMAP_NO_ERROR) {
 		imap_handle_error(SESSION(session), NULL, r);
@@ -4562,6 +5584,7 @@ static gint imap_cmd_expunge(IMAPSession *session)
 		return -1;
 	}
 
+	imap_store_pending_selected(session);
 	statusbar_print_all(_("Expunging deleted messages..."));
 	r = imap_threaded_expunge(session->folder);
 	statusbar_pop_all();
@@ -4639,23 +5662,210 @@ static gboolean imap_rename_folder_func(GNode *node, gpointer data)
 	return FALSE;
 }
 
-static gint get_list_of_uids(IMAPSession *session, Folder *folder, IMAPFolderItem *item, GSList **msgnum_list)
+/* Sorted UIDs of the folder as of the last scan: the list got then,
+ * else the ones in the cache, loaded or on disk */
+static GArray *imap_get_known_uids(IMAPFolderItem *item)
+{
+	GArray *known;
+	GSList *cur;
+
+	if (item->uid_list != NULL) {
+		known = g_array_new(FALSE, FALSE, sizeof(guint));
+		for (cur = item->uid_list; cur != NULL; cur = cur->next) {
+			guint uid = GPOINTER_TO_UINT(cur->data);
+
+			g_array_append_val(known, uid);
+		}
+	} else if (item->item.cache != NULL) {
+		known = msgcache_get_msg_num_array(item->item.cache);
+	} else {
+		gchar *path = folder_item_get_path(FOLDER_ITEM(item));
+		gchar *file = g_strconcat(path, G_DIR_SEPARATOR_S, CACHE_FILE, NULL);
+		guint32 *nums;
+		guint count, i;
+
+		nums = msgcache_read_cache_column(file, MSGCACHE_COL_MSGNUM, &count);
+		g_free(file);
+		g_free(path);
+		if (nums == NULL)
+			return NULL;
+		known = g_array_sized_new(FALSE, FALSE, sizeof(guint), count);
+		for (i = 0; i < count; i++) {
+			guint uid = nums[i];
+
+			g_array_append_val(known, uid);
+		}
+		g_free(nums);
+	}
+	sort_uint_array((guint *)known->data, known->len);
+
+	return known;
+}
+
+typedef struct _IMAPUidRange {
+	guint first;
+	guint last;
+} IMAPUidRange;
+
+static gint imap_uid_range_compare(gconstpointer a, gconstpointer b)
+{
+	guint fa = ((const IMAPUidRange *)a)->first;
+	guint fb = ((const IMAPUidRange *)b)->first;
+
+	return (fa > fb) - (fa < fb);
+}
+
+static gint imap_uint_compare(const void *a, const void *b)
+{
+	guint ua = *(const guint *)a;
+	guint ub = *(const guint *)b;
+
+	return (ua > ub) - (ua < ub);
+}
+
+/* RFC 7162: the UIDs known at the last scan, minus the ones VANISHED
+ * since, plus the ones changed since (new ones included). The flags
+ * got on the way are kept for imap_get_flags(). Returns -1 if the
+ * full list has to be fetched instead. */
+static gint get_list_of_changed_uids(IMAPSession *session, Folder *folder,
+				     IMAPFolderItem *item, gint exists)
+{
+	GArray *known, *ranges;
+	carray *lep_uidtab = NULL;
+	struct mailimap_set *vanished = NULL;
+	GHashTable *flags_hash, *tags_hash;
+	GHashTableIter iter;
+	gpointer key;
+	GSList *uidlist = NULL;
+	guint i, v;
+	gint nummsgs = 0;
+	int r;
+
+	if (item->modseq == 0 || session->highestmodseq == 0
+	    || session->uid_validity != item->item.mtime)
+		return -1;
+
+	known = imap_get_known_uids(item);
+	if (known == NULL)
+		return -1;
+
+	flags_hash = g_hash_table_new(g_direct_hash, g_direct_equal);
+	tags_hash = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	if (session->highestmodseq != item->modseq) {
+		r = imap_threaded_fetch_uid_flags_changed(folder, item->modseq,
+							  &lep_uidtab, &vanished);
+		if (r != MAILIMAP_NO_ERROR) {
+			imap_handle_error(SESSION(session), NULL, r);
+			g_array_free(known, TRUE);
+			g_hash_table_destroy(flags_hash);
+			g_hash_table_destroy(tags_hash);
+			return -1;
+		}
+		imap_flags_hash_from_lep_uid_flags_tab(lep_uidtab, flags_hash, tags_hash);
+		imap_fetch_uid_flags_list_free(lep_uidtab);
+	}
+
+	ranges = g_array_new(FALSE, FALSE, sizeof(IMAPUidRange));
+	if (vanished != NULL) {
+		clistiter *cur;
+
+		for (cur = clist_begin(vanished->set_list); cur != NULL;
+		     cur = clist_next(cur)) {
+			struct mailimap_set_item *set_item = clist_content(cur);
+			IMAPUidRange range;
+
+			range.first = set_item->set_first;
+			range.last = set_item->set_last ? set_item->set_last : G_MAXUINT;
+			if (range.first > range.last) {
+				guint tmp = range.first;
+
+				range.first = range.last;
+				range.last = tmp;
+			}
+			g_array_append_val(ranges, range);
+		}
+		mailimap_set_free(vanished);
+		g_array_sort(ranges, imap_uid_range_compare);
+	}
+
+	for (i = 0, v = 0; i < known->len; i++) {
+		guint uid = g_array_index(known, guint, i);
+
+		while (v < ranges->len
+		       && g_array_index(ranges, IMAPUidRange, v).last < uid)
+			v++;
+		if (v < ranges->len
+		    && g_array_index(ranges, IMAPUidRange, v).first <= uid)
+			continue;
+		uidlist = g_slist_prepend(uidlist, GUINT_TO_POINTER(uid));
+		nummsgs++;
+	}
+
+	g_hash_table_iter_init(&iter, flags_hash);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		guint uid = GPOINTER_TO_UINT(key);
+
+		if (bsearch(&uid, known->data, known->len, sizeof(guint),
+			    imap_uint_compare) == NULL) {
+			uidlist = g_slist_prepend(uidlist, key);
+			nummsgs++;
+		}
+	}
+
+	debug_print("get_list_of_changed_uids: %d known, %d changed, %d vanished "
+		    "ranges, %d now, %d exist\n", known->len,
+		    g_hash_table_size(flags_hash), ranges->len, nummsgs, exists);
+	g_array_free(known, TRUE);
+	g_array_free(ranges, TRUE);
+
+	/* the known list was not what the server had at item->modseq */
+	if (nummsgs != exists) {
+		g_slist_free(uidlist);
+		item->changed_flags = flags_hash;
+		item->changed_tags = tags_hash;
+		imap_forget_changed_flags(item);
+		return -1;
+	}
+
+	g_slist_free(item->uid_list);
+	item->uid_list = uidlist;
+
+	item->changed_flags = flags_hash;
+	item->changed_tags = tags_hash;
+
+	return nummsgs;
+}
+
+/* Fills item->uid_list with the UIDs in the mailbox */
+static gint get_list_of_uids(IMAPSession *session, Folder *folder, IMAPFolderItem *item)
 {
-	GSList *uidlist, *elem;
+	GSList *uidlist;
 	int r = -1;
 	clist * lep_uidlist;
-	gint ok, nummsgs = 0;
+	gint ok, nummsgs = 0, exists = 0;
 
 	if (session == NULL) {
 		return -1;
 	}
 
+	/* with QRESYNC, select again for a current HIGHESTMODSEQ */
 	ok = imap_select(session, IMAP_FOLDER(folder), FOLDER_ITEM(item),
-			 NULL, NULL, NULL, NULL, NULL, TRUE);
+			 session->qresync ? &exists : NULL, NULL, NULL, NULL, NULL, TRUE);
 	if (ok != MAILIMAP_NO_ERROR) {
 		return -1;
 	}
 
+	imap_forget_changed_flags(item);
+	item->pending_modseq = session->highestmodseq;
+	if (session->qresync) {
+		nummsgs = get_list_of_changed_uids(session, folder, item,
+						   exists);
+		if (nummsgs >= 0)
+			return nummsgs;
+		nummsgs = 0;
+	}
+
 	g_slist_free(item->uid_list);
 	item->uid_list = NULL;
 
@@ -4689,27 +5899,20 @@ static gint get_list_of_uids(IMAPSession *session, Folder *folder, IMAPFolderIte
 		return -1;
 	}
 
-	for (elem = uidlist; elem != NULL; elem = g_slist_next(elem)) {
-		guint msgnum;
-
-		msgnum = GPOINTER_TO_INT(elem->data);
-
-		*msgnum_list = g_slist_prepend(*msgnum_list, GINT_TO_POINTER(msgnum));
-		item->uid_list = g_slist_prepend(item->uid_list, GINT_TO_POINTER(msgnum));
-		nummsgs++;
-	}
-	g_slist_free(uidlist);
+	item->uid_list = uidlist;
+	nummsgs = g_slist_length(uidlist);
 
 	return nummsgs;
 
 }
 
-gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list, gboolean *old_uids_valid)
+/* Brings item->uid_list up to date with the server, and returns the
+ * number of UIDs in it, or -1 */
+static gint imap_scan_uid_list(Folder *folder, FolderItem *_item, gboolean *old_uids_valid)
 {
 	IMAPFolderItem *item = (IMAPFolderItem *)_item;
 	IMAPSession *session;
 	gint nummsgs;
-	GSList *uidlist = NULL;
 	gchar *dir;
 	gint known_list_len = 0;
 	gchar *path;
@@ -4728,7 +5931,6 @@ gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list,
 		*old_uids_valid = TRUE;
 		if (known_list_len == item->item.total_msgs
 		 && known_list_len > 0) {
-			*msgnum_list = g_slist_copy(item->uid_list);
 			return known_list_len;
 		} else {
 			debug_print("don't know the list length...\n");
@@ -4751,7 +5953,7 @@ gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list,
 	g_free(path);
 
 	debug_print("getting session...\n");
-	session = imap_session_get(folder);
+	session = imap_session_get_for(folder, _item);
 	g_return_val_if_fail(session != NULL, -1);
 
 	lock_session(session);
@@ -4770,6 +5972,7 @@ gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list,
 		item->lastuid = 0;
 		g_slist_free(item->uid_list);
 		item->uid_list = NULL;
+		item->modseq = 0;
 
 		imap_delete_all_cached_messages((FolderItem *)item);
 	} else {
@@ -4777,7 +5980,7 @@ gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list,
 		*old_uids_valid = TRUE;
 	}
 
-	nummsgs = get_list_of_uids(session, folder, item, &uidlist);
+	nummsgs = get_list_of_uids(session, folder, item);
 
 	unlock_session(session);
 
@@ -4790,13 +5993,15 @@ gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list,
 		return -1;
 	}
 
-	*msgnum_list = uidlist;
-
 	dir = folder_item_get_path((FolderItem *)item);
 	debug_print("removing old messages from %s\n", dir);
-	remove_numbered_files_not_in_list(dir, *msgnum_list);
+	remove_numbered_files_not_in_list(dir, item->uid_list);
 	g_free(dir);
 	
+	/* no flags to get, already in sync */
+	if (nummsgs == 0)
+		item->modseq = item->pending_modseq;
+
 	debug_print("get_num_list - ok - %i\n", nummsgs);
 	statusbar_pop_all();
 	item->should_trash_cache = FALSE;
@@ -4804,6 +6009,35 @@ gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list,
 	return nummsgs;
 }
 
+gint imap_get_num_list(Folder *folder, FolderItem *_item, GSList **msgnum_list, gboolean *old_uids_valid)
+{
+	gint nummsgs;
+
+	nummsgs = imap_scan_uid_list(folder, _item, old_uids_valid);
+	if (nummsgs >= 0)
+		*msgnum_list = g_slist_copy(IMAP_FOLDER_ITEM(_item)->uid_list);
+
+	return nummsgs;
+}
+
+static gint imap_get_num_array(Folder *folder, FolderItem *_item, GArray *array, gboolean *old_uids_valid)
+{
+	GSList *cur;
+	gint nummsgs;
+
+	nummsgs = imap_scan_uid_list(folder, _item, old_uids_valid);
+	if (nummsgs < 0)
+		return nummsgs;
+
+	for (cur = IMAP_FOLDER_ITEM(_item)->uid_list; cur != NULL; cur = cur->next) {
+		guint msgnum = GPOINTER_TO_UINT(cur->data);
+
+		g_array_append_val(array, msgnum);
+	}
+
+	return nummsgs;
+}
+
 static MsgInfo *imap_parse_msg(const gchar *file, FolderItem *item)
 {
 	MsgInfo *msginfo;
@@ -4844,7 +6078,7 @@ GSList *imap_get_msginfos(Folder *folder, FolderItem *item,
 	g_return_val_if_fail(msgnum_list != NULL, NULL);
 
 	debug_print("getting session...\n");
-	session = imap_session_get(folder);
+	session = imap_session_get_for(folder, item);
 	g_return_val_if_fail(session != NULL, NULL);
 
 	lock_session(session); /* unlocked later in the function */
@@ -4937,6 +6171,7 @@ gboolean imap_scan_required(Folder *folder, FolderItem *_item)
 	IMAPFolderItem *item = (IMAPFolderItem *)_item;
 	gint ok, exists = 0, unseen = 0;
 	guint32 uid_next = 0, uid_val = 0;
+	guint64 modseq = 0;
 	gboolean selected_folder;
 	
 	g_return_val_if_fail(folder != NULL, FALSE);
@@ -4952,7 +6187,7 @@ gboolean imap_scan_required(Folder *folder, FolderItem *_item)
 		return TRUE;
 	}
 	debug_print("getting session...\n");
-	session = imap_session_get(folder);
+	session = imap_session_get_for(folder, _item);
 	
 	g_return_val_if_fail(session != NULL, FALSE);
 	lock_session(session); /* unlocked later in the function */
@@ -4994,7 +6229,8 @@ gboolean imap_scan_required(Folder *folder, FolderItem *_item)
 		}
 	} else {
 		ok = imap_status(session, IMAP_FOLDER(folder), item->item.path, IMAP_FOLDER_ITEM(item),
-				 &exists, &uid_next, &uid_val, &unseen, FALSE);
+				 &exists, &uid_next, &uid_val, &unseen,
+				 session->qresync ? &modseq : NULL, FALSE);
 		if (ok != MAILIMAP_NO_ERROR) {
 			return FALSE;
 		}
@@ -5002,13 +6238,17 @@ gboolean imap_scan_required(Folder *folder, FolderItem *_item)
 		debug_print("exists %d, item->item.total_msgs %d\n"
 			    "\tunseen %d, item->item.unread_msgs %d\n"
 			    "\tuid_next %d, item->uid_next %d\n"
-			    "\tuid_val %d, item->item.mtime %ld\n",
+			    "\tuid_val %d, item->item.mtime %ld\n"
+			    "\tmodseq %" G_GUINT64_FORMAT ", item->modseq %" G_GUINT64_FORMAT "\n",
 			    exists, item->item.total_msgs, unseen, item->item.unread_msgs,
-			    uid_next, item->uid_next, uid_val, (long)(item->item.mtime));
+			    uid_next, item->uid_next, uid_val, (long)(item->item.mtime),
+			    modseq, item->modseq);
+		/* the modseq also tells about flags changed elsewhere */
 		if (exists != item->item.total_msgs
 		    || unseen != item->item.unread_msgs 
 		    || uid_next != item->uid_next
-		    || uid_val != item->item.mtime) {
+		    || uid_val != item->item.mtime
+		    || (modseq != 0 && modseq != item->modseq)) {
 			debug_print("CHANGED (status)! scan_required\n");
 			item->last_change = time(NULL);
 			item->should_update = TRUE;
@@ -5031,9 +6271,6 @@ void imap_change_flags(Folder *folder, FolderItem *item, MsgInfo *msginfo, MsgPe
 {
 	IMAPSession *session;
 	IMAPFlags flags_set = 0, flags_unset = 0;
-	gint ok = MAILIMAP_NO_ERROR;
-	MsgNumberList numlist;
-	hashtable_data *ht_data = NULL;
 
 	g_return_if_fail(folder != NULL);
 	g_return_if_fail(folder->klass == &imap_class);
@@ -5083,64 +6320,22 @@ void imap_change_flags(Folder *folder, FolderItem *item, MsgInfo *msginfo, MsgPe
 	}
 
 	debug_print("getting session...\n");
-	session = imap_session_get(folder);
+	session = imap_session_get_for(folder, item);
 	if (!session) {
 		return;
 	}
 
-	if ((ok = imap_select(session, IMAP_FOLDER(folder), msginfo->folder,
-	    NULL, NULL, NULL, NULL, NULL, FALSE)) != MAILIMAP_NO_ERROR) {
-		return;
-	}
-	numlist.next = NULL;
-	numlist.data = GINT_TO_POINTER(msginfo->msgnum);
-
-	if (IMAP_FOLDER_ITEM(item)->batching) {
-		/* instead of performing an UID STORE command for each message change,
-		 * as a lot of them can change "together", we just fill in hashtables
-		 * and defer the treatment so that we're able to send only one
-		 * command.
-		 */
-		debug_print("IMAP batch mode on, deferring flags change\n");
-		if (flags_set) {
-			ht_data = g_hash_table_lookup(IMAP_FOLDER_ITEM(item)->flags_set_table, 
-				GINT_TO_POINTER(flags_set));
-			if (ht_data == NULL) {
-				ht_data = g_new0(hashtable_data, 1);
-				ht_data->item = IMAP_FOLDER_ITEM(item);
-				g_hash_table_insert(IMAP_FOLDER_ITEM(item)->flags_set_table, 
-					GINT_TO_POINTER(flags_set), ht_data);
-			}
-			ht_data->msglist = g_slist_prepend(ht_data->msglist, GINT_TO_POINTER(msginfo->msgnum));
-		} 
-		if (flags_unset) {
-			ht_data = g_hash_table_lookup(IMAP_FOLDER_ITEM(item)->flags_unset_table, 
-				GINT_TO_POINTER(flags_unset));
-			if (ht_data == NULL) {
-				ht_data = g_new0(hashtable_data, 1);
-				ht_data->item = IMAP_FOLDER_ITEM(item);
-				g_hash_table_insert(IMAP_FOLDER_ITEM(item)->flags_unset_table, 
-					GINT_TO_POINTER(flags_unset), ht_data);
-			}
-			ht_data->msglist = g_slist_prepend(ht_data->msglist, 
-					GINT_TO_POINTER(msginfo->msgnum));		
-		}
-	} else {
-		debug_print("IMAP changing flags\n");
-		if (flags_set) {
-			ok = imap_set_message_flags(session, IMAP_FOLDER_ITEM(item), &numlist, flags_set, NULL, TRUE);
-			if (ok != MAILIMAP_NO_ERROR) {
-				return;
-			}
-		}
-
-		if (flags_unset) {
-			ok = imap_set_message_flags(session, IMAP_FOLDER_ITEM(item), &numlist, flags_unset, NULL, FALSE);
-			if (ok != MAILIMAP_NO_ERROR) {
-				return;
-			}
-		}
-	}
+	/* instead of performing an UID STORE command for each message change,
+	 * as a lot of them can change "together", we just queue them and
+	 * send them later in as few commands as possible. */
+	debug_print("IMAP %s, deferring flags change\n",
+		    IMAP_FOLDER_ITEM(item)->batching ? "batch mode on" : "queueing");
+	if (flags_set)
+		imap_pending_flags(IMAP_FOLDER_ITEM(item), msginfo->msgnum,
+				   flags_set, TRUE);
+	if (flags_unset)
+		imap_pending_flags(IMAP_FOLDER_ITEM(item), msginfo->msgnum,
+				   flags_unset, FALSE);
 	msginfo->flags.perm_flags = newflags;
 	return;
 }
@@ -5262,8 +6457,9 @@ static /*gint*/ void *imap_get_flags_thread(void *data)
 	gboolean selected_folder;
 	gint exists_cnt, unseen_cnt;
 	gboolean got_alien_tags = FALSE;
+	gboolean changes_only = FALSE;
 
-	session = imap_session_get(folder);
+	session = imap_session_get_for(folder, fitem);
 
 	if (session == NULL) {
 		stuff->done = TRUE;
@@ -5298,7 +6494,14 @@ static /*gint*/ void *imap_get_flags_thread(void *data)
 		seq_list = g_slist_append(NULL, set);
 	}
 
-	if (folder->account && folder->account->low_bandwidth) {
+	if (full_search && IMAP_FOLDER_ITEM(fitem)->changed_flags != NULL) {
+		/* the scan got the flags changed since the last one */
+		changes_only = TRUE;
+		flags_hash = IMAP_FOLDER_ITEM(fitem)->changed_flags;
+		tags_hash = IMAP_FOLDER_ITEM(fitem)->changed_tags;
+		IMAP_FOLDER_ITEM(fitem)->changed_flags = NULL;
+		IMAP_FOLDER_ITEM(fitem)->changed_tags = NULL;
+	} else if (folder->account && folder->account->low_bandwidth) {
 		for (cur = seq_list; cur != NULL; cur = g_slist_next(cur)) {
 			struct mailimap_set * imapset;
 			clist * lep_uidlist;
@@ -5417,8 +6620,15 @@ static /*gint*/ void *imap_get_flags_thread(void *data)
 	}
 
 bail:
-	if (r == MAILIMAP_NO_ERROR)
+	if (r == MAILIMAP_NO_ERROR) {
+		/* everything is known as of the select of the scan; the
+		 * low bandwidth searches don't get all the flags */
+		if (full_search && (changes_only || !folder->account
+				    || !folder->account->low_bandwidth))
+			IMAP_FOLDER_ITEM(fitem)->modseq =
+				IMAP_FOLDER_ITEM(fitem)->pending_modseq;
 		unlock_session(session);
+	}
 	
 	for (elem = sorted_list; elem != NULL; elem = g_slist_next(elem)) {
 		MsgInfo *msginfo;
@@ -5430,7 +6640,10 @@ bail:
 		wasnew = (flags & MSG_NEW);
 		oldflags = flags & ~(MSG_NEW|MSG_UNREAD|MSG_REPLIED|MSG_FORWARDED|MSG_MARKED|MSG_DELETED|MSG_SPAM);
 
-		if (folder->account && folder->account->low_bandwidth) {
+		if (changes_only && !g_hash_table_contains(flags_hash,
+					GUINT_TO_POINTER(msginfo->msgnum))) {
+			/* unchanged on the server */
+		} else if (!changes_only && folder->account && folder->account->low_bandwidth) {
 			if (fitem->opened || fitem->processing_pending || fitem == folder->inbox) {
 				flags &= ~((reverse_seen ? 0 : MSG_UNREAD | MSG_NEW) | MSG_REPLIED | MSG_FORWARDED | MSG_MARKED | MSG_SPAM);
 			} else {
@@ -5554,6 +6767,10 @@ static gint imap_get_flags(Folder *folder, FolderItem *item,
 		return -1;
 	}
 
+	/* do not read back flags we have not stored yet */
+	if (!IMAP_FOLDER_ITEM(item)->batching)
+		imap_flush_pending(IMAP_FOLDER_ITEM(item));
+
 	tmp = folder_item_get_msg_list(item);
 
 	if (g_slist_length(tmp) <= g_slist_length(msginfo_list))
@@ -5571,115 +6788,6 @@ static gint imap_get_flags(Folder *folder, FolderItem *item,
 
 }
 
-static gboolean process_flags(gpointer key, gpointer value, gpointer user_data)
-{
-	gboolean flags_set = GPOINTER_TO_INT(user_data);
-	gint flags_value = GPOINTER_TO_INT(key);
-	hashtable_data *data = (hashtable_data *)value;
-	IMAPFolderItem *_item = data->item;
-	FolderItem *item = (FolderItem *)_item;
-	gint ok = MAILIMAP_ERROR_BAD_STATE;
-	IMAPSession *session = NULL;
-	
-	debug_print("getting session...\n");
-	session = imap_session_get(item->folder);
-
-	data->msglist = g_slist_reverse(data->msglist);
-	
-	debug_print("IMAP %ssetting flags to %d for %d messages\n",
-		flags_set?"":"un",
-		flags_value,
-		g_slist_length(data->msglist));
-	
-	lock_session(session);
-	if (session) {
-		ok = imap_select(session, IMAP_FOLDER(item->folder), item,
-			 NULL, NULL, NULL, NULL, NULL, FALSE);
-	}
-	if (ok == MAILIMAP_NO_ERROR) {
-		ok = imap_set_message_flags(session, IMAP_FOLDER_ITEM(item),
-			data->msglist, flags_value, NULL, flags_set);
-	} else {
-		g_warning("can't select mailbox %s", item->path);
-	}
-
-	if (!is_fatal(ok))
-		unlock_session(session);
-
-	g_slist_free(data->msglist);	
-	g_free(data);
-	return TRUE;
-}
-
-static gboolean process_tags(gpointer key, gpointer value, gpointer user_data)
-{
-	gboolean tags_set = GPOINTER_TO_INT(user_data);
-	TagsData *data = (TagsData *)value;
-	IMAPFolderItem *_item = data->item;
-	FolderItem *item = (FolderItem *)_item;
-	gchar *str = data->str;
-	gint ok = MAILIMAP_ERROR_BAD_STATE;
-	IMAPSession *session = NULL;
-	
-	debug_print("getting session...\n");
-	session = imap_session_get(item->folder);
-
-	data->msglist = g_slist_reverse(data->msglist);
-	
-	debug_print("IMAP %ssetting tags %s for %d messages\n",
-		tags_set?"":"un",
-		str,
-		g_slist_length(data->msglist));
-	
-	lock_session(session);
-	if (session) {
-		ok = imap_select(session, IMAP_FOLDER(item->folder), item,
-			 NULL, NULL, NULL, NULL, NULL, FALSE);
-	}
-	if (ok == MAILIMAP_NO_ERROR) {
-		GSList list;
-		list.data = str;
-		list.next = NULL;
-		ok = imap_set_message_flags(session, IMAP_FOLDER_ITEM(item),
-			data->msglist, 0, &list, tags_set);
-	} else {
-		g_warning("can't select mailbox %s", item->path);
-	}
-
-	if (!is_fatal(ok))
-		unlock_session(session);
-
-	g_slist_free(data->msglist);	
-	g_free(data->str);
-	g_free(data);
-	return TRUE;
-}
-
-static void process_hashtable(IMAPFolderItem *item)
-{
-	if (item->flags_set_table) {
-		g_hash_table_foreach_remove(item->flags_set_table, process_flags, GINT_TO_POINTER(TRUE));
-		g_hash_table_destroy(item->flags_set_table);
-		item->flags_set_table = NULL;
-	}
-	if (item->flags_unset_table) {
-		g_hash_table_foreach_remove(item->flags_unset_table, process_flags, GINT_TO_POINTER(FALSE));
-		g_hash_table_destroy(item->flags_unset_table);
-		item->flags_unset_table = NULL;
-	}
-	if (item->tags_set_table) {
-		g_hash_table_foreach_remove(item->tags_set_table, process_tags, GINT_TO_POINTER(TRUE));
-		g_hash_table_destroy(item->tags_set_table);
-		item->tags_set_table = NULL;
-	}
-	if (item->tags_unset_table) {
-		g_hash_table_foreach_remove(item->tags_unset_table, process_tags, GINT_TO_POINTER(FALSE));
-		g_hash_table_destroy(item->tags_unset_table);
-		item->tags_unset_table = NULL;
-	}
-	
-}
-
 static void imap_set_batch (Folder *folder, FolderItem *_item, gboolean batch)
 {
 	IMAPFolderItem *item = (IMAPFolderItem *)_item;
@@ -5693,17 +6801,10 @@ static void imap_set_batch (Folder *folder, FolderItem *_item, gboolean batch)
 	if (batch) {
 		item->batching = TRUE;
 		debug_print("IMAP switching to batch mode\n");
-		if (!item->flags_set_table) {
-			item->flags_set_table = g_hash_table_new(NULL, g_direct_equal);
-		}
-		if (!item->flags_unset_table) {
-			item->flags_unset_table = g_hash_table_new(NULL, g_direct_equal);
-		}
-		if (!item->tags_set_table) {
-			item->tags_set_table = g_hash_table_new(NULL, g_direct_equal);
-		}
-		if (!item->tags_unset_table) {
-			item->tags_unset_table = g_hash_table_new(NULL, g_direct_equal);
+		/* the changes wait for the end of the batch */
+		if (item->flush_timer != 0) {
+			g_source_remove(item->flush_timer);
+			item->flush_timer = 0;
 		}
 		session = imap_session_get(folder);
 		if (session) {
@@ -5712,9 +6813,9 @@ static void imap_set_batch (Folder *folder, FolderItem *_item, gboolean batch)
 		}
 	} else {
 		debug_print("IMAP switching away from batch mode\n");
-		/* process stuff */
-		process_hashtable(item);
+		/* send the changes queued meanwhile */
 		item->batching = FALSE;
+		imap_flush_pending(item);
 		session = imap_session_get(folder);
 		if (session) {
 			session->sens_update_block = FALSE;
@@ -6110,11 +7211,38 @@ void imap_disconnect_all(gboolean have_connectivity)
 		PrefsAccount *account = list->data;
 		if (account->protocol == A_IMAP4) {
 			RemoteFolder *folder = (RemoteFolder *)account->folder;
-			if (folder && folder->session) {
-				if (imap_is_busy(FOLDER(folder)))
-					imap_threaded_cancel(FOLDER(folder));
+			GSList *pending, *cur;
+
+			if (folder == NULL)
+				continue;
+			/* the flag changes still queued would be lost */
+			if (have_connectivity && !imap_is_busy(FOLDER(folder))) {
+				pending = g_slist_copy(IMAP_FOLDER(folder)->pending_items);
+				for (cur = pending; cur != NULL; cur = cur->next)
+					imap_flush_pending((IMAPFolderItem *)cur->data);
+				g_slist_free(pending);
+			}
+			while (IMAP_FOLDER(folder)->pool != NULL) {
+				IMAPSession *session = IMAP_FOLDER(folder)->pool->data;
 
+				IMAP_FOLDER(folder)->pool = g_slist_remove(
+					IMAP_FOLDER(folder)->pool, session);
+				imap_session_use(session);
+				if (session->busy)
+					imap_threaded_cancel(FOLDER(folder));
+				if (have_connectivity)
+					imap_threaded_disconnect(FOLDER(folder));
+				SESSION(session)->state = SESSION_DISCONNECTED;
+				SESSION(session)->sock = NULL;
+				imap_safe_destroy(session);
+			}
+			imap_threaded_use_connection(FOLDER(folder), 0);
+			if (folder->session) {
 				IMAPSession *session = (IMAPSession *)folder->session;
+
+				if (session->busy)
+					imap_threaded_cancel(FOLDER(folder));
+
 				if (have_connectivity)
 					imap_threaded_disconnect(FOLDER(folder));
 				SESSION(session)->state = SESSION_DISCONNECTED;
@@ -6145,17 +7273,26 @@ void imap_cancel_all(void)
 		Folder *folder = (Folder *) cur->data;
 
 		if (folder->klass == &imap_class) {
-			if (imap_is_busy(folder)) {
-				IMAPSession *imap_session;
-				RemoteFolder *rfolder;
-				
+			RemoteFolder *rfolder = (RemoteFolder *) folder;
+			GSList *sessions, *elem;
+
+			sessions = g_slist_copy(IMAP_FOLDER(folder)->pool);
+			if (rfolder->session)
+				sessions = g_slist_prepend(sessions, rfolder->session);
+
+			for (elem = sessions; elem != NULL; elem = elem->next) {
+				IMAPSession *imap_session = elem->data;
+				gint slot = imap_threaded_get_connection(folder);
+
+				if (!imap_session->busy)
+					continue;
 				g_printerr("cancelled\n");
+				imap_session_use(imap_session);
 				imap_threaded_cancel(folder);
-				rfolder = (RemoteFolder *) folder;
-				imap_session = (IMAPSession *) rfolder->session;
-				if (imap_session)
-					imap_session->cancelled = 1;
+				imap_threaded_use_connection(folder, slot);
+				imap_session->cancelled = 1;
 			}
+			g_slist_free(sessions);
 		}
 	}
 }
@@ -6184,12 +7321,18 @@ static gboolean imap_is_busy(Folder *folder)
 	IMAPSession *imap_session;
 	RemoteFolder *rfolder;
 	
+	GSList *cur;
+	
 	rfolder = (RemoteFolder *) folder;
 	imap_session = (IMAPSession *) rfolder->session;
-	if (imap_session == NULL)
-		return FALSE;
+	if (imap_session != NULL && imap_session->busy)
+		return TRUE;
+
+	for (cur = IMAP_FOLDER(folder)->pool; cur != NULL; cur = cur->next)
+		if (IMAP_SESSION(cur->data)->busy)
+			return TRUE;
 	
-	return imap_session->busy;
+	return FALSE;
 }
 
 #else /* HAVE_LIBETPAN */
@@ -6279,6 +7422,10 @@ void imap_cache_msg(FolderItem *item, gint msgnum)
 {
 }
 
+void imap_prefetch(FolderItem *item, gint days)
+{
+}
+
 void imap_cancel_all(void)
 {
 }
@@ -6321,6 +7468,8 @@ static void imap_item_set_xml(Folder *folder, FolderItem *item, XMLTag *tag)
 			IMAP_FOLDER_ITEM(item)->last_sync = (time_t)atol(attr->value);
 		if (!strcmp(attr->name, "last_change"))
 			IMAP_FOLDER_ITEM(item)->last_change = (time_t)atol(attr->value);
+		if (!strcmp(attr->name, "modseq"))
+			IMAP_FOLDER_ITEM(item)->modseq = g_ascii_strtoull(attr->value, NULL, 10);
 	}
 	if (IMAP_FOLDER_ITEM(item)->last_change == 0)
 		IMAP_FOLDER_ITEM(item)->last_change = time(NULL);
@@ -6340,6 +7489,13 @@ static XMLTag *imap_item_get_xml(Folder *folder, FolderItem *item)
 			IMAP_FOLDER_ITEM(item)->last_sync));
 	xml_tag_add_attr(tag, xml_attr_new_time_t("last_change", 
 			IMAP_FOLDER_ITEM(item)->last_change));
+	if (IMAP_FOLDER_ITEM(item)->modseq != 0) {
+		gchar *modseq = g_strdup_printf("%" G_GUINT64_FORMAT,
+				IMAP_FOLDER_ITEM(item)->modseq);
+
+		xml_tag_add_attr(tag, xml_attr_new("modseq", modseq));
+		g_free(modseq);
+	}
 
 #endif
 	return tag;
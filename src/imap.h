@@ -39,6 +39,9 @@ typedef enum
 	IMAP_AUTH_SCRAM_SHA512	= 1 << 12,
 } IMAPAuthType;
 
+/* upper limit for the connections of an account */
+#define IMAP_MAX_CONNECTIONS	8
+
 FolderClass *imap_get_class		(void);
 guint imap_folder_get_refcnt(Folder *folder);
 void imap_folder_ref(Folder *folder);
@@ -48,6 +51,7 @@ void imap_disconnect_all(gboolean have_connectivity);
 gint imap_subscribe(Folder *folder, FolderItem *item, gchar *rpath, gboolean sub);
 GList *imap_scan_subtree(Folder *folder, FolderItem *item, gboolean unsubs_only, gboolean recursive);
 void imap_cache_msg(FolderItem *item, gint msgnum);
+void imap_prefetch(FolderItem *item, gint days);
 
 void imap_cancel_all(void);
 gboolean imap_cancel_all_enabled(void);
@@ -438,30 +438,7 @@ void imap_gtk_synchronise(FolderItem *item, gint days)
 	gtk_widget_set_sensitive(folderview->ctree, FALSE);
 	main_window_progress_on(mainwin);
 	GTK_EVENTS_FLUSH();
-	if (item->no_select == FALSE) {
-		GSList *mlist;
-		GSList *cur;
-		gint num = 0;
-		gint total = item->total_msgs;
-		time_t t = time(NULL);
-
-		mlist = folder_item_get_msg_list(item);
-		for (cur = mlist; cur != NULL; cur = cur->next) {
-			MsgInfo *msginfo = (MsgInfo *)cur->data;
-			gint age = (t - msginfo->date_t) / (60*60*24);
-			if (days == 0 || age <= days) {
-				imap_cache_msg(msginfo->folder, msginfo->msgnum);
-				folder_item_fetch_msg_full(msginfo->folder, msginfo->msgnum,
-							   TRUE, TRUE);
-			}
-			statusbar_progress_all(num++,total, 100);
-			if (num % 100 == 0)
-				GTK_EVENTS_FLUSH();
-		}
-
-		statusbar_progress_all(0,0,0);
-		procmsg_msg_list_free(mlist);
-	}
+	imap_prefetch(item, days);
 
 	folder_set_ui_func(item->folder, NULL, NULL);
 	main_window_progress_off(mainwin);
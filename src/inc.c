@@ -95,7 +95,8 @@ static void inc_progress_dialog_destroy	(IncProgressDialog	*inc_dialog);
 static IncSession *inc_session_new	(PrefsAccount		*account);
 static void inc_session_destroy		(IncSession		*session);
 static gint inc_start			(IncProgressDialog	*inc_dialog);
-static IncState inc_pop3_session_do	(IncSession		*session);
+static gboolean inc_pop3_session_start	(IncSession		*session);
+static IncState inc_pop3_session_finish	(IncSession		*session);
 
 static void inc_progress_dialog_update	(IncProgressDialog	*inc_dialog,
 					 IncSession		*inc_session);
@@ -514,7 +515,7 @@ static IncProgressDialog *inc_progress_dialog_create(gboolean autocheck)
 	dialog->progress_tv = g_date_time_new_now_local();
 	dialog->folder_tv = g_date_time_new_now_local();
 	dialog->queue_list = NULL;
-	dialog->cur_row = 0;
+	dialog->cancelled = FALSE;
 
 	inc_dialog_list = g_list_append(inc_dialog_list, dialog);
 
@@ -524,12 +525,14 @@ static IncProgressDialog *inc_progress_dialog_create(gboolean autocheck)
 static void inc_progress_dialog_set_list(IncProgressDialog *inc_dialog)
 {
 	GList *list;
+	gint row = 0;
 
 	for (list = inc_dialog->queue_list; list != NULL; list = list->next) {
 		IncSession *session = list->data;
 		Pop3Session *pop3_session = POP3_SESSION(session->session);
 
 		session->data = inc_dialog;
+		session->row = row++;
 
 		progress_dialog_list_set(inc_dialog->dialog,
 					 -1, NULL,
@@ -621,6 +624,8 @@ static gint inc_start(IncProgressDialog *inc_dialog)
 	gchar *fin_msg;
 	FolderItem *processing, *inbox;
 	GSList *msglist, *msglist_element;
+	GList *pending, *running = NULL;
+	guint max_running;
 	gboolean cancelled = FALSE;
 
 	qlist = inc_dialog->queue_list;
@@ -671,150 +676,213 @@ static gint inc_start(IncProgressDialog *inc_dialog)
 #define SET_PIXMAP_AND_TEXT(pix, str)					   \
 {									   \
 	progress_dialog_list_set(inc_dialog->dialog,			   \
-				 inc_dialog->cur_row,			   \
+				 session->row,				   \
 				 pix,					   \
 				 NULL,					   \
 				 str);					   \
 }
 
-	for (; inc_dialog->queue_list != NULL && !cancelled; inc_dialog->cur_row++) {
-		session = inc_dialog->queue_list->data;
-		pop3_session = POP3_SESSION(session->session);
+	/* several accounts are checked at once, but what they received
+	 * is filtered one account after the other; once cancelled, the
+	 * sessions still running are stopped and what they got is filed
+	 * the same way */
+	max_running = MAX(prefs_common.recv_max_parallel, 1);
+	pending = g_list_copy(inc_dialog->queue_list);
+
+	while ((pending != NULL && !cancelled && !inc_dialog->cancelled) ||
+	       running != NULL) {
+		GList *cur, *next;
 		GSList *filtered, *unfiltered;
 
-		if (pop3_session->pass == NULL) {
-			SET_PIXMAP_AND_TEXT(okpix, _("Cancelled"));
-			inc_dialog->queue_list =
-				g_list_remove(inc_dialog->queue_list, session);
-			inc_session_destroy(session);
-			continue;
+		while (!cancelled && !inc_dialog->cancelled && pending != NULL &&
+		       g_list_length(running) < max_running) {
+			session = pending->data;
+			pending = g_list_delete_link(pending, pending);
+			pop3_session = POP3_SESSION(session->session);
+
+			if (pop3_session->pass == NULL) {
+				SET_PIXMAP_AND_TEXT(okpix, _("Cancelled"));
+				inc_dialog->queue_list =
+					g_list_remove(inc_dialog->queue_list, session);
+				inc_session_destroy(session);
+				continue;
+			}
+
+			if (running == NULL)
+				inc_progress_dialog_clear(inc_dialog);
+			progress_dialog_scroll_to_row(inc_dialog->dialog,
+						      session->row);
+
+			SET_PIXMAP_AND_TEXT(currentpix, _("Retrieving"));
+
+			/* begin POP3 session */
+			session->started = TRUE;
+			inc_pop3_session_start(session);
+			running = g_list_append(running, session);
 		}
 
-		inc_progress_dialog_clear(inc_dialog);
-		progress_dialog_scroll_to_row(inc_dialog->dialog,
-					      inc_dialog->cur_row);
-
-		SET_PIXMAP_AND_TEXT(currentpix, _("Retrieving"));
-
-		/* begin POP3 session */
-		inc_state = inc_pop3_session_do(session);
-
-		switch (inc_state) {
-		case INC_SUCCESS:
-			if (pop3_session->cur_total_num > 0)
-				msg = g_strdup_printf(
-					ngettext("Done (%d message (%s) received)",
-						 "Done (%d messages (%s) received)",
-					 pop3_session->cur_total_num),
-					 pop3_session->cur_total_num,
-					 to_human_readable((goffset)pop3_session->cur_total_recv_bytes));
-			else
-				msg = g_strdup_printf(_("Done (no new messages)"));
-			SET_PIXMAP_AND_TEXT(okpix, msg);
-			g_free(msg);
-			break;
-		case INC_CONNECT_ERROR:
-			SET_PIXMAP_AND_TEXT(errorpix, _("Connection failed"));
-			break;
-		case INC_AUTH_FAILED:
-			SET_PIXMAP_AND_TEXT(errorpix, _("Auth failed"));
-			if (pop3_session->ac_prefs->session_passwd) {
-				g_free(pop3_session->ac_prefs->session_passwd);
-				pop3_session->ac_prefs->session_passwd = NULL;
+		if (running == NULL)
+			continue;
+
+		/* wait for one of them to end */
+		for (;;) {
+			for (cur = running; cur != NULL; cur = cur->next) {
+				session = cur->data;
+				if (!session_is_running(session->session) ||
+				    session->inc_state == INC_CANCEL)
+					break;
 			}
-			break;
-		case INC_LOCKED:
-			SET_PIXMAP_AND_TEXT(errorpix, _("Locked"));
-			break;
-		case INC_ERROR:
-		case INC_NO_SPACE:
-		case INC_IO_ERROR:
-		case INC_SOCKET_ERROR:
-		case INC_EOF:
-			SET_PIXMAP_AND_TEXT(errorpix, _("Error"));
-			break;
-		case INC_TIMEOUT:
-			SET_PIXMAP_AND_TEXT(errorpix, _("Timeout"));
-			break;
-		case INC_CANCEL:
-			SET_PIXMAP_AND_TEXT(okpix, _("Cancelled"));
-			if (!inc_dialog->show_dialog)
-				cancelled = TRUE;
-			break;
-		default:
-			break;
+			if (cur != NULL)
+				break;
+			gtk_main_iteration();
 		}
-		
-		if (pop3_session->error_val == PS_AUTHFAIL) {
-			if(prefs_common.show_recv_err_dialog) {
-				if((prefs_common.recv_dialog_mode == RECV_DIALOG_ALWAYS) ||
-				    ((prefs_common.recv_dialog_mode == RECV_DIALOG_MANUAL) && focus_window))
-					manage_window_focus_in(inc_dialog->dialog->window, NULL, NULL);
+
+		for (cur = running; cur != NULL; cur = next) {
+			next = cur->next;
+			session = cur->data;
+			pop3_session = POP3_SESSION(session->session);
+
+			if (session_is_running(session->session) &&
+			    session->inc_state != INC_CANCEL)
+				continue;
+
+			running = g_list_delete_link(running, cur);
+			inc_state = inc_pop3_session_finish(session);
+
+			switch (inc_state) {
+			case INC_SUCCESS:
+				if (pop3_session->cur_total_num > 0)
+					msg = g_strdup_printf(
+						ngettext("Done (%d message (%s) received)",
+							 "Done (%d messages (%s) received)",
+						 pop3_session->cur_total_num),
+						 pop3_session->cur_total_num,
+						 to_human_readable((goffset)pop3_session->cur_total_recv_bytes));
+				else
+					msg = g_strdup_printf(_("Done (no new messages)"));
+				SET_PIXMAP_AND_TEXT(okpix, msg);
+				g_free(msg);
+				break;
+			case INC_CONNECT_ERROR:
+				SET_PIXMAP_AND_TEXT(errorpix, _("Connection failed"));
+				break;
+			case INC_AUTH_FAILED:
+				SET_PIXMAP_AND_TEXT(errorpix, _("Auth failed"));
+				if (pop3_session->ac_prefs->session_passwd) {
+					g_free(pop3_session->ac_prefs->session_passwd);
+					pop3_session->ac_prefs->session_passwd = NULL;
+				}
+				break;
+			case INC_LOCKED:
+				SET_PIXMAP_AND_TEXT(errorpix, _("Locked"));
+				break;
+			case INC_ERROR:
+			case INC_NO_SPACE:
+			case INC_IO_ERROR:
+			case INC_SOCKET_ERROR:
+			case INC_EOF:
+				SET_PIXMAP_AND_TEXT(errorpix, _("Error"));
+				break;
+			case INC_TIMEOUT:
+				SET_PIXMAP_AND_TEXT(errorpix, _("Timeout"));
+				break;
+			case INC_CANCEL:
+				SET_PIXMAP_AND_TEXT(okpix, _("Cancelled"));
+				if (!inc_dialog->show_dialog)
+					cancelled = TRUE;
+				break;
+			default:
+				break;
+			}
+
+			if (pop3_session->error_val == PS_AUTHFAIL) {
+				if(prefs_common.show_recv_err_dialog) {
+					if((prefs_common.recv_dialog_mode == RECV_DIALOG_ALWAYS) ||
+					    ((prefs_common.recv_dialog_mode == RECV_DIALOG_MANUAL) && focus_window))
+						manage_window_focus_in(inc_dialog->dialog->window, NULL, NULL);
+				}
 			}
-		}
 
-		/* CLAWS: perform filtering actions on dropped message */
-		/* CLAWS: get default inbox (perhaps per account) */
-		if (pop3_session->ac_prefs->inbox) {
-			/* CLAWS: get destination folder / mailbox */
-			inbox = folder_find_item_from_identifier(pop3_session->ac_prefs->inbox);
-			if (!inbox)
+			/* CLAWS: perform filtering actions on dropped message */
+			/* CLAWS: get default inbox (perhaps per account) */
+			if (pop3_session->ac_prefs->inbox) {
+				/* CLAWS: get destination folder / mailbox */
+				inbox = folder_find_item_from_identifier(pop3_session->ac_prefs->inbox);
+				if (!inbox)
+					inbox = folder_get_default_inbox();
+			} else
 				inbox = folder_get_default_inbox();
-		} else
-			inbox = folder_get_default_inbox();
 
-		/* get list of messages in processing */
-		processing = folder_get_default_processing(pop3_session->ac_prefs->account_id);
-		folder_item_scan(processing);
-		msglist = folder_item_get_msg_list(processing);
+			/* get list of messages in processing */
+			processing = folder_get_default_processing(pop3_session->ac_prefs->account_id);
+			folder_item_scan(processing);
+			msglist = folder_item_get_msg_list(processing);
 
-		/* process messages */
-		folder_item_update_freeze();
-		
-		procmsg_msglist_filter(msglist, pop3_session->ac_prefs, 
-				&filtered, &unfiltered, 
-				pop3_session->ac_prefs->filter_on_recv);
+			/* process messages */
+			folder_item_update_freeze();
 
-		filtering_move_and_copy_msgs(msglist);
-		if (unfiltered != NULL)		
-			folder_item_move_msgs(inbox, unfiltered);
+			procmsg_msglist_filter(msglist, pop3_session->ac_prefs, 
+					&filtered, &unfiltered, 
+					pop3_session->ac_prefs->filter_on_recv);
 
-		for(msglist_element = msglist; msglist_element != NULL; 
-		    msglist_element = msglist_element->next) {
-			procmsg_msginfo_free((MsgInfo**)&(msglist_element->data));
-		}
-		folder_item_update_thaw();
-		
-		g_slist_free(msglist);
-		g_slist_free(filtered);
-		g_slist_free(unfiltered);
+			filtering_move_and_copy_msgs(msglist);
+			if (unfiltered != NULL)		
+				folder_item_move_msgs(inbox, unfiltered);
 
-		statusbar_pop_all();
+			for(msglist_element = msglist; msglist_element != NULL; 
+			    msglist_element = msglist_element->next) {
+				procmsg_msginfo_free((MsgInfo**)&(msglist_element->data));
+			}
+			folder_item_update_thaw();
+
+			g_slist_free(msglist);
+			g_slist_free(filtered);
+			g_slist_free(unfiltered);
+
+			statusbar_pop_all();
+
+			new_msgs += pop3_session->cur_total_num;
+
+			pop3_write_uidl_list(pop3_session);
+
+			if (inc_state != INC_SUCCESS && inc_state != INC_CANCEL) {
+				error_num++;
+				if (inc_dialog->show_dialog)
+					manage_window_focus_in
+						(inc_dialog->dialog->window,
+						 NULL, NULL);
+				inc_put_error(inc_state, pop3_session);
+				if (inc_dialog->show_dialog)
+					manage_window_focus_out
+						(inc_dialog->dialog->window,
+						 NULL, NULL);
+				if (inc_state == INC_NO_SPACE ||
+				    inc_state == INC_IO_ERROR)
+					cancelled = TRUE;
+			}
+			folder_item_free_cache(processing, TRUE);
 
-		new_msgs += pop3_session->cur_total_num;
-
-		pop3_write_uidl_list(pop3_session);
-
-		if (inc_state != INC_SUCCESS && inc_state != INC_CANCEL) {
-			error_num++;
-			if (inc_dialog->show_dialog)
-				manage_window_focus_in
-					(inc_dialog->dialog->window,
-					 NULL, NULL);
-			inc_put_error(inc_state, pop3_session);
-			if (inc_dialog->show_dialog)
-				manage_window_focus_out
-					(inc_dialog->dialog->window,
-					 NULL, NULL);
-			if (inc_state == INC_NO_SPACE ||
-			    inc_state == INC_IO_ERROR)
-				break;
+			inc_session_destroy(session);
+			inc_dialog->queue_list =
+				g_list_remove(inc_dialog->queue_list, session);
+
+			if (cancelled) {
+				GList *other;
+
+				for (other = running; other != NULL;
+				     other = other->next) {
+					IncSession *running_session = other->data;
+
+					if (session_is_running(running_session->session))
+						running_session->inc_state = INC_CANCEL;
+				}
+			}
 		}
-		folder_item_free_cache(processing, TRUE);
+	}
 
-		inc_session_destroy(session);
-		inc_dialog->queue_list =
-			g_list_remove(inc_dialog->queue_list, session);
+	for (; pending != NULL; pending = g_list_delete_link(pending, pending)) {
+		session = pending->data;
+		SET_PIXMAP_AND_TEXT(okpix, _("Cancelled"));
 	}
 
 #undef SET_PIXMAP_AND_TEXT
@@ -851,7 +919,7 @@ static gint inc_start(IncProgressDialog *inc_dialog)
 	return new_msgs;
 }
 
-static IncState inc_pop3_session_do(IncSession *session)
+static gboolean inc_pop3_session_start(IncSession *session)
 {
 	Pop3Session *pop3_session = POP3_SESSION(session->session);
 	IncProgressDialog *inc_dialog = (IncProgressDialog *)session->data;
@@ -891,8 +959,10 @@ static IncState inc_pop3_session_do(IncSession *session)
 			  "server? The communication would not be "
 			  "secure."),
 			NULL, _("_Cancel"), NULL, _("Con_tinue connecting"), NULL, NULL,
-			ALERTFOCUS_FIRST, FALSE, NULL, ALERT_WARNING) != G_ALERTALTERNATE)
-			return INC_CANCEL;
+			ALERTFOCUS_FIRST, FALSE, NULL, ALERT_WARNING) != G_ALERTALTERNATE) {
+			session->inc_state = INC_CANCEL;
+			return FALSE;
+		}
 	}
 #endif
 
@@ -939,12 +1009,17 @@ static IncState inc_pop3_session_do(IncSession *session)
 		}
 		session->inc_state = INC_CONNECT_ERROR;
 		statusbar_pop_all();
-		return INC_CONNECT_ERROR;
+		return FALSE;
 	}
 
-	while (session_is_running(SESSION(pop3_session)) &&
-	       session->inc_state != INC_CANCEL)
-		gtk_main_iteration();
+	return TRUE;
+}
+
+/* Called once the session started by inc_pop3_session_start() ended or
+ * was cancelled, returns how it went */
+static IncState inc_pop3_session_finish(IncSession *session)
+{
+	Pop3Session *pop3_session = POP3_SESSION(session->session);
 
 	if (session->inc_state == INC_SUCCESS) {
 		switch (pop3_session->error_val) {
@@ -1054,28 +1129,42 @@ static void inc_progress_dialog_set_progress(IncProgressDialog *inc_dialog,
 	gchar buf[MESSAGEBUFSIZE];
 	Pop3Session *pop3_session = POP3_SESSION(inc_session->session);
 	gchar *total_size_str;
-	gint cur_total;
-	gint total;
+	GList *cur;
+	goffset cur_total = 0;
+	goffset total = 0;
+	gint cur_msg = 0, count = 0;
 
 	if (!pop3_session->new_msg_exist) return;
 
-	cur_total = inc_session->cur_total_bytes;
-	total = pop3_session->total_bytes;
+	/* the accounts being checked at once share the progress bar, so
+	 * it shows where all of them are */
+	for (cur = inc_dialog->queue_list; cur != NULL; cur = cur->next) {
+		IncSession *session = cur->data;
+		Pop3Session *pop3 = POP3_SESSION(session->session);
+
+		if (!session->started || !pop3->new_msg_exist)
+			continue;
+		cur_total += session->cur_total_bytes;
+		total += pop3->total_bytes;
+		cur_msg += pop3->cur_msg;
+		count += pop3->count;
+	}
+
 	if (pop3_session->state == POP3_RETR ||
 	    pop3_session->state == POP3_RETR_RECV ||
 	    pop3_session->state == POP3_DELETE) {
-		Xstrdup_a(total_size_str, to_human_readable((goffset)total), return);
+		Xstrdup_a(total_size_str, to_human_readable(total), return);
 		g_snprintf(buf, sizeof(buf),
 			   _("Retrieving message (%d / %d) (%s / %s)"),
-			   pop3_session->cur_msg, pop3_session->count,
-			   to_human_readable((goffset)cur_total), total_size_str);
+			   cur_msg, count,
+			   to_human_readable(cur_total), total_size_str);
 		progress_dialog_set_label(inc_dialog->dialog, buf);
 	}
 
 	progress_dialog_set_fraction
 		(inc_dialog->dialog, (total == 0) ? 0: (gfloat)cur_total / (gfloat)total);
 
-	statusbar_progress_all(pop3_session->cur_msg, pop3_session->count, 1);
+	statusbar_progress_all(cur_msg, count, 1);
 
 	if (pop3_session->cur_total_num > 0) {
 		g_snprintf(buf, sizeof(buf),
@@ -1086,7 +1175,7 @@ static void inc_progress_dialog_set_progress(IncProgressDialog *inc_dialog,
 			   to_human_readable
 			   ((goffset)pop3_session->cur_total_recv_bytes));
 		progress_dialog_list_set_status(inc_dialog->dialog,
-						inc_dialog->cur_row,
+						inc_session->row,
 						buf);
 	}
 }
@@ -1328,7 +1417,7 @@ static void inc_put_error(IncState istate, Pop3Session *session)
 
 static void inc_cancel(IncProgressDialog *dialog)
 {
-	IncSession *session;
+	GList *cur;
 
 	cm_return_if_fail(dialog != NULL);
 
@@ -1337,9 +1426,14 @@ static void inc_cancel(IncProgressDialog *dialog)
 		return;
 	}
 
-	session = dialog->queue_list->data;
+	/* the accounts not started yet are skipped by inc_start() */
+	dialog->cancelled = TRUE;
+	for (cur = dialog->queue_list; cur != NULL; cur = cur->next) {
+		IncSession *session = cur->data;
 
-	session->inc_state = INC_CANCEL;
+		if (session->started)
+			session->inc_state = INC_CANCEL;
+	}
 
 	log_message(LOG_PROTOCOL, _("Incorporation cancelled\n"));
 }
@@ -62,13 +62,15 @@ struct _IncProgressDialog
 	GDateTime *folder_tv;
 
 	GList *queue_list;	/* list of IncSession */
-	gint cur_row;
+	gboolean cancelled;	/* no more sessions are started */
 };
 
 struct _IncSession
 {
 	Session *session;
 	IncState inc_state;
+	gboolean started;
+	gint row;		/* in the progress dialog list */
 
 	gint cur_total_bytes;
 
@@ -27,9 +27,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
-
-#ifdef USE_PTHREAD
-#include <pthread.h>
+#ifndef G_OS_WIN32
+#include <signal.h>
 #endif
 
 #include "defs.h"
@@ -48,6 +47,7 @@
 #include "folder_item_prefs.h"
 #include "procmsg.h"
 #include "file-utils.h"
+#include "string_match.h"
 
 /*!
  *\brief	Keyword lookup element
@@ -651,28 +651,300 @@ static gboolean matcherprop_header_line_match(MatcherProp *prop, const gchar *hd
 	return res;
 }
 
-#ifdef USE_PTHREAD
-typedef struct _thread_data {
-	const gchar *cmd;
+/* an external "test" command, possibly shared by the rules of a
+ * filtering run that test the same message with the same command */
+typedef struct _MatcherTest {
+	gchar *key;		/* folder, msgnum and cmd */
+	gchar *cmd;
+	GPid pid;
+	gboolean started;
 	gboolean done;
-} thread_data;
-#endif
+	gboolean orphan;	/* forgotten while running, freed when done */
+	gint status;		/* wait status, -1 if it couldn't run */
+	guint timeout_id;
+} MatcherTest;
+
+/* seconds before giving up on a test command */
+#define MATCHER_TEST_TIMEOUT	30
+
+static GHashTable *matcher_tests = NULL;	/* key -> MatcherTest */
+static gint matcher_tests_depth = 0;
+static GQueue matcher_tests_pending = G_QUEUE_INIT;
+static guint matcher_tests_running = 0;
+
+static void matcher_test_free(MatcherTest *test)
+{
+	g_free(test->key);
+	g_free(test->cmd);
+	g_free(test);
+}
+
+static void matcher_test_start_pending(void);
+
+static void matcher_test_finish(MatcherTest *test, gint status)
+{
+	if (test->timeout_id != 0) {
+		g_source_remove(test->timeout_id);
+		test->timeout_id = 0;
+	}
+	if (!test->done) {
+		test->status = status;
+		test->done = TRUE;
+	}
+}
+
+#ifndef G_OS_WIN32
+static void matcher_test_exited(GPid pid, gint status, gpointer data)
+{
+	MatcherTest *test = (MatcherTest *)data;
+
+	g_spawn_close_pid(pid);
+	matcher_test_finish(test, status);
+	test->pid = 0;
+	matcher_tests_running--;
+	debug_print("test command exited with status %d: %s\n", status, test->cmd);
+
+	if (test->orphan)
+		matcher_test_free(test);
+	matcher_test_start_pending();
+}
 
-#ifdef USE_PTHREAD
-static void *matcher_test_thread(void *data)
+static gboolean matcher_test_timeout(gpointer data)
 {
-	thread_data *td = (thread_data *)data;
-	int result = -1;
+	MatcherTest *test = (MatcherTest *)data;
 
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+	g_warning("test command still running after %d seconds, giving up: %s",
+		  MATCHER_TEST_TIMEOUT, test->cmd);
+	test->timeout_id = 0;
+	matcher_test_finish(test, -1);
+	/* reaped by matcher_test_exited() */
+	kill(test->pid, SIGTERM);
 
-	result = system(td->cmd);
-	td->done = TRUE; /* let the caller thread join() */
-	return GINT_TO_POINTER(result);
+	return FALSE;
 }
 #endif
 
+static void matcher_test_spawn(MatcherTest *test)
+{
+#ifndef G_OS_WIN32
+	gchar *argv[4];
+	GError *error = NULL;
+
+	test->started = TRUE;
+
+	/* debug output */
+	if (debug_filtering_session
+			&& prefs_common.filtering_debug_level >= FILTERING_DEBUG_LEVEL_HIGH) {
+		log_print(LOG_DEBUG_FILTERING,
+				"starting command [ %s ]\n",
+				test->cmd);
+	}
+
+	/* the command line is run as system() runs it, as before the
+	 * tests were run in parallel: by /bin/sh -c, so that the quoting,
+	 * redirections and pipes of existing rules work the same, with
+	 * stdin and the descriptors inherited, and 0 meaning a match */
+	argv[0] = "/bin/sh";
+	argv[1] = "-c";
+	argv[2] = test->cmd;
+	argv[3] = NULL;
+
+	if (!g_spawn_async(NULL, argv, NULL,
+			   G_SPAWN_DO_NOT_REAP_CHILD |
+			   G_SPAWN_CHILD_INHERITS_STDIN |
+			   G_SPAWN_LEAVE_DESCRIPTORS_OPEN,
+			   NULL, NULL, &test->pid, &error)) {
+		g_warning("couldn't execute test command: %s", error->message);
+		g_error_free(error);
+		matcher_test_finish(test, -1);
+		return;
+	}
+
+	matcher_tests_running++;
+	g_child_watch_add(test->pid, matcher_test_exited, test);
+	test->timeout_id = g_timeout_add_seconds(MATCHER_TEST_TIMEOUT,
+						 matcher_test_timeout, test);
+#else
+	test->started = TRUE;
+	matcher_test_finish(test, system(test->cmd));
+#endif
+}
+
+static void matcher_test_start_pending(void)
+{
+	guint max_running = MAX(g_get_num_processors(), 2);
+	MatcherTest *test;
+
+	while (matcher_tests_running < max_running &&
+	       (test = g_queue_pop_head(&matcher_tests_pending)) != NULL)
+		matcher_test_spawn(test);
+}
+
+/* the test of a message by a command, shared within a filtering run */
+static MatcherTest *matcher_test_get(const MatcherProp *prop, MsgInfo *info,
+				     gboolean *shared)
+{
+	MatcherTest *test;
+	gchar *file;
+	gchar *cmd, *key;
+
+	file = procmsg_get_message_file(info);
+	if (file == NULL)
+		return NULL;
+	g_free(file);
+
+	cmd = matching_build_command(prop->expr, info);
+	if (cmd == NULL)
+		return NULL;
+
+	/* a command without %-substitutions is the same for every
+	 * message, its result is not */
+	key = g_strdup_printf("%p %d %s", info->folder, info->msgnum, cmd);
+	*shared = matcher_tests != NULL;
+	if (matcher_tests != NULL) {
+		test = g_hash_table_lookup(matcher_tests, key);
+		if (test != NULL) {
+			g_free(key);
+			g_free(cmd);
+			return test;
+		}
+	}
+
+	test = g_new0(MatcherTest, 1);
+	test->key = key;
+	test->cmd = cmd;
+	if (matcher_tests != NULL)
+		g_hash_table_insert(matcher_tests, test->key, test);
+
+	return test;
+}
+
+/*!
+ *\brief	Check if a rule has "test" conditions
+ *
+ *\param	matchers Conditions of a rule
+ *
+ *\return	gboolean TRUE if running the rule may run a command
+ */
+gboolean matcherlist_has_test(MatcherList *matchers)
+{
+	GSList *l;
+
+	if (matchers == NULL)
+		return FALSE;
+
+	for (l = matchers->matchers; l != NULL; l = g_slist_next(l)) {
+		MatcherProp *prop = (MatcherProp *)l->data;
+
+		if (prop->criteria == MATCHCRITERIA_TEST ||
+		    prop->criteria == MATCHCRITERIA_NOT_TEST)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*!
+ *\brief	Start the "test" conditions of a rule on a message ahead,
+ *		so that they run in parallel, if the other conditions
+ *		leave the result to them. Only between
+ *		\ref matcher_tests_begin and \ref matcher_tests_end
+ *
+ *\param	matchers Conditions of a rule
+ *\param	info Message the rule is about to be tried on
+ *\param	cache Cache created for \a info with
+ *		\ref matcher_msg_cache_new
+ *
+ *\return	gboolean FALSE if the rule cannot match the message
+ */
+gboolean matcherlist_start_tests(MatcherList *matchers, MsgInfo *info,
+				 MatcherMsgCache *cache)
+{
+	MatcherList others;
+	GSList *tests = NULL, *l;
+	gboolean result;
+
+	if (matchers == NULL)
+		return FALSE;
+
+	others.matchers = NULL;
+	others.bool_and = matchers->bool_and;
+	for (l = matchers->matchers; l != NULL; l = g_slist_next(l)) {
+		MatcherProp *prop = (MatcherProp *)l->data;
+
+		if (prop->criteria == MATCHCRITERIA_TEST ||
+		    prop->criteria == MATCHCRITERIA_NOT_TEST)
+			tests = g_slist_prepend(tests, prop);
+		else
+			others.matchers = g_slist_prepend(others.matchers, prop);
+	}
+	others.matchers = g_slist_reverse(others.matchers);
+	tests = g_slist_reverse(tests);
+	if (tests == NULL) {
+		g_slist_free(others.matchers);
+		return TRUE;
+	}
+
+	/* the tests are only needed when all the other conditions match,
+	 * or none of them for rules matching any condition */
+	result = matcherlist_match_cached(&others, info, cache);
+	g_slist_free(others.matchers);
+	if (result != matchers->bool_and) {
+		g_slist_free(tests);
+		return result;
+	}
+
+	for (l = tests; matcher_tests != NULL && l != NULL; l = g_slist_next(l)) {
+		MatcherTest *test;
+		gboolean shared;
+
+		test = matcher_test_get((MatcherProp *)l->data, info, &shared);
+		if (test != NULL && !test->started && !test->done &&
+		    !g_queue_find(&matcher_tests_pending, test))
+			g_queue_push_tail(&matcher_tests_pending, test);
+	}
+	g_slist_free(tests);
+	matcher_test_start_pending();
+
+	return TRUE;
+}
+
+/*!
+ *\brief	Share the results of "test" conditions until
+ *		\ref matcher_tests_end. Calls can be nested
+ */
+void matcher_tests_begin(void)
+{
+	if (matcher_tests_depth++ == 0)
+		matcher_tests = g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+static gboolean matcher_tests_forget(gpointer key, gpointer value,
+				     gpointer data)
+{
+	MatcherTest *test = (MatcherTest *)value;
+
+	g_queue_remove(&matcher_tests_pending, test);
+	if (test->pid != 0)
+		test->orphan = TRUE;
+	else
+		matcher_test_free(test);
+
+	return TRUE;
+}
+
+void matcher_tests_end(void)
+{
+	cm_return_if_fail(matcher_tests_depth > 0);
+
+	if (--matcher_tests_depth > 0)
+		return;
+
+	g_hash_table_foreach_remove(matcher_tests, matcher_tests_forget, NULL);
+	g_hash_table_destroy(matcher_tests);
+	matcher_tests = NULL;
+}
+
 /*!
  *\brief	Execute a command defined in the matcher structure
  *
@@ -684,87 +956,357 @@ static void *matcher_test_thread(void *data)
 static gboolean matcherprop_match_test(const MatcherProp *prop, 
 					  MsgInfo *info)
 {
-	gchar *file;
-	gchar *cmd;
+	MatcherTest *test;
+	gboolean shared = FALSE;
 	gint retval;
-#ifdef USE_PTHREAD
-	pthread_t pt;
-	thread_data *td = g_new0(thread_data, 1);
-	void *res = NULL;
-	time_t start_time = time(NULL);
-#endif
 
-	file = procmsg_get_message_file(info);
-	if (file == NULL) {
-#ifdef USE_PTHREAD
-		g_free(td);
-#endif
+	test = matcher_test_get(prop, info, &shared);
+	if (test == NULL)
 		return FALSE;
+
+	if (!test->started) {
+		g_queue_remove(&matcher_tests_pending, test);
+		if (g_main_context_acquire(NULL)) {
+			matcher_test_spawn(test);
+			g_main_context_release(NULL);
+		} else {
+			/* no main loop to wait in */
+			test->started = TRUE;
+			matcher_test_finish(test, system(test->cmd));
+		}
+	} else if (shared && debug_filtering_session
+			&& prefs_common.filtering_debug_level >= FILTERING_DEBUG_LEVEL_HIGH) {
+		log_print(LOG_DEBUG_FILTERING,
+				"reusing result of command [ %s ]\n",
+				test->cmd);
 	}
-	g_free(file);		
 
-	cmd = matching_build_command(prop->expr, info);
-	if (cmd == NULL) {
-#ifdef USE_PTHREAD
-		g_free(td);
-#endif	
-		return FALSE;
-}
+	/* the main loop keeps running, without spinning */
+	while (!test->done)
+		g_main_context_iteration(NULL, TRUE);
+	retval = test->status;
+	debug_print("Command exit code: %d\n", retval);
 
-#ifdef USE_PTHREAD
 	/* debug output */
 	if (debug_filtering_session
 			&& prefs_common.filtering_debug_level >= FILTERING_DEBUG_LEVEL_HIGH) {
 		log_print(LOG_DEBUG_FILTERING,
-				"starting threaded command [ %s ]\n",
-				cmd);
+				"command returned [ %d ]\n",
+				retval);
 	}
 
-	td->cmd = cmd;
-	td->done = FALSE;
-	if (pthread_create(&pt, NULL, matcher_test_thread, td) != 0)
-		retval = system(cmd);
-	else {
-		debug_print("waiting for test thread\n");
-		while(!td->done) {
-			/* don't let the interface freeze while waiting */
-			if (time(NULL) - start_time > 0) {
-				claws_do_idle();
+	if (!shared) {
+		if (test->pid != 0)
+			test->orphan = TRUE;
+		else
+			matcher_test_free(test);
+	}
+
+	return (retval == 0);
+}
+
+/*!
+ *\brief	MsgInfo fields that "contains" conditions can be
+ *		compiled for
+ */
+enum {
+	MATCHER_FIELD_SUBJECT,
+	MATCHER_FIELD_FROM,
+	MATCHER_FIELD_TO,
+	MATCHER_FIELD_CC,
+	MATCHER_FIELD_NEWSGROUPS,
+	MATCHER_FIELD_MESSAGEID,
+	MATCHER_FIELD_INREPLYTO,
+	N_MATCHER_FIELDS
+};
+
+/*!
+ *\brief	One compiled "contains" condition
+ */
+typedef struct _MatcherLiteral {
+	MatcherProp *prop;
+	/* copied, to notice a condition list changed under us */
+	gint criteria;
+	gint matchtype;
+	gchar *expr;
+	guint ids[N_MATCHER_FIELDS]; /*!< pattern id in each field's set */
+} MatcherLiteral;
+
+/*!
+ *\brief	The "contains" conditions of a set of condition lists,
+ *		compiled into one pattern set per field and casefolding,
+ *		so that each field of a message is scanned once for all
+ *		of them
+ */
+struct _MatcherLiterals {
+	GArray *literals;	/*!< MatcherLiteral, in condition order */
+	GHashTable *props;	/*!< MatcherProp -> MatcherLiteral */
+	StringMatchSet *sets[N_MATCHER_FIELDS][2];
+};
+
+/* fields looked at by a condition, -1 if none */
+static void matcher_literal_fields(gint criteria, gint *field1, gint *field2)
+{
+	*field1 = *field2 = -1;
+
+	switch (criteria) {
+	case MATCHCRITERIA_SUBJECT:
+	case MATCHCRITERIA_NOT_SUBJECT:
+		*field1 = MATCHER_FIELD_SUBJECT;
+		break;
+	case MATCHCRITERIA_FROM:
+	case MATCHCRITERIA_NOT_FROM:
+		*field1 = MATCHER_FIELD_FROM;
+		break;
+	case MATCHCRITERIA_TO:
+	case MATCHCRITERIA_NOT_TO:
+		*field1 = MATCHER_FIELD_TO;
+		break;
+	case MATCHCRITERIA_CC:
+	case MATCHCRITERIA_NOT_CC:
+		*field1 = MATCHER_FIELD_CC;
+		break;
+	case MATCHCRITERIA_TO_OR_CC:
+	case MATCHCRITERIA_NOT_TO_AND_NOT_CC:
+		*field1 = MATCHER_FIELD_TO;
+		*field2 = MATCHER_FIELD_CC;
+		break;
+	case MATCHCRITERIA_NEWSGROUPS:
+	case MATCHCRITERIA_NOT_NEWSGROUPS:
+		*field1 = MATCHER_FIELD_NEWSGROUPS;
+		break;
+	case MATCHCRITERIA_MESSAGEID:
+	case MATCHCRITERIA_NOT_MESSAGEID:
+		*field1 = MATCHER_FIELD_MESSAGEID;
+		break;
+	case MATCHCRITERIA_INREPLYTO:
+	case MATCHCRITERIA_NOT_INREPLYTO:
+		*field1 = MATCHER_FIELD_INREPLYTO;
+		break;
+	}
+}
+
+static gboolean matcherprop_is_literal(const MatcherProp *prop)
+{
+	gint field1, field2;
+
+	if (prop->matchtype != MATCHTYPE_MATCH &&
+	    prop->matchtype != MATCHTYPE_MATCHCASE)
+		return FALSE;
+	if (prop->expr == NULL)
+		return FALSE;
+	matcher_literal_fields(prop->criteria, &field1, &field2);
+
+	return field1 >= 0;
+}
+
+/*!
+ *\brief	Compile the "contains" conditions of condition lists
+ *
+ *\param	matcher_lists List of MatcherList, may contain NULLs
+ *
+ *\return	MatcherLiterals * Compiled conditions, to be passed to
+ *		\ref matcher_msg_cache_set_literals
+ */
+MatcherLiterals *matcher_literals_new(GSList *matcher_lists)
+{
+	MatcherLiterals *literals = g_new0(MatcherLiterals, 1);
+	GSList *cur, *l;
+	guint i, j;
+
+	literals->literals = g_array_new(FALSE, TRUE, sizeof(MatcherLiteral));
+	literals->props = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	for (cur = matcher_lists; cur != NULL; cur = cur->next) {
+		MatcherList *matchers = (MatcherList *) cur->data;
+
+		if (!matchers)
+			continue;
+		for (l = matchers->matchers; l != NULL; l = l->next) {
+			MatcherProp *prop = (MatcherProp *) l->data;
+			MatcherLiteral literal;
+			gboolean casefold;
+			gchar *pattern;
+			gint field[2];
+
+			if (!matcherprop_is_literal(prop))
+				continue;
+
+			memset(&literal, 0, sizeof(literal));
+			literal.prop = prop;
+			literal.criteria = prop->criteria;
+			literal.matchtype = prop->matchtype;
+			literal.expr = g_strdup(prop->expr);
+
+			/* same patterns as matcherprop_string_match() */
+			casefold = (prop->matchtype == MATCHTYPE_MATCHCASE);
+			if (casefold) {
+				if (!prop->casefold_expr)
+					prop->casefold_expr = g_utf8_casefold(prop->expr, -1);
+				pattern = prop->casefold_expr;
+			} else {
+				pattern = prop->expr;
 			}
-			if (time(NULL) - start_time > 30) {
-				pthread_cancel(pt);
-				td->done = TRUE;
-				retval = -1;
+
+			matcher_literal_fields(prop->criteria, &field[0], &field[1]);
+			for (i = 0; i < 2 && field[i] >= 0; i++) {
+				StringMatchSet **set = &literals->sets[field[i]][casefold];
+
+				if (!*set)
+					*set = string_match_set_new();
+				literal.ids[field[i]] = string_match_set_add(*set, pattern);
 			}
+			g_array_append_val(literals->literals, literal);
 		}
-		pthread_join(pt, &res);
-		retval = GPOINTER_TO_INT(res);
-		debug_print(" test thread returned %d\n", retval);
 	}
-	g_free(td);
-#else
-	/* debug output */
-	if (debug_filtering_session
-			&& prefs_common.filtering_debug_level >= FILTERING_DEBUG_LEVEL_HIGH) {
-		log_print(LOG_DEBUG_FILTERING,
-				"starting synchronous command [ %s ]\n",
-				cmd);
+
+	for (i = 0; i < literals->literals->len; i++) {
+		MatcherLiteral *literal = &g_array_index(literals->literals,
+							 MatcherLiteral, i);
+		g_hash_table_insert(literals->props, literal->prop, literal);
 	}
+	for (i = 0; i < N_MATCHER_FIELDS; i++)
+		for (j = 0; j < 2; j++)
+			if (literals->sets[i][j])
+				string_match_set_compile(literals->sets[i][j]);
 
-	retval = system(cmd);
-#endif
-	debug_print("Command exit code: %d\n", retval);
+	return literals;
+}
 
-	/* debug output */
-	if (debug_filtering_session
-			&& prefs_common.filtering_debug_level >= FILTERING_DEBUG_LEVEL_HIGH) {
-		log_print(LOG_DEBUG_FILTERING,
-				"command returned [ %d ]\n",
-				retval);
+/*!
+ *\brief	Check that compiled conditions are still those of the
+ *		condition lists
+ *
+ *\param	literals Compiled conditions
+ *\param	matcher_lists List of MatcherList, may contain NULLs
+ *
+ *\return	gboolean TRUE if \a literals can be used for the lists
+ */
+gboolean matcher_literals_is_valid(MatcherLiterals *literals,
+				   GSList *matcher_lists)
+{
+	GSList *cur, *l;
+	guint i = 0;
+
+	cm_return_val_if_fail(literals != NULL, FALSE);
+
+	for (cur = matcher_lists; cur != NULL; cur = cur->next) {
+		MatcherList *matchers = (MatcherList *) cur->data;
+
+		if (!matchers)
+			continue;
+		for (l = matchers->matchers; l != NULL; l = l->next) {
+			MatcherProp *prop = (MatcherProp *) l->data;
+			MatcherLiteral *literal;
+
+			if (!matcherprop_is_literal(prop))
+				continue;
+			if (i >= literals->literals->len)
+				return FALSE;
+			literal = &g_array_index(literals->literals,
+						 MatcherLiteral, i++);
+			if (literal->prop != prop ||
+			    literal->criteria != prop->criteria ||
+			    literal->matchtype != prop->matchtype ||
+			    strcmp(literal->expr, prop->expr) != 0)
+				return FALSE;
+		}
 	}
 
-	g_free(cmd);
-	return (retval == 0);
+	return i == literals->literals->len;
+}
+
+/*!
+ *\brief	Free compiled conditions
+ *
+ *\param	literals Compiled conditions
+ */
+void matcher_literals_free(MatcherLiterals *literals)
+{
+	guint i, j;
+
+	if (!literals)
+		return;
+
+	for (i = 0; i < literals->literals->len; i++)
+		g_free(g_array_index(literals->literals, MatcherLiteral, i).expr);
+	g_array_free(literals->literals, TRUE);
+	g_hash_table_destroy(literals->props);
+	for (i = 0; i < N_MATCHER_FIELDS; i++)
+		for (j = 0; j < 2; j++)
+			string_match_set_free(literals->sets[i][j]);
+	g_free(literals);
+}
+
+/*!
+ *\brief	Per-message state shared by the condition lists tested
+ *		on one message, so that running a whole filter set
+ *		fetches, reads and parses the message only once
+ */
+struct _MatcherMsgCache {
+	MsgInfo *info;
+	gchar *file;		/*!< message file, NULL until fetched */
+	gboolean file_has_body;	/*!< file was fetched with its body */
+	gboolean file_preset;	/*!< file was given by the caller, never
+				     fetch it */
+	GPtrArray *headers;	/*!< Header per header line, in file order,
+				     NULL entries for unparsable lines */
+	GHashTable *header_index; /*!< lowercased header name -> GSList
+				       of the matching Headers */
+	MimeInfo *mimeinfo;	/*!< scanned MIME tree, NULL until needed */
+	MatcherLiterals *literals; /*!< compiled literal conditions, or NULL */
+	gboolean *literal_found[N_MATCHER_FIELDS][2]; /*!< per field and
+				     casefolding, NULL until scanned */
+};
+
+/*!
+ *\brief	Find out if a MsgInfo field matches a condition, using
+ *		the compiled conditions of the message cache if any
+ *
+ *\param	prop Matcher structure
+ *\param	str Field value
+ *\param	field Field, MATCHER_FIELD_*
+ *\param	debug_context Field name for the debug log
+ *\param	cache Message cache, or NULL
+ *
+ *\return	gboolean TRUE if str matches the condition
+ */
+static gboolean matcherprop_field_match(MatcherProp *prop, const gchar *str,
+					gint field, const gchar *debug_context,
+					MatcherMsgCache *cache)
+{
+	MatcherLiteral *literal;
+	gboolean casefold;
+	gboolean **found;
+
+	if (str == NULL)
+		return FALSE;
+
+	/* the per-condition path logs every comparison */
+	if (!cache || !cache->literals || debug_filtering_session)
+		return matcherprop_string_match(prop, str, debug_context);
+
+	literal = g_hash_table_lookup(cache->literals->props, prop);
+	if (!literal)
+		return matcherprop_string_match(prop, str, debug_context);
+
+	casefold = (prop->matchtype == MATCHTYPE_MATCHCASE);
+	found = &cache->literal_found[field][casefold];
+	if (!*found) {
+		StringMatchSet *set = cache->literals->sets[field][casefold];
+
+		*found = g_new0(gboolean, string_match_set_get_size(set));
+		if (casefold) {
+			gchar *str1 = g_utf8_casefold(str, -1);
+
+			string_match_set_scan(set, str1, *found);
+			g_free(str1);
+		} else {
+			string_match_set_scan(set, str, *found);
+		}
+	}
+
+	return (*found)[literal->ids[field]];
 }
 
 /*!
@@ -773,11 +1315,13 @@ static gboolean matcherprop_match_test(const MatcherProp *prop,
  *
  *\param	prop Pointer to matcher structure
  *\param	info Pointer to message info
+ *\param	cache Message cache, or NULL
  *
  *\return	gboolean TRUE if a match
  */
 static gboolean matcherprop_match(MatcherProp *prop, 
-				  MsgInfo *info)
+				  MsgInfo *info,
+				  MatcherMsgCache *cache)
 {
 	time_t t;
 	gint age_mult_hours = 1;
@@ -874,27 +1418,39 @@ static gboolean matcherprop_match(MatcherProp *prop,
 	case MATCHCRITERIA_NOT_WATCH_THREAD:
 		return !MSG_IS_WATCH_THREAD(info->flags);
 	case MATCHCRITERIA_SUBJECT:
-		return matcherprop_string_match(prop, info->subject, context_str[CONTEXT_SUBJECT]);
+		return matcherprop_field_match(prop, info->subject, MATCHER_FIELD_SUBJECT,
+				context_str[CONTEXT_SUBJECT], cache);
 	case MATCHCRITERIA_NOT_SUBJECT:
-		return !matcherprop_string_match(prop, info->subject, context_str[CONTEXT_SUBJECT]);
+		return !matcherprop_field_match(prop, info->subject, MATCHER_FIELD_SUBJECT,
+				context_str[CONTEXT_SUBJECT], cache);
 	case MATCHCRITERIA_FROM:
-		return matcherprop_string_match(prop, info->from, context_str[CONTEXT_FROM]);
+		return matcherprop_field_match(prop, info->from, MATCHER_FIELD_FROM,
+				context_str[CONTEXT_FROM], cache);
 	case MATCHCRITERIA_NOT_FROM:
-		return !matcherprop_string_match(prop, info->from, context_str[CONTEXT_FROM]);
+		return !matcherprop_field_match(prop, info->from, MATCHER_FIELD_FROM,
+				context_str[CONTEXT_FROM], cache);
 	case MATCHCRITERIA_TO:
-		return matcherprop_string_match(prop, info->to, context_str[CONTEXT_TO]);
+		return matcherprop_field_match(prop, info->to, MATCHER_FIELD_TO,
+				context_str[CONTEXT_TO], cache);
 	case MATCHCRITERIA_NOT_TO:
-		return !matcherprop_string_match(prop, info->to, context_str[CONTEXT_TO]);
+		return !matcherprop_field_match(prop, info->to, MATCHER_FIELD_TO,
+				context_str[CONTEXT_TO], cache);
 	case MATCHCRITERIA_CC:
-		return matcherprop_string_match(prop, info->cc, context_str[CONTEXT_CC]);
+		return matcherprop_field_match(prop, info->cc, MATCHER_FIELD_CC,
+				context_str[CONTEXT_CC], cache);
 	case MATCHCRITERIA_NOT_CC:
-		return !matcherprop_string_match(prop, info->cc, context_str[CONTEXT_CC]);
+		return !matcherprop_field_match(prop, info->cc, MATCHER_FIELD_CC,
+				context_str[CONTEXT_CC], cache);
 	case MATCHCRITERIA_TO_OR_CC:
-		return matcherprop_string_match(prop, info->to, context_str[CONTEXT_TO])
-		     || matcherprop_string_match(prop, info->cc, context_str[CONTEXT_CC]);
+		return matcherprop_field_match(prop, info->to, MATCHER_FIELD_TO,
+				context_str[CONTEXT_TO], cache)
+		     || matcherprop_field_match(prop, info->cc, MATCHER_FIELD_CC,
+				context_str[CONTEXT_CC], cache);
 	case MATCHCRITERIA_NOT_TO_AND_NOT_CC:
-		return !matcherprop_string_match(prop, info->to, context_str[CONTEXT_TO])
-		     && !matcherprop_string_match(prop, info->cc, context_str[CONTEXT_CC]);
+		return !matcherprop_field_match(prop, info->to, MATCHER_FIELD_TO,
+				context_str[CONTEXT_TO], cache)
+		     && !matcherprop_field_match(prop, info->cc, MATCHER_FIELD_CC,
+				context_str[CONTEXT_CC], cache);
 	case MATCHCRITERIA_TAG:
 		return matcherprop_tag_match(prop, info, context_str[CONTEXT_TAG]);
 	case MATCHCRITERIA_NOT_TAG:
@@ -1155,17 +1711,23 @@ static gboolean matcherprop_match(MatcherProp *prop,
 		return ret;
 	}
 	case MATCHCRITERIA_NEWSGROUPS:
-		return matcherprop_string_match(prop, info->newsgroups, context_str[CONTEXT_NEWSGROUPS]);
+		return matcherprop_field_match(prop, info->newsgroups, MATCHER_FIELD_NEWSGROUPS,
+				context_str[CONTEXT_NEWSGROUPS], cache);
 	case MATCHCRITERIA_NOT_NEWSGROUPS:
-		return !matcherprop_string_match(prop, info->newsgroups, context_str[CONTEXT_NEWSGROUPS]);
+		return !matcherprop_field_match(prop, info->newsgroups, MATCHER_FIELD_NEWSGROUPS,
+				context_str[CONTEXT_NEWSGROUPS], cache);
 	case MATCHCRITERIA_MESSAGEID:
-		return matcherprop_string_match(prop, info->msgid, context_str[CONTEXT_MESSAGEID]);
+		return matcherprop_field_match(prop, info->msgid, MATCHER_FIELD_MESSAGEID,
+				context_str[CONTEXT_MESSAGEID], cache);
 	case MATCHCRITERIA_NOT_MESSAGEID:
-		return !matcherprop_string_match(prop, info->msgid, context_str[CONTEXT_MESSAGEID]);
+		return !matcherprop_field_match(prop, info->msgid, MATCHER_FIELD_MESSAGEID,
+				context_str[CONTEXT_MESSAGEID], cache);
 	case MATCHCRITERIA_INREPLYTO:
-		return matcherprop_string_match(prop, info->inreplyto, context_str[CONTEXT_IN_REPLY_TO]);
+		return matcherprop_field_match(prop, info->inreplyto, MATCHER_FIELD_INREPLYTO,
+				context_str[CONTEXT_IN_REPLY_TO], cache);
 	case MATCHCRITERIA_NOT_INREPLYTO:
-		return !matcherprop_string_match(prop, info->inreplyto, context_str[CONTEXT_IN_REPLY_TO]);
+		return !matcherprop_field_match(prop, info->inreplyto, MATCHER_FIELD_INREPLYTO,
+				context_str[CONTEXT_IN_REPLY_TO], cache);
 	case MATCHCRITERIA_REFERENCES:
 		return matcherprop_list_match(prop, info->references, context_str[CONTEXT_REFERENCES]);
 	case MATCHCRITERIA_NOT_REFERENCES:
@@ -1201,6 +1763,27 @@ MatcherList *matcherlist_new(GSList *matchers, gboolean bool_and)
 	return cond;
 }
 
+/*!
+ *\brief	Copy a list of matchers
+ *
+ *\param	src List of matchers to copy
+ *
+ *\return	MatcherList * Newly allocated list, with its own copy
+ *		of each matcher
+ */
+MatcherList *matcherlist_copy(const MatcherList *src)
+{
+	GSList *matchers = NULL, *l;
+
+	cm_return_val_if_fail(src != NULL, NULL);
+
+	for (l = src->matchers; l != NULL; l = g_slist_next(l))
+		matchers = g_slist_prepend(matchers,
+				matcherprop_copy((MatcherProp *) l->data));
+
+	return matcherlist_new(g_slist_reverse(matchers), src->bool_and);
+}
+
 #ifdef G_OS_UNIX
 /*!
  *\brief	Builds a single regular expresion from an array of srings.
@@ -1319,63 +1902,234 @@ void matcherlist_free(MatcherList *cond)
 	g_free(cond);
 }
 
+/*!
+ *\brief	Create an empty per-message cache
+ *
+ *\param	info Message the cache is used for
+ *
+ *\return	MatcherMsgCache * Cache to pass to
+ *		\ref matcherlist_match_cached
+ */
+MatcherMsgCache *matcher_msg_cache_new(MsgInfo *info)
+{
+	MatcherMsgCache *cache;
+
+	cm_return_val_if_fail(info != NULL, NULL);
+
+	cache = g_new0(MatcherMsgCache, 1);
+	cache->info = info;
+
+	return cache;
+}
+
+static void matcher_header_index_free_list(gpointer key, gpointer value,
+					   gpointer data)
+{
+	g_slist_free((GSList *) value);
+}
+
+/*!
+ *\brief	Free a per-message cache
+ *
+ *\param	cache Cache to free
+ */
+void matcher_msg_cache_free(MatcherMsgCache *cache)
+{
+	gint i;
+
+	if (!cache)
+		return;
+
+	if (cache->header_index) {
+		g_hash_table_foreach(cache->header_index,
+				     matcher_header_index_free_list, NULL);
+		g_hash_table_destroy(cache->header_index);
+	}
+	if (cache->headers)
+		g_ptr_array_free(cache->headers, TRUE);
+	if (cache->mimeinfo)
+		procmime_mimeinfo_free_all(&cache->mimeinfo);
+	for (i = 0; i < N_MATCHER_FIELDS; i++) {
+		g_free(cache->literal_found[i][FALSE]);
+		g_free(cache->literal_found[i][TRUE]);
+	}
+	g_free(cache->file);
+	g_free(cache);
+}
+
+/*!
+ *\brief	Use compiled conditions for the "contains" conditions
+ *		tested on the message
+ *
+ *\param	cache Message cache
+ *\param	literals Compiled conditions, owned by the caller and
+ *		valid for all condition lists tested with \a cache
+ */
+void matcher_msg_cache_set_literals(MatcherMsgCache *cache,
+				    MatcherLiterals *literals)
+{
+	cm_return_if_fail(cache != NULL);
+	cm_return_if_fail(cache->literals == NULL);
+
+	cache->literals = literals;
+}
+
+/*!
+ *\brief	Give the message file to use instead of fetching it
+ *
+ *\param	cache Message cache
+ *\param	file Complete message file, NULL if it could not be
+ *		fetched
+ *
+ *\note		Together with \ref matcherlist_can_match_in_thread this
+ *		allows testing conditions outside the main thread, as
+ *		fetching a message is not thread-safe.
+ */
+void matcher_msg_cache_set_file(MatcherMsgCache *cache, const gchar *file)
+{
+	cm_return_if_fail(cache != NULL);
+
+	g_free(cache->file);
+	cache->file = g_strdup(file);
+	cache->file_has_body = TRUE;
+	cache->file_preset = TRUE;
+}
+
+/* key used by procheader_headername_equal(): case-insensitive,
+ * without the trailing colon */
+static gchar *matcher_header_index_key(const gchar *name)
+{
+	gssize len = strlen(name);
+
+	if (len > 0 && name[len - 1] == ':')
+		len--;
+
+	return g_ascii_strdown(name, len);
+}
+
+static gboolean matcher_msg_cache_fetch(MatcherMsgCache *cache,
+					gboolean read_headers,
+					gboolean read_body)
+{
+	if (cache->file_preset)
+		return cache->file != NULL;
+	if (cache->file && (cache->file_has_body || !read_body))
+		return TRUE;
+
+	g_free(cache->file);
+	cache->file = procmsg_get_message_file_full(cache->info,
+						    read_headers, read_body);
+	cache->file_has_body = read_body;
+
+	return cache->file != NULL;
+}
+
+static gboolean matcher_msg_cache_read_headers(MatcherMsgCache *cache)
+{
+	FILE *fp;
+	gchar *buf = NULL;
+	gint i;
+
+	if (cache->headers)
+		return TRUE;
+
+	if ((fp = claws_fopen(cache->file, "rb")) == NULL) {
+		FILE_OP_ERROR(cache->file, "claws_fopen");
+		return FALSE;
+	}
+
+	cache->headers = g_ptr_array_new_with_free_func
+				((GDestroyNotify) procheader_header_free);
+	while (procheader_get_one_field(&buf, fp, NULL) != -1) {
+		g_ptr_array_add(cache->headers, procheader_parse_header(buf));
+		g_free(buf);
+		buf = NULL;
+	}
+	claws_fclose(fp);
+
+	/* walk backwards so that each list ends up in file order */
+	cache->header_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    g_free, NULL);
+	for (i = cache->headers->len - 1; i >= 0; i--) {
+		Header *header = g_ptr_array_index(cache->headers, i);
+		GSList *list;
+		gchar *key;
+
+		if (!header)
+			continue;
+		key = matcher_header_index_key(header->name);
+		list = g_hash_table_lookup(cache->header_index, key);
+		g_hash_table_insert(cache->header_index, key,
+				    g_slist_prepend(list, header));
+	}
+
+	return TRUE;
+}
+
+static GSList *matcher_msg_cache_lookup_header(MatcherMsgCache *cache,
+					       const gchar *name)
+{
+	gchar *key = matcher_header_index_key(name);
+	GSList *list = g_hash_table_lookup(cache->header_index, key);
+
+	g_free(key);
+
+	return list;
+}
+
+static gboolean matcher_header_is_address(Header *header)
+{
+	return procheader_headername_equal(header->name, "From") ||
+		procheader_headername_equal(header->name, "To") ||
+		procheader_headername_equal(header->name, "Cc") ||
+		procheader_headername_equal(header->name, "Reply-To") ||
+		procheader_headername_equal(header->name, "Sender") ||
+		procheader_headername_equal(header->name, "Resent-From") ||
+		procheader_headername_equal(header->name, "Resent-To");
+}
+
 /*!
  *\brief	Check if a header matches a matcher condition
  *
  *\param	matcher Matcher structure to check header for
- *\param	buf Header name
+ *\param	header Parsed header line, NULL if the line could not be parsed
  *
  *\return	boolean TRUE if matching header
  */
 static gboolean matcherprop_match_one_header(MatcherProp *matcher,
-					     gchar *buf)
+					     Header *header)
 {
 	gboolean result = FALSE;
-	Header *header = NULL;
+
+	if (!header)
+		return FALSE;
 
 	switch (matcher->criteria) {
 	case MATCHCRITERIA_HEADER:
 	case MATCHCRITERIA_NOT_HEADER:
-		header = procheader_parse_header(buf);
-		if (!header)
-			return FALSE;
 		if (procheader_headername_equal(header->name,
 						matcher->header)) {
 			if (matcher->criteria == MATCHCRITERIA_HEADER)
 				result = matcherprop_string_match(matcher, header->body, context_str[CONTEXT_HEADER]);
 			else
 				result = !matcherprop_string_match(matcher, header->body, context_str[CONTEXT_HEADER]);
-			procheader_header_free(header);
 			return result;
 		}
-		else {
-			procheader_header_free(header);
-		}
 		break;
 	case MATCHCRITERIA_HEADERS_PART:
 	case MATCHCRITERIA_HEADERS_CONT:
 	case MATCHCRITERIA_MESSAGE:
-		header = procheader_parse_header(buf);
-		if (!header)
-			return FALSE;
-		result = matcherprop_header_line_match(matcher, 
+		return matcherprop_header_line_match(matcher, 
 			       header->name, header->body,
 			       (matcher->criteria == MATCHCRITERIA_HEADERS_PART),
 			       context_str[CONTEXT_HEADER_LINE]);
-		procheader_header_free(header);
-		return result;
 	case MATCHCRITERIA_NOT_HEADERS_CONT:
 	case MATCHCRITERIA_NOT_HEADERS_PART:
 	case MATCHCRITERIA_NOT_MESSAGE:
-		header = procheader_parse_header(buf);
-		if (!header)
-			return FALSE;
-		result = !matcherprop_header_line_match(matcher, 
+		return !matcherprop_header_line_match(matcher, 
 			       header->name, header->body,
 			       (matcher->criteria == MATCHCRITERIA_NOT_HEADERS_PART),
 			       context_str[CONTEXT_HEADER_LINE]);
-		procheader_header_free(header);
-		return result;
 	case MATCHCRITERIA_FOUND_IN_ADDRESSBOOK:
 	case MATCHCRITERIA_NOT_FOUND_IN_ADDRESSBOOK:
 		{
@@ -1391,34 +2145,17 @@ static gboolean matcherprop_match_one_header(MatcherProp *matcher,
 
 			if (match == MATCH_ONE) {
 				/* matching one address header exactly, is that the right one? */
-				header = procheader_parse_header(buf);
-				if (!header ||
-						!procheader_headername_equal(header->name, matcher->header)) {
-					procheader_header_free(header);
+				if (!procheader_headername_equal(header->name, matcher->header))
 					return FALSE;
-				}
 				address_list = address_list_append(address_list, header->body);
-				if (address_list == NULL) {
-					procheader_header_free(header);
+				if (address_list == NULL)
 					return FALSE;
-				}
-				procheader_header_free(header);
 
 			} else {
-				header = procheader_parse_header(buf);
-				if (!header)
-					return FALSE;
 				/* address header is one of the headers we have to match when checking
 				   for any address header or all address headers? */
-				if (procheader_headername_equal(header->name, "From") ||
-					 procheader_headername_equal(header->name, "To") ||
-					 procheader_headername_equal(header->name, "Cc") ||
-					 procheader_headername_equal(header->name, "Reply-To") ||
-					 procheader_headername_equal(header->name, "Sender") ||
-					 procheader_headername_equal(header->name, "Resent-From") ||
-					 procheader_headername_equal(header->name, "Resent-To"))
+				if (matcher_header_is_address(header))
 					address_list = address_list_append(address_list, header->body);
-				procheader_header_free(header);
 				if (address_list == NULL)
 					return FALSE;
 			}
@@ -1485,97 +2222,106 @@ static gboolean matcherprop_criteria_message(MatcherProp *matcher)
 	}
 }
 
+/*!
+ *\brief	Check if one condition matches a header line
+ *
+ *\param	matcher Condition, its result and done fields are updated
+ *\param	header Parsed header line, NULL if the line could not be parsed
+ */
+static void matcherprop_match_header_line(MatcherProp *matcher, Header *header)
+{
+	gint match = MATCH_ANY;
+
+	/* determine the match range (all, any are our concern here) */
+	if (matcher->criteria == MATCHCRITERIA_NOT_HEADERS_PART ||
+	    matcher->criteria == MATCHCRITERIA_NOT_HEADERS_CONT ||
+	    matcher->criteria == MATCHCRITERIA_NOT_MESSAGE) {
+		match = MATCH_ALL;
+
+	} else if (matcher->criteria == MATCHCRITERIA_FOUND_IN_ADDRESSBOOK ||
+	 		   matcher->criteria == MATCHCRITERIA_NOT_FOUND_IN_ADDRESSBOOK) {
+		if (!header)
+			return;
+		/* address header is one of the headers we have to match when checking
+		   for any address header or all address headers? */
+		if (matcher_header_is_address(header)) {
+			if (strcasecmp(matcher->header, "Any") == 0)
+				match = MATCH_ANY;
+			else if (strcasecmp(matcher->header, "All") == 0)
+				match = MATCH_ALL;
+			else
+				match = MATCH_ONE;
+		}
+		/* else matching one address header exactly, is that the right one?
+		   further call to matcherprop_match_one_header() will tell us */
+	}
+
+	/* ZERO line must NOT match for the rule to match.
+	 */
+	if (match == MATCH_ALL) {
+		if (matcherprop_match_one_header(matcher, header)) {
+			matcher->result = TRUE;
+		} else {
+			matcher->result = FALSE;
+			matcher->done = TRUE;
+		}
+	/* else, just one line matching is enough for the rule to match
+	 */
+	} else if (matcherprop_criteria_headers(matcher) ||
+	           matcherprop_criteria_message(matcher)) {
+		if (matcherprop_match_one_header(matcher, header)) {
+			matcher->result = TRUE;
+			matcher->done = TRUE;
+		}
+	}
+}
+
 /*!
  *\brief	Check if a list of conditions matches one header in
  *		a message file.
  *
  *\param	matchers List of conditions
- *\param	fp Message file
+ *\param	cache Message cache holding the parsed headers
  *
  *\return	gboolean TRUE if one of the headers is matched by
  *		the list of conditions.	
+ *
+ *\note		Each condition is tested on its own, so a ~header
+ *		condition only looks at the lines carrying that header.
  */
-static gboolean matcherlist_match_headers(MatcherList *matchers, FILE *fp)
+static gboolean matcherlist_match_headers(MatcherList *matchers,
+					  MatcherMsgCache *cache)
 {
 	GSList *l;
-	gchar *buf = NULL;
-	gint ret;
 
-	while ((ret = procheader_get_one_field(&buf, fp, NULL)) != -1) {
-		for (l = matchers->matchers ; l != NULL ; l = g_slist_next(l)) {
-			MatcherProp *matcher = (MatcherProp *) l->data;
-			gint match = MATCH_ANY;
+	for (l = matchers->matchers ; l != NULL ; l = g_slist_next(l)) {
+		MatcherProp *matcher = (MatcherProp *) l->data;
 
-			if (matcher->done)
-				continue;
+		if (!matcherprop_criteria_headers(matcher) &&
+		    !matcherprop_criteria_message(matcher))
+			continue;
 
-			/* determine the match range (all, any are our concern here) */
-			if (matcher->criteria == MATCHCRITERIA_NOT_HEADERS_PART ||
-			    matcher->criteria == MATCHCRITERIA_NOT_HEADERS_CONT ||
-			    matcher->criteria == MATCHCRITERIA_NOT_MESSAGE) {
-				match = MATCH_ALL;
+		if (matcher->criteria == MATCHCRITERIA_HEADER ||
+		    matcher->criteria == MATCHCRITERIA_NOT_HEADER) {
+			GSList *cur = matcher_msg_cache_lookup_header(cache,
+							matcher->header);
 
-			} else if (matcher->criteria == MATCHCRITERIA_FOUND_IN_ADDRESSBOOK ||
-			 		   matcher->criteria == MATCHCRITERIA_NOT_FOUND_IN_ADDRESSBOOK) {
-				Header *header = NULL;
+			for (; cur != NULL && !matcher->done; cur = cur->next)
+				matcherprop_match_header_line(matcher, cur->data);
+		} else {
+			guint i;
 
-				/* address header is one of the headers we have to match when checking
-				   for any address header or all address headers? */
-				header = procheader_parse_header(buf);
-				if (header &&
-					(procheader_headername_equal(header->name, "From") ||
-					 procheader_headername_equal(header->name, "To") ||
-					 procheader_headername_equal(header->name, "Cc") ||
-					 procheader_headername_equal(header->name, "Reply-To") ||
-					 procheader_headername_equal(header->name, "Sender") ||
-					 procheader_headername_equal(header->name, "Resent-From") ||
-					 procheader_headername_equal(header->name, "Resent-To"))) {
-
-					if (strcasecmp(matcher->header, "Any") == 0)
-						match = MATCH_ANY;
-					else if (strcasecmp(matcher->header, "All") == 0)
-						match = MATCH_ALL;
-					else
-						match = MATCH_ONE;
-				} else {
-					if (!header)
-						continue;
-					/* matching one address header exactly, is that the right one?
-					   further call to matcherprop_match_one_header() will tell us */
-				}
-				procheader_header_free(header);
-			}
+			for (i = 0; i < cache->headers->len && !matcher->done; i++)
+				matcherprop_match_header_line(matcher,
+					g_ptr_array_index(cache->headers, i));
+		}
 
-			/* ZERO line must NOT match for the rule to match.
-			 */
-			if (match == MATCH_ALL) {
-				if (matcherprop_match_one_header(matcher, buf)) {
-					matcher->result = TRUE;
-				} else {
-					matcher->result = FALSE;
-					matcher->done = TRUE;
-				}
-			/* else, just one line matching is enough for the rule to match
-			 */
-			} else if (matcherprop_criteria_headers(matcher) ||
-			           matcherprop_criteria_message(matcher)) {
-				if (matcherprop_match_one_header(matcher, buf)) {
-					matcher->result = TRUE;
-					matcher->done = TRUE;
-				}
-			}
-			
-			/* if the rule matched and the matchers are OR, no need to
-			 * check the others */
-			if (matcher->result && matcher->done) {
-				if (!matchers->bool_and) {
-					g_free(buf);
-					return TRUE;
-				}
-			}
+		/* if the rule matched and the matchers are OR, no need to
+		 * check the others */
+		if (matcher->result && matcher->done) {
+			if (!matchers->bool_and)
+				return TRUE;
 		}
-		g_free(buf);
-		buf = NULL;
 	}
 
 	return FALSE;
@@ -1725,19 +2471,29 @@ static gboolean matcherlist_match_text_content(MatcherList *matchers, MimeInfo *
  *		the criteria
  *
  *\param	matchers List of conditions
- *\param	fp Message file
+ *\param	body_only Only look at the first text part
+ *\param	cache Message cache, the scanned MIME tree is kept there
  *
  *\return	gboolean TRUE if successful match
  */
-static gboolean matcherlist_match_body(MatcherList *matchers, gboolean body_only, MsgInfo *info)
+static gboolean matcherlist_match_body(MatcherList *matchers, gboolean body_only,
+				       MatcherMsgCache *cache)
 {
 	MimeInfo *mimeinfo = NULL;
 	MimeInfo *partinfo = NULL;
 	gboolean first_text_found = FALSE;
 
-	cm_return_val_if_fail(info != NULL, FALSE);
+	cm_return_val_if_fail(cache != NULL, FALSE);
 
-	mimeinfo = procmime_scan_message(info);
+	/* same as procmime_scan_message(), on the file already fetched */
+	if (!cache->mimeinfo && cache->file) {
+		if (!folder_has_parent_of_type(cache->info->folder, F_QUEUE) &&
+		    !folder_has_parent_of_type(cache->info->folder, F_DRAFT))
+			cache->mimeinfo = procmime_scan_file(cache->file);
+		else
+			cache->mimeinfo = procmime_scan_queue_file(cache->file);
+	}
+	mimeinfo = cache->mimeinfo;
 
 	/* Skip headers */
 	partinfo = procmime_mimeinfo_next(mimeinfo);
@@ -1749,19 +2505,15 @@ static gboolean matcherlist_match_body(MatcherList *matchers, gboolean body_only
 
 		if (partinfo->type == MIMETYPE_TEXT) {
 			first_text_found = TRUE;
-			if (matcherlist_match_text_content(matchers, partinfo)) {
-				procmime_mimeinfo_free_all(&mimeinfo);
+			if (matcherlist_match_text_content(matchers, partinfo))
 				return TRUE;
-			}
 		} else if (matcherlist_match_binary_content(matchers, partinfo)) {
-			procmime_mimeinfo_free_all(&mimeinfo);
 			return TRUE;
 		}
 
 		if (body_only && first_text_found)
 			break;
 	}
-	procmime_mimeinfo_free_all(&mimeinfo);
 
 	return FALSE;
 }
@@ -1772,18 +2524,17 @@ static gboolean matcherlist_match_body(MatcherList *matchers, gboolean body_only
  *\param	matchers Criteria
  *\param	info Message info
  *\param	result Default result
+ *\param	cache Message cache
  *
  *\return	gboolean TRUE if matched
  */
 static gboolean matcherlist_match_file(MatcherList *matchers, MsgInfo *info,
-				gboolean result)
+				gboolean result, MatcherMsgCache *cache)
 {
 	gboolean read_headers;
 	gboolean read_body;
 	gboolean body_only;
 	GSList *l;
-	FILE *fp;
-	gchar *file;
 
 	/* file need to be read ? */
 
@@ -1809,28 +2560,22 @@ static gboolean matcherlist_match_file(MatcherList *matchers, MsgInfo *info,
 	if (!read_headers && !read_body)
 		return result;
 
-	file = procmsg_get_message_file_full(info, read_headers, read_body);
-	if (file == NULL)
+	if (!matcher_msg_cache_fetch(cache, read_headers, read_body))
 		return FALSE;
 
-	if ((fp = claws_fopen(file, "rb")) == NULL) {
-		FILE_OP_ERROR(file, "claws_fopen");
-		g_free(file);
+	/* the headers are parsed once per message, even when only
+	 * the body is needed, so that an unreadable file is noticed */
+	if (!matcher_msg_cache_read_headers(cache))
 		return result;
-	}
-
-	/* read the headers */
 
 	if (read_headers) {
-		if (matcherlist_match_headers(matchers, fp))
+		if (matcherlist_match_headers(matchers, cache))
 			read_body = FALSE;
-	} else {
-		procheader_skip_headers(fp);
 	}
 
 	/* read the body */
 	if (read_body) {
-		matcherlist_match_body(matchers, body_only, info);
+		matcherlist_match_body(matchers, body_only, cache);
 	}
 	
 	for (l = matchers->matchers; l != NULL; l = g_slist_next(l)) {
@@ -1854,13 +2599,54 @@ static gboolean matcherlist_match_file(MatcherList *matchers, MsgInfo *info,
 		}			
 	}
 
-	g_free(file);
-
-	claws_fclose(fp);
-	
 	return result;
 }
 
+/*!
+ *\brief	Check if a list of conditions reads the message file and
+ *		can be tested outside the main thread, on its own copy
+ *		(see \ref matcherlist_copy) and with the message file
+ *		given by \ref matcher_msg_cache_set_file
+ *
+ *\param	matchers List of conditions
+ *
+ *\return	gboolean TRUE if worth and safe to test in a thread
+ */
+gboolean matcherlist_can_match_in_thread(MatcherList *matchers)
+{
+	gboolean reads_file = FALSE;
+	GSList *l;
+
+	cm_return_val_if_fail(matchers != NULL, FALSE);
+
+	/* the debug log is not thread-safe */
+	if (debug_filtering_session)
+		return FALSE;
+
+	for (l = matchers->matchers; l != NULL; l = g_slist_next(l)) {
+		MatcherProp *matcher = (MatcherProp *) l->data;
+
+		switch (matcher->criteria) {
+		/* the address completion and command execution rely
+		 * on the main loop */
+		case MATCHCRITERIA_FOUND_IN_ADDRESSBOOK:
+		case MATCHCRITERIA_NOT_FOUND_IN_ADDRESSBOOK:
+		case MATCHCRITERIA_TEST:
+		case MATCHCRITERIA_NOT_TEST:
+		/* nor is the tag table locked */
+		case MATCHCRITERIA_TAG:
+		case MATCHCRITERIA_NOT_TAG:
+			return FALSE;
+		}
+		if (matcherprop_criteria_headers(matcher) ||
+		    matcherprop_criteria_body(matcher) ||
+		    matcherprop_criteria_message(matcher))
+			reads_file = TRUE;
+	}
+
+	return reads_file;
+}
+
 /*!
  *\brief	Test list of conditions on a message.
  *
@@ -1870,6 +2656,33 @@ static gboolean matcherlist_match_file(MatcherList *matchers, MsgInfo *info,
  *\return	gboolean TRUE if matched
  */
 gboolean matcherlist_match(MatcherList *matchers, MsgInfo *info)
+{
+	MatcherMsgCache *cache;
+	gboolean result;
+
+	if (!matchers)
+		return FALSE;
+
+	cache = matcher_msg_cache_new(info);
+	result = matcherlist_match_cached(matchers, info, cache);
+	matcher_msg_cache_free(cache);
+
+	return result;
+}
+
+/*!
+ *\brief	Test list of conditions on a message, reusing the
+ *		message file and parsed headers of earlier tests.
+ *
+ *\param	matchers List of conditions
+ *\param	info Message info
+ *\param	cache Cache created for \a info with
+ *		\ref matcher_msg_cache_new
+ *
+ *\return	gboolean TRUE if matched
+ */
+gboolean matcherlist_match_cached(MatcherList *matchers, MsgInfo *info,
+				  MatcherMsgCache *cache)
 {
 	GSList *l;
 	gboolean result;
@@ -1877,6 +2690,8 @@ gboolean matcherlist_match(MatcherList *matchers, MsgInfo *info)
 	if (!matchers)
 		return FALSE;
 
+	cm_return_val_if_fail(cache != NULL && cache->info == info, FALSE);
+
 	if (matchers->bool_and)
 		result = TRUE;
 	else
@@ -1959,7 +2774,7 @@ gboolean matcherlist_match(MatcherList *matchers, MsgInfo *info)
 		case MATCHCRITERIA_NOT_TEST:
 		case MATCHCRITERIA_PARTIAL:
 		case MATCHCRITERIA_NOT_PARTIAL:
-			if (matcherprop_match(matcher, info)) {
+			if (matcherprop_match(matcher, info, cache)) {
 				if (!matchers->bool_and) {
 					if (debug_filtering_session)
 						log_status_ok(LOG_DEBUG_FILTERING, _("message matches\n"));
@@ -1978,7 +2793,7 @@ gboolean matcherlist_match(MatcherList *matchers, MsgInfo *info)
 
 	/* test the condition on the file */
 
-	if (matcherlist_match_file(matchers, info, result)) {
+	if (matcherlist_match_file(matchers, info, result, cache)) {
 		if (!matchers->bool_and) {
 			if (debug_filtering_session)
 				log_status_ok(LOG_DEBUG_FILTERING, _("message matches\n"));
@@ -2629,4 +3444,5 @@ void prefs_matcher_read_config(void)
 		matcher_parser_start_parsing(f);
 		claws_fclose(matcher_parserin);
 	}
+	filtering_rules_changed();
 }
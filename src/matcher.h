@@ -172,11 +172,34 @@ MatcherList * matcherlist_new_from_lines(gchar		*lines,
 					 gboolean	bool_and,
 					 gboolean	case_sensitive);
 void matcherlist_free			(MatcherList	*cond);
+MatcherList *matcherlist_copy		(const MatcherList *src);
 
 MatcherList *matcherlist_parse		(gchar		**str);
 
 gboolean matcherlist_match		(MatcherList	*cond, 
 					 MsgInfo	*info);
+gboolean matcherlist_match_cached	(MatcherList	*cond,
+					 MsgInfo	*info,
+					 MatcherMsgCache *cache);
+gboolean matcherlist_can_match_in_thread(MatcherList	*cond);
+gboolean matcherlist_has_test		(MatcherList	*cond);
+gboolean matcherlist_start_tests	(MatcherList	*cond,
+					 MsgInfo	*info,
+					 MatcherMsgCache *cache);
+void matcher_tests_begin		(void);
+void matcher_tests_end			(void);
+
+MatcherMsgCache *matcher_msg_cache_new	(MsgInfo	*info);
+void matcher_msg_cache_free		(MatcherMsgCache *cache);
+void matcher_msg_cache_set_literals	(MatcherMsgCache *cache,
+					 MatcherLiterals *literals);
+void matcher_msg_cache_set_file		(MatcherMsgCache *cache,
+					 const gchar	*file);
+
+MatcherLiterals *matcher_literals_new	(GSList		*matcher_lists);
+gboolean matcher_literals_is_valid	(MatcherLiterals *literals,
+					 GSList		*matcher_lists);
+void matcher_literals_free		(MatcherLiterals *literals);
 
 gint matcher_parse_keyword		(gchar		**str);
 gint matcher_parse_number		(gchar		**str);
@@ -26,4 +26,10 @@ typedef struct _MatcherProp MatcherProp;
 struct _MatcherList;
 typedef struct _MatcherList MatcherList;
 
+struct _MatcherMsgCache;
+typedef struct _MatcherMsgCache MatcherMsgCache;
+
+struct _MatcherLiterals;
+typedef struct _MatcherLiterals MatcherLiterals;
+
 #endif
@@ -30,6 +30,9 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 #include "folder.h"
 #include "folder_item_prefs.h"
@@ -57,6 +60,23 @@
 # endif
 #endif
 
+typedef struct _MHFolderItem	MHFolderItem;
+
+struct _MHFolderItem
+{
+	FolderItem item;
+
+	/* change journal: the message numbers in the directory, kept
+	 * up to date from inotify events between full scans, and the
+	 * ones whose file was written or replaced since the last scan */
+	gint journal_wd;
+	GHashTable *journal_nums;
+	GHashTable *journal_changed;
+	gboolean journal_valid;
+	/* the numbers changed before the scan in progress, NULL if the
+	 * directory was listed: then each file has to be checked */
+	GHashTable *scan_changed;
+};
 
 static void	mh_folder_init		(Folder		*folder,
 					 const gchar	*name,
@@ -65,6 +85,11 @@ static void	mh_folder_init		(Folder		*folder,
 static Folder	*mh_folder_new		(const gchar	*name,
 					 const gchar	*path);
 static void     mh_folder_destroy	(Folder		*folder);
+static FolderItem *mh_folder_item_new	(Folder		*folder);
+static void	mh_folder_item_destroy	(Folder		*folder,
+					 FolderItem	*item);
+static void	mh_journal_stop		(MHFolder	*folder,
+					 MHFolderItem	*item);
 static gchar   *mh_fetch_msg		(Folder		*folder,
 					 FolderItem	*item,
 					 gint		 num);
@@ -99,9 +124,9 @@ static gboolean mh_is_msg_changed	(Folder		*folder,
 					 FolderItem	*item,
 					 MsgInfo	*msginfo);
 
-static gint 	mh_get_num_list		(Folder 	*folder,
+static gint 	mh_get_num_array	(Folder 	*folder,
 			    		 FolderItem 	*item, 
-					 GSList 	**list, 
+					 GArray 	*array, 
 					 gboolean 	*old_uids_valid);
 static gint 	mh_scan_tree		(Folder 	*folder);
 
@@ -160,11 +185,13 @@ FolderClass *mh_get_class(void)
 		mh_class.create_tree = mh_create_tree;
 
 		/* FolderItem functions */
+		mh_class.item_new = mh_folder_item_new;
+		mh_class.item_destroy = mh_folder_item_destroy;
 		mh_class.item_get_path = mh_item_get_path;
 		mh_class.create_folder = mh_create_folder;
 		mh_class.rename_folder = mh_rename_folder;
 		mh_class.remove_folder = mh_remove_folder;
-		mh_class.get_num_list = mh_get_num_list;
+		mh_class.get_num_array = mh_get_num_array;
 		mh_class.scan_required = mh_scan_required;
 		mh_class.set_mtime = mh_set_mtime;
 		mh_class.close = mh_item_close;
@@ -200,13 +227,228 @@ static Folder *mh_folder_new(const gchar *name, const gchar *path)
 
 static void mh_folder_destroy(Folder *folder)
 {
+	MHFolder *mhfolder = MH_FOLDER(folder);
+
+	if (mhfolder->journal_fd >= 0)
+		close(mhfolder->journal_fd);
+	g_hash_table_destroy(mhfolder->journal_items);
+
 	folder_local_folder_destroy(LOCAL_FOLDER(folder));
 }
 
 static void mh_folder_init(Folder *folder, const gchar *name, const gchar *path)
 {
+	MHFolder *mhfolder = MH_FOLDER(folder);
+
 	folder_local_folder_init(folder, name, path);
 
+	mhfolder->journal_fd = -1;
+	mhfolder->journal_items = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+static FolderItem *mh_folder_item_new(Folder *folder)
+{
+	MHFolderItem *item;
+
+	item = g_new0(MHFolderItem, 1);
+	item->journal_wd = -1;
+
+	return (FolderItem *)item;
+}
+
+static void mh_folder_item_destroy(Folder *folder, FolderItem *_item)
+{
+	MHFolderItem *item = (MHFolderItem *)_item;
+
+	cm_return_if_fail(item != NULL);
+
+	mh_journal_stop(MH_FOLDER(folder), item);
+	g_free(_item);
+}
+
+/*
+ * Change journal.
+ *
+ * Once an item has been listed completely, an inotify watch on its
+ * directory keeps the set of message numbers up to date, so that the
+ * next scans don't have to read the whole directory again.  The
+ * journal is dropped, and the next scan lists the directory, if the
+ * event queue overflows or the directory itself goes away; it isn't
+ * saved, so the first scan after a restart is always a full one.
+ */
+
+static void mh_journal_stop(MHFolder *folder, MHFolderItem *item)
+{
+	if (item->journal_wd >= 0) {
+#ifdef HAVE_SYS_INOTIFY_H
+		inotify_rm_watch(folder->journal_fd, item->journal_wd);
+#endif
+		g_hash_table_remove(folder->journal_items,
+				    GINT_TO_POINTER(item->journal_wd));
+		item->journal_wd = -1;
+	}
+	if (item->journal_nums != NULL) {
+		g_hash_table_destroy(item->journal_nums);
+		item->journal_nums = NULL;
+	}
+	if (item->journal_changed != NULL) {
+		g_hash_table_destroy(item->journal_changed);
+		item->journal_changed = NULL;
+	}
+	if (item->scan_changed != NULL) {
+		g_hash_table_destroy(item->scan_changed);
+		item->scan_changed = NULL;
+	}
+	item->journal_valid = FALSE;
+}
+
+/* Starts watching the item's directory, with an empty set of numbers;
+ * must be called before listing it, so that no change is lost. */
+static gboolean mh_journal_start(MHFolder *folder, MHFolderItem *item,
+				 const gchar *path)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	gint wd;
+
+	if (folder->journal_fd < 0) {
+		folder->journal_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (folder->journal_fd < 0) {
+			debug_print("MH: no change journal: %s\n",
+				    g_strerror(errno));
+			return FALSE;
+		}
+	}
+
+	wd = inotify_add_watch(folder->journal_fd, path,
+			       IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+			       IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE |
+			       IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+	if (wd < 0) {
+		debug_print("MH: can't watch %s: %s\n", path, g_strerror(errno));
+		mh_journal_stop(folder, item);
+		return FALSE;
+	}
+
+	if (item->journal_wd >= 0 && item->journal_wd != wd)
+		g_hash_table_remove(folder->journal_items,
+				    GINT_TO_POINTER(item->journal_wd));
+	item->journal_wd = wd;
+	g_hash_table_insert(folder->journal_items, GINT_TO_POINTER(wd), item);
+
+	if (item->journal_nums == NULL) {
+		item->journal_nums = g_hash_table_new(g_direct_hash,
+						      g_direct_equal);
+		item->journal_changed = g_hash_table_new(g_direct_hash,
+							 g_direct_equal);
+	} else {
+		g_hash_table_remove_all(item->journal_nums);
+		g_hash_table_remove_all(item->journal_changed);
+	}
+	item->journal_valid = FALSE;
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+static void mh_journal_invalidate_func(gpointer key, gpointer value,
+				       gpointer data)
+{
+	MHFolderItem *item = (MHFolderItem *)value;
+
+	item->journal_valid = FALSE;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+static void mh_journal_apply(MHFolder *folder, const struct inotify_event *event)
+{
+	MHFolderItem *item;
+	gint num;
+
+	if (event->mask & IN_Q_OVERFLOW) {
+		debug_print("MH: change journal overflowed\n");
+		g_hash_table_foreach(folder->journal_items,
+				     mh_journal_invalidate_func, NULL);
+		return;
+	}
+
+	item = g_hash_table_lookup(folder->journal_items,
+				   GINT_TO_POINTER(event->wd));
+	if (item == NULL)
+		return;
+
+	if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+		mh_journal_stop(folder, item);
+		return;
+	}
+
+	if (!item->journal_valid || event->len == 0 || (event->mask & IN_ISDIR))
+		return;
+	if ((num = to_number(event->name)) <= 0)
+		return;
+
+	if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+		g_hash_table_add(item->journal_nums, GINT_TO_POINTER(num));
+		g_hash_table_add(item->journal_changed, GINT_TO_POINTER(num));
+	} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+		g_hash_table_remove(item->journal_nums, GINT_TO_POINTER(num));
+		g_hash_table_remove(item->journal_changed, GINT_TO_POINTER(num));
+	} else if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)) {
+		/* touch(1) or a restored backup changes the mtime the
+		 * cache compares against without writing the file */
+		g_hash_table_add(item->journal_changed, GINT_TO_POINTER(num));
+	}
+}
+#endif
+
+/* Applies the pending events to the journals of the folder's items. */
+static void mh_journal_read(MHFolder *folder)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	union {
+		struct inotify_event event;
+		gchar buf[4096];
+	} events;
+	gssize len;
+
+	if (folder->journal_fd < 0)
+		return;
+
+	for (;;) {
+		gchar *p;
+
+		len = read(folder->journal_fd, &events, sizeof(events));
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		for (p = events.buf; p < events.buf + len; ) {
+			const struct inotify_event *event =
+				(const struct inotify_event *)p;
+
+			mh_journal_apply(folder, event);
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	if (len < 0 && errno != EAGAIN) {
+		debug_print("MH: can't read change journal: %s\n",
+			    g_strerror(errno));
+		g_hash_table_foreach(folder->journal_items,
+				     mh_journal_invalidate_func, NULL);
+	}
+#endif
+}
+
+static void mh_journal_get_nums_func(gpointer key, gpointer value,
+				     gpointer data)
+{
+	GArray *array = (GArray *)data;
+	guint num = GPOINTER_TO_UINT(key);
+
+	g_array_append_val(array, num);
 }
 
 gboolean mh_scan_required(Folder *folder, FolderItem *item)
@@ -243,9 +485,8 @@ gboolean mh_scan_required(Folder *folder, FolderItem *item)
 
 static void mh_get_last_num(Folder *folder, FolderItem *item)
 {
-	gchar *path, *fullpath;
-	GDir *dp;
-	const gchar *d;
+	gchar *path;
+	DirScanner *dp;
 	GError *error = NULL;
 	gint max = 0;
 	gint num;
@@ -257,7 +498,7 @@ static void mh_get_last_num(Folder *folder, FolderItem *item)
 	path = folder_item_get_path(item);
 	cm_return_if_fail(path != NULL);
 
-	if ((dp = g_dir_open(path, 0, &error)) == NULL) {
+	if ((dp = dir_scanner_open(path, &error)) == NULL) {
 		g_warning("couldn't open directory '%s': %s (%d)",
 				path, error->message, error->code);
 		g_error_free(error);
@@ -265,59 +506,88 @@ static void mh_get_last_num(Folder *folder, FolderItem *item)
 		return;
 	}
 
-	while ((d = g_dir_read_name(dp)) != NULL) {
-		fullpath = g_strconcat(path, G_DIR_SEPARATOR_S, d, NULL);
-		if ((num = to_number(d)) > 0 &&
-		    g_file_test(fullpath, G_FILE_TEST_IS_REGULAR)) {
-			if (max < num)
-				max = num;
-		}
-		g_free(fullpath);
+	while (dir_scanner_next(dp) != NULL) {
+		if ((num = dir_scanner_get_number(dp)) > max &&
+		    dir_scanner_get_type(dp) == DIR_ENTRY_FILE)
+			max = num;
 
 		if (num % 2000 == 0)
 			GTK_EVENTS_FLUSH();
 	}
-	g_dir_close(dp);
+	dir_scanner_close(dp);
 	g_free(path);
 
 	debug_print("Last number in dir %s = %d\n", item->path?item->path:"(null)", max);
 	item->last_num = max;
 }
 
-gint mh_get_num_list(Folder *folder, FolderItem *item, GSList **list, gboolean *old_uids_valid)
+static gint mh_get_num_array(Folder *folder, FolderItem *item, GArray *array, gboolean *old_uids_valid)
 {
-
+	MHFolder *mhfolder = MH_FOLDER(folder);
+	MHFolderItem *mhitem = (MHFolderItem *)item;
 	gchar *path;
-	GDir *dp;
-	const gchar *d;
+	DirScanner *dp;
 	GError *error = NULL;
 	gint num, nummsgs = 0;
+	gboolean journal;
 
 	cm_return_val_if_fail(item != NULL, -1);
 
-	debug_print("mh_get_num_list(): Scanning %s ...\n", item->path?item->path:"(null)");
-
 	*old_uids_valid = TRUE;
 
+	if (mhitem->scan_changed != NULL) {
+		g_hash_table_destroy(mhitem->scan_changed);
+		mhitem->scan_changed = NULL;
+	}
+
+	mh_journal_read(mhfolder);
+	if (mhitem->journal_valid) {
+		debug_print("mh_get_num_array(): Using change journal of %s (%u changed)\n",
+			    item->path?item->path:"(null)",
+			    g_hash_table_size(mhitem->journal_changed));
+		g_hash_table_foreach(mhitem->journal_nums,
+				     mh_journal_get_nums_func, array);
+		/* the scan only has to check those */
+		mhitem->scan_changed = mhitem->journal_changed;
+		mhitem->journal_changed = g_hash_table_new(g_direct_hash,
+							   g_direct_equal);
+		mh_set_mtime(folder, item);
+		return g_hash_table_size(mhitem->journal_nums);
+	}
+
+	debug_print("mh_get_num_array(): Scanning %s ...\n", item->path?item->path:"(null)");
+
 	path = folder_item_get_path(item);
 	cm_return_val_if_fail(path != NULL, -1);
 
-	if ((dp = g_dir_open(path, 0, &error)) == NULL) {
+	journal = mh_journal_start(mhfolder, mhitem, path);
+
+	if ((dp = dir_scanner_open(path, &error)) == NULL) {
 		g_message("Couldn't open current directory: %s (%d).\n",
 				error->message, error->code);
 		g_error_free(error);
 		g_free(path);
+		mh_journal_stop(mhfolder, mhitem);
 		return -1;
 	}
 	g_free(path);
 
-	while ((d = g_dir_read_name(dp)) != NULL) {
-		if ((num = to_number(d)) > 0) {
-			*list = g_slist_prepend(*list, GINT_TO_POINTER(num));
+	while (dir_scanner_next(dp) != NULL) {
+		if ((num = dir_scanner_get_number(dp)) > 0) {
+			g_array_append_val(array, num);
+			if (journal)
+				g_hash_table_add(mhitem->journal_nums,
+						 GINT_TO_POINTER(num));
 		   	nummsgs++;
 		}
 	}
-	g_dir_close(dp);
+	dir_scanner_close(dp);
+
+	/* catch up with the changes made while listing */
+	if (journal) {
+		mhitem->journal_valid = TRUE;
+		mh_journal_read(mhfolder);
+	}
 
 	mh_set_mtime(folder, item);
 	return nummsgs;
@@ -753,6 +1023,14 @@ static gboolean mh_is_msg_changed(Folder *folder, FolderItem *item,
 #endif
 	gchar *path;
 	gchar *parent_path;
+	MHFolderItem *mhitem = (MHFolderItem *)item;
+
+	/* while scanning with the change journal, the files it didn't
+	 * see written are as they were */
+	if (item->scanning != ITEM_NOT_SCANNING && mhitem->scan_changed != NULL &&
+	    !g_hash_table_contains(mhitem->scan_changed,
+				   GINT_TO_POINTER(msginfo->msgnum)))
+		return FALSE;
 
 	parent_path = folder_item_get_path(item);
 	path = g_strdup_printf("%s%c%d", parent_path,
@@ -1179,7 +1457,7 @@ static void mh_remove_missing_folder_items(Folder *folder)
 static void mh_scan_tree_recursive(FolderItem *item)
 {
 	Folder *folder;
-	GDir *dir;
+	DirScanner *dir;
 	const gchar *dir_name;
 	gchar *entry, *utf8entry, *utf8name, *path;
 	gint n_msg = 0;
@@ -1192,7 +1470,7 @@ static void mh_scan_tree_recursive(FolderItem *item)
 
 	path = folder_item_get_path(item);
 	debug_print("mh_scan_tree_recursive() opening '%s'\n", path);
-	dir = g_dir_open(path, 0, &error);
+	dir = dir_scanner_open(path, &error);
 	if (!dir) {
 		g_warning("failed to open directory '%s': %s (%d)",
 				path, error->message, error->code);
@@ -1207,22 +1485,29 @@ static void mh_scan_tree_recursive(FolderItem *item)
 	if (folder->ui_func)
 		folder->ui_func(folder, item, folder->ui_func_data);
 
-	while ((dir_name = g_dir_read_name(dir)) != NULL) {
+	while ((dir_name = dir_scanner_next(dir)) != NULL) {
 		if (dir_name[0] == '.') continue;
 
-		entry = g_strconcat(path, G_DIR_SEPARATOR_S, dir_name, NULL);
-
-		utf8name = mh_filename_to_utf8(dir_name);
-		if (item->path)
-			utf8entry = g_strconcat(item->path, G_DIR_SEPARATOR_S,
-						utf8name, NULL);
-		else
-			utf8entry = g_strdup(utf8name);
+		/* message files need neither a stat() nor the names below */
+		if (dir_scanner_get_number(dir) > 0 &&
+		    dir_scanner_get_type(dir) == DIR_ENTRY_FILE) {
+			n_msg++;
+			continue;
+		}
 
-		if (g_file_test(entry, G_FILE_TEST_IS_DIR)) {
+		if (dir_scanner_get_type(dir) == DIR_ENTRY_DIR) {
 			FolderItem *new_item = NULL;
 			GNode *node;
 
+			entry = g_strconcat(path, G_DIR_SEPARATOR_S, dir_name, NULL);
+
+			utf8name = mh_filename_to_utf8(dir_name);
+			if (item->path)
+				utf8entry = g_strconcat(item->path, G_DIR_SEPARATOR_S,
+							utf8name, NULL);
+			else
+				utf8entry = g_strdup(utf8name);
+
 			node = item->node;
 			for (node = node->children; node != NULL; node = node->next) {
 				FolderItem *cur_item = FOLDER_ITEM(node->data);
@@ -1264,15 +1549,15 @@ static void mh_scan_tree_recursive(FolderItem *item)
 				}
 			}
 
-			mh_scan_tree_recursive(new_item);
-		} else if (to_number(dir_name) > 0) n_msg++;
+			g_free(entry);
+			g_free(utf8entry);
+			g_free(utf8name);
 
-		g_free(entry);
-		g_free(utf8entry);
-		g_free(utf8name);
+			mh_scan_tree_recursive(new_item);
+		} else if (dir_scanner_get_number(dir) > 0) n_msg++;
 	}
 
-	g_dir_close(dir);
+	dir_scanner_close(dir);
 	g_free(path);
 
 	mh_set_mtime(folder, item);
@@ -32,6 +32,10 @@ typedef struct _MHFolder	MHFolder;
 struct _MHFolder
 {
 	LocalFolder lfolder;
+
+	/* inotify instance shared by the change journals of the items */
+	gint journal_fd;
+	GHashTable *journal_items;	/* watch descriptor -> item */
 };
 
 FolderClass *mh_get_class	(void);
@@ -88,6 +88,7 @@ static gboolean msgcache_use_mmap_read = TRUE;
 #endif
 
 static gboolean swapping = TRUE;
+static gboolean msgcache_use_arena = TRUE;
 
 typedef enum
 {
@@ -99,8 +100,40 @@ typedef enum
 struct _MsgCache {
 	GHashTable	*msgnum_table;
 	GHashTable	*msgid_table;
+	MsgCacheArena	*arena;
+	ThreadIndex	*thread_index;
 	guint		 memusage;
 	time_t		 last_access;
+	gboolean	 outdated;
+};
+
+/* The cache file is made of sections, one per MsgCacheColumn, each
+ * holding the values of every message in ascending msgnum order.
+ * After the version and charset, the file starts with the number of
+ * messages, the number of sections and one (id, offset, length) entry
+ * per section, so that a reader can go straight to the columns it
+ * needs. Integer sections are plain arrays of 32-bit values; string
+ * sections hold length-prefixed strings, several per message for
+ * MSGCACHE_COL_ADDRESSES and MSGCACHE_COL_OTHERS.
+ * ROW_CACHE_VERSION files store each message as one record and are
+ * still read; they get converted the next time the cache is written. */
+#define ROW_CACHE_VERSION	24
+
+typedef struct _CacheCursor CacheCursor;
+struct _CacheCursor {
+	gchar	*data;
+	gint	 rem_len;
+};
+
+/* One block holding all the NUL-terminated strings of a cache file, so
+ * that loading a folder doesn't cost one allocation per header field.
+ * Every MsgInfo loaded into it holds a reference; the strings are only
+ * released once the last of these is freed. */
+struct _MsgCacheArena {
+	guint		 refcnt;
+	gchar		*data;
+	gsize		 size;
+	gsize		 used;
 };
 
 typedef struct _StringConverter StringConverter;
@@ -122,6 +155,93 @@ struct _CharsetConverter {
 	gchar *dstcharset;
 };
 
+static MsgCacheArena *msgcache_arena_new(gsize size)
+{
+	MsgCacheArena *arena;
+
+	arena = g_new0(MsgCacheArena, 1);
+	arena->data = g_try_malloc(size);
+	if (arena->data == NULL) {
+		g_free(arena);
+		return NULL;
+	}
+	arena->size = size;
+	arena->refcnt = 1;
+
+	return arena;
+}
+
+MsgCacheArena *msgcache_arena_ref(MsgCacheArena *arena)
+{
+	cm_return_val_if_fail(arena != NULL, NULL);
+
+	arena->refcnt++;
+
+	return arena;
+}
+
+void msgcache_arena_unref(MsgCacheArena *arena)
+{
+	if (arena == NULL)
+		return;
+
+	arena->refcnt--;
+	if (arena->refcnt > 0)
+		return;
+
+	g_free(arena->data);
+	g_free(arena);
+}
+
+gboolean msgcache_arena_owns(MsgCacheArena *arena, const gchar *str)
+{
+	if (arena == NULL || str == NULL)
+		return FALSE;
+
+	return str >= arena->data && str < arena->data + arena->used;
+}
+
+#define FREESTR(n) { \
+	if (!msgcache_arena_owns(msginfo->arena, n)) \
+		g_free(n); \
+	n = NULL; \
+}
+/*!
+ *\brief	Free the header strings and references of a message,
+ *		except those living in its cache arena, and drop its
+ *		reference on the arena
+ */
+void msgcache_msginfo_free_strings(MsgInfo *msginfo)
+{
+	GSList *cur;
+
+	FREESTR(msginfo->fromname);
+
+	FREESTR(msginfo->date);
+	FREESTR(msginfo->from);
+	FREESTR(msginfo->to);
+	FREESTR(msginfo->cc);
+	FREESTR(msginfo->newsgroups);
+	FREESTR(msginfo->subject);
+	FREESTR(msginfo->msgid);
+	FREESTR(msginfo->inreplyto);
+	FREESTR(msginfo->xref);
+
+	for (cur = msginfo->references; cur != NULL; cur = cur->next)
+		FREESTR(cur->data);
+	g_slist_free(msginfo->references);
+	msginfo->references = NULL;
+
+	msgcache_arena_unref(msginfo->arena);
+	msginfo->arena = NULL;
+}
+#undef FREESTR
+
+void msgcache_set_use_arena(gboolean use_arena)
+{
+	msgcache_use_arena = use_arena;
+}
+
 MsgCache *msgcache_new(void)
 {
 	MsgCache *cache;
@@ -144,9 +264,11 @@ void msgcache_destroy(MsgCache *cache)
 {
 	cm_return_if_fail(cache != NULL);
 
+	thread_index_free(cache->thread_index);
 	g_hash_table_foreach_remove(cache->msgnum_table, msgcache_msginfo_free_func, NULL);
 	g_hash_table_destroy(cache->msgid_table);
 	g_hash_table_destroy(cache->msgnum_table);
+	msgcache_arena_unref(cache->arena);
 	g_free(cache);
 }
 
@@ -161,6 +283,8 @@ void msgcache_add_msg(MsgCache *cache, MsgInfo *msginfo)
 	g_hash_table_insert(cache->msgnum_table, &newmsginfo->msgnum, newmsginfo);
 	if(newmsginfo->msgid != NULL)
 		g_hash_table_insert(cache->msgid_table, newmsginfo->msgid, newmsginfo);
+	if (cache->thread_index)
+		thread_index_add(cache->thread_index, newmsginfo);
 	cache->memusage += procmsg_msginfo_memusage(msginfo);
 	cache->last_access = time(NULL);
 
@@ -183,6 +307,8 @@ void msgcache_remove_msg(MsgCache *cache, guint msgnum)
 	if(msginfo->msgid)
 		g_hash_table_remove(cache->msgid_table, msginfo->msgid);
 	g_hash_table_remove(cache->msgnum_table, &msginfo->msgnum);
+	if (cache->thread_index)
+		thread_index_remove(cache->thread_index, msginfo);
 
 	msginfo->folder->cache_dirty = TRUE;
 
@@ -193,6 +319,38 @@ void msgcache_remove_msg(MsgCache *cache, guint msgnum)
 	debug_print("Cache size: %d messages, %u bytes\n", g_hash_table_size(cache->msgnum_table), cache->memusage);
 }
 
+void msgcache_remove_msgs(MsgCache *cache, const guint *msgnums, guint count)
+{
+	guint i;
+
+	cm_return_if_fail(cache != NULL);
+
+	if (count == 0)
+		return;
+
+	for (i = 0; i < count; i++) {
+		MsgInfo *msginfo;
+
+		msginfo = (MsgInfo *) g_hash_table_lookup(cache->msgnum_table, &msgnums[i]);
+		if(!msginfo)
+			continue;
+
+		cache->memusage -= procmsg_msginfo_memusage(msginfo);
+		if(msginfo->msgid)
+			g_hash_table_remove(cache->msgid_table, msginfo->msgid);
+		g_hash_table_remove(cache->msgnum_table, &msginfo->msgnum);
+		if (cache->thread_index)
+			thread_index_remove(cache->thread_index, msginfo);
+
+		msginfo->folder->cache_dirty = TRUE;
+
+		procmsg_msginfo_free(&msginfo);
+	}
+	cache->last_access = time(NULL);
+
+	debug_print("Removed %u messages, cache size: %d messages, %u bytes\n", count, g_hash_table_size(cache->msgnum_table), cache->memusage);
+}
+
 void msgcache_update_msg(MsgCache *cache, MsgInfo *msginfo)
 {
 	MsgInfo *oldmsginfo, *newmsginfo;
@@ -205,6 +363,8 @@ void msgcache_update_msg(MsgCache *cache, MsgInfo *msginfo)
 		g_hash_table_remove(cache->msgid_table, oldmsginfo->msgid);
 	if (oldmsginfo) {
 		g_hash_table_remove(cache->msgnum_table, &oldmsginfo->msgnum);
+		if (cache->thread_index)
+			thread_index_remove(cache->thread_index, oldmsginfo);
 		cache->memusage -= procmsg_msginfo_memusage(oldmsginfo);
 		procmsg_msginfo_free(&oldmsginfo);
 	}
@@ -213,6 +373,8 @@ void msgcache_update_msg(MsgCache *cache, MsgInfo *msginfo)
 	g_hash_table_insert(cache->msgnum_table, &newmsginfo->msgnum, newmsginfo);
 	if(newmsginfo->msgid)
 		g_hash_table_insert(cache->msgid_table, newmsginfo->msgid, newmsginfo);
+	if (cache->thread_index)
+		thread_index_add(cache->thread_index, newmsginfo);
 	cache->memusage += procmsg_msginfo_memusage(newmsginfo);
 	cache->last_access = time(NULL);
 	
@@ -274,6 +436,66 @@ MsgInfoList *msgcache_get_msg_list(MsgCache *cache)
 	return msg_list;
 }
 
+static void msgcache_get_msg_num_array_func(gpointer key, gpointer value, gpointer user_data)
+{
+	GArray *array = user_data;
+	MsgInfo *msginfo = value;
+
+	g_array_append_val(array, msginfo->msgnum);
+}
+
+/* returns the unsorted message numbers of the cache, without taking
+ * references on the MsgInfos like msgcache_get_msg_list() does */
+GArray *msgcache_get_msg_num_array(MsgCache *cache)
+{
+	GArray *array;
+
+	cm_return_val_if_fail(cache != NULL, NULL);
+
+	array = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+				  g_hash_table_size(cache->msgnum_table));
+	g_hash_table_foreach(cache->msgnum_table, msgcache_get_msg_num_array_func, array);
+	cache->last_access = time(NULL);
+
+	return array;
+}
+
+static void msgcache_get_thread_list_func(gpointer key, gpointer value, gpointer user_data)
+{
+	MsgInfoList **listptr = user_data;
+
+	*listptr = g_slist_prepend(*listptr, value);
+}
+
+static gint msgcache_thread_list_cmp(gconstpointer a, gconstpointer b)
+{
+	const MsgInfo *msginfo_a = a;
+	const MsgInfo *msginfo_b = b;
+
+	return (msginfo_a->msgnum > msginfo_b->msgnum) -
+	       (msginfo_a->msgnum < msginfo_b->msgnum);
+}
+
+/* The thread index is built the first time it is asked for, and then
+ * follows the changes of the cache */
+ThreadIndex *msgcache_get_thread_index(MsgCache *cache)
+{
+	cm_return_val_if_fail(cache != NULL, NULL);
+
+	if (cache->thread_index == NULL) {
+		MsgInfoList *msg_list = NULL;
+
+		g_hash_table_foreach(cache->msgnum_table,
+				     msgcache_get_thread_list_func, &msg_list);
+		/* the first message of a Message-ID stays its owner */
+		msg_list = g_slist_sort(msg_list, msgcache_thread_list_cmp);
+		cache->thread_index = thread_index_new(msg_list);
+		g_slist_free(msg_list);
+	}
+
+	return cache->thread_index;
+}
+
 time_t msgcache_get_last_access_time(MsgCache *cache)
 {
 	cm_return_val_if_fail(cache != NULL, 0);
@@ -288,6 +510,13 @@ gint msgcache_get_memory_usage(MsgCache *cache)
 	return cache->memusage;
 }
 
+gboolean msgcache_is_outdated(MsgCache *cache)
+{
+	cm_return_val_if_fail(cache != NULL, FALSE);
+
+	return cache->outdated;
+}
+
 /*
  *  Cache saving functions
  */
@@ -338,7 +567,9 @@ gint msgcache_get_memory_usage(MsgCache *cache)
 		error = TRUE;									\
 		goto bail_err;									\
 	}											\
-	if ((tmp_len = msgcache_get_cache_data_str(walk_data, &data, tmp_len, conv)) < 0) { \
+	if ((tmp_len = (arena != NULL ?							\
+			msgcache_get_cache_data_arena_str(walk_data, &data, tmp_len, arena) :	\
+			msgcache_get_cache_data_str(walk_data, &data, tmp_len, conv))) < 0) {	\
 		g_print("error at rem_len:%d\n", rem_len);\
 		procmsg_msginfo_free(&msginfo); \
 		error = TRUE; \
@@ -547,6 +778,32 @@ static gint msgcache_get_cache_data_str(gchar *src, gchar **str, gint len,
 	return len;
 }
 
+static gint msgcache_get_cache_data_arena_str(gchar *src, gchar **str, gint len,
+					      MsgCacheArena *arena)
+{
+	*str = NULL;
+
+	if (len == 0)
+		return 0;
+
+	if (len > 2*1024*1024) {
+		g_warning("read_data_str: refusing to allocate %d bytes", len);
+		return -1;
+	}
+
+	if (arena->used + len + 1 > arena->size) {
+		g_warning("read_data_str: cache arena overflow");
+		return -1;
+	}
+
+	*str = arena->data + arena->used;
+	memcpy(*str, src, len);
+	(*str)[len] = '\0';
+	arena->used += len + 1;
+
+	return len;
+}
+
 static gchar *strconv_charset_convert(StringConverter *conv, gchar *srcstr)
 {
 	CharsetConverter *charsetconv = (CharsetConverter *) conv;
@@ -562,6 +819,264 @@ static void strconv_charset_free(StringConverter *conv)
 	g_free(charsetconv->dstcharset);
 }
 
+static gboolean msgcache_cursor_get_int(CacheCursor *cursor, guint32 *n)
+{
+	if (cursor->data == NULL || cursor->rem_len < 4)
+		return FALSE;
+
+	*n = MMAP_TO_GUINT32_SWAPPED(cursor->data);
+	cursor->data += 4;
+	cursor->rem_len -= 4;
+
+	return TRUE;
+}
+
+static gboolean msgcache_cursor_get_str(CacheCursor *cursor, gchar **str,
+					StringConverter *conv,
+					MsgCacheArena *arena,
+					guint *memusage)
+{
+	guint32 len;
+	gint tmp_len;
+
+	*str = NULL;
+
+	if (!msgcache_cursor_get_int(cursor, &len) || len > (guint32)cursor->rem_len)
+		return FALSE;
+
+	if (arena != NULL)
+		tmp_len = msgcache_get_cache_data_arena_str(cursor->data, str, len, arena);
+	else
+		tmp_len = msgcache_get_cache_data_str(cursor->data, str, len, conv);
+	if (tmp_len < 0)
+		return FALSE;
+
+	cursor->data += len;
+	cursor->rem_len -= len;
+	*memusage += len;
+
+	return TRUE;
+}
+
+static gboolean msgcache_read_section_index(CacheCursor *header,
+					    gchar *data, gint data_len,
+					    guint32 *count,
+					    CacheCursor *sections)
+{
+	guint32 num_sections, id, offset, length, i;
+
+	if (!msgcache_cursor_get_int(header, count) ||
+	    !msgcache_cursor_get_int(header, &num_sections))
+		return FALSE;
+
+	for (i = 0; i < MSGCACHE_NUM_COLUMNS; i++) {
+		sections[i].data = NULL;
+		sections[i].rem_len = 0;
+	}
+
+	for (i = 0; i < num_sections; i++) {
+		if (!msgcache_cursor_get_int(header, &id) ||
+		    !msgcache_cursor_get_int(header, &offset) ||
+		    !msgcache_cursor_get_int(header, &length))
+			return FALSE;
+		if (offset > (guint32)data_len || length > (guint32)data_len - offset) {
+			g_warning("cache section %u out of bounds (%u+%u > %d)",
+				  id, offset, length, data_len);
+			return FALSE;
+		}
+		/* skip sections written by newer versions */
+		if (id >= MSGCACHE_NUM_COLUMNS)
+			continue;
+		sections[id].data = data + offset;
+		sections[id].rem_len = length;
+	}
+
+	for (i = 0; i < MSGCACHE_NUM_COLUMNS; i++) {
+		if (sections[i].data == NULL && *count > 0) {
+			g_warning("cache section %u missing", i);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+#define GET_COLUMN_INT(col, n)						\
+{									\
+	if (!msgcache_cursor_get_int(&sections[col], &tmp_int))	\
+		goto bail_err;						\
+	n = tmp_int;							\
+}
+
+#define GET_COLUMN_STR(col, str)					\
+{									\
+	if (!msgcache_cursor_get_str(&sections[col], &str, conv,	\
+				     arena, memusage))			\
+		goto bail_err;						\
+}
+
+static gboolean msgcache_read_columns(MsgCache *cache, FolderItem *item,
+				      gchar *data, gint data_len, gint pos,
+				      StringConverter *conv,
+				      MsgTmpFlags tmp_flags,
+				      guint *memusage)
+{
+	CacheCursor header, sections[MSGCACHE_NUM_COLUMNS];
+	MsgCacheArena *arena = NULL;
+	MsgInfo *msginfo = NULL;
+	guint32 count, tmp_int, refnum, i;
+	gchar *ref;
+
+	header.data = data + pos;
+	header.rem_len = data_len - pos;
+	if (!msgcache_read_section_index(&header, data, data_len, &count, sections))
+		return FALSE;
+
+	if (msgcache_use_arena && conv == NULL) {
+		gsize strings_len = sections[MSGCACHE_COL_MSGID].rem_len
+			+ sections[MSGCACHE_COL_SUBJECT].rem_len
+			+ sections[MSGCACHE_COL_ADDRESSES].rem_len
+			+ sections[MSGCACHE_COL_OTHERS].rem_len;
+
+		if (strings_len > 0)
+			arena = msgcache_arena_new(strings_len);
+		cache->arena = arena;
+	}
+
+	for (i = 0; i < count; i++) {
+		msginfo = procmsg_msginfo_new();
+		if (arena != NULL)
+			msginfo->arena = msgcache_arena_ref(arena);
+
+		GET_COLUMN_INT(MSGCACHE_COL_MSGNUM, msginfo->msgnum);
+		GET_COLUMN_INT(MSGCACHE_COL_SIZE, msginfo->size);
+		GET_COLUMN_INT(MSGCACHE_COL_MTIME, msginfo->mtime);
+		GET_COLUMN_INT(MSGCACHE_COL_DATE_T, msginfo->date_t);
+		GET_COLUMN_INT(MSGCACHE_COL_FLAGS, msginfo->flags.tmp_flags);
+		*memusage += sizeof(MsgInfo);
+
+		GET_COLUMN_STR(MSGCACHE_COL_MSGID, msginfo->msgid);
+		GET_COLUMN_STR(MSGCACHE_COL_SUBJECT, msginfo->subject);
+
+		GET_COLUMN_STR(MSGCACHE_COL_ADDRESSES, msginfo->fromname);
+		GET_COLUMN_STR(MSGCACHE_COL_ADDRESSES, msginfo->from);
+		GET_COLUMN_STR(MSGCACHE_COL_ADDRESSES, msginfo->to);
+		GET_COLUMN_STR(MSGCACHE_COL_ADDRESSES, msginfo->cc);
+		GET_COLUMN_STR(MSGCACHE_COL_ADDRESSES, msginfo->newsgroups);
+
+		GET_COLUMN_STR(MSGCACHE_COL_OTHERS, msginfo->date);
+		GET_COLUMN_STR(MSGCACHE_COL_OTHERS, msginfo->inreplyto);
+		GET_COLUMN_STR(MSGCACHE_COL_OTHERS, msginfo->xref);
+		GET_COLUMN_INT(MSGCACHE_COL_OTHERS, msginfo->planned_download);
+		GET_COLUMN_INT(MSGCACHE_COL_OTHERS, msginfo->total_size);
+		GET_COLUMN_INT(MSGCACHE_COL_OTHERS, refnum);
+
+		for (; refnum != 0; refnum--) {
+			GET_COLUMN_STR(MSGCACHE_COL_OTHERS, ref);
+			if (ref != NULL)
+				msginfo->references =
+					g_slist_prepend(msginfo->references, ref);
+		}
+		msginfo->references = g_slist_reverse(msginfo->references);
+
+		msginfo->folder = item;
+		msginfo->flags.tmp_flags |= tmp_flags;
+
+		g_hash_table_insert(cache->msgnum_table, &msginfo->msgnum, msginfo);
+		if(msginfo->msgid)
+			g_hash_table_insert(cache->msgid_table, msginfo->msgid, msginfo);
+	}
+
+	if (arena != NULL) {
+		/* the strings are all in the arena, count it once */
+		*memusage = count * sizeof(MsgInfo) + arena->size;
+		debug_print("Cache strings in a %"G_GSIZE_FORMAT" bytes arena (%"G_GSIZE_FORMAT" used)\n",
+			    arena->size, arena->used);
+	}
+
+	return TRUE;
+
+bail_err:
+	g_warning("cache data corrupted at message %u of %u", i, count);
+	procmsg_msginfo_free(&msginfo);
+	return FALSE;
+}
+
+#undef GET_COLUMN_INT
+#undef GET_COLUMN_STR
+
+guint32 *msgcache_read_cache_column(const gchar *cache_file,
+				    MsgCacheColumn column,
+				    guint *count)
+{
+	FILE *fp;
+	gchar *charset = NULL;
+	guint32 num_msgs, num_sections, id, offset, length, i;
+	guint32 col_offset = 0, col_length = 0;
+	guint32 *values = NULL;
+	gboolean found = FALSE;
+
+	cm_return_val_if_fail(cache_file != NULL, NULL);
+	cm_return_val_if_fail(count != NULL, NULL);
+	cm_return_val_if_fail(column == MSGCACHE_COL_MSGNUM ||
+			      column == MSGCACHE_COL_SIZE ||
+			      column == MSGCACHE_COL_MTIME ||
+			      column == MSGCACHE_COL_DATE_T ||
+			      column == MSGCACHE_COL_FLAGS, NULL);
+
+	*count = 0;
+
+	/* only the section index and the one section are read */
+	if ((fp = msgcache_open_data_file(cache_file, CACHE_VERSION,
+					  DATA_READ, NULL, 0)) == NULL)
+		return NULL;
+
+	if (msgcache_read_cache_data_str(fp, &charset, NULL) < 0)
+		goto bail_err;
+	g_free(charset);
+
+#define READ_INDEX_INT(n) \
+	if (claws_fread(&n, sizeof(n), 1, fp) != 1) \
+		goto bail_err; \
+	n = bswap_32(n);
+
+	READ_INDEX_INT(num_msgs);
+	READ_INDEX_INT(num_sections);
+	for (i = 0; i < num_sections; i++) {
+		READ_INDEX_INT(id);
+		READ_INDEX_INT(offset);
+		READ_INDEX_INT(length);
+		if (id == column) {
+			col_offset = offset;
+			col_length = length;
+			found = TRUE;
+		}
+	}
+#undef READ_INDEX_INT
+
+	if (!found || col_length != num_msgs * sizeof(guint32) ||
+	    fseek(fp, col_offset, SEEK_SET) != 0)
+		goto bail_err;
+
+	values = g_new(guint32, num_msgs > 0 ? num_msgs : 1);
+	if (claws_fread(values, sizeof(guint32), num_msgs, fp) != num_msgs) {
+		g_free(values);
+		values = NULL;
+		goto bail_err;
+	}
+	for (i = 0; i < num_msgs; i++)
+		values[i] = bswap_32(values[i]);
+	*count = num_msgs;
+
+bail_err:
+	if (values == NULL)
+		debug_print("couldn't read cache column %d from %s\n",
+			    column, cache_file);
+	claws_fclose(fp);
+
+	return values;
+}
+
 MsgCache *msgcache_read_cache(FolderItem *item, const gchar *cache_file)
 {
 	MsgCache *cache;
@@ -579,6 +1094,8 @@ MsgCache *msgcache_read_cache(FolderItem *item, const gchar *cache_file)
 	guint memusage = 0;
 	gint tmp_len = 0, map_len = -1;
 	char *cache_data = NULL;
+	MsgCacheArena *arena = NULL;
+	gboolean columns = TRUE;
 	struct stat st;
 
 	cm_return_val_if_fail(cache_file != NULL, NULL);
@@ -589,15 +1106,20 @@ MsgCache *msgcache_read_cache(FolderItem *item, const gchar *cache_file)
 	/* In case we can't open the mark file with MARK_VERSION, check if we can open it with the
 	 * swapped MARK_VERSION. As msgcache_open_data_file swaps it too, if this succeeds, 
 	 * it means it's the old version (not little-endian) on a big-endian machine. The code has
-	 * no effect on x86 as their file doesn't change. */
+	 * no effect on x86 as their file doesn't change. 
+	 * Column caches have only ever been written little-endian. */
 
 	if ((fp = msgcache_open_data_file
 		(cache_file, CACHE_VERSION, DATA_READ, file_buf, sizeof(file_buf))) == NULL) {
+		columns = FALSE;
 		if ((fp = msgcache_open_data_file
-		(cache_file, bswap_32(CACHE_VERSION), DATA_READ, file_buf, sizeof(file_buf))) == NULL)
-			return NULL;
-		else
-			swapping = FALSE;
+			(cache_file, ROW_CACHE_VERSION, DATA_READ, file_buf, sizeof(file_buf))) == NULL) {
+			if ((fp = msgcache_open_data_file
+			(cache_file, bswap_32(ROW_CACHE_VERSION), DATA_READ, file_buf, sizeof(file_buf))) == NULL)
+				return NULL;
+			else
+				swapping = FALSE;
+		}
 	}
 
 	debug_print("\tReading %sswapped message cache from %s...\n", swapping?"":"un", cache_file);
@@ -635,6 +1157,7 @@ MsgCache *msgcache_read_cache(FolderItem *item, const gchar *cache_file)
 	g_free(srccharset);
 
 	cache = msgcache_new();
+	cache->outdated = !columns;
 
 	if (msgcache_use_mmap_read == TRUE) {
 		if (fstat(fileno(fp), &st) >= 0)
@@ -662,12 +1185,39 @@ MsgCache *msgcache_read_cache(FolderItem *item, const gchar *cache_file)
 	} else {
 		cache_data = NULL;
 	}
-	if (cache_data != NULL && cache_data != MAP_FAILED) {
+	if (columns) {
+		gchar *file_data = NULL;
+		gsize file_len = 0;
+		gint pos = ftell(fp);
+
+		if (cache_data != NULL && cache_data != MAP_FAILED) {
+			error = !msgcache_read_columns(cache, item, cache_data, map_len,
+						       pos, conv, tmp_flags, &memusage);
+		} else if (g_file_get_contents(cache_file, &file_data, &file_len, NULL)) {
+			error = !msgcache_read_columns(cache, item, file_data, file_len,
+						       pos, conv, tmp_flags, &memusage);
+			g_free(file_data);
+		} else {
+			error = TRUE;
+		}
+	} else if (cache_data != NULL && cache_data != MAP_FAILED) {
 		int rem_len = map_len-ftell(fp);
 		char *walk_data = cache_data+ftell(fp);
 
+		/* Every string is preceded by its 32-bit length, so the rest
+		 * of the file is always large enough to hold all of them
+		 * NUL-terminated. Strings needing charset conversion are
+		 * allocated one by one as before. */
+		if (msgcache_use_arena && conv == NULL && rem_len > 0) {
+			arena = msgcache_arena_new(rem_len);
+			if (arena != NULL)
+				cache->arena = arena;
+		}
+
 		while(rem_len > 0) {
 			msginfo = procmsg_msginfo_new();
+			if (arena != NULL)
+				msginfo->arena = msgcache_arena_ref(arena);
 
 			GET_CACHE_DATA_INT(num);
 
@@ -705,7 +1255,8 @@ MsgCache *msgcache_read_cache(FolderItem *item, const gchar *cache_file)
 						msginfo->references =
 							g_slist_prepend(msginfo->references, ref);
                     } else {
-						g_free(ref);
+						if (!msgcache_arena_owns(arena, ref))
+							g_free(ref);
 						ref = NULL;
 					}
                 }
@@ -799,6 +1350,13 @@ bail_err:
 	}
 
 	cache->last_access = time(NULL);
+	if (arena != NULL) {
+		/* the strings are all in the arena, count it once */
+		memusage = g_hash_table_size(cache->msgnum_table) * sizeof(MsgInfo)
+			+ arena->size;
+		debug_print("Cache strings in a %"G_GSIZE_FORMAT" bytes arena (%"G_GSIZE_FORMAT" used)\n",
+			    arena->size, arena->used);
+	}
 	cache->memusage = memusage;
 
 	debug_print("done. (%d items read)\n", g_hash_table_size(cache->msgnum_table));
@@ -1014,40 +1572,107 @@ bail_err:
 	}
 }
 
-static int msgcache_write_cache(MsgInfo *msginfo, FILE *fp)
+static int msgcache_write_column(MsgInfo *msginfo, MsgCacheColumn column,
+				 FILE *fp)
 {
 	MsgTmpFlags flags = msginfo->flags.tmp_flags & MSG_CACHED_FLAG_MASK;
 	GSList *cur;
 	int w_err = 0, wrote = 0;
 
-	WRITE_CACHE_DATA_INT(msginfo->msgnum, fp);
-	WRITE_CACHE_DATA_INT(msginfo->size, fp);
-	WRITE_CACHE_DATA_INT(msginfo->mtime, fp);
-	WRITE_CACHE_DATA_INT(msginfo->date_t, fp);
-	WRITE_CACHE_DATA_INT(flags, fp);
-
-	WRITE_CACHE_DATA(msginfo->fromname, fp);
-
-	WRITE_CACHE_DATA(msginfo->date, fp);
-	WRITE_CACHE_DATA(msginfo->from, fp);
-	WRITE_CACHE_DATA(msginfo->to, fp);
-	WRITE_CACHE_DATA(msginfo->cc, fp);
-	WRITE_CACHE_DATA(msginfo->newsgroups, fp);
-	WRITE_CACHE_DATA(msginfo->subject, fp);
-	WRITE_CACHE_DATA(msginfo->msgid, fp);
-	WRITE_CACHE_DATA(msginfo->inreplyto, fp);
-	WRITE_CACHE_DATA(msginfo->xref, fp);
-	WRITE_CACHE_DATA_INT(msginfo->planned_download, fp);
-	WRITE_CACHE_DATA_INT(msginfo->total_size, fp);
-        
-	WRITE_CACHE_DATA_INT(g_slist_length(msginfo->references), fp);
-
-	for (cur = msginfo->references; cur != NULL; cur = cur->next) {
-		WRITE_CACHE_DATA((gchar *)cur->data, fp);
+	switch (column) {
+	case MSGCACHE_COL_MSGNUM:
+		WRITE_CACHE_DATA_INT(msginfo->msgnum, fp);
+		break;
+	case MSGCACHE_COL_SIZE:
+		WRITE_CACHE_DATA_INT(msginfo->size, fp);
+		break;
+	case MSGCACHE_COL_MTIME:
+		WRITE_CACHE_DATA_INT(msginfo->mtime, fp);
+		break;
+	case MSGCACHE_COL_DATE_T:
+		WRITE_CACHE_DATA_INT(msginfo->date_t, fp);
+		break;
+	case MSGCACHE_COL_FLAGS:
+		WRITE_CACHE_DATA_INT(flags, fp);
+		break;
+	case MSGCACHE_COL_MSGID:
+		WRITE_CACHE_DATA(msginfo->msgid, fp);
+		break;
+	case MSGCACHE_COL_SUBJECT:
+		WRITE_CACHE_DATA(msginfo->subject, fp);
+		break;
+	case MSGCACHE_COL_ADDRESSES:
+		WRITE_CACHE_DATA(msginfo->fromname, fp);
+		WRITE_CACHE_DATA(msginfo->from, fp);
+		WRITE_CACHE_DATA(msginfo->to, fp);
+		WRITE_CACHE_DATA(msginfo->cc, fp);
+		WRITE_CACHE_DATA(msginfo->newsgroups, fp);
+		break;
+	case MSGCACHE_COL_OTHERS:
+		WRITE_CACHE_DATA(msginfo->date, fp);
+		WRITE_CACHE_DATA(msginfo->inreplyto, fp);
+		WRITE_CACHE_DATA(msginfo->xref, fp);
+		WRITE_CACHE_DATA_INT(msginfo->planned_download, fp);
+		WRITE_CACHE_DATA_INT(msginfo->total_size, fp);
+		WRITE_CACHE_DATA_INT(g_slist_length(msginfo->references), fp);
+		for (cur = msginfo->references; cur != NULL; cur = cur->next) {
+			WRITE_CACHE_DATA((gchar *)cur->data, fp);
+		}
+		break;
+	default:
+		break;
 	}
+
 	return w_err ? -1 : wrote;
 }
 
+static int msgcache_write_columns(GPtrArray *msgs, FILE *fp)
+{
+	guint32 offsets[MSGCACHE_NUM_COLUMNS], lengths[MSGCACHE_NUM_COLUMNS];
+	long index_pos, start;
+	guint i, col;
+	int w_err = 0, wrote = 0, total, tmp;
+
+	WRITE_CACHE_DATA_INT(msgs->len, fp);
+	WRITE_CACHE_DATA_INT(MSGCACHE_NUM_COLUMNS, fp);
+
+	/* the index is filled in once the sections are written */
+	index_pos = ftell(fp);
+	for (col = 0; col < MSGCACHE_NUM_COLUMNS; col++) {
+		WRITE_CACHE_DATA_INT(col, fp);
+		WRITE_CACHE_DATA_INT(0, fp);
+		WRITE_CACHE_DATA_INT(0, fp);
+	}
+
+	for (col = 0; col < MSGCACHE_NUM_COLUMNS && w_err == 0; col++) {
+		start = ftell(fp);
+		for (i = 0; i < msgs->len; i++) {
+			tmp = msgcache_write_column(g_ptr_array_index(msgs, i), col, fp);
+			if (tmp < 0) {
+				w_err = 1;
+				break;
+			}
+			wrote += tmp;
+		}
+		offsets[col] = start;
+		lengths[col] = ftell(fp) - start;
+	}
+
+	if (w_err != 0 || index_pos < 0 || fseek(fp, index_pos, SEEK_SET) != 0)
+		return -1;
+
+	total = wrote;
+	for (col = 0; col < MSGCACHE_NUM_COLUMNS; col++) {
+		WRITE_CACHE_DATA_INT(col, fp);
+		WRITE_CACHE_DATA_INT(offsets[col], fp);
+		WRITE_CACHE_DATA_INT(lengths[col], fp);
+	}
+	if (fseek(fp, 0, SEEK_END) != 0)
+		w_err = 1;
+
+	return w_err ? -1 : total;
+}
+
 static int msgcache_write_flags(MsgInfo *msginfo, FILE *fp)
 {
 	MsgPermFlags flags = msginfo->flags.perm_flags;
@@ -1085,22 +1710,29 @@ struct write_fps
 	guint tags_size;
 };
 
-static void msgcache_write_func(gpointer key, gpointer value, gpointer user_data)
+static void msgcache_get_msg_array_func(gpointer key, gpointer value, gpointer user_data)
+{
+	g_ptr_array_add((GPtrArray *)user_data, value);
+}
+
+static gint msgcache_cmp_msgnum(gconstpointer a, gconstpointer b)
+{
+	const MsgInfo *msginfo_a = *(const MsgInfo **)a;
+	const MsgInfo *msginfo_b = *(const MsgInfo **)b;
+
+	return (msginfo_a->msgnum > msginfo_b->msgnum) -
+	       (msginfo_a->msgnum < msginfo_b->msgnum);
+}
+
+static void msgcache_write_func(gpointer data, gpointer user_data)
 {
 	MsgInfo *msginfo;
 	struct write_fps *write_fps;
 	int tmp;
 
-	msginfo = (MsgInfo *)value;
+	msginfo = (MsgInfo *)data;
 	write_fps = user_data;
 
-	if (write_fps->cache_fp) {
-		tmp = msgcache_write_cache(msginfo, write_fps->cache_fp);
-		if (tmp < 0)
-			write_fps->error = 1;
-		else
-			write_fps->cache_size += tmp;
-	}
 	if (write_fps->mark_fp) {
 	tmp= msgcache_write_flags(msginfo, write_fps->mark_fp);
 		if (tmp < 0)
@@ -1121,7 +1753,8 @@ gint msgcache_write(const gchar *cache_file, const gchar *mark_file, const gchar
 {
 	struct write_fps write_fps;
 	gchar *new_cache = NULL, *new_mark = NULL, *new_tags = NULL;
-	int w_err = 0, wrote = 0;
+	GPtrArray *msgs;
+	int w_err = 0, wrote = 0, tmp;
 
 	START_TIMING("");
 	cm_return_val_if_fail(cache != NULL, -1);
@@ -1214,8 +1847,20 @@ gint msgcache_write(const gchar *cache_file, const gchar *mark_file, const gchar
 	if (write_fps.tags_fp)
 		write_fps.tags_size = ftell(write_fps.tags_fp);
 
-	/* write data to the files */
-	g_hash_table_foreach(cache->msgnum_table, msgcache_write_func, (gpointer)&write_fps);
+	/* write data to the files, in msgnum order */
+	msgs = g_ptr_array_sized_new(g_hash_table_size(cache->msgnum_table));
+	g_hash_table_foreach(cache->msgnum_table, msgcache_get_msg_array_func, msgs);
+	g_ptr_array_sort(msgs, msgcache_cmp_msgnum);
+
+	if (write_fps.cache_fp) {
+		tmp = msgcache_write_columns(msgs, write_fps.cache_fp);
+		if (tmp < 0)
+			write_fps.error = 1;
+		else
+			write_fps.cache_size += tmp;
+	}
+	g_ptr_array_foreach(msgs, msgcache_write_func, (gpointer)&write_fps);
+	g_ptr_array_free(msgs, TRUE);
 
 	/* close files */
 	if (write_fps.cache_fp)
@@ -1243,6 +1888,8 @@ gint msgcache_write(const gchar *cache_file, const gchar *mark_file, const gchar
 			move_file(new_mark, mark_file, TRUE);
 		if (tags_file)
 			move_file(new_tags, tags_file, TRUE);
+		if (cache_file)
+			cache->outdated = FALSE;
 		cache->last_access = time(NULL);
 	}
 
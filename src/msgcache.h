@@ -28,13 +28,31 @@
 
 typedef struct _MsgCache MsgCache;
 
+/* Sections of the on-disk cache, in file order */
+typedef enum {
+	MSGCACHE_COL_MSGNUM,
+	MSGCACHE_COL_SIZE,
+	MSGCACHE_COL_MTIME,
+	MSGCACHE_COL_DATE_T,
+	MSGCACHE_COL_FLAGS,
+	MSGCACHE_COL_MSGID,
+	MSGCACHE_COL_SUBJECT,
+	MSGCACHE_COL_ADDRESSES,	/* fromname, from, to, cc, newsgroups */
+	MSGCACHE_COL_OTHERS,	/* date, inreplyto, xref, sizes, references */
+	MSGCACHE_NUM_COLUMNS
+} MsgCacheColumn;
+
 #include "procmsg.h"
+#include "threadindex.h"
 #include "folder.h"
 
 MsgCache   	*msgcache_new				(void);
 void	   	 msgcache_destroy			(MsgCache *cache);
 MsgCache   	*msgcache_read_cache			(FolderItem *item,
 							 const gchar *cache_file);
+guint32		*msgcache_read_cache_column		(const gchar *cache_file,
+							 MsgCacheColumn column,
+							 guint *count);
 void	   	 msgcache_read_mark			(MsgCache *cache,
 							 const gchar *mark_file);
 void	   	 msgcache_read_tags			(MsgCache *cache,
@@ -47,6 +65,9 @@ void 	   	 msgcache_add_msg			(MsgCache *cache,
 							 MsgInfo *msginfo);
 void 	   	 msgcache_remove_msg			(MsgCache *cache,
 							 guint num);
+void 	   	 msgcache_remove_msgs			(MsgCache *cache,
+							 const guint *msgnums,
+							 guint count);
 void 	    	 msgcache_update_msg			(MsgCache *cache,
 							 MsgInfo *msginfo);
 MsgInfo	   	*msgcache_get_msg			(MsgCache *cache,
@@ -54,7 +75,17 @@ MsgInfo	   	*msgcache_get_msg			(MsgCache *cache,
 MsgInfo	   	*msgcache_get_msg_by_id			(MsgCache *cache,
 							 const gchar *msgid);
 MsgInfoList	*msgcache_get_msg_list			(MsgCache *cache);
+GArray		*msgcache_get_msg_num_array		(MsgCache *cache);
+ThreadIndex	*msgcache_get_thread_index		(MsgCache *cache);
 time_t	   	 msgcache_get_last_access_time		(MsgCache *cache);
 gint	   	 msgcache_get_memory_usage		(MsgCache *cache);
+gboolean	 msgcache_is_outdated			(MsgCache *cache);
+
+MsgCacheArena	*msgcache_arena_ref			(MsgCacheArena *arena);
+void		 msgcache_arena_unref			(MsgCacheArena *arena);
+gboolean	 msgcache_arena_owns			(MsgCacheArena *arena,
+							 const gchar *str);
+void		 msgcache_msginfo_free_strings		(MsgInfo *msginfo);
+void		 msgcache_set_use_arena			(gboolean use_arena);
 
 #endif
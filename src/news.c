@@ -123,9 +123,9 @@ static gint news_select_group		 (Folder	*folder,
 					  gint		*first,
 					  gint		*last);
 static MsgInfo *news_parse_xover	 (struct newsnntp_xover_resp_item *item);
-static gint news_get_num_list		 	 (Folder 	*folder, 
+static gint news_get_num_ranges		 (Folder 	*folder, 
 					  FolderItem 	*item,
-					  GSList       **list,
+					  GArray	*ranges,
 					  gboolean	*old_uids_valid);
 static MsgInfo *news_get_msginfo		 (Folder 	*folder, 
 					  FolderItem 	*item,
@@ -133,6 +133,9 @@ static MsgInfo *news_get_msginfo		 (Folder 	*folder,
 static GSList *news_get_msginfos		 (Folder 	*folder,
 					  FolderItem 	*item,
 					  GSList 	*msgnum_list);
+static GSList *news_get_msginfos_for_ranges	 (Folder 	*folder,
+					  FolderItem 	*item,
+					  GArray 	*ranges);
 static gboolean news_scan_required		 (Folder 	*folder,
 					  FolderItem 	*item);
 
@@ -164,7 +167,7 @@ FolderClass *news_get_class(void)
 
 		/* FolderItem functions */
 		news_class.item_get_path = news_item_get_path;
-		news_class.get_num_list = news_get_num_list;
+		news_class.get_num_ranges = news_get_num_ranges;
 		news_class.scan_required = news_scan_required;
 		news_class.rename_folder = news_rename_folder;
 		news_class.remove_folder = news_remove_folder;
@@ -172,6 +175,7 @@ FolderClass *news_get_class(void)
 		/* Message functions */
 		news_class.get_msginfo = news_get_msginfo;
 		news_class.get_msginfos = news_get_msginfos;
+		news_class.get_msginfos_for_ranges = news_get_msginfos_for_ranges;
 		news_class.fetch_msg = news_fetch_msg;
 		news_class.synchronise = news_synchronise;
 		news_class.search_msgs = folder_item_search_msgs_local;
@@ -1042,10 +1046,10 @@ static gchar *news_item_get_path(Folder *folder, FolderItem *item)
 	return path;
 }
 
-static gint news_get_num_list(Folder *folder, FolderItem *item, GSList **msgnum_list, gboolean *old_uids_valid)
+static gint news_get_num_ranges(Folder *folder, FolderItem *item, GArray *ranges, gboolean *old_uids_valid)
 {
 	NewsSession *session;
-	gint i, ok, num, first, last, nummsgs = 0;
+	gint ok, num, first, last, nummsgs = 0;
 	gchar *dir;
 
 	cm_return_val_if_fail(item != NULL, -1);
@@ -1073,11 +1077,10 @@ static gint news_get_num_list(Folder *folder, FolderItem *item, GSList **msgnum_
 		log_warning(LOG_PROTOCOL, _("invalid article range: %d - %d\n"),
 			    first, last);
 	else {
-		for (i = first; i <= last; i++) {
-			*msgnum_list = g_slist_prepend(*msgnum_list, 
-						       GINT_TO_POINTER(i));
-			nummsgs++;
-		}
+		/* GROUP only gives the bounds, the articles missing in
+		 * between are left out by XOVER */
+		uint_ranges_append(ranges, first, last);
+		nummsgs = last - first + 1;
 		debug_print("removing old messages from %d to %d in %s\n",
 			    first, last, dir);
 		remove_numbered_files(dir, 1, first - 1);
@@ -1321,52 +1324,65 @@ static MsgInfo *news_get_msginfo(Folder *folder, FolderItem *item, gint num)
 	return msginfo;
 }
 
-static GSList *news_get_msginfos(Folder *folder, FolderItem *item, GSList *msgnum_list)
+static GSList *news_get_msginfos_for_ranges(Folder *folder, FolderItem *item, GArray *ranges)
 {
 	NewsSession *session;
-	GSList *elem, *msginfo_list = NULL, *tmp_msgnum_list, *tmp_msginfo_list;
-	guint first, last, next;
-	
+	GSList *msginfo_list = NULL, *tmp_msginfo_list;
+	guint i;
+
 	cm_return_val_if_fail(folder != NULL, NULL);
 	cm_return_val_if_fail(FOLDER_CLASS(folder) == &news_class, NULL);
-	cm_return_val_if_fail(msgnum_list != NULL, NULL);
+	cm_return_val_if_fail(ranges != NULL, NULL);
 	cm_return_val_if_fail(item != NULL, NULL);
-	
+
 	session = news_session_get(folder);
 	cm_return_val_if_fail(session != NULL, NULL);
 
-	tmp_msgnum_list = g_slist_copy(msgnum_list);
-	tmp_msgnum_list = g_slist_sort(tmp_msgnum_list, g_int_compare);
-
 	progressindicator_start(PROGRESS_TYPE_NETWORK);
 
-	first = GPOINTER_TO_INT(tmp_msgnum_list->data);
-	last = first;
-	
 	news_folder_lock(NEWS_FOLDER(item->folder));
-	
-	for(elem = g_slist_next(tmp_msgnum_list); elem != NULL; elem = g_slist_next(elem)) {
-		next = GPOINTER_TO_INT(elem->data);
-		if(next != (last + 1)) {
-			tmp_msginfo_list = news_get_msginfos_for_range(session, item, first, last);
-			msginfo_list = g_slist_concat(msginfo_list, tmp_msginfo_list);
-			first = next;
-		}
-		last = next;
+
+	for (i = 0; i < ranges->len; i++) {
+		UIntRange *range = &g_array_index(ranges, UIntRange, i);
+
+		tmp_msginfo_list = news_get_msginfos_for_range(session, item,
+							       range->first,
+							       range->last);
+		msginfo_list = g_slist_concat(msginfo_list, tmp_msginfo_list);
 	}
-	
+
 	news_folder_unlock(NEWS_FOLDER(item->folder));
-	
-	tmp_msginfo_list = news_get_msginfos_for_range(session, item, first, last);
-	msginfo_list = g_slist_concat(msginfo_list, tmp_msginfo_list);
 
-	g_slist_free(tmp_msgnum_list);
-	
 	progressindicator_stop(PROGRESS_TYPE_NETWORK);
 
 	return msginfo_list;
 }
 
+static GSList *news_get_msginfos(Folder *folder, FolderItem *item, GSList *msgnum_list)
+{
+	GSList *msginfo_list, *elem;
+	GArray *nums, *ranges;
+
+	cm_return_val_if_fail(msgnum_list != NULL, NULL);
+
+	nums = g_array_new(FALSE, FALSE, sizeof(guint));
+	for (elem = msgnum_list; elem != NULL; elem = g_slist_next(elem)) {
+		guint num = GPOINTER_TO_UINT(elem->data);
+
+		g_array_append_val(nums, num);
+	}
+	sort_uint_array((guint *) nums->data, nums->len);
+
+	ranges = g_array_new(FALSE, FALSE, sizeof(UIntRange));
+	uint_ranges_append_array(ranges, (guint *) nums->data, nums->len);
+	g_array_free(nums, TRUE);
+
+	msginfo_list = news_get_msginfos_for_ranges(folder, item, ranges);
+	g_array_free(ranges, TRUE);
+
+	return msginfo_list;
+}
+
 static gboolean news_scan_required(Folder *folder, FolderItem *item)
 {
 	return TRUE;
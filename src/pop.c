@@ -72,12 +72,20 @@ static gint pop3_retr_recv		(Pop3Session *session,
 static gint pop3_delete_send		(Pop3Session *session);
 static gint pop3_delete_recv		(Pop3Session *session);
 static gint pop3_logout_send		(Pop3Session *session);
+static gint pop3_pipeline_next		(Pop3Session *session);
 
 static void pop3_gen_send		(Pop3Session	*session,
 					 const gchar	*format, ...);
 
 static void pop3_session_destroy	(Session	*session);
 
+static Pop3MsgFile *pop3_msg_file_open	(const gchar	*file,
+					 const gchar	*prefix);
+static gint pop3_msg_file_write		(Pop3MsgFile	*msg_file,
+					 const gchar	*data,
+					 guint		 len);
+static gchar *pop3_msg_file_close	(Pop3MsgFile	*msg_file);
+static void pop3_msg_file_abort		(Pop3MsgFile	*msg_file);
 static gint pop3_write_msg_to_file	(const gchar	*file,
 					 const gchar	*data,
 					 guint		 len,
@@ -92,6 +100,10 @@ static gint pop3_session_recv_msg		(Session	*session,
 static gint pop3_session_recv_data_finished	(Session	*session,
 						 guchar		*data,
 						 guint		 len);
+static gint pop3_session_recv_data_chunk	(Session	*session,
+						 const guchar	*data,
+						 guint		 len,
+						 gpointer	 user_data);
 static void pop3_get_uidl_table(PrefsAccount *ac_prefs, Pop3Session *session);
 
 static gint pop3_greeting_recv(Pop3Session *session, const gchar *msg)
@@ -253,6 +265,33 @@ static gint pop3_getauth_oauth2_send(Pop3Session *session)
 }
 #endif
 
+static gint pop3_getcapa_send(Pop3Session *session)
+{
+	session->state = POP3_GETCAPA;
+	pop3_gen_send(session, "CAPA");
+	return PS_SUCCESS;
+}
+
+static gint pop3_getcapa_recv(Pop3Session *session, const gchar *data,
+			      guint len)
+{
+	const gchar *p = data, *lastp = data + len;
+
+	while (p < lastp) {
+		const gchar *newline = memchr(p, '\n', lastp - p);
+		const gchar *end = newline ? newline : lastp;
+
+		if (end - p >= 10 && !g_ascii_strncasecmp(p, "PIPELINING", 10) &&
+		    (end - p == 10 || g_ascii_isspace(p[10])))
+			session->pipelining = TRUE;
+		p = end + 1;
+	}
+
+	debug_print("POP3 server %s pipelining\n",
+		    session->pipelining ? "supports" : "does not support");
+	return PS_SUCCESS;
+}
+
 static gint pop3_getrange_stat_send(Pop3Session *session)
 {
 	session->state = POP3_GETRANGE_STAT;
@@ -426,12 +465,81 @@ static gint pop3_retr_send(Pop3Session *session)
 	return PS_SUCCESS;
 }
 
+/* Starts receiving a message, straight to a file unless a plugin wants
+ * to see it whole first */
+static void pop3_msg_recv_start(Pop3Session *session, const gchar *prefix)
+{
+	gchar *file;
+
+	if (!hooks_has_hooks(MAIL_RECEIVE_HOOKLIST)) {
+		file = get_tmp_file();
+		session->recv_msg_file = pop3_msg_file_open(file, prefix);
+		g_free(file);
+	}
+
+	if (session->recv_msg_file != NULL)
+		session_recv_data_stream(SESSION(session), ".\r\n",
+					 pop3_session_recv_data_chunk, session);
+	else
+		session_recv_data(SESSION(session), 0, ".\r\n");
+}
+
+/* Returns the file the message was written to as it was received */
+static gchar *pop3_msg_recv_finish(Pop3Session *session)
+{
+	gchar *file;
+
+	file = pop3_msg_file_close(session->recv_msg_file);
+	session->recv_msg_file = NULL;
+	if (file == NULL)
+		session->error_val = PS_IOERR;
+
+	return file;
+}
+
+static gint pop3_session_recv_data_chunk(Session *session,
+					 const guchar *data, guint len,
+					 gpointer user_data)
+{
+	Pop3Session *pop3_session = POP3_SESSION(user_data);
+
+	if (pop3_msg_file_write(pop3_session->recv_msg_file,
+				(const gchar *)data, len) < 0) {
+		pop3_msg_file_abort(pop3_session->recv_msg_file);
+		pop3_session->recv_msg_file = NULL;
+		pop3_session->error_val = PS_IOERR;
+		return -1;
+	}
+
+	return 0;
+}
+
+static gchar *pop3_partial_notice(Pop3Session *session)
+{
+	return g_strdup_printf("SC-Marked-For-Download: 0\n"
+			       "SC-Partially-Retrieved: %s\n"
+			       "SC-Account-Server: %s\n"
+			       "SC-Account-Login: %s\n"
+			       "SC-Message-Size: %d",
+			       session->msg[session->cur_msg].uidl,
+			       session->ac_prefs->recv_server,
+			       session->ac_prefs->userid,
+			       session->msg[session->cur_msg].size);
+}
+
 static gint pop3_retr_recv(Pop3Session *session, const gchar *data, guint len)
 {
 	gchar *file;
 	gint drop_ok;
 	MailReceiveData mail_receive_data;
 
+	if (data == NULL) {
+		file = pop3_msg_recv_finish(session);
+		if (file == NULL)
+			return -1;
+		goto written;
+	}
+
 	/* NOTE: we allocate a slightly larger buffer with a zero terminator
 	 * because some plugins may think that it has a C string. */
 	mail_receive_data.session  = session;
@@ -451,6 +559,8 @@ static gint pop3_retr_recv(Pop3Session *session, const gchar *data, guint len)
 	}
 	g_free(mail_receive_data.data);
 
+written:
+
 	if (session->msg[session->cur_msg].partial_recv
 	    == POP3_MUST_COMPLETE_RECV) {
 		gchar *old_file = partial_get_filename(
@@ -486,11 +596,16 @@ static gint pop3_retr_recv(Pop3Session *session, const gchar *data, guint len)
 	return PS_SUCCESS;
 }
 
+static gint pop3_top_lines(gint max_size)
+{
+	return (max_size*1024)/82; /* consider lines to be 80 chars */
+}
+
 static gint pop3_top_send(Pop3Session *session, gint max_size)
 {
-	gint num_lines = (max_size*1024)/82; /* consider lines to be 80 chars */
 	session->state = POP3_TOP;
-	pop3_gen_send(session, "TOP %d %d", session->cur_msg, num_lines);
+	pop3_gen_send(session, "TOP %d %d", session->cur_msg,
+		      pop3_top_lines(max_size));
 	return PS_SUCCESS;
 }
 
@@ -501,6 +616,13 @@ static gint pop3_top_recv(Pop3Session *session, const gchar *data, guint len)
 	MailReceiveData mail_receive_data;
 	gchar *partial_notice = NULL;
 
+	if (data == NULL) {
+		file = pop3_msg_recv_finish(session);
+		if (file == NULL)
+			return -1;
+		goto written;
+	}
+
 	/* NOTE: we allocate a slightly larger buffer with a zero terminator
 	 * because some plugins may think that it has a C string. */
 	mail_receive_data.session  = session;
@@ -510,15 +632,7 @@ static gint pop3_top_recv(Pop3Session *session, const gchar *data, guint len)
 
 	hooks_invoke(MAIL_RECEIVE_HOOKLIST, &mail_receive_data);
 
-	partial_notice = g_strdup_printf("SC-Marked-For-Download: 0\n"
-					 "SC-Partially-Retrieved: %s\n"
-					 "SC-Account-Server: %s\n"
-					 "SC-Account-Login: %s\n"
-					 "SC-Message-Size: %d",
-					 session->msg[session->cur_msg].uidl,
-					 session->ac_prefs->recv_server,
-					 session->ac_prefs->userid,
-					 session->msg[session->cur_msg].size);
+	partial_notice = pop3_partial_notice(session);
 	file = get_tmp_file();
 	if (pop3_write_msg_to_file(file, mail_receive_data.data,
 				   mail_receive_data.data_len,
@@ -532,6 +646,7 @@ static gint pop3_top_recv(Pop3Session *session, const gchar *data, guint len)
 	g_free(mail_receive_data.data);
 	g_free(partial_notice);
 
+written:
 	/* drop_ok: 0: success 1: don't receive -1: error */
 	drop_ok = session->drop_message(session, file);
 	g_free(file);
@@ -632,6 +747,7 @@ Session *pop3_session_new(PrefsAccount *account)
 	session->current_time = time(NULL);
 	session->error_val = PS_SUCCESS;
 	session->error_msg = NULL;
+	session->pipeline = g_queue_new();
 
 	return SESSION(session);
 }
@@ -643,6 +759,11 @@ static void pop3_session_destroy(Session *session)
 
 	cm_return_if_fail(session != NULL);
 
+	if (pop3_session->recv_msg_file)
+		pop3_msg_file_abort(pop3_session->recv_msg_file);
+	g_queue_free_full(pop3_session->pipeline, g_free);
+	g_slist_free(pop3_session->pipeline_deletes);
+
 	for (n = 1; n <= pop3_session->count; n++)
 		g_free(pop3_session->msg[n].uidl);
 	g_free(pop3_session->msg);
@@ -817,146 +938,389 @@ err_write:
 
 #undef TRY
 
-static gint pop3_write_msg_to_file(const gchar *file, const gchar *data,
-				   guint len, const gchar *prefix)
+typedef enum {
+	POP3_UNSTUFF_LINE_START,
+	POP3_UNSTUFF_DOT,
+	POP3_UNSTUFF_LINE,
+	POP3_UNSTUFF_CR
+} Pop3UnstuffState;
+
+/* A message being written to a file while it is received: CRLFs become
+ * LFs and the dot-stuffing is undone on the way, the state remembering
+ * where the previous chunk ended. */
+struct _Pop3MsgFile
 {
+	gchar *file;
 	FILE *fp;
-	const gchar *prev, *cur;
+	Pop3UnstuffState state;
+	gchar last;
+};
 
-	cm_return_val_if_fail(file != NULL, -1);
+static void pop3_msg_file_abort(Pop3MsgFile *msg_file)
+{
+	if (msg_file->fp)
+		claws_fclose(msg_file->fp);
+	claws_unlink(msg_file->file);
+	g_free(msg_file->file);
+	g_free(msg_file);
+}
+
+static Pop3MsgFile *pop3_msg_file_open(const gchar *file, const gchar *prefix)
+{
+	Pop3MsgFile *msg_file;
+	FILE *fp;
+
+	cm_return_val_if_fail(file != NULL, NULL);
 
 	if ((fp = claws_fopen(file, "wb")) == NULL) {
 		FILE_OP_ERROR(file, "claws_fopen");
-		return -1;
+		return NULL;
 	}
 
 	if (change_file_mode_rw(fp, file) < 0)
 		FILE_OP_ERROR(file, "chmod");
 
+	msg_file = g_new0(Pop3MsgFile, 1);
+	msg_file->file = g_strdup(file);
+	msg_file->fp = fp;
+	msg_file->state = POP3_UNSTUFF_LINE_START;
+	msg_file->last = '\n';
+
 	if (prefix != NULL) {
 		if (fprintf(fp, "%s\n", prefix) < 0) {
 			FILE_OP_ERROR(file, "fprintf");
-			claws_fclose(fp);
-			claws_unlink(file);
-			return -1;
+			pop3_msg_file_abort(msg_file);
+			return NULL;
 		}
 	}
 
-	/* +------------------+----------------+--------------------------+ *
-	 * ^data              ^prev            ^cur             data+len-1^ */
-
-	prev = data;
-	while ((cur = (gchar *)my_memmem(prev, len - (prev - data), "\r\n", 2))
-	       != NULL) {
-		if ((cur > prev && claws_fwrite(prev, 1, cur - prev, fp) < 1) ||
-		    claws_fputc('\n', fp) == EOF) {
-			FILE_OP_ERROR(file, "claws_fwrite");
-			g_warning("can't write to file: %s", file);
-			claws_fclose(fp);
-			claws_unlink(file);
-			return -1;
-		}
+	return msg_file;
+}
 
-		if (cur == data + len - 1) {
-			prev = cur + 1;
+static gint pop3_msg_file_putc(Pop3MsgFile *msg_file, gchar c)
+{
+	if (claws_fputc(c, msg_file->fp) == EOF)
+		return -1;
+	msg_file->last = c;
+	return 0;
+}
+
+static gint pop3_msg_file_write(Pop3MsgFile *msg_file, const gchar *data,
+				guint len)
+{
+	const gchar *p = data, *end = data + len;
+
+	while (p < end) {
+		switch (msg_file->state) {
+		case POP3_UNSTUFF_LINE_START:
+			msg_file->state = POP3_UNSTUFF_LINE;
+			if (*p == '.') {
+				msg_file->state = POP3_UNSTUFF_DOT;
+				p++;
+			}
+			break;
+		case POP3_UNSTUFF_DOT:
+			/* ".." stands for "." */
+			if (pop3_msg_file_putc(msg_file, '.') < 0)
+				goto err_write;
+			msg_file->state = POP3_UNSTUFF_LINE;
+			if (*p == '.')
+				p++;
+			break;
+		case POP3_UNSTUFF_CR:
+			if (*p == '\n') {
+				if (pop3_msg_file_putc(msg_file, '\n') < 0)
+					goto err_write;
+				msg_file->state = POP3_UNSTUFF_LINE_START;
+				p++;
+			} else {
+				if (pop3_msg_file_putc(msg_file, '\r') < 0)
+					goto err_write;
+				msg_file->state = POP3_UNSTUFF_LINE;
+			}
+			break;
+		case POP3_UNSTUFF_LINE: {
+			const gchar *cr = memchr(p, '\r', end - p);
+			const gchar *stop = cr != NULL ? cr : end;
+
+			if (stop > p) {
+				if (claws_fwrite(p, 1, stop - p, msg_file->fp) < 1)
+					goto err_write;
+				msg_file->last = *(stop - 1);
+			}
+			p = stop;
+			if (cr != NULL) {
+				msg_file->state = POP3_UNSTUFF_CR;
+				p++;
+			}
 			break;
 		}
+		}
+	}
 
-		if (*(cur + 1) == '\n')
-			prev = cur + 2;
-		else
-			prev = cur + 1;
+	return 0;
 
-		if (prev - data < len - 1 && *prev == '.' && *(prev + 1) == '.')
-			prev++;
+err_write:
+	FILE_OP_ERROR(msg_file->file, "claws_fwrite");
+	g_warning("can't write to file: %s", msg_file->file);
+	return -1;
+}
 
-		if (prev - data >= len)
-			break;
+/* Completes the file, frees msg_file and returns the file name, or NULL
+ * if the file could not be written */
+static gchar *pop3_msg_file_close(Pop3MsgFile *msg_file)
+{
+	gchar *file;
+	gint ret = 0;
+
+	if (msg_file->state == POP3_UNSTUFF_DOT)
+		ret = pop3_msg_file_putc(msg_file, '.');
+	else if (msg_file->state == POP3_UNSTUFF_CR)
+		ret = pop3_msg_file_putc(msg_file, '\r');
+	if (ret == 0 && msg_file->last != '\r' && msg_file->last != '\n')
+		ret = pop3_msg_file_putc(msg_file, '\n');
+	if (ret < 0) {
+		FILE_OP_ERROR(msg_file->file, "claws_fputc");
+		g_warning("can't write to file: %s", msg_file->file);
+		pop3_msg_file_abort(msg_file);
+		return NULL;
 	}
 
-	if (prev - data < len &&
-	    claws_fwrite(prev, 1, len - (prev - data), fp) < 1) {
-		FILE_OP_ERROR(file, "claws_fwrite");
-		g_warning("can't write to file: %s", file);
-		claws_fclose(fp);
-		claws_unlink(file);
-		return -1;
-	}
-	if (data[len - 1] != '\r' && data[len - 1] != '\n') {
-		if (claws_fputc('\n', fp) == EOF) {
-			FILE_OP_ERROR(file, "claws_fputc");
-			g_warning("can't write to file: %s", file);
-			claws_fclose(fp);
-			claws_unlink(file);
-			return -1;
-		}
+	if (claws_safe_fclose(msg_file->fp) == EOF) {
+		FILE_OP_ERROR(msg_file->file, "claws_fclose");
+		msg_file->fp = NULL;
+		pop3_msg_file_abort(msg_file);
+		return NULL;
 	}
 
-	if (claws_safe_fclose(fp) == EOF) {
-		FILE_OP_ERROR(file, "claws_fclose");
-		claws_unlink(file);
+	file = msg_file->file;
+	g_free(msg_file);
+	return file;
+}
+
+static gint pop3_write_msg_to_file(const gchar *file, const gchar *data,
+				   guint len, const gchar *prefix)
+{
+	Pop3MsgFile *msg_file;
+	gchar *written;
+
+	msg_file = pop3_msg_file_open(file, prefix);
+	if (msg_file == NULL)
+		return -1;
+
+	if (pop3_msg_file_write(msg_file, data, len) < 0) {
+		pop3_msg_file_abort(msg_file);
 		return -1;
 	}
 
+	written = pop3_msg_file_close(msg_file);
+	if (written == NULL)
+		return -1;
+	g_free(written);
+
 	return 0;
 }
 
-static Pop3State pop3_lookup_next(Pop3Session *session)
+/* Decides what message n needs: POP3_DELETE if it has been left on the
+ * server long enough, POP3_TOP or POP3_RETR to get it, POP3_READY if it
+ * is skipped */
+static Pop3State pop3_msg_action(Pop3Session *session, gint n)
 {
-	Pop3MsgInfo *msg;
+	Pop3MsgInfo *msg = &session->msg[n];
 	PrefsAccount *ac = session->ac_prefs;
-	gint size;
+	gint size = msg->size;
 	gboolean size_limit_over;
 
+	size_limit_over =
+	    (ac->enable_size_limit &&
+	     ac->size_limit > 0 &&
+	     size > ac->size_limit * 1024);
+
+	if (ac->rmmail &&
+	    msg->recv_time != RECV_TIME_NONE &&
+	    msg->recv_time != RECV_TIME_KEEP &&
+	    msg->partial_recv == POP3_TOTALLY_RECEIVED &&
+	    session->current_time - msg->recv_time >=
+	    ((ac->msg_leave_time * 24 * 60 * 60) +
+	     (ac->msg_leave_hour * 60 * 60))) {
+		log_message(LOG_PROTOCOL,
+				_("POP: Deleting expired message %d [%s]\n"),
+				n, msg->uidl?msg->uidl:" ");
+		session->cur_total_bytes += size;
+		return POP3_DELETE;
+	}
+
+	if (size_limit_over) {
+		if (!msg->received && msg->partial_recv !=
+		    POP3_MUST_COMPLETE_RECV)
+			return POP3_TOP;
+		else if (msg->partial_recv == POP3_MUST_COMPLETE_RECV)
+			return POP3_RETR;
+
+		log_message(LOG_PROTOCOL,
+				_("POP: Skipping message %d [%s] (%d bytes)\n"),
+				n, msg->uidl?msg->uidl:" ", size);
+	}
+
+	if (size == 0 || msg->received || size_limit_over) {
+		session->cur_total_bytes += size;
+		return POP3_READY;
+	}
+
+	return POP3_RETR;
+}
+
+static Pop3State pop3_lookup_next(Pop3Session *session)
+{
 	for (;;) {
-		msg = &session->msg[session->cur_msg];
-		size = msg->size;
-		size_limit_over =
-		    (ac->enable_size_limit &&
-		     ac->size_limit > 0 &&
-		     size > ac->size_limit * 1024);
-
-		if (ac->rmmail &&
-		    msg->recv_time != RECV_TIME_NONE &&
-		    msg->recv_time != RECV_TIME_KEEP &&
-		    msg->partial_recv == POP3_TOTALLY_RECEIVED &&
-		    session->current_time - msg->recv_time >=
-		    ((ac->msg_leave_time * 24 * 60 * 60) +
-		     (ac->msg_leave_hour * 60 * 60))) {
-			log_message(LOG_PROTOCOL,
-					_("POP: Deleting expired message %d [%s]\n"),
-					session->cur_msg, msg->uidl?msg->uidl:" ");
-			session->cur_total_bytes += size;
+		switch (pop3_msg_action(session, session->cur_msg)) {
+		case POP3_DELETE:
 			pop3_delete_send(session);
 			return POP3_DELETE;
+		case POP3_TOP:
+			pop3_top_send(session, session->ac_prefs->size_limit);
+			return POP3_TOP;
+		case POP3_RETR:
+			pop3_retr_send(session);
+			return POP3_RETR;
+		default:
+			break;
 		}
 
-		if (size_limit_over) {
-			if (!msg->received && msg->partial_recv !=
-			    POP3_MUST_COMPLETE_RECV) {
-				pop3_top_send(session, ac->size_limit);
-				return POP3_TOP;
-			} else if (msg->partial_recv == POP3_MUST_COMPLETE_RECV)
-				break;
-
-			log_message(LOG_PROTOCOL,
-					_("POP: Skipping message %d [%s] (%d bytes)\n"),
-					session->cur_msg, msg->uidl?msg->uidl:" ", size);
+		if (session->cur_msg == session->count) {
+			pop3_logout_send(session);
+			return POP3_LOGOUT;
 		}
+		session->cur_msg++;
+	}
+}
 
-		if (size == 0 || msg->received || size_limit_over) {
-			session->cur_total_bytes += size;
-			if (session->cur_msg == session->count) {
-				pop3_logout_send(session);
-				return POP3_LOGOUT;
-			} else
-				session->cur_msg++;
-		} else
+/* Goes on with the messages after the current one */
+static gint pop3_next_msg(Pop3Session *session)
+{
+	if (session->pipelining)
+		return pop3_pipeline_next(session);
+
+	if (session->cur_msg == session->count)
+		pop3_logout_send(session);
+	else {
+		session->cur_msg++;
+		if (pop3_lookup_next(session) == POP3_ERROR)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* How many messages a batch of pipelined commands may fetch */
+#define POP3_PIPELINE_DEPTH	16
+
+typedef struct _Pop3PipelinedCmd
+{
+	Pop3State state;
+	gint msg;
+} Pop3PipelinedCmd;
+
+static void pop3_pipeline_add(Pop3Session *session, GString *cmds,
+			      Pop3State state, gint msg,
+			      const gchar *format, ...)
+{
+	Pop3PipelinedCmd *cmd;
+	gchar *buf;
+	va_list args;
+
+	va_start(args, format);
+	buf = g_strdup_vprintf(format, args);
+	va_end(args);
+
+	log_print(LOG_PROTOCOL, "POP> %s\n", buf);
+	if (cmds->len > 0)
+		g_string_append(cmds, "\r\n");
+	g_string_append(cmds, buf);
+	g_free(buf);
+
+	cmd = g_new(Pop3PipelinedCmd, 1);
+	cmd->state = state;
+	cmd->msg = msg;
+	g_queue_push_tail(session->pipeline, cmd);
+}
+
+/* Queues the next batch: the deletions the previous one left, then what
+ * the next messages need, and QUIT once nothing can be left to delete */
+static void pop3_pipeline_fill(Pop3Session *session, GString *cmds)
+{
+	PrefsAccount *ac = session->ac_prefs;
+	GSList *cur;
+	gint fetches = 0;
+
+	session->pipeline_deletes = g_slist_reverse(session->pipeline_deletes);
+	for (cur = session->pipeline_deletes; cur != NULL; cur = cur->next) {
+		gint n = GPOINTER_TO_INT(cur->data);
+
+		pop3_pipeline_add(session, cmds, POP3_DELETE, n, "DELE %d", n);
+	}
+	g_slist_free(session->pipeline_deletes);
+	session->pipeline_deletes = NULL;
+
+	while (fetches < POP3_PIPELINE_DEPTH &&
+	       session->pipeline_msg <= session->count) {
+		gint n = session->pipeline_msg++;
+
+		switch (pop3_msg_action(session, n)) {
+		case POP3_DELETE:
+			pop3_pipeline_add(session, cmds, POP3_DELETE, n,
+					  "DELE %d", n);
+			break;
+		case POP3_TOP:
+			pop3_pipeline_add(session, cmds, POP3_TOP, n, "TOP %d %d",
+					  n, pop3_top_lines(ac->size_limit));
+			fetches++;
+			break;
+		case POP3_RETR:
+			pop3_pipeline_add(session, cmds, POP3_RETR, n,
+					  "RETR %d", n);
+			fetches++;
 			break;
+		default:
+			break;
+		}
 	}
 
-	pop3_retr_send(session);
-	return POP3_RETR;
+	if (session->pipeline_msg > session->count && fetches == 0)
+		pop3_pipeline_add(session, cmds, POP3_LOGOUT, 0, "QUIT");
+}
+
+/* Waits for the response to the next pipelined command, sending a new
+ * batch first if they have all been answered */
+static gint pop3_pipeline_next(Pop3Session *session)
+{
+	Pop3PipelinedCmd *cmd;
+	GString *cmds = NULL;
+
+	if (g_queue_is_empty(session->pipeline)) {
+		cmds = g_string_new(NULL);
+		pop3_pipeline_fill(session, cmds);
+	}
+
+	cmd = g_queue_pop_head(session->pipeline);
+	if (cmd == NULL) {
+		g_string_free(cmds, TRUE);
+		session->error_val = PS_ERROR;
+		return -1;
+	}
+
+	session->state = cmd->state;
+	if (cmd->msg > 0)
+		session->cur_msg = cmd->msg;
+	g_free(cmd);
+
+	if (cmds != NULL) {
+		session_send_msg(SESSION(session), cmds->str);
+		g_string_free(cmds, TRUE);
+	} else
+		session_recv_msg(SESSION(session));
+
+	return 0;
 }
 
 static Pop3ErrorValue pop3_ok(Pop3Session *session, const gchar *msg)
@@ -992,6 +1356,7 @@ static Pop3ErrorValue pop3_ok(Pop3Session *session, const gchar *msg)
 				log_error(LOG_PROTOCOL, _("error occurred on authentication\n"));
 				ok = PS_AUTHFAIL;
 				break;
+			case POP3_GETCAPA:
 			case POP3_GETRANGE_LAST:
 			case POP3_GETRANGE_UIDL:
 			case POP3_TOP:
@@ -1087,10 +1452,19 @@ static gint pop3_session_recv_msg(Session *session, const gchar *msg)
 	case POP3_GETAUTH_OAUTH2:
 #endif
 		if (!pop3_session->pop_before_smtp)
-			val = pop3_getrange_stat_send(pop3_session);
+			val = pop3_getcapa_send(pop3_session);
 		else
 			val = pop3_logout_send(pop3_session);
 		break;
+	case POP3_GETCAPA:
+		if (val == PS_NOTSUPPORTED) {
+			pop3_session->error_val = PS_SUCCESS;
+			val = pop3_getrange_stat_send(pop3_session);
+		} else {
+			pop3_session->state = POP3_GETCAPA_RECV;
+			session_recv_data(session, 0, ".\r\n");
+		}
+		break;
 	case POP3_GETRANGE_STAT:
 		if (pop3_getrange_stat_recv(pop3_session, body) < 0)
 			return -1;
@@ -1124,25 +1498,30 @@ static gint pop3_session_recv_msg(Session *session, const gchar *msg)
 		break;
 	case POP3_RETR:
 		pop3_session->state = POP3_RETR_RECV;
-		session_recv_data(session, 0, ".\r\n");
+		pop3_msg_recv_start(pop3_session, NULL);
 		break;
 	case POP3_TOP:
 		if (val == PS_NOTSUPPORTED) {
 			pop3_session->error_val = PS_SUCCESS;
+			/* the next commands are on their way already */
+			if (pop3_session->pipelining) {
+				log_warning(LOG_PROTOCOL, _("TOP command unsupported\n"));
+				val = PS_SUCCESS;
+				if (pop3_next_msg(pop3_session) < 0)
+					return -1;
+			}
 		} else {
+			gchar *partial_notice = pop3_partial_notice(pop3_session);
+
 			pop3_session->state = POP3_TOP_RECV;
-			session_recv_data(session, 0, ".\r\n");
+			pop3_msg_recv_start(pop3_session, partial_notice);
+			g_free(partial_notice);
 		}
 		break;
 	case POP3_DELETE:
 		pop3_delete_recv(pop3_session);
-		if (pop3_session->cur_msg == pop3_session->count)
-			val = pop3_logout_send(pop3_session);
-		else {
-			pop3_session->cur_msg++;
-			if (pop3_lookup_next(pop3_session) == POP3_ERROR)
-				return -1;
-		}
+		if (pop3_next_msg(pop3_session) < 0)
+			return -1;
 		break;
 	case POP3_LOGOUT:
 		pop3_session->state = POP3_DONE;
@@ -1173,12 +1552,19 @@ static gint pop3_session_recv_data_finished(Session *session, guchar *data,
 		} else
 			return -1;
 		break;
+	case POP3_GETCAPA_RECV:
+		pop3_getcapa_recv(pop3_session, data, len);
+		pop3_getrange_stat_send(pop3_session);
+		break;
 	case POP3_GETSIZE_LIST_RECV:
 		val = pop3_getsize_list_recv(pop3_session, data, len);
-		if (val == PS_SUCCESS) {
-			if (pop3_lookup_next(pop3_session) == POP3_ERROR)
+		if (val != PS_SUCCESS)
+			return -1;
+		if (pop3_session->pipelining) {
+			pop3_session->pipeline_msg = pop3_session->cur_msg;
+			if (pop3_pipeline_next(pop3_session) < 0)
 				return -1;
-		} else
+		} else if (pop3_lookup_next(pop3_session) == POP3_ERROR)
 			return -1;
 		break;
 	case POP3_RETR_RECV:
@@ -1189,37 +1575,30 @@ static gint pop3_session_recv_data_finished(Session *session, guchar *data,
 		    pop3_session->ac_prefs->msg_leave_time == 0 &&
 		    pop3_session->ac_prefs->msg_leave_hour == 0 &&
 		    pop3_session->msg[pop3_session->cur_msg].recv_time
-		    != RECV_TIME_KEEP)
-			pop3_delete_send(pop3_session);
-		else if (pop3_session->cur_msg == pop3_session->count)
-			pop3_logout_send(pop3_session);
-		else {
-			pop3_session->cur_msg++;
-			if (pop3_lookup_next(pop3_session) == POP3_ERROR)
-				return -1;
-		}
+		    != RECV_TIME_KEEP) {
+			if (!pop3_session->pipelining)
+				pop3_delete_send(pop3_session);
+			else {
+				pop3_session->pipeline_deletes =
+					g_slist_prepend(pop3_session->pipeline_deletes,
+						GINT_TO_POINTER(pop3_session->cur_msg));
+				if (pop3_pipeline_next(pop3_session) < 0)
+					return -1;
+			}
+		} else if (pop3_next_msg(pop3_session) < 0)
+			return -1;
 		break;
 	case POP3_TOP_RECV:
 		if (pop3_top_recv(pop3_session, data, len) < 0)
 			return -1;
 
-		if (pop3_session->cur_msg == pop3_session->count)
-			pop3_logout_send(pop3_session);
-		else {
-			pop3_session->cur_msg++;
-			if (pop3_lookup_next(pop3_session) == POP3_ERROR)
-				return -1;
-		}
+		if (pop3_next_msg(pop3_session) < 0)
+			return -1;
 		break;
 	case POP3_TOP:
 		log_warning(LOG_PROTOCOL, _("TOP command unsupported\n"));
-		if (pop3_session->cur_msg == pop3_session->count)
-			pop3_logout_send(pop3_session);
-		else {
-			pop3_session->cur_msg++;
-			if (pop3_lookup_next(pop3_session) == POP3_ERROR)
-				return -1;
-		}
+		if (pop3_next_msg(pop3_session) < 0)
+			return -1;
 		break;
 	case POP3_ERROR:
 	default:
@@ -31,6 +31,7 @@
 
 typedef struct _Pop3MsgInfo	Pop3MsgInfo;
 typedef struct _Pop3Session	Pop3Session;
+typedef struct _Pop3MsgFile	Pop3MsgFile;
 
 #define POP3_SESSION(obj)	((Pop3Session *)obj)
 
@@ -54,6 +55,8 @@ typedef enum {
 	POP3_GETAUTH_PASS,
 	POP3_GETAUTH_APOP,
 	POP3_GETAUTH_OAUTH2,
+	POP3_GETCAPA,
+	POP3_GETCAPA_RECV,
 	POP3_GETRANGE_STAT,
 	POP3_GETRANGE_LAST,
 	POP3_GETRANGE_UIDL,
@@ -133,6 +136,17 @@ struct _Pop3Session
 
 	Pop3MsgInfo *msg;
 
+	/* message being written to disk as it is received */
+	Pop3MsgFile *recv_msg_file;
+
+	/* with RFC 2449 PIPELINING, the commands sent and not answered
+	 * yet, the messages to delete with the next ones, and the next
+	 * message to send a command for */
+	gboolean pipelining;
+	GQueue *pipeline;
+	GSList *pipeline_deletes;
+	gint pipeline_msg;
+
 	GHashTable *uidl_table;
 	GHashTable *partial_recv_table;
 
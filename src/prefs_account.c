@@ -184,7 +184,10 @@ typedef struct ReceivePage
 	GtkWidget *imapdir_entry;
 	GtkWidget *subsonly_checkbtn;
 	GtkWidget *low_bandwidth_checkbtn;
+	GtkWidget *imap_idle_checkbtn;
 	GtkWidget *imap_batch_size_spinbtn;
+	GtkWidget *imap_max_connections_spinbtn;
+	GtkWidget *imap_sync_rate_spinbtn;
 
 	GtkWidget *frame_maxarticle;
 	GtkWidget *maxarticle_label;
@@ -609,10 +612,22 @@ static PrefParam receive_param[] = {
 	 &receive_page.low_bandwidth_checkbtn,
 	 prefs_set_data_from_toggle, prefs_set_toggle},
 
+	{"imap_idle", "TRUE", &tmp_ac_prefs.imap_idle, P_BOOL,
+	 &receive_page.imap_idle_checkbtn,
+	 prefs_set_data_from_toggle, prefs_set_toggle},
+
 	{"imap_batch_size", "500", &tmp_ac_prefs.imap_batch_size, P_INT,
 	 &receive_page.imap_batch_size_spinbtn,
 	 prefs_set_data_from_spinbtn, prefs_set_spinbtn},
 
+	{"imap_max_connections", "1", &tmp_ac_prefs.imap_max_connections, P_INT,
+	 &receive_page.imap_max_connections_spinbtn,
+	 prefs_set_data_from_spinbtn, prefs_set_spinbtn},
+
+	{"imap_sync_rate", "0", &tmp_ac_prefs.imap_sync_rate, P_INT,
+	 &receive_page.imap_sync_rate_spinbtn,
+	 prefs_set_data_from_spinbtn, prefs_set_spinbtn},
+
 	{"autochk_use_default", "TRUE", &tmp_ac_prefs.autochk_use_default, P_BOOL,
 		&receive_page.autochk_use_default_checkbtn,
 		prefs_set_data_from_toggle, prefs_set_toggle},
@@ -1569,7 +1584,10 @@ static void receive_create_widget_func(PrefsPage * _page,
 	GtkWidget *imapdir_entry;
 	GtkWidget *subsonly_checkbtn;
 	GtkWidget *low_bandwidth_checkbtn;
+	GtkWidget *imap_idle_checkbtn;
 	GtkWidget *imap_batch_size_spinbtn;
+	GtkWidget *imap_max_connections_spinbtn;
+	GtkWidget *imap_sync_rate_spinbtn;
 	GtkWidget *local_frame;
 	GtkWidget *local_vbox;
 	GtkWidget *local_hbox;
@@ -1841,6 +1859,16 @@ static void receive_create_widget_func(PrefsPage * _page,
 	gtk_widget_show (hbox1);
 	gtk_box_pack_start (GTK_BOX (vbox2), hbox1, FALSE, FALSE, 4);
 
+	PACK_CHECK_BUTTON (hbox1, imap_idle_checkbtn,
+			   _("Watch Inbox for new messages while idle (IDLE)"));
+	CLAWS_SET_TIP(imap_idle_checkbtn,
+			     _("New messages in the Inbox are shown as soon as they "
+			       "arrive, if the server supports it."));
+
+	hbox1 = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+	gtk_widget_show (hbox1);
+	gtk_box_pack_start (GTK_BOX (vbox2), hbox1, FALSE, FALSE, 4);
+
 	label = gtk_label_new(_("Batch size"));
 	gtk_widget_show (label);
 	gtk_box_pack_start(GTK_BOX(hbox1), label, FALSE, FALSE, 0);
@@ -1854,6 +1882,41 @@ static void receive_create_widget_func(PrefsPage * _page,
 	gtk_widget_show (hbox1);
 	gtk_box_pack_start (GTK_BOX (vbox2), hbox1, FALSE, FALSE, 4);
 
+	label = gtk_label_new(_("Maximum number of connections"));
+	gtk_widget_show (label);
+	gtk_box_pack_start(GTK_BOX(hbox1), label, FALSE, FALSE, 0);
+
+	imap_max_connections_spinbtn = gtk_spin_button_new_with_range(1,
+						IMAP_MAX_CONNECTIONS, 1);
+	gtk_widget_show (imap_max_connections_spinbtn);
+	gtk_box_pack_start(GTK_BOX(hbox1), imap_max_connections_spinbtn, FALSE, FALSE, 0);
+	CLAWS_SET_TIP(imap_max_connections_spinbtn,
+			     _("With more than one, folders can be checked while "
+			       "a message is being downloaded."));
+
+	hbox1 = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+	gtk_widget_show (hbox1);
+	gtk_box_pack_start (GTK_BOX (vbox2), hbox1, FALSE, FALSE, 4);
+
+	label = gtk_label_new(_("Limit offline synchronisation to"));
+	gtk_widget_show (label);
+	gtk_box_pack_start(GTK_BOX(hbox1), label, FALSE, FALSE, 0);
+
+	imap_sync_rate_spinbtn = gtk_spin_button_new_with_range(0, 1000000, 1);
+	gtk_widget_set_size_request(imap_sync_rate_spinbtn, 64, -1);
+	gtk_widget_show (imap_sync_rate_spinbtn);
+	gtk_box_pack_start(GTK_BOX(hbox1), imap_sync_rate_spinbtn, FALSE, FALSE, 0);
+	CLAWS_SET_TIP(imap_sync_rate_spinbtn,
+			     _("0 means no limit."));
+
+	label = gtk_label_new(_("KiB/s"));
+	gtk_widget_show (label);
+	gtk_box_pack_start(GTK_BOX(hbox1), label, FALSE, FALSE, 0);
+
+	hbox1 = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+	gtk_widget_show (hbox1);
+	gtk_box_pack_start (GTK_BOX (vbox2), hbox1, FALSE, FALSE, 4);
+
 	/* Auto-checking */
 	vbox4 = gtkut_get_options_frame(vbox1, &frame, _("Automatic checking"));
 
@@ -1948,7 +2011,10 @@ static void receive_create_widget_func(PrefsPage * _page,
 	page->imapdir_entry		= imapdir_entry;
 	page->subsonly_checkbtn		= subsonly_checkbtn;
 	page->low_bandwidth_checkbtn	= low_bandwidth_checkbtn;
+	page->imap_idle_checkbtn	= imap_idle_checkbtn;
 	page->imap_batch_size_spinbtn	= imap_batch_size_spinbtn;
+	page->imap_max_connections_spinbtn = imap_max_connections_spinbtn;
+	page->imap_sync_rate_spinbtn	= imap_sync_rate_spinbtn;
 	page->local_frame		= local_frame;
 	page->local_inbox_label	= local_inbox_label;
 	page->local_inbox_entry	= local_inbox_entry;
@@ -5516,7 +5582,10 @@ static void prefs_account_protocol_changed(GtkComboBox *combobox, gpointer data)
 		gtk_widget_hide(receive_page.imapdir_entry);
 		gtk_widget_hide(receive_page.subsonly_checkbtn);
 		gtk_widget_hide(receive_page.low_bandwidth_checkbtn);
+		gtk_widget_hide(receive_page.imap_idle_checkbtn);
 		gtk_widget_hide(receive_page.imap_batch_size_spinbtn);
+		gtk_widget_hide(receive_page.imap_max_connections_spinbtn);
+		gtk_widget_hide(receive_page.imap_sync_rate_spinbtn);
 		break;
 	case A_LOCAL:
 		gtk_widget_show(send_page.msgid_checkbtn);
@@ -5598,7 +5667,10 @@ static void prefs_account_protocol_changed(GtkComboBox *combobox, gpointer data)
 		gtk_widget_hide(receive_page.imapdir_entry);
 		gtk_widget_hide(receive_page.subsonly_checkbtn);
 		gtk_widget_hide(receive_page.low_bandwidth_checkbtn);
+		gtk_widget_hide(receive_page.imap_idle_checkbtn);
 		gtk_widget_hide(receive_page.imap_batch_size_spinbtn);
+		gtk_widget_hide(receive_page.imap_max_connections_spinbtn);
+		gtk_widget_hide(receive_page.imap_sync_rate_spinbtn);
 		break;
 	case A_IMAP4:
 #ifndef HAVE_LIBETPAN
@@ -5689,7 +5761,10 @@ static void prefs_account_protocol_changed(GtkComboBox *combobox, gpointer data)
 		gtk_widget_show(receive_page.imapdir_entry);
 		gtk_widget_show(receive_page.subsonly_checkbtn);
 		gtk_widget_show(receive_page.low_bandwidth_checkbtn);
+		gtk_widget_show(receive_page.imap_idle_checkbtn);
 		gtk_widget_show(receive_page.imap_batch_size_spinbtn);
+		gtk_widget_show(receive_page.imap_max_connections_spinbtn);
+		gtk_widget_show(receive_page.imap_sync_rate_spinbtn);
 		break;
 	case A_NONE:
 		gtk_widget_show(send_page.msgid_checkbtn);
@@ -5769,7 +5844,10 @@ static void prefs_account_protocol_changed(GtkComboBox *combobox, gpointer data)
 		gtk_widget_hide(receive_page.imapdir_entry);
 		gtk_widget_hide(receive_page.subsonly_checkbtn);
 		gtk_widget_hide(receive_page.low_bandwidth_checkbtn);
+		gtk_widget_hide(receive_page.imap_idle_checkbtn);
 		gtk_widget_hide(receive_page.imap_batch_size_spinbtn);
+		gtk_widget_hide(receive_page.imap_max_connections_spinbtn);
+		gtk_widget_hide(receive_page.imap_sync_rate_spinbtn);
 		break;
 	case A_POP3:
 		/* continue to default: */
@@ -5856,7 +5934,10 @@ static void prefs_account_protocol_changed(GtkComboBox *combobox, gpointer data)
 		gtk_widget_hide(receive_page.imapdir_entry);
 		gtk_widget_hide(receive_page.subsonly_checkbtn);
 		gtk_widget_hide(receive_page.low_bandwidth_checkbtn);
+		gtk_widget_hide(receive_page.imap_idle_checkbtn);
 		gtk_widget_hide(receive_page.imap_batch_size_spinbtn);
+		gtk_widget_hide(receive_page.imap_max_connections_spinbtn);
+		gtk_widget_hide(receive_page.imap_sync_rate_spinbtn);
 		break;
 	}
 
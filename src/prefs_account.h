@@ -211,6 +211,9 @@ struct _PrefsAccount
 	gchar *imap_dir;
 	gboolean imap_subsonly;
 	gboolean low_bandwidth;
+	gboolean imap_idle;
+	gint imap_max_connections;
+	gint imap_sync_rate;
 
 	gboolean set_sent_folder;
 	gchar *sent_folder;
@@ -190,6 +190,8 @@ static PrefParam param[] = {
 	 P_BOOL, NULL, NULL, NULL},
 	{"close_receive_dialog", "TRUE", &prefs_common.close_recv_dialog,
 	 P_BOOL, NULL, NULL, NULL},
+	{"receive_max_parallel", "4", &prefs_common.recv_max_parallel,
+	 P_INT, NULL, NULL, NULL},
  
 	/* Send */
 	{"save_message", "TRUE", &prefs_common.savemsg, P_BOOL,
@@ -1290,6 +1292,8 @@ static PrefParam param[] = {
 
 	{"flush_metadata", "TRUE", &prefs_common.flush_metadata, P_BOOL,
 	 NULL, NULL, NULL},
+	{"use_body_index", "FALSE", &prefs_common.use_body_index, P_BOOL,
+	 NULL, NULL, NULL},
 
 	{"nav_history_length", "50", &prefs_common.nav_history_length, P_INT,
 	 NULL, NULL, NULL},
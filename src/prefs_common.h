@@ -164,6 +164,7 @@ struct _PrefsCommon
 	gboolean close_recv_dialog;
 	gboolean no_recv_err_panel;
 	gboolean show_recv_err_dialog;
+	gint recv_max_parallel;
 
 	/* Send */
 	gboolean savemsg;
@@ -576,6 +577,7 @@ struct _PrefsCommon
 	gboolean two_line_vert;
 	gboolean inherit_folder_props;
 	gboolean flush_metadata;
+	gboolean use_body_index;
 
 	gint nav_history_length;
 
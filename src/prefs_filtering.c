@@ -736,6 +736,7 @@ void prefs_filtering_delete_path(const gchar *path)
         delete_path(&pre_global_processing, path);
         delete_path(&post_global_processing, path);
         delete_path(&filtering_rules, path);
+	filtering_rules_changed();
         
 	prefs_matcher_write_config();
 }
@@ -957,6 +958,7 @@ static void prefs_filtering_set_list(void)
 	}				
 	
         *p_processing_list = prefs_filtering;
+	filtering_rules_changed();
 }
 
 static gint prefs_filtering_list_view_set_row(gint row, FilteringProp * prop)
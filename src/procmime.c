@@ -1023,14 +1023,16 @@ gboolean procmime_msginfo_is_encrypted(MsgInfo *msginfo)
 
 gchar *procmime_get_tmp_file_name(MimeInfo *mimeinfo)
 {
-	static guint32 id = 0;
+	static gint id = 0;
 	gchar *base;
 	gchar *filename;
 	gchar f_prefix[10];
 
 	cm_return_val_if_fail(mimeinfo != NULL, NULL);
 
-	g_snprintf(f_prefix, sizeof(f_prefix), "%08x.", id++);
+	/* search workers scan messages in parallel */
+	g_snprintf(f_prefix, sizeof(f_prefix), "%08x.",
+		   (guint)g_atomic_int_add(&id, 1));
 
 	if ((mimeinfo->type == MIMETYPE_TEXT) && !g_ascii_strcasecmp(mimeinfo->subtype, "html"))
 		base = g_strdup("mimetmp.html");
@@ -941,7 +941,8 @@ static gboolean procmsg_is_last_for_account(FolderItem *queue, MsgInfo *msginfo,
 		MsgInfo *cur_msginfo = (MsgInfo *)cur->data;
 		file = folder_item_fetch_msg(queue, cur_msginfo->msgnum);
 		
-		if (cur_msginfo != msginfo && !MSG_IS_LOCKED(cur_msginfo->flags)) {
+		if (cur_msginfo != msginfo && !MSG_IS_LOCKED(cur_msginfo->flags) &&
+		    !MSG_IS_DELETED(cur_msginfo->flags)) {
 			if (procmsg_get_account_from_file(file) == ac) {
 				g_free(file);
 				return FALSE;
@@ -987,6 +988,7 @@ gint procmsg_send_queue(FolderItem *queue, gboolean save_msgs, gchar **errstr)
 	gint sent = 0, err = 0;
 	GSList *list, *elem;
 	GSList *sorted_list = NULL;
+	GList *cur_ac;
 	GNode *node, *next;
 	
 	if (!procmsg_queue_lock(errstr)) {
@@ -1043,6 +1045,11 @@ gint procmsg_send_queue(FolderItem *queue, gboolean save_msgs, gchar **errstr)
 	}
 
 	g_slist_free(sorted_list);
+
+	/* the message a session was kept for may have failed early */
+	for (cur_ac = account_get_list(); cur_ac != NULL; cur_ac = cur_ac->next)
+		send_message_smtp_close((PrefsAccount *)cur_ac->data);
+
 	folder_item_scan(queue);
 
 	if (queue->node && queue->node->children) {
@@ -1423,17 +1430,8 @@ void procmsg_msginfo_free(MsgInfo **msginfo_ptr)
 
 	FREENULL(msginfo->fromspace);
 
-	FREENULL(msginfo->fromname);
-
-	FREENULL(msginfo->date);
-	FREENULL(msginfo->from);
-	FREENULL(msginfo->to);
-	FREENULL(msginfo->cc);
-	FREENULL(msginfo->newsgroups);
-	FREENULL(msginfo->subject);
-	FREENULL(msginfo->msgid);
-	FREENULL(msginfo->inreplyto);
-	FREENULL(msginfo->xref);
+	/* some strings may live in the cache arena */
+	msgcache_msginfo_free_strings(msginfo);
 
 	if (msginfo->extradata) {
 		if (msginfo->extradata->avatars) {
@@ -1457,8 +1455,6 @@ void procmsg_msginfo_free(MsgInfo **msginfo_ptr)
 		FREENULL(msginfo->extradata->resent_from);
 		FREENULL(msginfo->extradata);
 	}
-	slist_free_strings_full(msginfo->references);
-	msginfo->references = NULL;
 	g_slist_free(msginfo->tags);
 	msginfo->tags = NULL;
 
@@ -1469,34 +1465,28 @@ void procmsg_msginfo_free(MsgInfo **msginfo_ptr)
 }
 #undef FREENULL
 
+/* strings living in a cache arena are accounted for by the MsgCache */
+#define STRUSAGE(str) \
+	((str) && !msgcache_arena_owns(msginfo->arena, (str)) ? strlen(str) : 0)
 guint procmsg_msginfo_memusage(MsgInfo *msginfo)
 {
 	guint memusage = 0;
 	GSList *tmp;
 	
 	memusage += sizeof(MsgInfo);
-	if (msginfo->fromname)
-		memusage += strlen(msginfo->fromname);
-	if (msginfo->date)
-		memusage += strlen(msginfo->date);
-	if (msginfo->from)
-		memusage += strlen(msginfo->from);
-	if (msginfo->to)
-		memusage += strlen(msginfo->to);
-	if (msginfo->cc)
-		memusage += strlen(msginfo->cc);
-	if (msginfo->newsgroups)
-		memusage += strlen(msginfo->newsgroups);
-	if (msginfo->subject)
-		memusage += strlen(msginfo->subject);
-	if (msginfo->msgid)
-		memusage += strlen(msginfo->msgid);
-	if (msginfo->inreplyto)
-		memusage += strlen(msginfo->inreplyto);
+	memusage += STRUSAGE(msginfo->fromname);
+	memusage += STRUSAGE(msginfo->date);
+	memusage += STRUSAGE(msginfo->from);
+	memusage += STRUSAGE(msginfo->to);
+	memusage += STRUSAGE(msginfo->cc);
+	memusage += STRUSAGE(msginfo->newsgroups);
+	memusage += STRUSAGE(msginfo->subject);
+	memusage += STRUSAGE(msginfo->msgid);
+	memusage += STRUSAGE(msginfo->inreplyto);
 
 	for (tmp = msginfo->references; tmp; tmp=tmp->next) {
 		gchar *r = (gchar *)tmp->data;
-		memusage += r?strlen(r):0 + sizeof(GSList);
+		memusage += STRUSAGE(r) + sizeof(GSList);
 	}
 	if (msginfo->fromspace)
 		memusage += strlen(msginfo->fromspace);
@@ -1542,6 +1532,7 @@ guint procmsg_msginfo_memusage(MsgInfo *msginfo)
 	}
 	return memusage;
 }
+#undef STRUSAGE
 
 static gint procmsg_send_message_queue_full(const gchar *file, gboolean keep_session, gchar **errstr,
 					    FolderItem *queue, gint msgnum, gboolean *queued_removed)
@@ -2346,6 +2337,11 @@ void procmsg_msglist_filter(GSList *list, PrefsAccount *ac,
 		to_do = mail_filtering_data.unfiltered;
 	} 
 
+	/* external "test" commands run in parallel for the whole batch,
+	 * and once per message and command */
+	matcher_tests_begin();
+	filtering_start_tests(filtering_rules, to_do, ac);
+
 	for (cur = to_do; cur; cur = cur->next) {
 		MsgInfo *info = (MsgInfo *)cur->data;
 		if (procmsg_msginfo_filter(info, ac))
@@ -2355,6 +2351,8 @@ void procmsg_msglist_filter(GSList *list, PrefsAccount *ac,
 		statusbar_progress_all(curnum++, total, prefs_common.statusbar_update_step);
 	}
 
+	matcher_tests_end();
+
 	g_slist_free(mail_filtering_data.filtered);
 	g_slist_free(mail_filtering_data.unfiltered);
 	
@@ -232,6 +232,11 @@ struct _MsgInfo
 	GSList *tags;
 
 	MsgInfoExtraData *extradata;
+
+	/* set when the header strings above were loaded from the
+	 * cache into a shared block; they must not be g_free()d
+	 * individually, use procmsg_msginfo_copy() to modify them */
+	MsgCacheArena *arena;
 };
 
 struct _MsgInfoExtraData
@@ -49,6 +49,9 @@ typedef struct _MsgInfoExtraData	MsgInfoExtraData;
 struct _MsgInfoAvatar;
 typedef struct _MsgInfoAvatar		MsgInfoAvatar;
 
+struct _MsgCacheArena;
+typedef struct _MsgCacheArena		MsgCacheArena;
+
 typedef GSList MsgInfoList;
 typedef GSList MsgNumberList;
 
@@ -479,8 +479,11 @@ gint send_message_smtp_full(PrefsAccount *ac_prefs, GSList *to_list, FILE *fp, g
 		send_progress_dialog_destroy(send_dialog);
 	} else {
 		g_free(smtp_session->from);
+		smtp_session->from = NULL;
 		g_free(smtp_session->send_data);
+		smtp_session->send_data = NULL;
 		g_free(smtp_session->error_msg);
+		smtp_session->error_msg = NULL;
 	}
 	if (keep_session && ret == 0 && ac_prefs->session == NULL)
 		ac_prefs->session = SMTP_SESSION(session);
@@ -496,6 +499,29 @@ gint send_message_smtp(PrefsAccount *ac_prefs, GSList *to_list, FILE *fp)
 	return send_message_smtp_full(ac_prefs, to_list, fp, FALSE);
 }
 
+/* Closes the session send_message_smtp_full() kept open for the
+ * account, if any */
+void send_message_smtp_close(PrefsAccount *ac_prefs)
+{
+	Session *session;
+
+	cm_return_if_fail(ac_prefs != NULL);
+
+	if (ac_prefs->session == NULL)
+		return;
+
+	session = SESSION(ac_prefs->session);
+	ac_prefs->session = NULL;
+	send_dialog = (SendProgressDialog *)SMTP_SESSION(session)->dialog;
+
+	if (session_is_connected(session))
+		smtp_quit(SMTP_SESSION(session));
+	while (session_is_connected(session) && !send_dialog->cancelled)
+		gtk_main_iteration();
+	session_destroy(session);
+	send_progress_dialog_destroy(send_dialog);
+}
+
 static gint send_recv_message(Session *session, const gchar *msg, gpointer data)
 {
 	gchar buf[BUFFSIZE];
@@ -557,14 +583,20 @@ static gint send_send_data_progressive(Session *session, guint cur_len,
 {
 	gchar buf[BUFFSIZE];
 	SendProgressDialog *dialog = (SendProgressDialog *)data;
+	SMTPSession *smtp_session = SMTP_SESSION(session);
 	MainWindow *mainwin = mainwindow_get_mainwindow();
 	
 	cm_return_val_if_fail(dialog != NULL, -1);
 
-	if (SMTP_SESSION(session)->state != SMTP_SEND_DATA &&
-	    SMTP_SESSION(session)->state != SMTP_EOM)
+	if (smtp_session->state != SMTP_SEND_DATA &&
+	    smtp_session->state != SMTP_EOM)
 		return 0;
 
+	/* the message is written in slices, cur_len is within the one
+	 * being written */
+	total_len = smtp_session->send_data_len;
+	cur_len = MIN(smtp_session->send_data_pos + cur_len, total_len);
+
 	g_snprintf(buf, sizeof(buf), _("Sending message (%d / %d bytes)"),
 		   cur_len, total_len);
 	progress_dialog_set_label(dialog->dialog, buf);
@@ -589,6 +621,10 @@ static gint send_send_data_finished(Session *session, guint len, gpointer data)
 
 	cm_return_val_if_fail(dialog != NULL, -1);
 
+	/* more slices of the message follow */
+	if (SMTP_SESSION(session)->state == SMTP_SEND_DATA)
+		return 0;
+
 	send_send_data_progressive(session, len, len, dialog);
 	if (mainwin) {
 		gtk_widget_hide(mainwin->progressbar);
@@ -41,6 +41,7 @@ gint send_message_smtp_full	(PrefsAccount *ac_prefs,
 				 GSList *to_list, 
 				 FILE *fp, 
 				 gboolean keep_session);
+void send_message_smtp_close	(PrefsAccount *ac_prefs);
 void send_cancel	(void);
 gboolean send_is_active	(void);
 
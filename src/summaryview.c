@@ -83,12 +83,16 @@
 #include "manual.h"
 #include "manage_window.h"
 #include "avatars.h"
+#include "threadindex.h"
 
 #define SUMMARY_COL_MARK_WIDTH		10
 #define SUMMARY_COL_STATUS_WIDTH	13
 #define SUMMARY_COL_LOCKED_WIDTH	13
 #define SUMMARY_COL_MIME_WIDTH		11
 
+/* rows whose text is kept once drawn, the oldest ones are emptied */
+#define SUMMARY_FILLED_ROWS_MAX		4096
+
 static int normal_row_height = -1;
 static GtkStyle *bold_style;
 
@@ -121,6 +125,10 @@ static void summary_set_marks_func	(GtkCMCTree		*ctree,
 					 GtkCMCTreeNode		*node,
 					 gpointer		 data);
 
+static void summary_sort_keys_clear	(SummaryView		*summaryview);
+static void summary_sort_keys_remove	(SummaryView		*summaryview,
+					 MsgInfo		*msginfo);
+
 void  summary_set_menu_sensitive	(SummaryView		*summaryview);
 guint summary_get_msgnum		(SummaryView		*summaryview,
 					 GtkCMCTreeNode		*node);
@@ -162,6 +170,9 @@ static void summary_set_column_titles	(SummaryView		*summaryview);
 static void summary_set_ctree_from_list	(SummaryView		*summaryview,
 					 GSList			*mlist,
 					 guint			selected_msgnum);
+static gboolean summary_update_ctree_from_list
+					(SummaryView		*summaryview,
+					 GSList			*mlist);
 static inline void summary_set_header	(SummaryView		*summaryview,
 					 gchar			*text[],
 					 MsgInfo		*msginfo);
@@ -367,31 +378,18 @@ static gint summary_cmp_by_date		(GtkCMCList		*clist,
 static gint summary_cmp_by_thread_date	(GtkCMCList		*clist,
 					 gconstpointer		 ptr1,
 					 gconstpointer		 ptr2);
-static gint summary_cmp_by_from		(GtkCMCList		*clist,
+static gint summary_cmp_by_sort_key	(GtkCMCList		*clist,
 					 gconstpointer		 ptr1,
 					 gconstpointer		 ptr2);
-static gint summary_cmp_by_simplified_subject
-					(GtkCMCList 		*clist, 
-					 gconstpointer 		 ptr1, 
-					 gconstpointer 		 ptr2);
 static gint summary_cmp_by_score	(GtkCMCList		*clist,
 					 gconstpointer		 ptr1,
 					 gconstpointer		 ptr2);
 static gint summary_cmp_by_label	(GtkCMCList		*clist,
 					 gconstpointer		 ptr1,
 					 gconstpointer		 ptr2);
-static gint summary_cmp_by_to		(GtkCMCList		*clist,
-					 gconstpointer		 ptr1,
-					 gconstpointer		 ptr2);
-static gint summary_cmp_by_subject	(GtkCMCList		*clist,
-					 gconstpointer		 ptr1,
-					 gconstpointer		 ptr2);
 static gint summary_cmp_by_locked	(GtkCMCList 		*clist,
 				         gconstpointer 		 ptr1, 
 					 gconstpointer 		 ptr2);
-static gint summary_cmp_by_tags		(GtkCMCList 		*clist,
-				         gconstpointer 		 ptr1, 
-					 gconstpointer 		 ptr2);
 
 static void quicksearch_execute_cb	(QuickSearch    *quicksearch,
 					 gpointer	 data);
@@ -1107,6 +1105,9 @@ static void summary_switch_from_to(SummaryView *summaryview, FolderItem *item)
 	gtk_cmclist_set_column_visibility
 		(GTK_CMCLIST(ctree), to_pos, col_state[to_pos].visible);
 
+	/* the From and To keys came from the text of the columns */
+	summary_sort_keys_clear(summaryview);
+
 	summary_set_column_titles(summaryview);
 }
 
@@ -1274,11 +1275,15 @@ gboolean summary_show(SummaryView *summaryview, FolderItem *item, gboolean avoid
 	GSList *mlist = NULL;
 	gchar *buf;
 	gboolean is_refresh;
+	gboolean keep_rows;
 	guint selected_msgnum = 0;
 	guint displayed_msgnum = 0;
 	GSList *cur;
         GSList *not_killed;
 	gboolean hidden_removed = FALSE;
+	gboolean updating_contents = summaryview->updating_contents;
+
+	summaryview->updating_contents = FALSE;
 
 	if (summary_is_locked(summaryview)) return FALSE;
 
@@ -1357,7 +1362,14 @@ gboolean summary_show(SummaryView *summaryview, FolderItem *item, gboolean avoid
 	
 	summary_freeze(summaryview);
 
-	summary_clear_list(summaryview);
+	/* showing the folder again after its messages changed keeps the
+	 * rows of the others, unless read threads are hidden and have to
+	 * be weeded again; other refreshes, after the threading or the
+	 * columns changed, set the rows again */
+	keep_rows = updating_contents && is_refresh && item &&
+		    !item->hide_read_threads;
+	if (!keep_rows)
+		summary_clear_list(summaryview);
 
 	buf = NULL;
 	if (!item || !item->path || !folder_item_parent(item) || item->no_select) {
@@ -1506,7 +1518,14 @@ gboolean summary_show(SummaryView *summaryview, FolderItem *item, gboolean avoid
 
 	/* set ctree and hash table from the msginfo list, and
 	   create the thread */
-	summary_set_ctree_from_list(summaryview, mlist, selected_msgnum);
+	if (!keep_rows || !summary_update_ctree_from_list(summaryview, mlist)) {
+		if (keep_rows) {
+			summary_clear_list(summaryview);
+			summaryview->folder_item = item;
+			item->opened = TRUE;
+		}
+		summary_set_ctree_from_list(summaryview, mlist, selected_msgnum);
+	}
 
 	g_slist_free(mlist);
 
@@ -1689,6 +1708,13 @@ static void summary_cancel_mark_read_timeout(SummaryView *summaryview) {
 	}
 }
 
+/* Shows the current folder again after its messages changed */
+gboolean summary_show_updated(SummaryView *summaryview)
+{
+	summaryview->updating_contents = TRUE;
+	return summary_show(summaryview, summaryview->folder_item, FALSE);
+}
+
 void summary_clear_list(SummaryView *summaryview)
 {
 	GtkCMCList *clist = GTK_CMCLIST(summaryview->ctree);
@@ -1721,9 +1747,14 @@ void summary_clear_list(SummaryView *summaryview)
 		g_hash_table_destroy(summaryview->subject_table);
 		summaryview->subject_table = NULL;
 	}
+	summary_sort_keys_clear(summaryview);
 	summaryview->mlist = NULL;
 
 	gtk_cmclist_clear(clist);
+	if (summaryview->address_completion) {
+		end_address_completion();
+		summaryview->address_completion = FALSE;
+	}
 	if (summaryview->col_pos[S_COL_SUBJECT] == N_SUMMARY_COLS - 1) {
 		optimal_width = gtk_cmclist_optimal_column_width
 			(clist, summaryview->col_pos[S_COL_SUBJECT]);
@@ -2605,7 +2636,9 @@ static void summary_set_marks_func(GtkCMCTree *ctree, GtkCMCTreeNode *node,
 
 	summaryview->total_size += msginfo->size;
 
-	summary_set_row_marks(summaryview, node);
+	/* rows not drawn yet get their marks when they are filled */
+	if (!GTK_CMCTREE_ROW(node)->row.unfilled)
+		summary_set_row_marks(summaryview, node);
 }
 
 static void summary_update_status(SummaryView *summaryview)
@@ -3048,13 +3081,10 @@ void summary_sort(SummaryView *summaryview,
 		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_thread_date;
 		break;
 	case SORT_BY_FROM:
-		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_from;
-		break;
 	case SORT_BY_SUBJECT:
-		if (summaryview->simplify_subject_preg)
-			cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_simplified_subject;
-		else
-			cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_subject;
+	case SORT_BY_TO:
+	case SORT_BY_TAGS:
+		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_sort_key;
 		break;
 	case SORT_BY_SCORE:
 		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_score;
@@ -3062,21 +3092,19 @@ void summary_sort(SummaryView *summaryview,
 	case SORT_BY_LABEL:
 		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_label;
 		break;
-	case SORT_BY_TO:
-		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_to;
-		break;
 	case SORT_BY_LOCKED:
 		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_locked;
 		break;
-	case SORT_BY_TAGS:
-		cmp_func = (GtkCMCListCompareFunc)summary_cmp_by_tags;
-		break;
 	case SORT_BY_NONE:
 		break;
 	default:
 		goto unlock;
 	}
 
+	/* the keys are those of the previous sort column */
+	if (summaryview->sort_key != sort_key)
+		summary_sort_keys_clear(summaryview);
+
 	summaryview->sort_key = sort_key;
 	summaryview->sort_type = sort_type;
 
@@ -3190,22 +3218,20 @@ static gboolean summary_thread_is_selected(GNode *gnode, guint selected_msgnum)
 	return selected.is_selected;
 }
 
-static gboolean summary_insert_gnode_func(GtkCMCTree *ctree, guint depth, GNode *gnode,
-				   GtkCMCTreeNode *cnode, gpointer data)
+/* Sets the text of the cells of a row from its message */
+static void summary_set_row_text(SummaryView *summaryview,
+				 GtkCMCTreeNode *cnode, MsgInfo *msginfo)
 {
-	SummaryView *summaryview = (SummaryView *)data;
-	MsgInfo *msginfo = (MsgInfo *)gnode->data;
+	GtkCMCTree *ctree = GTK_CMCTREE(summaryview->ctree);
 	gchar *text[N_SUMMARY_COLS];
 	gint *col_pos = summaryview->col_pos;
-	const gchar *msgid = msginfo->msgid;
-	GHashTable *msgid_table = summaryview->msgid_table;
 	gboolean vert_layout = (prefs_common.layout_mode == VERTICAL_LAYOUT);
 	gboolean small_layout = (prefs_common.layout_mode == SMALL_LAYOUT);
 
 	summary_set_header(summaryview, text, msginfo);
 
-	gtk_cmctree_set_node_info(ctree, cnode, text[col_pos[S_COL_SUBJECT]], 2,
-				NULL, NULL, FALSE, summaryview->threaded && !summaryview->thread_collapsed);
+	gtk_cmctree_node_set_pixtext(ctree, cnode, col_pos[S_COL_SUBJECT],
+				     text[col_pos[S_COL_SUBJECT]], 2, NULL);
 #define SET_TEXT(col) {						\
 	gtk_cmctree_node_set_text(ctree, cnode, col_pos[col], 	\
 				text[col_pos[col]]);		\
@@ -3230,6 +3256,34 @@ static gboolean summary_insert_gnode_func(GtkCMCTree *ctree, guint depth, GNode
 		g_free(text[summaryview->col_pos[S_COL_SUBJECT]]);
 
 #undef SET_TEXT
+}
+
+/* Formats a row the first time it is drawn, so that opening a large
+ * folder does not format the rows that are never shown */
+static void summary_fill_row(GtkCMCList *clist, GList *row, gpointer data)
+{
+	SummaryView *summaryview = (SummaryView *)data;
+	GtkCMCTreeNode *node = GTK_CMCTREE_NODE(row);
+	MsgInfo *msginfo = GTKUT_CTREE_NODE_GET_ROW_DATA(node);
+
+	if (!msginfo)
+		return;
+
+	summary_set_row_text(summaryview, node, msginfo);
+	summary_set_row_marks(summaryview, node);
+}
+
+static gboolean summary_insert_gnode_func(GtkCMCTree *ctree, guint depth, GNode *gnode,
+				   GtkCMCTreeNode *cnode, gpointer data)
+{
+	SummaryView *summaryview = (SummaryView *)data;
+	MsgInfo *msginfo = (MsgInfo *)gnode->data;
+	const gchar *msgid = msginfo->msgid;
+	GHashTable *msgid_table = summaryview->msgid_table;
+
+	gtk_cmctree_set_node_info(ctree, cnode, NULL, 2,
+				NULL, NULL, FALSE, summaryview->threaded && !summaryview->thread_collapsed);
+	GTK_CMCTREE_ROW(cnode)->row.unfilled = TRUE;
 
 	GTKUT_CTREE_NODE_SET_ROW_DATA(cnode, msginfo);
 	summary_set_marks_func(ctree, cnode, summaryview);
@@ -3251,8 +3305,6 @@ static void summary_set_ctree_from_list(SummaryView *summaryview,
 	GSList * cur;
 	GdkDisplay *display;
 
-	gboolean vert_layout = (prefs_common.layout_mode == VERTICAL_LAYOUT);
-	gboolean small_layout = (prefs_common.layout_mode == SMALL_LAYOUT);
 	START_TIMING("");
 	
 	if (!mlist) return;
@@ -3277,15 +3329,22 @@ static void summary_set_ctree_from_list(SummaryView *summaryview,
 		summaryview->subject_table = NULL;
 	}
 
-	if (prefs_common.use_addr_book)
+	/* the rows are formatted as they are drawn, keep the address
+	 * book open until the list is cleared */
+	if (prefs_common.use_addr_book && !summaryview->address_completion) {
 		start_address_completion(NULL);
+		summaryview->address_completion = TRUE;
+	}
 	
 	if (summaryview->threaded) {
 		GNode *root, *gnode;
+		ThreadIndex *index;
 		START_TIMING("threaded");
-		root = procmsg_get_thread_tree(mlist);
+		index = folder_item_get_thread_index(summaryview->folder_item);
+		root = index ? thread_index_get_tree(index, mlist) : NULL;
+		if (!root)
+			root = procmsg_get_thread_tree(mlist);
 
-		
 		for (gnode = root->children; gnode != NULL;
 		     gnode = gnode->next) {
 			if (!summaryview->folder_item->hide_read_threads ||
@@ -3302,20 +3361,16 @@ static void summary_set_ctree_from_list(SummaryView *summaryview,
                 
 		END_TIMING();
 	} else {
-		gchar *text[N_SUMMARY_COLS];
 		START_TIMING("unthreaded");
 		cur = mlist;
 		for (; mlist != NULL; mlist = mlist->next) {
 			msginfo = (MsgInfo *)mlist->data;
 
-			summary_set_header(summaryview, text, msginfo);
-
 			node = gtk_sctree_insert_node
-				(ctree, NULL, node, text, 2,
+				(ctree, NULL, node, NULL, 2,
 				 NULL, NULL,
 				 FALSE, FALSE);
-			if ((vert_layout || small_layout) && prefs_common.two_line_vert)
-				g_free(text[summaryview->col_pos[S_COL_SUBJECT]]);
+			GTK_CMCTREE_ROW(node)->row.unfilled = TRUE;
 
 			GTKUT_CTREE_NODE_SET_ROW_DATA(node, msginfo);
 			summary_set_marks_func(ctree, node, summaryview);
@@ -3344,9 +3399,6 @@ static void summary_set_ctree_from_list(SummaryView *summaryview,
 					   optimal_width);
 	}
 
-	if (prefs_common.use_addr_book)
-		end_address_completion();
-
 	debug_print("Setting summary from message data done.\n");
 	STATUSBAR_POP(summaryview->mainwin);
 	if (debug_get_mode()) {
@@ -3377,6 +3429,298 @@ static void summary_set_ctree_from_list(SummaryView *summaryview,
 	END_TIMING();
 }
 
+/* A refresh sets the list again when more than 1/n of the rows change */
+#define SUMMARY_UPDATE_MAX_CHANGES	4
+
+static void summary_get_rows_func(GtkCMCTree *ctree, GtkCMCTreeNode *node,
+				  gpointer data)
+{
+	GHashTable *row_table = (GHashTable *)data;
+	MsgInfo *msginfo = GTKUT_CTREE_NODE_GET_ROW_DATA(node);
+
+	if (msginfo)
+		g_hash_table_insert(row_table, msginfo, node);
+}
+
+static void summary_find_thread_date_func(GtkCMCTree *ctree,
+					  GtkCMCTreeNode *node, gpointer data)
+{
+	MsgInfo *msginfo = GTKUT_CTREE_NODE_GET_ROW_DATA(node);
+	time_t *most_recent = (time_t *)data;
+
+	if (msginfo && msginfo->date_t > *most_recent)
+		*most_recent = msginfo->date_t;
+}
+
+/* Returns the row of the closest ancestor of msginfo which is shown */
+static GtkCMCTreeNode *summary_find_thread_parent(ThreadIndex *index,
+						  GHashTable *row_table,
+						  MsgInfo *msginfo)
+{
+	GtkCMCTreeNode *parent = NULL;
+
+	while (parent == NULL &&
+	       (msginfo = thread_index_get_parent(index, msginfo)) != NULL)
+		parent = g_hash_table_lookup(row_table, msginfo);
+
+	return parent;
+}
+
+/* Adds the rows of the replies to msginfo, looking through the
+ * replies which are not shown */
+static GSList *summary_find_thread_children(ThreadIndex *index,
+					    GHashTable *row_table,
+					    MsgInfo *msginfo, GSList *nodes)
+{
+	GSList *cur;
+
+	for (cur = thread_index_get_children(index, msginfo); cur != NULL;
+	     cur = cur->next) {
+		GtkCMCTreeNode *node = g_hash_table_lookup(row_table, cur->data);
+
+		if (node)
+			nodes = g_slist_prepend(nodes, node);
+		else
+			nodes = summary_find_thread_children(index, row_table,
+							     cur->data, nodes);
+	}
+
+	return nodes;
+}
+
+/* Brings the rows in line with mlist on a refresh, removing and
+ * inserting only the rows of the messages which changed, and moving
+ * and sorting again only the threads they belong to. Returns FALSE,
+ * leaving the rows and mlist alone, if the list should rather be set
+ * from scratch. */
+static gboolean summary_update_ctree_from_list(SummaryView *summaryview,
+					       GSList *mlist)
+{
+	GtkCMCTree *ctree = GTK_CMCTREE(summaryview->ctree);
+	ThreadIndex *index = NULL;
+	GHashTable *row_table, *new_table, *parents;
+	GHashTableIter iter;
+	gpointer key, value;
+	GSList *added = NULL, *removed = NULL, *moved = NULL, *cur;
+	gboolean sort_top = FALSE;
+	gboolean updated = FALSE;
+	guint changes = 0;
+
+	if (summaryview->msgid_table == NULL || summaryview->folder_item == NULL)
+		return FALSE;
+
+	if (summaryview->threaded) {
+		index = folder_item_get_thread_index(summaryview->folder_item);
+		if (index == NULL)
+			return FALSE;
+	}
+
+	START_TIMING("");
+
+	row_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	new_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	parents = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	gtk_cmctree_pre_recursive(ctree, NULL, summary_get_rows_func, row_table);
+
+	for (cur = mlist; cur != NULL; cur = cur->next) {
+		MsgInfo *msginfo = (MsgInfo *)cur->data;
+
+		g_hash_table_insert(new_table, msginfo, msginfo);
+		if (g_hash_table_lookup(row_table, msginfo) != NULL)
+			continue;
+		/* the threads only come from the index of this folder */
+		if (msginfo->folder != summaryview->folder_item)
+			goto out;
+		added = g_slist_prepend(added, msginfo);
+		changes++;
+	}
+
+	g_hash_table_iter_init(&iter, row_table);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (g_hash_table_lookup(new_table, key) == NULL) {
+			removed = g_slist_prepend(removed, value);
+			changes++;
+		}
+	}
+
+	if (changes > g_hash_table_size(row_table) / SUMMARY_UPDATE_MAX_CHANGES)
+		goto out;
+
+	debug_print("Updating summary: %d messages added, %d removed\n",
+		    g_slist_length(added), g_slist_length(removed));
+	updated = TRUE;
+
+	/* the rows already hold a reference to the messages they keep */
+	for (cur = mlist; cur != NULL; cur = cur->next) {
+		MsgInfo *msginfo = (MsgInfo *)cur->data;
+
+		if (g_hash_table_lookup(row_table, msginfo) != NULL)
+			procmsg_msginfo_free(&msginfo);
+	}
+
+	g_signal_handlers_block_by_func(G_OBJECT(ctree),
+				       G_CALLBACK(summary_tree_expanded), summaryview);
+	GTK_SCTREE(ctree)->sorting = TRUE;
+
+	for (cur = removed; cur != NULL; cur = cur->next) {
+		GtkCMCTreeNode *node = (GtkCMCTreeNode *)cur->data;
+		GtkCMCTreeNode *parent = GTK_CMCTREE_ROW(node)->parent;
+		GtkCMCTreeNode *child, *next;
+		MsgInfo *msginfo = GTKUT_CTREE_NODE_GET_ROW_DATA(node);
+
+		/* the replies stay, the thread is mended below */
+		for (child = GTK_CMCTREE_ROW(node)->children; child != NULL;
+		     child = next) {
+			next = GTK_CMCTREE_ROW(child)->sibling;
+			gtk_cmctree_move(ctree, child, parent, NULL);
+			moved = g_slist_prepend(moved, child);
+		}
+		if (parent)
+			moved = g_slist_prepend(moved, parent);
+		moved = g_slist_remove_all(moved, node);
+
+		if (node == summaryview->selected)
+			summaryview->selected = NULL;
+		if (node == summaryview->displayed) {
+			summary_cancel_mark_read_timeout(summaryview);
+			summaryview->displayed = NULL;
+		}
+		if (gtkut_ctree_node_is_selected(ctree, node))
+			summary_unselect_all(summaryview);
+
+		gtk_cmctree_node_set_row_data(ctree, node, NULL);
+		g_hash_table_remove(row_table, msginfo);
+
+		if (msginfo->msgid && *msginfo->msgid &&
+		    node == g_hash_table_lookup(summaryview->msgid_table,
+						msginfo->msgid))
+			g_hash_table_remove(summaryview->msgid_table,
+					    msginfo->msgid);
+		if (prefs_common.thread_by_subject &&
+		    msginfo->subject && *msginfo->subject &&
+		    node == subject_table_lookup(summaryview->subject_table,
+						 msginfo->subject))
+			subject_table_remove(summaryview->subject_table,
+					     msginfo->subject);
+		summary_sort_keys_remove(summaryview, msginfo);
+		procmsg_msginfo_free(&msginfo);
+
+		gtk_sctree_remove_node((GtkSCTree *)ctree, node);
+	}
+
+	for (cur = added; cur != NULL; cur = cur->next) {
+		MsgInfo *msginfo = (MsgInfo *)cur->data;
+		GtkCMCTreeNode *node;
+
+		node = gtk_sctree_insert_node
+			(ctree, NULL, NULL, NULL, 2, NULL, NULL, FALSE,
+			 summaryview->threaded && !summaryview->thread_collapsed);
+		GTK_CMCTREE_ROW(node)->row.unfilled = TRUE;
+
+		GTKUT_CTREE_NODE_SET_ROW_DATA(node, msginfo);
+		g_hash_table_insert(row_table, msginfo, node);
+
+		if (msginfo->msgid && msginfo->msgid[0] != '\0')
+			g_hash_table_insert(summaryview->msgid_table,
+					    msginfo->msgid, node);
+		if (!summaryview->threaded && summaryview->subject_table)
+			subject_table_insert(summaryview->subject_table,
+					     msginfo->subject, node);
+
+		moved = g_slist_prepend(moved, node);
+	}
+
+	if (index != NULL) {
+		/* replies to the new messages may be shown at the top */
+		for (cur = added; cur != NULL; cur = cur->next)
+			moved = summary_find_thread_children(index, row_table,
+							     cur->data, moved);
+
+		for (cur = moved; cur != NULL; cur = cur->next) {
+			GtkCMCTreeNode *node = (GtkCMCTreeNode *)cur->data;
+
+			if (GTK_CMCTREE_ROW(node)->parent != NULL)
+				gtk_cmctree_move(ctree, node, NULL, NULL);
+		}
+		for (cur = moved; cur != NULL; cur = cur->next) {
+			GtkCMCTreeNode *node = (GtkCMCTreeNode *)cur->data;
+			GtkCMCTreeNode *parent;
+
+			parent = summary_find_thread_parent(index, row_table,
+					GTKUT_CTREE_NODE_GET_ROW_DATA(node));
+			if (parent && parent != GTK_CMCTREE_ROW(node)->parent)
+				gtk_cmctree_move(ctree, node, parent, NULL);
+		}
+	}
+
+	for (cur = moved; cur != NULL; cur = cur->next) {
+		GtkCMCTreeNode *node = (GtkCMCTreeNode *)cur->data;
+		GtkCMCTreeNode *top;
+
+		if (GTK_CMCTREE_ROW(node)->parent == NULL) {
+			sort_top = TRUE;
+		} else {
+			g_hash_table_insert(parents,
+					    GTK_CMCTREE_ROW(node)->parent,
+					    GTK_CMCTREE_ROW(node)->parent);
+		}
+
+		if (index != NULL &&
+		    summaryview->sort_key == SORT_BY_THREAD_DATE) {
+			MsgInfo *msginfo;
+			time_t most_recent;
+
+			for (top = node; GTK_CMCTREE_ROW(top)->parent != NULL;
+			     top = GTK_CMCTREE_ROW(top)->parent)
+				;
+			msginfo = GTKUT_CTREE_NODE_GET_ROW_DATA(top);
+			most_recent = msginfo->date_t;
+			gtk_cmctree_pre_recursive(ctree, top,
+					summary_find_thread_date_func,
+					&most_recent);
+			msginfo->thread_date = most_recent;
+			sort_top = TRUE;
+		}
+	}
+
+	if (summaryview->sort_key != SORT_BY_NONE) {
+		START_TIMING("sorting");
+		if (sort_top)
+			gtk_sctree_sort_node(ctree, NULL);
+		g_hash_table_iter_init(&iter, parents);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+			gtk_sctree_sort_node(ctree, GTK_CMCTREE_NODE(key));
+		END_TIMING();
+	}
+
+	/* the threads which changed may be shown differently when folded */
+	g_hash_table_iter_init(&iter, parents);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		GtkCMCTreeNode *node = GTK_CMCTREE_NODE(key);
+
+		if (!GTK_CMCTREE_ROW(node)->row.unfilled)
+			summary_set_row_marks(summaryview, node);
+	}
+
+	GTK_SCTREE(ctree)->sorting = FALSE;
+	g_signal_handlers_unblock_by_func(G_OBJECT(ctree),
+				       G_CALLBACK(summary_tree_expanded), summaryview);
+
+	summary_update_status(summaryview);
+
+out:
+	g_slist_free(added);
+	g_slist_free(removed);
+	g_slist_free(moved);
+	g_hash_table_destroy(parents);
+	g_hash_table_destroy(new_table);
+	g_hash_table_destroy(row_table);
+	END_TIMING();
+
+	return updated;
+}
+
 static gchar *summary_complete_address(const gchar *addr)
 {
 	gint count;
@@ -6124,6 +6468,7 @@ static gboolean summary_set_row_tag(SummaryView *summaryview, GtkCMCTreeNode *ro
 	cm_return_val_if_fail(msginfo, FALSE);
 
 	procmsg_msginfo_update_tags(msginfo, set, id);
+	summary_sort_keys_remove(summaryview, msginfo);
 	
 	if (summaryview->col_state[summaryview->col_pos[S_COL_TAGS]].visible) {
 		tags_str = procmsg_msginfo_get_tags_str(msginfo);
@@ -6413,6 +6758,7 @@ void summaryview_destroy(SummaryView *summaryview)
 		g_free(summaryview->simplify_subject_preg);
 		summaryview->simplify_subject_preg = NULL;
 	}
+	summary_sort_keys_clear(summaryview);
 }
 static void summary_tags_menu_item_apply_tags_activate_cb(GtkWidget *widget,
 						     gpointer data)
@@ -6771,6 +7117,8 @@ static GtkWidget *summary_ctree_create(SummaryView *summaryview)
 
 	gtk_cmctree_set_indent(GTK_CMCTREE(ctree), 12);
 	g_object_set_data(G_OBJECT(ctree), "summaryview", (gpointer)summaryview); 
+	gtk_cmclist_set_fill_func(GTK_CMCLIST(ctree), summary_fill_row,
+				  summaryview, SUMMARY_FILLED_ROWS_MAX);
 
 	for (pos = 0; pos < N_SUMMARY_COLS; pos++) {
 		gtk_widget_set_can_focus(GTK_CMCLIST(ctree)->column[pos].button,
@@ -7757,24 +8105,6 @@ CMP_FUNC_DEF(summary_cmp_by_size, msginfo1->size - msginfo2->size)
 
 #undef CMP_FUNC_DEF
 
-static gint summary_cmp_by_subject(GtkCMCList *clist,
-				   gconstpointer ptr1,
-				   gconstpointer ptr2)
-{
-	MsgInfo *msginfo1 = ((GtkCMCListRow *)ptr1)->data;
-	MsgInfo *msginfo2 = ((GtkCMCListRow *)ptr2)->data;
-	gint res;
-
-	if (!msginfo1->subject)
-		return (msginfo2->subject != NULL);
-	if (!msginfo2->subject)
-		return -1;
-
-	res = subject_compare_for_sort
-		(msginfo1->subject, msginfo2->subject);
-	return (res != 0)? res: summary_cmp_by_date(clist, ptr1, ptr2);
-}
-
 static gint summary_cmp_by_thread_date(GtkCMCList *clist,
 				   gconstpointer ptr1,
 				   gconstpointer ptr2)
@@ -7789,138 +8119,141 @@ static gint summary_cmp_by_thread_date(GtkCMCList *clist,
 		return msginfo1->date_t - msginfo2->date_t;
 }
 
-static gint summary_cmp_by_from(GtkCMCList *clist, gconstpointer ptr1,
-				gconstpointer ptr2)
+static void summary_sort_key_free_msginfo(gpointer data)
 {
-	const gchar *str1, *str2;
-	const GtkCMCListRow *r1 = (const GtkCMCListRow *) ptr1;
-	const GtkCMCListRow *r2 = (const GtkCMCListRow *) ptr2;
-	MsgInfo *msginfo1 = ((GtkCMCListRow *)ptr1)->data;
-	MsgInfo *msginfo2 = ((GtkCMCListRow *)ptr2)->data;
-	const SummaryView *sv = g_object_get_data(G_OBJECT(clist), "summaryview");
-	gint res;
+	MsgInfo *msginfo = (MsgInfo *)data;
 
-	cm_return_val_if_fail(sv, -1);
-	if (sv->col_state[sv->col_pos[S_COL_FROM]].visible) {
-		str1 = GTK_CMCELL_TEXT(r1->cell[sv->col_pos[S_COL_FROM]])->text;
-		str2 = GTK_CMCELL_TEXT(r2->cell[sv->col_pos[S_COL_FROM]])->text;
-	} else {
-		str1 = msginfo1->from;
-		str2 = msginfo2->from;
+	procmsg_msginfo_free(&msginfo);
+}
+
+static void summary_sort_keys_clear(SummaryView *summaryview)
+{
+	if (summaryview->sort_keys) {
+		g_hash_table_destroy(summaryview->sort_keys);
+		summaryview->sort_keys = NULL;
 	}
+}
 
-	if (!str1)
-		return str2 != NULL;
- 
-	if (!str2)
- 		return -1;
- 
-	res = g_utf8_collate(str1, str2);
-	return (res != 0)? res: summary_cmp_by_date(clist, ptr1, ptr2);
+static void summary_sort_keys_remove(SummaryView *summaryview,
+				     MsgInfo *msginfo)
+{
+	if (summaryview->sort_keys)
+		g_hash_table_remove(summaryview->sort_keys, msginfo);
 }
- 
-static gint summary_cmp_by_to(GtkCMCList *clist, gconstpointer ptr1,
-				gconstpointer ptr2)
+
+/* Returns a copy of the text of a column, formatted the way the row
+ * will be if it has not been drawn yet */
+static gchar *summary_get_row_text(SummaryView *summaryview,
+				   const GtkCMCListRow *row, gint col)
 {
-	const gchar *str1, *str2;
-	const GtkCMCListRow *r1 = (const GtkCMCListRow *) ptr1;
-	const GtkCMCListRow *r2 = (const GtkCMCListRow *) ptr2;
-	MsgInfo *msginfo1 = ((GtkCMCListRow *)ptr1)->data;
-	MsgInfo *msginfo2 = ((GtkCMCListRow *)ptr2)->data;
-	const SummaryView *sv = g_object_get_data(G_OBJECT(clist), "summaryview");
-	gint res;
-	cm_return_val_if_fail(sv, -1);
-	
-	if (sv->col_state[sv->col_pos[S_COL_TO]].visible) {
-		str1 = GTK_CMCELL_TEXT(r1->cell[sv->col_pos[S_COL_TO]])->text;
-		str2 = GTK_CMCELL_TEXT(r2->cell[sv->col_pos[S_COL_TO]])->text;
-	} else {
-		str1 = msginfo1->to;
-		str2 = msginfo2->to;
-	}
+	gchar *text[N_SUMMARY_COLS];
+	gint *col_pos = summaryview->col_pos;
+	gboolean vert_layout = (prefs_common.layout_mode == VERTICAL_LAYOUT);
+	gboolean small_layout = (prefs_common.layout_mode == SMALL_LAYOUT);
+	gchar *str;
 
-	if (!str1)
-		return str2 != NULL;
- 
-	if (!str2)
- 		return -1;
- 
-	res = g_utf8_collate(str1, str2);
-	return (res != 0)? res: summary_cmp_by_date(clist, ptr1, ptr2);
+	if (!row->unfilled)
+		return g_strdup(GTK_CMCELL_TEXT(row->cell[col_pos[col]])->text);
+
+	summary_set_header(summaryview, text, row->data);
+	str = g_strdup(text[col_pos[col]]);
+	if ((vert_layout || small_layout) && prefs_common.two_line_vert)
+		g_free(text[col_pos[S_COL_SUBJECT]]);
+
+	return str;
 }
- 
-static gint summary_cmp_by_tags(GtkCMCList *clist, gconstpointer ptr1,
-				gconstpointer ptr2)
+
+/* Returns the collation key of the text the row is sorted on, built
+ * once per message so that comparing two rows is a strcmp(). The
+ * table holds a reference on the message, so that its address cannot
+ * be reused by another one while the key is kept. */
+static const gchar *summary_get_sort_key(SummaryView *summaryview,
+					 const GtkCMCListRow *row)
 {
-	gchar *str1, *str2;
-	const GtkCMCListRow *r1 = (const GtkCMCListRow *) ptr1;
-	const GtkCMCListRow *r2 = (const GtkCMCListRow *) ptr2;
-	const SummaryView *sv = g_object_get_data(G_OBJECT(clist), "summaryview");
-	MsgInfo *msginfo1 = ((GtkCMCListRow *)ptr1)->data;
-	MsgInfo *msginfo2 = ((GtkCMCListRow *)ptr2)->data;
-	gint res;
-	cm_return_val_if_fail(sv, -1);
-	
-	if (sv->col_state[sv->col_pos[S_COL_TAGS]].visible) {
-		str1 = g_strdup(GTK_CMCELL_TEXT(r1->cell[sv->col_pos[S_COL_TAGS]])->text);
-		str2 = g_strdup(GTK_CMCELL_TEXT(r2->cell[sv->col_pos[S_COL_TAGS]])->text);
-	} else {
-		str1 = procmsg_msginfo_get_tags_str(msginfo1);
-		str2 = procmsg_msginfo_get_tags_str(msginfo2);
-	}
+	MsgInfo *msginfo = row->data;
+	gint *col_pos = summaryview->col_pos;
+	gchar *str = NULL;
+	gchar *key = NULL;
+
+	if (!msginfo)
+		return NULL;
+
+	if (!summaryview->sort_keys)
+		summaryview->sort_keys = g_hash_table_new_full(
+				g_direct_hash, g_direct_equal,
+				summary_sort_key_free_msginfo, g_free);
+	else if (g_hash_table_lookup_extended(summaryview->sort_keys, msginfo,
+					      NULL, (gpointer *)&key))
+		return key;
 
-	if (!str1) {
-		res = (str2 != NULL);
-		g_free(str2);
-		return res;
+#define COL_VISIBLE(col) (summaryview->col_state[col_pos[col]].visible)
+#define COL_TEXT(col) (summary_get_row_text(summaryview, row, col))
+
+	switch (summaryview->sort_key) {
+	case SORT_BY_FROM:
+		str = COL_VISIBLE(S_COL_FROM) ?
+			COL_TEXT(S_COL_FROM) : g_strdup(msginfo->from);
+		break;
+	case SORT_BY_TO:
+		str = COL_VISIBLE(S_COL_TO) ?
+			COL_TEXT(S_COL_TO) : g_strdup(msginfo->to);
+		break;
+	case SORT_BY_TAGS:
+		if (COL_VISIBLE(S_COL_TAGS))
+			str = COL_TEXT(S_COL_TAGS);
+		else
+			str = procmsg_msginfo_get_tags_str(msginfo);
+		break;
+	case SORT_BY_SUBJECT:
+		/* the column shows the simplified subject */
+		if (summaryview->simplify_subject_preg &&
+		    COL_VISIBLE(S_COL_SUBJECT))
+			str = COL_TEXT(S_COL_SUBJECT);
+		else
+			str = g_strdup(msginfo->subject);
+		if (str) {
+			key = subject_get_sort_key(str);
+			g_free(str);
+			str = NULL;
+		}
+		break;
+	default:
+		break;
 	}
-	if (!str2) {
-		g_free(str1);
- 		return -1;
+
+#undef COL_VISIBLE
+#undef COL_TEXT
+
+	if (str) {
+		key = g_utf8_collate_key(str, -1);
+		g_free(str);
 	}
- 
-	res = g_utf8_collate(str1, str2);
-	g_free(str1);
-	g_free(str2);
-	return (res != 0)? res: summary_cmp_by_date(clist, ptr1, ptr2);
+
+	g_hash_table_insert(summaryview->sort_keys,
+			    procmsg_msginfo_new_ref(msginfo), key);
+
+	return key;
 }
- 
-static gint summary_cmp_by_simplified_subject
-	(GtkCMCList *clist, gconstpointer ptr1, gconstpointer ptr2)
-{
-	const FolderItemPrefs *prefs;
-	const gchar *str1, *str2;
-	const GtkCMCListRow *r1 = (const GtkCMCListRow *) ptr1;
-	const GtkCMCListRow *r2 = (const GtkCMCListRow *) ptr2;
-	const MsgInfo *msginfo1 = r1->data;
-	const MsgInfo *msginfo2 = r2->data;
-	const SummaryView *sv = g_object_get_data(G_OBJECT(clist), "summaryview");
+
+static gint summary_cmp_by_sort_key(GtkCMCList *clist,
+				    gconstpointer ptr1, gconstpointer ptr2)
+{
+	SummaryView *sv = g_object_get_data(G_OBJECT(clist), "summaryview");
+	const gchar *key1, *key2;
 	gint res;
 
 	cm_return_val_if_fail(sv, -1);
-	cm_return_val_if_fail(msginfo1 != NULL && msginfo2 != NULL, -1);
-	
-	if (sv->col_state[sv->col_pos[S_COL_SUBJECT]].visible) {
-		str1 = GTK_CMCELL_TEXT(r1->cell[sv->col_pos[S_COL_SUBJECT]])->text;
-		str2 = GTK_CMCELL_TEXT(r2->cell[sv->col_pos[S_COL_SUBJECT]])->text;
-	} else {
-		str1 = msginfo1->subject;
-		str2 = msginfo2->subject;
-	}
 
-	if (!str1)
-		return str2 != NULL;
+	key1 = summary_get_sort_key(sv, ptr1);
+	key2 = summary_get_sort_key(sv, ptr2);
 
-	if (!str2)
-		return -1;
+	if (!key1)
+		return key2 != NULL;
 
-	prefs = msginfo1->folder->prefs;
-	if (!prefs)
-		prefs = msginfo2->folder->prefs;
-	if (!prefs)
+	if (!key2)
 		return -1;
-	
-	res = subject_compare_for_sort(str1, str2);
+
+	res = strcmp(key1, key2);
 	return (res != 0)? res: summary_cmp_by_date(clist, ptr1, ptr2);
 }
 
@@ -8381,6 +8714,8 @@ static gboolean summary_update_msg(gpointer source, gpointer data)
 			summary_set_row_marks(summaryview, node);
 	}
 
+	summary_sort_keys_remove(summaryview, msginfo_update->msginfo);
+
 	return FALSE;
 }
 
@@ -155,6 +155,16 @@ private:
 	GHashTable *msgid_table;
 	GHashTable *subject_table;
 
+	/* collation keys of the rows for the current sort column */
+	GHashTable *sort_keys;
+
+	/* whether the address book is open for formatting the rows */
+	gboolean address_completion;
+
+	/* set while showing the same folder again because its messages
+	 * changed, so that the rows can be kept */
+	gboolean updating_contents;
+
 	/* list for moving/deleting messages */
 	GSList *mlist;
 	int msginfo_update_callback_id;
@@ -186,6 +196,7 @@ void summary_init		  (SummaryView		*summaryview);
 gboolean summary_show		  (SummaryView		*summaryview,
 				   FolderItem		*fitem,
 				   gboolean		 avoid_refresh);
+gboolean summary_show_updated	  (SummaryView		*summaryview);
 void summary_clear_list		  (SummaryView		*summaryview);
 void summary_clear_all		  (SummaryView		*summaryview);
 
@@ -0,0 +1,415 @@
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "defs.h"
+#include "bodyindex.h"
+#include "folder.h"
+#include "matcher.h"
+#include "procmime.h"
+#include "procmsg.h"
+#include "prefs_common.h"
+
+#include "mock_procmsg_msginfo.h"
+#include "mock_procmsg_get_message_file.h"
+#include "mock_procmime.h"
+#include "mock_folder_has_parent_of_type.h"
+#include "mock_tags_get_tag.h"
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+#include "mock_prefs_common.h"
+
+static FolderClass test_class;
+static Folder test_folder;
+static FolderItem test_item;
+static GArray *test_nums;
+
+static const gchar *test_bodies[] = {
+	"The quarterly report is attached.\n",
+	"Lunch tomorrow?\nBring the REPORT.\n",
+	"Buy cheap watches now!\n",
+	"Nothing to see here.\n",
+};
+
+static const gchar *test_words[] = {
+	"report", "lunch", "watches", "nothing", "zebra", "the",
+};
+
+/* the folder is the files in the test directory */
+
+gchar *folder_item_get_path(FolderItem *item)
+{
+	return g_strdup(item->path);
+}
+
+MsgNumberList *folder_item_get_number_list(FolderItem *item)
+{
+	MsgNumberList *nums = NULL;
+	guint i;
+
+	for (i = 0; i < test_nums->len; i++)
+		nums = g_slist_append(nums, GUINT_TO_POINTER(
+				g_array_index(test_nums, guint, i)));
+
+	return nums;
+}
+
+MsgInfo *folder_item_get_msginfo(FolderItem *item, gint num)
+{
+	MsgInfo *msginfo;
+	GStatBuf s;
+	gchar *file;
+
+	file = g_strdup_printf("%s%c%d", item->path, G_DIR_SEPARATOR, num);
+	if (g_stat(file, &s) < 0) {
+		g_free(file);
+		return NULL;
+	}
+	g_free(file);
+
+	msginfo = procmsg_msginfo_new();
+	msginfo->msgnum = num;
+	msginfo->folder = item;
+	msginfo->size = s.st_size;
+	msginfo->mtime = s.st_mtime;
+
+	return msginfo;
+}
+
+static void
+write_msg(guint num, const gchar *body)
+{
+	gchar *path, *contents;
+	guint i;
+
+	contents = g_strdup_printf("From: sender@example.com\n"
+				   "Subject: message %u\n"
+				   "\n"
+				   "%s", num, body);
+	path = g_strdup_printf("%s%c%u", test_item.path, G_DIR_SEPARATOR, num);
+	g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+	g_free(contents);
+	g_free(path);
+
+	for (i = 0; i < test_nums->len; i++)
+		if (g_array_index(test_nums, guint, i) == num)
+			return;
+	g_array_append_val(test_nums, num);
+}
+
+static void
+unlink_msg(guint num)
+{
+	gchar *path;
+	guint i;
+
+	path = g_strdup_printf("%s%c%u", test_item.path, G_DIR_SEPARATOR, num);
+	g_unlink(path);
+	g_free(path);
+
+	for (i = 0; i < test_nums->len; i++) {
+		if (g_array_index(test_nums, guint, i) == num) {
+			g_array_remove_index(test_nums, i);
+			break;
+		}
+	}
+}
+
+static void
+remove_msg(guint num)
+{
+	unlink_msg(num);
+	body_index_remove_msgs(&test_item, &num, 1);
+}
+
+static gchar *
+index_file(void)
+{
+	return g_build_filename(test_item.path, BODY_INDEX_FILE, NULL);
+}
+
+/* messages removed but still in some postings, from the header */
+static guint
+index_nstale(void)
+{
+	gchar *file = index_file(), *contents;
+	const guchar *p;
+	gsize len;
+	guint nstale;
+
+	g_assert_true(g_file_get_contents(file, &contents, &len, NULL));
+	g_assert_cmpuint(len, >=, 20);
+	p = (const guchar *)contents + 16;
+	nstale = p[0] | (p[1] << 8) | (p[2] << 16) | ((guint)p[3] << 24);
+	g_free(contents);
+	g_free(file);
+
+	return nstale;
+}
+
+static void
+setup_folder(void)
+{
+	guint i;
+
+	prefs_common.use_body_index = TRUE;
+	test_class.type = F_MH;
+	test_folder.klass = &test_class;
+	test_item.folder = &test_folder;
+	test_item.path = g_dir_make_tmp("bodyindex_test_XXXXXX", NULL);
+	g_assert_nonnull(test_item.path);
+	test_nums = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	for (i = 0; i < G_N_ELEMENTS(test_bodies); i++)
+		write_msg(i + 1, test_bodies[i]);
+}
+
+static void
+teardown_folder(void)
+{
+	gchar *file;
+
+	body_index_forget(&test_item);
+	while (test_nums->len > 0)
+		unlink_msg(g_array_index(test_nums, guint, 0));
+	file = index_file();
+	g_unlink(file);
+	g_free(file);
+	g_rmdir(test_item.path);
+	g_free(test_item.path);
+	test_item.path = NULL;
+	g_array_free(test_nums, TRUE);
+}
+
+/* let the background build run to its end */
+static void
+run_build(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static BodyIndexQuery *
+query_new(const gchar *word1, const gchar *word2, gboolean bool_and)
+{
+	MatcherProp prop1 = { 0 }, prop2 = { 0 };
+	MatcherList list = { 0 };
+	BodyIndexQuery *query;
+
+	prop1.criteria = prop2.criteria = MATCHCRITERIA_BODY_PART;
+	prop1.matchtype = prop2.matchtype = MATCHTYPE_MATCHCASE;
+	prop1.expr = (gchar *)word1;
+	prop2.expr = (gchar *)word2;
+	list.matchers = g_slist_append(NULL, &prop1);
+	if (word2)
+		list.matchers = g_slist_append(list.matchers, &prop2);
+	list.bool_and = bool_and;
+
+	query = body_index_query_new(&test_item, &list);
+	g_slist_free(list.matchers);
+
+	return query;
+}
+
+static gboolean
+excludes(BodyIndexQuery *query, guint num)
+{
+	MsgInfo *msginfo = folder_item_get_msginfo(&test_item, num);
+	gboolean result;
+
+	g_assert_nonnull(msginfo);
+	result = body_index_query_excludes(query, msginfo);
+	procmsg_msginfo_free(&msginfo);
+
+	return result;
+}
+
+/* whether the message with that number is ruled out for each word */
+static gchar *
+excluded_string(void)
+{
+	GString *str = g_string_new(NULL);
+	guint i, j;
+
+	for (i = 0; i < G_N_ELEMENTS(test_words); i++) {
+		BodyIndexQuery *query = query_new(test_words[i], NULL, TRUE);
+
+		g_assert_nonnull(query);
+		for (j = 0; j < test_nums->len; j++)
+			g_string_append_c(str, excludes(query,
+				g_array_index(test_nums, guint, j)) ? 'x' : '.');
+		g_string_append_c(str, ' ');
+		body_index_query_free(query);
+	}
+
+	return g_string_free(str, FALSE);
+}
+
+static void
+test_bodyindex_build(void)
+{
+	gchar *file, *contents;
+	gsize len;
+
+	setup_folder();
+
+	/* no index yet: the first search starts building it */
+	g_assert_null(query_new("report", NULL, TRUE));
+	run_build();
+
+	file = index_file();
+	g_assert_true(g_file_get_contents(file, &contents, &len, NULL));
+	g_assert_cmpuint(len, >, 20);
+	/* magic and version, little-endian whatever the host */
+	g_assert_cmpint(memcmp(contents, "CBI1\2\0\0\0", 8), ==, 0);
+	/* four messages, no stale ones */
+	g_assert_cmpint(memcmp(contents + 8, "\4\0\0\0", 4), ==, 0);
+	g_assert_cmpint(memcmp(contents + 16, "\0\0\0\0", 4), ==, 0);
+	g_free(contents);
+	g_free(file);
+
+	teardown_folder();
+}
+
+static void
+test_bodyindex_query(void)
+{
+	BodyIndexQuery *query;
+	gchar *str;
+
+	setup_folder();
+	g_assert_null(query_new("report", NULL, TRUE));
+	run_build();
+
+	/* casefolded, so "report" doesn't rule out "REPORT" */
+	str = excluded_string();
+	g_assert_cmpstr(str, ==, "..xx x.xx xx.x xxx. xxxx ..xx ");
+	g_free(str);
+
+	query = query_new("report", "lunch", TRUE);
+	g_assert_true(excludes(query, 1));
+	g_assert_false(excludes(query, 2));
+	g_assert_true(excludes(query, 3));
+	body_index_query_free(query);
+
+	query = query_new("report", "watches", FALSE);
+	g_assert_false(excludes(query, 1));
+	g_assert_false(excludes(query, 2));
+	g_assert_false(excludes(query, 3));
+	g_assert_true(excludes(query, 4));
+	body_index_query_free(query);
+
+	/* too short to have a trigram */
+	g_assert_null(query_new("re", NULL, TRUE));
+
+	teardown_folder();
+}
+
+static void
+test_bodyindex_update(void)
+{
+	BodyIndexQuery *query;
+	gchar *str;
+
+	setup_folder();
+	g_assert_null(query_new("report", NULL, TRUE));
+	run_build();
+
+	/* new and changed messages are tested until indexed again */
+	write_msg(5, "Zebra crossing report.\n");
+	write_msg(3, "No more watches, a zebra instead.\n");
+	query = query_new("zebra", NULL, TRUE);
+	g_assert_nonnull(query);
+	g_assert_false(excludes(query, 3));
+	g_assert_false(excludes(query, 5));
+	g_assert_true(excludes(query, 4));
+	body_index_query_free(query);
+
+	body_index_schedule(&test_item);
+	run_build();
+	str = excluded_string();
+	g_assert_cmpstr(str, ==,
+			"..xx. x.xxx xx.xx xxx.x xx.x. ..xxx ");
+	g_free(str);
+
+	remove_msg(2);
+	body_index_schedule(&test_item);
+	run_build();
+	str = excluded_string();
+	g_assert_cmpstr(str, ==, ".xx. xxxx x.xx xx.x x.x. .xxx ");
+	g_free(str);
+
+	teardown_folder();
+}
+
+static void
+test_bodyindex_round_trip(void)
+{
+	gchar *before, *after;
+	guint i;
+
+	setup_folder();
+	g_assert_null(query_new("report", NULL, TRUE));
+	run_build();
+
+	before = excluded_string();
+	body_index_forget(&test_item);
+	after = excluded_string();
+	g_assert_cmpstr(after, ==, before);
+	g_free(before);
+	g_free(after);
+
+	/* only the trigrams of the new message are written again; the
+	 * rest is copied from the file read back */
+	write_msg(5, "Zebra crossing report.\n");
+	body_index_schedule(&test_item);
+	run_build();
+	before = excluded_string();
+	body_index_forget(&test_item);
+	after = excluded_string();
+	g_assert_cmpstr(after, ==, before);
+	g_assert_cmpstr(after, ==, "..xx. x.xxx xx.xx xxx.x xxxx. ..xxx ");
+	g_free(before);
+	g_free(after);
+
+	/* removed messages are kept in the postings until they are a
+	 * quarter of the index, then dropped as they all get rewritten */
+	for (i = 0; i < 2; i++) {
+		remove_msg(i + 1);
+		body_index_schedule(&test_item);
+		run_build();
+		g_assert_cmpuint(index_nstale(), ==, i == 0 ? 1 : 0);
+		before = excluded_string();
+		body_index_forget(&test_item);
+		after = excluded_string();
+		g_assert_cmpstr(after, ==, before);
+		g_free(before);
+		g_free(after);
+	}
+	after = excluded_string();
+	g_assert_cmpstr(after, ==, "xx. xxx .xx x.x xx. xxx ");
+	g_free(after);
+
+	teardown_folder();
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/core/bodyindex/build",
+			test_bodyindex_build);
+	g_test_add_func("/core/bodyindex/query",
+			test_bodyindex_query);
+	g_test_add_func("/core/bodyindex/update",
+			test_bodyindex_update);
+	g_test_add_func("/core/bodyindex/round_trip",
+			test_bodyindex_round_trip);
+
+	return g_test_run();
+}
@@ -0,0 +1,289 @@
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "defs.h"
+#include "matcher.h"
+#include "procmime.h"
+#include "procmsg.h"
+#include "prefs_common.h"
+#include "prefs.h"
+#include "filtering.h"
+#include "log.h"
+
+#include "mock_procmsg_msginfo.h"
+#include "mock_procmsg_get_message_file.h"
+#include "mock_procmsg_msginfo_add_avatar.h"
+#include "mock_procmime.h"
+#include "mock_folder.h"
+#include "mock_folder_has_parent_of_type.h"
+#include "mock_tags_get_tag.h"
+#include "mock_filtering.h"
+#include "mock_addr_compl.h"
+#include "mock_log.h"
+#include "mock_prefs_file.h"
+#include "mock_matcher_parser.h"
+#include "mock_prefs_common_translated_header_name.h"
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+#include "mock_prefs_common.h"
+
+static FolderItem test_item;
+
+typedef struct {
+	const gchar *from;
+	const gchar *to;
+	const gchar *cc;
+	const gchar *subject;
+	/* the Subject: line as written, if it differs from subject */
+	const gchar *subject_header;
+	const gchar *headers;
+	const gchar *body;
+} TestMessage;
+
+/* folded headers, encoded words, repeated headers and bodies that only
+ * some of the conditions below find */
+static const TestMessage test_messages[] = {
+	{ "Alice <alice@example.com>", "list@example.org", NULL,
+	  "Weekly report", NULL,
+	  "X-Mailing-List: devel\n"
+	  "Received: from a.example.com\n"
+	  "Received: from b.example.com\n",
+	  "The build is green.\nNothing else to report.\n" },
+	{ "Bob <bob@example.net>", "alice@example.com", "carol@example.org",
+	  "Caf\xc3\xa9 meeting", "=?UTF-8?Q?Caf=C3=A9_meeting?=",
+	  "X-Priority: 1\n"
+	  "X-Mailing-List: users\n",
+	  "Lunch at the cafe?\nBring the REPORT.\n" },
+	{ "Carol <carol@example.org>", "bob@example.net", NULL,
+	  "Re: weekly report", NULL,
+	  "X-Spam-Status: Yes,\n"
+	  "\tscore=9.1 required=5.0\n"
+	  "Received: from c.example.com\n",
+	  "Buy cheap watches now!\n" },
+	{ "Dave <dave@example.com>", "list@example.org", "bob@example.net",
+	  "Patch 12/34: fix the parser", NULL,
+	  "X-Priority: 3\n"
+	  "X-Mailing-List: devel\n",
+	  "---\n matcher.c | 2 +-\n 1 file changed\n" },
+	{ "Eve <eve@example.net>", "eve@example.net", NULL,
+	  "Test", NULL,
+	  "",
+	  "" },
+};
+
+typedef struct {
+	gint criteria;
+	const gchar *header;
+	gint matchtype;
+	const gchar *expr;
+	/* whether each message above matches, as 0 or 1 */
+	const gchar *expected;
+} TestCondition;
+
+static const TestCondition test_conditions[] = {
+	{ MATCHCRITERIA_SUBJECT, NULL, MATCHTYPE_MATCH, "report", "10100" },
+	{ MATCHCRITERIA_SUBJECT, NULL, MATCHTYPE_MATCHCASE, "Weekly", "10100" },
+	{ MATCHCRITERIA_SUBJECT, NULL, MATCHTYPE_REGEXP, "^Re: ", "00100" },
+	{ MATCHCRITERIA_SUBJECT, NULL, MATCHTYPE_MATCH, "caf\xc3\xa9", "01000" },
+	{ MATCHCRITERIA_NOT_SUBJECT, NULL, MATCHTYPE_MATCH, "Patch", "11101" },
+	{ MATCHCRITERIA_FROM, NULL, MATCHTYPE_MATCH, "example.com", "10010" },
+	{ MATCHCRITERIA_TO_OR_CC, NULL, MATCHTYPE_MATCH, "bob@", "00110" },
+	{ MATCHCRITERIA_HEADER, "X-Mailing-List", MATCHTYPE_MATCH, "devel",
+	  "10010" },
+	/* folded */
+	{ MATCHCRITERIA_HEADER, "X-Spam-Status", MATCHTYPE_REGEXP, "score=[0-9]",
+	  "00100" },
+	/* the second of two */
+	{ MATCHCRITERIA_HEADER, "Received", MATCHTYPE_MATCHCASE, "b.example.com",
+	  "10000" },
+	/* needs a header which doesn't match */
+	{ MATCHCRITERIA_NOT_HEADER, "X-Priority", MATCHTYPE_MATCH, "1", "00010" },
+	{ MATCHCRITERIA_HEADERS_PART, NULL, MATCHTYPE_MATCHCASE, "x-priority",
+	  "01010" },
+	{ MATCHCRITERIA_HEADERS_CONT, NULL, MATCHTYPE_REGEXPCASE, "^FROM c\\.",
+	  "00100" },
+	{ MATCHCRITERIA_BODY_PART, NULL, MATCHTYPE_MATCH, "report", "10000" },
+	{ MATCHCRITERIA_BODY_PART, NULL, MATCHTYPE_REGEXPCASE, "[0-9]+ file",
+	  "00010" },
+	/* needs a line which doesn't match, so not the empty body */
+	{ MATCHCRITERIA_NOT_BODY_PART, NULL, MATCHTYPE_MATCHCASE, "cafe",
+	  "10110" },
+	{ MATCHCRITERIA_MESSAGE, NULL, MATCHTYPE_MATCH, "watches", "00100" },
+	{ MATCHCRITERIA_MESSAGE, NULL, MATCHTYPE_MATCHCASE, "USERS", "01000" },
+};
+
+static MsgInfo *
+write_message(guint num, const TestMessage *message)
+{
+	MsgInfo *msginfo = procmsg_msginfo_new();
+	gchar *path, *contents;
+
+	contents = g_strdup_printf("From: %s\n"
+				   "To: %s\n"
+				   "%s%s%s"
+				   "Subject: %s\n"
+				   "%s"
+				   "\n"
+				   "%s",
+				   message->from, message->to,
+				   message->cc ? "Cc: " : "",
+				   message->cc ? message->cc : "",
+				   message->cc ? "\n" : "",
+				   message->subject_header ? message->subject_header
+				   : message->subject, message->headers,
+				   message->body);
+	path = g_strdup_printf("%s%c%u", test_item.path, G_DIR_SEPARATOR, num);
+	g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+	g_free(contents);
+	g_free(path);
+
+	msginfo->msgnum = num;
+	msginfo->folder = &test_item;
+	msginfo->from = g_strdup(message->from);
+	msginfo->to = g_strdup(message->to);
+	msginfo->cc = g_strdup(message->cc);
+	msginfo->subject = g_strdup(message->subject);
+
+	return msginfo;
+}
+
+static MatcherList *
+make_list(const TestCondition *a, const TestCondition *b, gboolean bool_and)
+{
+	GSList *props;
+
+	props = g_slist_append(NULL, matcherprop_new(a->criteria,
+			a->header, a->matchtype, a->expr, 0));
+	if (b)
+		props = g_slist_append(props, matcherprop_new(b->criteria,
+				b->header, b->matchtype, b->expr, 0));
+
+	return matcherlist_new(props, bool_and);
+}
+
+static gboolean
+expected_match(const TestCondition *c, guint msg)
+{
+	return c->expected[msg] == '1';
+}
+
+static void
+check_match(MatcherList *list, MsgInfo *msginfo, MatcherMsgCache *cache,
+	    gboolean expected, const gchar *what)
+{
+	gboolean result;
+
+	result = matcherlist_match(list, msginfo);
+	if (result != expected)
+		g_error("%s, message %u: got %d", what, msginfo->msgnum, result);
+	result = matcherlist_match_cached(list, msginfo, cache);
+	if (result != expected)
+		g_error("%s, message %u: got %d with the cache", what,
+			msginfo->msgnum, result);
+}
+
+static void
+test_matcher_criteria(void)
+{
+	MsgInfo *msginfos[G_N_ELEMENTS(test_messages)];
+	MatcherMsgCache *caches[G_N_ELEMENTS(test_messages)];
+	GSList *lists = NULL, *cur;
+	MatcherLiterals *literals;
+	gchar *dir, *what;
+	guint i, j, m;
+
+	dir = g_dir_make_tmp("matcher_test_XXXXXX", NULL);
+	g_assert_nonnull(dir);
+	test_item.path = dir;
+
+	for (m = 0; m < G_N_ELEMENTS(test_messages); m++)
+		msginfos[m] = write_message(m + 1, &test_messages[m]);
+
+	/* every condition on its own, then pairs of them under AND and OR
+	 * so that the cache is shared between conditions */
+	for (i = 0; i < G_N_ELEMENTS(test_conditions); i++)
+		lists = g_slist_append(lists,
+				make_list(&test_conditions[i], NULL, TRUE));
+	for (i = 0; i < G_N_ELEMENTS(test_conditions); i++)
+		for (j = i + 1; j < G_N_ELEMENTS(test_conditions); j += 3)
+			lists = g_slist_append(lists,
+					make_list(&test_conditions[i],
+						  &test_conditions[j],
+						  (i + j) % 2 == 0));
+
+	literals = matcher_literals_new(lists);
+	for (m = 0; m < G_N_ELEMENTS(test_messages); m++) {
+		caches[m] = matcher_msg_cache_new(msginfos[m]);
+		matcher_msg_cache_set_literals(caches[m], literals);
+	}
+
+	cur = lists;
+	for (i = 0; i < G_N_ELEMENTS(test_conditions); i++, cur = cur->next) {
+		for (m = 0; m < G_N_ELEMENTS(test_messages); m++) {
+			what = g_strdup_printf("condition %u", i);
+			check_match((MatcherList *) cur->data, msginfos[m],
+				    caches[m],
+				    expected_match(&test_conditions[i], m),
+				    what);
+			g_free(what);
+		}
+	}
+	for (i = 0; i < G_N_ELEMENTS(test_conditions); i++) {
+		for (j = i + 1; j < G_N_ELEMENTS(test_conditions);
+		     j += 3, cur = cur->next) {
+			gboolean bool_and = (i + j) % 2 == 0;
+
+			for (m = 0; m < G_N_ELEMENTS(test_messages); m++) {
+				gboolean a, b;
+
+				a = expected_match(&test_conditions[i], m);
+				b = expected_match(&test_conditions[j], m);
+				what = g_strdup_printf("conditions %u %s %u",
+						i, bool_and ? "and" : "or", j);
+				check_match((MatcherList *) cur->data,
+					    msginfos[m], caches[m],
+					    bool_and ? a && b : a || b, what);
+				g_free(what);
+			}
+		}
+	}
+
+	for (m = 0; m < G_N_ELEMENTS(test_messages); m++)
+		matcher_msg_cache_free(caches[m]);
+	matcher_literals_free(literals);
+	g_slist_free_full(lists, (GDestroyNotify) matcherlist_free);
+	for (m = 0; m < G_N_ELEMENTS(test_messages); m++) {
+		gchar *path = g_strdup_printf("%s%c%u", dir, G_DIR_SEPARATOR, m + 1);
+
+		g_unlink(path);
+		g_free(path);
+		procmsg_msginfo_free(&msginfos[m]);
+	}
+	g_rmdir(dir);
+	g_free(dir);
+	test_item.path = NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int ret;
+
+	g_test_init(&argc, &argv, NULL);
+
+	matcher_init();
+
+	g_test_add_func("/core/matcher/criteria",
+			test_matcher_criteria);
+
+	ret = g_test_run();
+
+	matcher_done();
+
+	return ret;
+}
@@ -0,0 +1,19 @@
+guint start_address_completion(gchar *folderpath)
+{
+	return 0;
+}
+
+guint complete_address(const gchar *str)
+{
+	return 0;
+}
+
+gchar *get_complete_address(gint index)
+{
+	return NULL;
+}
+
+gint end_address_completion(void)
+{
+	return 0;
+}
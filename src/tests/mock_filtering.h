@@ -0,0 +1,19 @@
+gboolean debug_filtering_session = FALSE;
+GSList *filtering_rules = NULL;
+GSList *pre_global_processing = NULL;
+GSList *post_global_processing = NULL;
+
+gchar *filteringprop_to_string(FilteringProp *prop)
+{
+	return NULL;
+}
+
+void prefs_filtering_clear(void)
+{
+	return;
+}
+
+void filtering_rules_changed(void)
+{
+	return;
+}
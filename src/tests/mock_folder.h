@@ -0,0 +1,14 @@
+GList *folder_get_list(void)
+{
+	return NULL;
+}
+
+gchar *folder_item_get_identifier(FolderItem *item)
+{
+	return NULL;
+}
+
+gchar *folder_item_fetch_msg(FolderItem *item, gint num)
+{
+	return NULL;
+}
@@ -0,0 +1,4 @@
+gboolean folder_has_parent_of_type(FolderItem *item, SpecialFolderItemType type)
+{
+	return FALSE;
+}
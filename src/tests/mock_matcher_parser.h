@@ -0,0 +1,6 @@
+FILE *matcher_parserin = NULL;
+
+void matcher_parser_start_parsing(FILE *f)
+{
+	return;
+}
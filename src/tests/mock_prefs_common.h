@@ -0,0 +1 @@
+PrefsCommon prefs_common;
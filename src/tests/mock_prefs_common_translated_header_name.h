@@ -0,0 +1,4 @@
+const gchar *prefs_common_translated_header_name(const gchar *header_name)
+{
+	return header_name;
+}
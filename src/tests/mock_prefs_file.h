@@ -0,0 +1,14 @@
+PrefFile *prefs_write_open(const gchar *path)
+{
+	return NULL;
+}
+
+gint prefs_file_close(PrefFile *pfile)
+{
+	return -1;
+}
+
+gint prefs_file_close_revert(PrefFile *pfile)
+{
+	return -1;
+}
@@ -0,0 +1,100 @@
+/* a message is scanned as its headers followed by a single text/plain
+ * part, read as is */
+static MimeInfo *mock_procmime_scan(const gchar *filename)
+{
+	MimeInfo *mimeinfo, *partinfo;
+	FILE *fp;
+	gchar buf[BUFFSIZE];
+
+	if ((fp = g_fopen(filename, "rb")) == NULL)
+		return NULL;
+
+	mimeinfo = g_new0(MimeInfo, 1);
+	mimeinfo->type = MIMETYPE_MESSAGE;
+	mimeinfo->node = g_node_new(mimeinfo);
+
+	partinfo = g_new0(MimeInfo, 1);
+	partinfo->type = MIMETYPE_TEXT;
+	partinfo->subtype = g_strdup("plain");
+	partinfo->data.filename = g_strdup(filename);
+	while (fgets(buf, sizeof(buf), fp) != NULL && buf[0] != '\r' && buf[0] != '\n')
+		;
+	partinfo->offset = ftell(fp);
+	partinfo->node = g_node_new(partinfo);
+	g_node_append(mimeinfo->node, partinfo->node);
+	fclose(fp);
+
+	return mimeinfo;
+}
+
+MimeInfo *procmime_scan_file(const gchar *filename)
+{
+	return mock_procmime_scan(filename);
+}
+
+MimeInfo *procmime_scan_queue_file(const gchar *filename)
+{
+	return mock_procmime_scan(filename);
+}
+
+MimeInfo *procmime_mimeinfo_next(MimeInfo *mimeinfo)
+{
+	if (mimeinfo == NULL)
+		return NULL;
+	if (mimeinfo->node->children)
+		return (MimeInfo *) mimeinfo->node->children->data;
+	if (mimeinfo->node->next)
+		return (MimeInfo *) mimeinfo->node->next->data;
+	return NULL;
+}
+
+gboolean procmime_scan_text_content(MimeInfo *mimeinfo,
+		gboolean (*scan_callback)(const gchar *str, gpointer cb_data),
+		gpointer cb_data)
+{
+	FILE *fp;
+	gchar buf[BUFFSIZE];
+	gboolean scan_ret = FALSE;
+
+	if ((fp = g_fopen(mimeinfo->data.filename, "rb")) == NULL)
+		return TRUE;
+	fseek(fp, mimeinfo->offset, SEEK_SET);
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		strretchomp(buf);
+		if ((scan_ret = scan_callback(buf, cb_data)) == TRUE)
+			break;
+	}
+	fclose(fp);
+
+	return scan_ret;
+}
+
+FILE *procmime_get_binary_content(MimeInfo *mimeinfo)
+{
+	return NULL;
+}
+
+static gboolean mock_procmime_free_func(GNode *node, gpointer data)
+{
+	MimeInfo *mimeinfo = (MimeInfo *) node->data;
+
+	g_free(mimeinfo->subtype);
+	g_free(mimeinfo->data.filename);
+	g_free(mimeinfo);
+	return FALSE;
+}
+
+void procmime_mimeinfo_free_all(MimeInfo **mimeinfo_ptr)
+{
+	MimeInfo *mimeinfo = *mimeinfo_ptr;
+	GNode *node;
+
+	if (mimeinfo == NULL)
+		return;
+
+	node = mimeinfo->node;
+	g_node_traverse(node, G_IN_ORDER, G_TRAVERSE_ALL, -1,
+			mock_procmime_free_func, NULL);
+	g_node_destroy(node);
+	*mimeinfo_ptr = NULL;
+}
@@ -0,0 +1,17 @@
+/* messages are the files named after their number in the path of
+ * their item */
+gchar *procmsg_get_message_file_path(MsgInfo *msginfo)
+{
+	return g_strdup_printf("%s%c%d", msginfo->folder->path,
+			       G_DIR_SEPARATOR, msginfo->msgnum);
+}
+
+gchar *procmsg_get_message_file(MsgInfo *msginfo)
+{
+	return procmsg_get_message_file_path(msginfo);
+}
+
+gchar *procmsg_get_message_file_full(MsgInfo *msginfo, gboolean headers, gboolean body)
+{
+	return procmsg_get_message_file_path(msginfo);
+}
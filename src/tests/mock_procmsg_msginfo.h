@@ -0,0 +1,38 @@
+MsgInfo *procmsg_msginfo_new(void)
+{
+	MsgInfo *msginfo = g_new0(MsgInfo, 1);
+
+	msginfo->refcnt = 1;
+	return msginfo;
+}
+
+MsgInfo *procmsg_msginfo_new_ref(MsgInfo *msginfo)
+{
+	msginfo->refcnt++;
+	return msginfo;
+}
+
+/* the strings are freed as procmsg_msginfo_free() does, minding the
+ * cache arena */
+void procmsg_msginfo_free(MsgInfo **msginfo_ptr)
+{
+	MsgInfo *msginfo = *msginfo_ptr;
+
+	if (msginfo == NULL)
+		return;
+
+	msginfo->refcnt--;
+	if (msginfo->refcnt > 0)
+		return;
+
+	msgcache_msginfo_free_strings(msginfo);
+	g_slist_free(msginfo->tags);
+
+	g_free(msginfo);
+	*msginfo_ptr = NULL;
+}
+
+guint procmsg_msginfo_memusage(MsgInfo *msginfo)
+{
+	return sizeof(MsgInfo);
+}
@@ -0,0 +1,4 @@
+void procmsg_msginfo_add_avatar(MsgInfo *msginfo, gint type, const gchar *data)
+{
+	return;
+}
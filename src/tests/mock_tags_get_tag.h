@@ -0,0 +1,4 @@
+const gchar *tags_get_tag(gint id)
+{
+	return NULL;
+}
@@ -0,0 +1,363 @@
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "msgcache.h"
+#include "prefs_common.h"
+
+#include "mock_procmsg_msginfo.h"
+#include "mock_folder_has_parent_of_type.h"
+#include "mock_tags_get_tag.h"
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+#include "mock_prefs_common.h"
+
+#define SMALL_CACHE_SIZE 1000
+#define PERF_CACHE_SIZE 500000
+
+static FolderItem test_item;
+
+static MsgInfo *
+make_msginfo(guint num)
+{
+	MsgInfo *msginfo = procmsg_msginfo_new();
+
+	msginfo->msgnum = num;
+	msginfo->size = 1000 + num;
+	msginfo->mtime = 1700000000 + num;
+	msginfo->date_t = 1700000000 + num;
+	msginfo->folder = &test_item;
+
+	msginfo->fromname = g_strdup_printf("Sender %u", num % 997);
+	msginfo->date = g_strdup("Tue, 14 Nov 2023 22:13:20 +0000");
+	msginfo->from = g_strdup_printf("Sender %u <sender%u@example.com>",
+			num % 997, num % 997);
+	msginfo->to = g_strdup("list@example.org");
+	if (num % 3 == 0)
+		msginfo->cc = g_strdup_printf("someone%u@example.net", num);
+	msginfo->subject = g_strdup_printf("Re: synthetic message %u about nothing", num);
+	msginfo->msgid = g_strdup_printf("%u.synthetic@example.com", num);
+	if (num > 1) {
+		msginfo->inreplyto = g_strdup_printf("%u.synthetic@example.com", num - 1);
+		msginfo->references = g_slist_append(NULL,
+				g_strdup_printf("%u.synthetic@example.com", num / 2));
+		msginfo->references = g_slist_append(msginfo->references,
+				g_strdup(msginfo->inreplyto));
+	}
+
+	return msginfo;
+}
+
+static gchar *
+write_cache_file(const gchar *name, guint count)
+{
+	MsgCache *cache = msgcache_new();
+	gchar *path = g_build_filename(g_get_tmp_dir(), name, NULL);
+	guint i;
+
+	for (i = 1; i <= count; i++) {
+		MsgInfo *msginfo = make_msginfo(i);
+		msgcache_add_msg(cache, msginfo);
+		procmsg_msginfo_free(&msginfo);
+	}
+	g_assert_cmpint(msgcache_write(path, NULL, NULL, cache), ==, 0);
+	msgcache_destroy(cache);
+
+	return path;
+}
+
+static void
+assert_msginfo_equal(MsgInfo *a, MsgInfo *b)
+{
+	GSList *ra, *rb;
+
+	g_assert_cmpuint(a->msgnum, ==, b->msgnum);
+	g_assert_cmpint(a->size, ==, b->size);
+	g_assert_cmpint(a->date_t, ==, b->date_t);
+	g_assert_cmpstr(a->fromname, ==, b->fromname);
+	g_assert_cmpstr(a->date, ==, b->date);
+	g_assert_cmpstr(a->from, ==, b->from);
+	g_assert_cmpstr(a->to, ==, b->to);
+	g_assert_cmpstr(a->cc, ==, b->cc);
+	g_assert_cmpstr(a->subject, ==, b->subject);
+	g_assert_cmpstr(a->msgid, ==, b->msgid);
+	g_assert_cmpstr(a->inreplyto, ==, b->inreplyto);
+	for (ra = a->references, rb = b->references; ra && rb;
+	     ra = ra->next, rb = rb->next)
+		g_assert_cmpstr(ra->data, ==, rb->data);
+	g_assert_null(ra);
+	g_assert_null(rb);
+}
+
+static void
+test_msgcache_arena_same_contents(void)
+{
+	gchar *path = write_cache_file("msgcache_test_small.cache", SMALL_CACHE_SIZE);
+	MsgCache *plain, *arena;
+	guint i;
+
+	msgcache_set_use_arena(FALSE);
+	plain = msgcache_read_cache(&test_item, path);
+	msgcache_set_use_arena(TRUE);
+	arena = msgcache_read_cache(&test_item, path);
+	g_assert_nonnull(plain);
+	g_assert_nonnull(arena);
+
+	for (i = 1; i <= SMALL_CACHE_SIZE; i++) {
+		MsgInfo *a = msgcache_get_msg(plain, i);
+		MsgInfo *b = msgcache_get_msg(arena, i);
+
+		g_assert_nonnull(a);
+		g_assert_nonnull(b);
+		g_assert_null(a->arena);
+		g_assert_nonnull(b->arena);
+		g_assert_true(msgcache_arena_owns(b->arena, b->subject));
+		assert_msginfo_equal(a, b);
+		procmsg_msginfo_free(&a);
+		procmsg_msginfo_free(&b);
+	}
+
+	msgcache_destroy(plain);
+	msgcache_destroy(arena);
+	g_unlink(path);
+	g_free(path);
+}
+
+static void
+test_msgcache_arena_memusage(void)
+{
+	gchar *path = write_cache_file("msgcache_test_small.cache", SMALL_CACHE_SIZE);
+	MsgCache *cache;
+	gint memusage;
+
+	cache = msgcache_read_cache(&test_item, path);
+	g_assert_nonnull(cache);
+
+	/* the arena is counted once, on top of the MsgInfos */
+	memusage = msgcache_get_memory_usage(cache);
+	g_assert_cmpint(memusage, >, SMALL_CACHE_SIZE * sizeof(MsgInfo));
+
+	msgcache_remove_msg(cache, 1);
+	g_assert_cmpint(msgcache_get_memory_usage(cache), ==,
+			memusage - sizeof(MsgInfo));
+
+	msgcache_destroy(cache);
+	g_unlink(path);
+	g_free(path);
+}
+
+static void
+test_msgcache_arena_outlives_cache(void)
+{
+	gchar *path = write_cache_file("msgcache_test_small.cache", SMALL_CACHE_SIZE);
+	MsgCache *cache;
+	MsgInfo *msginfo;
+
+	cache = msgcache_read_cache(&test_item, path);
+	g_assert_nonnull(cache);
+	msginfo = msgcache_get_msg(cache, 42);
+	msgcache_destroy(cache);
+
+	/* strings stay valid as long as a MsgInfo references the arena */
+	g_assert_cmpstr(msginfo->msgid, ==, "42.synthetic@example.com");
+
+	procmsg_msginfo_free(&msginfo);
+	g_unlink(path);
+	g_free(path);
+}
+
+static void
+test_msgcache_arena_free_mixed(void)
+{
+	gchar *path = write_cache_file("msgcache_test_small.cache", SMALL_CACHE_SIZE);
+	MsgCache *cache;
+	MsgInfo *edited, *other;
+
+	cache = msgcache_read_cache(&test_item, path);
+	g_assert_nonnull(cache);
+	edited = msgcache_get_msg(cache, 7);
+	other = msgcache_get_msg(cache, 8);
+	g_assert_nonnull(edited->arena);
+	g_assert_true(edited->arena == other->arena);
+
+	/* strings set after loading are owned by the message and freed
+	 * with it, the others are left to the arena */
+	edited->subject = g_strdup("edited subject");
+	edited->references->data = g_strdup("edited@example.com");
+	g_assert_false(msgcache_arena_owns(edited->arena, edited->subject));
+	g_assert_true(msgcache_arena_owns(edited->arena, edited->from));
+
+	msgcache_destroy(cache);
+	procmsg_msginfo_free(&edited);
+	g_assert_null(edited);
+
+	/* the arena is freed with the last message referencing it */
+	g_assert_true(msgcache_arena_owns(other->arena, other->msgid));
+	g_assert_cmpstr(other->msgid, ==, "8.synthetic@example.com");
+	g_assert_cmpstr(other->inreplyto, ==, "7.synthetic@example.com");
+	procmsg_msginfo_free(&other);
+
+	g_unlink(path);
+	g_free(path);
+}
+
+static void
+test_msgcache_read_column(void)
+{
+	gchar *path = write_cache_file("msgcache_test_small.cache", SMALL_CACHE_SIZE);
+	guint32 *values;
+	guint count, i;
+
+	/* numbers are stored sorted */
+	values = msgcache_read_cache_column(path, MSGCACHE_COL_MSGNUM, &count);
+	g_assert_nonnull(values);
+	g_assert_cmpuint(count, ==, SMALL_CACHE_SIZE);
+	for (i = 0; i < count; i++)
+		g_assert_cmpuint(values[i], ==, i + 1);
+	g_free(values);
+
+	values = msgcache_read_cache_column(path, MSGCACHE_COL_SIZE, &count);
+	g_assert_nonnull(values);
+	g_assert_cmpuint(count, ==, SMALL_CACHE_SIZE);
+	for (i = 0; i < count; i++)
+		g_assert_cmpuint(values[i], ==, 1000 + i + 1);
+	g_free(values);
+
+	g_unlink(path);
+	g_free(path);
+}
+
+static void
+test_msgcache_thread_index(void)
+{
+	MsgCache *cache = msgcache_new();
+	ThreadIndex *index;
+	MsgInfo *first, *second, *third;
+
+	first = make_msginfo(1);
+	second = make_msginfo(2);
+	msgcache_add_msg(cache, first);
+	msgcache_add_msg(cache, second);
+
+	index = msgcache_get_thread_index(cache);
+	g_assert_nonnull(index);
+	g_assert_true(thread_index_get_parent(index, second) == first);
+
+	/* the index follows the cache */
+	third = make_msginfo(3);
+	msgcache_add_msg(cache, third);
+	g_assert_true(msgcache_get_thread_index(cache) == index);
+	g_assert_true(thread_index_get_parent(index, third) == second);
+
+	msgcache_remove_msg(cache, 2);
+	g_assert_true(thread_index_get_parent(index, third) == first);
+
+	msgcache_destroy(cache);
+	procmsg_msginfo_free(&first);
+	procmsg_msginfo_free(&second);
+	procmsg_msginfo_free(&third);
+}
+
+static glong
+get_rss_kb(void)
+{
+	gchar *contents = NULL;
+	glong size, rss;
+
+	if (!g_file_get_contents("/proc/self/statm", &contents, NULL, NULL))
+		return -1;
+	if (sscanf(contents, "%ld %ld", &size, &rss) != 2)
+		rss = -1;
+	else
+		rss = rss * (sysconf(_SC_PAGESIZE) / 1024);
+	g_free(contents);
+
+	return rss;
+}
+
+static void
+test_msgcache_perf_load(gconstpointer user_data)
+{
+	gboolean use_arena = GPOINTER_TO_INT(user_data);
+	gchar *path;
+
+	if (!g_test_perf() && !g_test_subprocess()) {
+		g_test_skip("only run in perf mode");
+		return;
+	}
+
+	path = g_build_filename(g_get_tmp_dir(), "msgcache_test_perf.cache", NULL);
+
+	if (!g_test_subprocess()) {
+		/* each loader runs in its own process, so that freed
+		 * memory of one run doesn't hide the RSS of the other */
+		if (!g_file_test(path, G_FILE_TEST_EXISTS))
+			g_free(write_cache_file("msgcache_test_perf.cache",
+						PERF_CACHE_SIZE));
+		g_test_trap_subprocess(NULL, 0, G_TEST_SUBPROCESS_INHERIT_STDOUT);
+		g_test_trap_assert_passed();
+	} else {
+		MsgCache *cache;
+		GTimer *timer;
+		glong rss_before, rss_after;
+
+		msgcache_set_use_arena(use_arena);
+		rss_before = get_rss_kb();
+		timer = g_timer_new();
+		cache = msgcache_read_cache(&test_item, path);
+		g_timer_stop(timer);
+		rss_after = get_rss_kb();
+		g_assert_nonnull(cache);
+
+		g_print("%s loader: %d messages in %.3f s, RSS +%ld kB, "
+			"reported %d bytes\n",
+			use_arena ? "arena" : "strdup", PERF_CACHE_SIZE,
+			g_timer_elapsed(timer, NULL), rss_after - rss_before,
+			msgcache_get_memory_usage(cache));
+
+		msgcache_destroy(cache);
+		g_timer_destroy(timer);
+	}
+	g_free(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+	gchar *perf_path;
+	int ret;
+
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/core/msgcache/arena/same_contents",
+			test_msgcache_arena_same_contents);
+	g_test_add_func("/core/msgcache/arena/memusage",
+			test_msgcache_arena_memusage);
+	g_test_add_func("/core/msgcache/arena/outlives_cache",
+			test_msgcache_arena_outlives_cache);
+	g_test_add_func("/core/msgcache/arena/free_mixed",
+			test_msgcache_arena_free_mixed);
+	g_test_add_func("/core/msgcache/read_column",
+			test_msgcache_read_column);
+	g_test_add_func("/core/msgcache/thread_index",
+			test_msgcache_thread_index);
+	g_test_add_data_func("/core/msgcache/perf/strdup",
+			GINT_TO_POINTER(FALSE), test_msgcache_perf_load);
+	g_test_add_data_func("/core/msgcache/perf/arena",
+			GINT_TO_POINTER(TRUE), test_msgcache_perf_load);
+
+	ret = g_test_run();
+
+	if (!g_test_subprocess()) {
+		perf_path = g_build_filename(g_get_tmp_dir(),
+				"msgcache_test_perf.cache", NULL);
+		g_unlink(perf_path);
+		g_free(perf_path);
+	}
+
+	return ret;
+}
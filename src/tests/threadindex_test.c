@@ -0,0 +1,354 @@
+#include "config.h"
+
+#include <glib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "threadindex.h"
+#include "procmsg.h"
+#include "prefs_common.h"
+
+#include "mock_prefs_common.h"
+#include "mock_prefs_common_get_use_shred.h"
+#include "mock_prefs_common_get_flush_metadata.h"
+
+#define RANDOM_FOLDER_SIZE 2000
+#define PERF_FOLDER_SIZE 200000
+
+static MsgInfo *
+make_msginfo(guint num, const gchar *subject, guint inreplyto, ...)
+{
+	MsgInfo *msginfo = g_new0(MsgInfo, 1);
+	va_list args;
+	guint ref;
+
+	msginfo->msgnum = num;
+	msginfo->date_t = 1700000000 + num * 60;
+	msginfo->subject = g_strdup(subject);
+	msginfo->msgid = g_strdup_printf("%u@example.com", num);
+	if (inreplyto != 0)
+		msginfo->inreplyto = g_strdup_printf("%u@example.com", inreplyto);
+
+	va_start(args, inreplyto);
+	while ((ref = va_arg(args, guint)) != 0)
+		msginfo->references = g_slist_append(msginfo->references,
+				g_strdup_printf("%u@example.com", ref));
+	va_end(args);
+
+	return msginfo;
+}
+
+static void
+free_msginfo(gpointer data)
+{
+	MsgInfo *msginfo = data;
+
+	g_free(msginfo->subject);
+	g_free(msginfo->msgid);
+	g_free(msginfo->inreplyto);
+	g_slist_free_full(msginfo->references, g_free);
+	g_free(msginfo);
+}
+
+static void
+test_thread_index_replies(void)
+{
+	MsgInfo *a = make_msginfo(1, "topic", 0, 0);
+	MsgInfo *b = make_msginfo(2, "Re: topic", 1, 1, 0);
+	MsgInfo *c = make_msginfo(3, "Re: topic", 2, 1, 2, 0);
+	MsgInfo *d = make_msginfo(4, "Re: topic", 0, 9, 1, 0);
+	GSList *mlist = NULL;
+	ThreadIndex *index;
+
+	prefs_common.thread_by_subject = FALSE;
+
+	/* the reply comes first, its parent adopts it when it arrives */
+	mlist = g_slist_append(mlist, c);
+	mlist = g_slist_append(mlist, d);
+	index = thread_index_new(mlist);
+	g_assert_null(thread_index_get_parent(index, c));
+	g_assert_null(thread_index_get_parent(index, d));
+
+	thread_index_add(index, a);
+	g_assert_true(thread_index_get_parent(index, c) == a);
+	g_assert_true(thread_index_get_parent(index, d) == a);
+
+	thread_index_add(index, b);
+	g_assert_true(thread_index_get_parent(index, b) == a);
+	g_assert_true(thread_index_get_parent(index, c) == b);
+	g_assert_cmpuint(g_slist_length(thread_index_get_children(index, a)), ==, 2);
+
+	/* its child goes back to the closest reference */
+	thread_index_remove(index, b);
+	g_assert_true(thread_index_get_parent(index, c) == a);
+	g_assert_null(thread_index_get_children(index, b));
+	g_assert_cmpuint(g_slist_length(thread_index_get_children(index, a)), ==, 2);
+
+	thread_index_remove(index, a);
+	g_assert_null(thread_index_get_parent(index, c));
+	g_assert_null(thread_index_get_parent(index, d));
+
+	thread_index_free(index);
+	g_slist_free(mlist);
+	free_msginfo(a);
+	free_msginfo(b);
+	free_msginfo(c);
+	free_msginfo(d);
+}
+
+static void
+test_thread_index_subject(void)
+{
+	MsgInfo *a = make_msginfo(1, "topic", 0, 0);
+	MsgInfo *b = make_msginfo(2, "Re: topic", 0, 0);
+	MsgInfo *c = make_msginfo(3, "Re: Re: topic", 0, 0);
+	MsgInfo *d = make_msginfo(4, "topic", 0, 0);
+	MsgInfo *e = make_msginfo(5, "Re: topic", 0, 0);
+	GSList *mlist = NULL;
+	ThreadIndex *index;
+
+	prefs_common.thread_by_subject = TRUE;
+	prefs_common.thread_by_subject_max_age = 10;
+
+	mlist = g_slist_append(mlist, b);
+	mlist = g_slist_append(mlist, c);
+	mlist = g_slist_append(mlist, d);
+	index = thread_index_new(mlist);
+	g_assert_true(thread_index_get_parent(index, c) == b);
+	g_assert_null(thread_index_get_parent(index, d));
+
+	/* the oldest message with the subject becomes the parent */
+	thread_index_add(index, a);
+	g_assert_true(thread_index_get_parent(index, b) == a);
+	g_assert_true(thread_index_get_parent(index, c) == a);
+	g_assert_null(thread_index_get_parent(index, d));
+
+	/* too old */
+	prefs_common.thread_by_subject_max_age = 0;
+	g_node_destroy(thread_index_get_tree(index, mlist));
+	g_assert_null(thread_index_get_parent(index, b));
+
+	/* subjects are indexed again when threading by subject is
+	 * turned back on */
+	prefs_common.thread_by_subject_max_age = 10;
+	prefs_common.thread_by_subject = FALSE;
+	g_node_destroy(thread_index_get_tree(index, mlist));
+	g_assert_null(thread_index_get_parent(index, c));
+	thread_index_add(index, e);
+	g_assert_null(thread_index_get_parent(index, e));
+	prefs_common.thread_by_subject = TRUE;
+	g_node_destroy(thread_index_get_tree(index, mlist));
+	g_assert_true(thread_index_get_parent(index, c) == a);
+	g_assert_true(thread_index_get_parent(index, e) == a);
+
+	prefs_common.thread_by_subject = FALSE;
+	thread_index_free(index);
+	g_slist_free(mlist);
+	free_msginfo(a);
+	free_msginfo(b);
+	free_msginfo(c);
+	free_msginfo(d);
+	free_msginfo(e);
+}
+
+static void
+test_thread_index_tree(void)
+{
+	MsgInfo *a = make_msginfo(1, "topic", 0, 0);
+	MsgInfo *b = make_msginfo(2, "Re: topic", 1, 0);
+	MsgInfo *c = make_msginfo(3, "Re: topic", 2, 0);
+	MsgInfo *other = make_msginfo(4, "other", 0, 0);
+	GSList *mlist = NULL, *shown = NULL;
+	ThreadIndex *index;
+	GNode *root;
+
+	prefs_common.thread_by_subject = FALSE;
+
+	mlist = g_slist_append(mlist, a);
+	mlist = g_slist_append(mlist, b);
+	mlist = g_slist_append(mlist, c);
+	index = thread_index_new(mlist);
+
+	/* b is hidden, c goes under a */
+	shown = g_slist_append(shown, c);
+	shown = g_slist_append(shown, a);
+	root = thread_index_get_tree(index, shown);
+	g_assert_nonnull(root);
+	g_assert_cmpuint(g_node_n_children(root), ==, 1);
+	g_assert_true(root->children->data == a);
+	g_assert_true(root->children->children->data == c);
+	g_node_destroy(root);
+
+	shown = g_slist_append(shown, other);
+	g_assert_null(thread_index_get_tree(index, shown));
+
+	thread_index_free(index);
+	g_slist_free(mlist);
+	g_slist_free(shown);
+	free_msginfo(a);
+	free_msginfo(b);
+	free_msginfo(c);
+	free_msginfo(other);
+}
+
+/* Replies only refer to older messages, so that the threads don't
+ * depend on the order the messages are added in */
+static GPtrArray *
+make_folder(guint count)
+{
+	GPtrArray *msgs = g_ptr_array_new_with_free_func(free_msginfo);
+	GRand *rand = g_rand_new_with_seed(42);
+	guint i;
+
+	for (i = 1; i <= count; i++) {
+		gchar *subject;
+		MsgInfo *msginfo;
+		guint parent = 0, ref = 0;
+
+		if (i > 1 && g_rand_int_range(rand, 0, 3) > 0) {
+			parent = g_rand_int_range(rand, 1, i);
+			if (parent > 1)
+				ref = g_rand_int_range(rand, 1, parent);
+		}
+		subject = g_strdup_printf("%stopic %u",
+				g_rand_boolean(rand) ? "Re: " : "",
+				g_rand_int_range(rand, 0, count / 10 + 1));
+		/* some parents are missing from the folder */
+		msginfo = make_msginfo(i, subject,
+				parent == 0 || g_rand_int_range(rand, 0, 5) ?
+				parent : count + parent,
+				ref, 0);
+		g_free(subject);
+		g_ptr_array_add(msgs, msginfo);
+	}
+	g_rand_free(rand);
+
+	return msgs;
+}
+
+static void
+assert_same_threads(ThreadIndex *index, ThreadIndex *expected,
+		    GPtrArray *msgs, GHashTable *removed)
+{
+	guint i;
+
+	for (i = 0; i < msgs->len; i++) {
+		MsgInfo *msginfo = g_ptr_array_index(msgs, i);
+
+		if (removed && g_hash_table_contains(removed, msginfo))
+			continue;
+		g_assert_true(thread_index_get_parent(index, msginfo) ==
+			      thread_index_get_parent(expected, msginfo));
+	}
+}
+
+static void
+test_thread_index_incremental(void)
+{
+	GPtrArray *msgs = make_folder(RANDOM_FOLDER_SIZE);
+	GHashTable *removed = g_hash_table_new(g_direct_hash, g_direct_equal);
+	GSList *mlist = NULL;
+	ThreadIndex *index, *expected;
+	GRand *rand = g_rand_new_with_seed(7);
+	guint i;
+
+	prefs_common.thread_by_subject = TRUE;
+	prefs_common.thread_by_subject_max_age = 30;
+
+	for (i = 0; i < msgs->len; i++)
+		mlist = g_slist_prepend(mlist, g_ptr_array_index(msgs, i));
+	expected = thread_index_new(mlist);
+
+	/* add the messages in reverse order, one by one */
+	index = thread_index_new(NULL);
+	for (i = msgs->len; i > 0; i--)
+		thread_index_add(index, g_ptr_array_index(msgs, i - 1));
+	assert_same_threads(index, expected, msgs, NULL);
+	thread_index_free(expected);
+
+	g_slist_free(mlist);
+	mlist = NULL;
+	for (i = 0; i < msgs->len; i++) {
+		MsgInfo *msginfo = g_ptr_array_index(msgs, i);
+
+		if (g_rand_boolean(rand)) {
+			thread_index_remove(index, msginfo);
+			g_hash_table_add(removed, msginfo);
+		} else
+			mlist = g_slist_prepend(mlist, msginfo);
+	}
+	expected = thread_index_new(mlist);
+	assert_same_threads(index, expected, msgs, removed);
+
+	prefs_common.thread_by_subject = FALSE;
+	thread_index_free(expected);
+	thread_index_free(index);
+	g_slist_free(mlist);
+	g_hash_table_destroy(removed);
+	g_rand_free(rand);
+	g_ptr_array_free(msgs, TRUE);
+}
+
+static void
+test_thread_index_perf(void)
+{
+	GPtrArray *msgs;
+	GSList *mlist = NULL;
+	ThreadIndex *index;
+	MsgInfo *msginfo;
+	GTimer *timer;
+	GNode *root;
+	gdouble build, tree, add;
+	guint i;
+
+	if (!g_test_perf()) {
+		g_test_skip("only run in perf mode");
+		return;
+	}
+
+	prefs_common.thread_by_subject = TRUE;
+	prefs_common.thread_by_subject_max_age = 30;
+
+	msgs = make_folder(PERF_FOLDER_SIZE);
+	for (i = 0; i < msgs->len - 1; i++)
+		mlist = g_slist_prepend(mlist, g_ptr_array_index(msgs, i));
+
+	timer = g_timer_new();
+	index = thread_index_new(mlist);
+	build = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	root = thread_index_get_tree(index, mlist);
+	tree = g_timer_elapsed(timer, NULL);
+	g_node_destroy(root);
+
+	msginfo = g_ptr_array_index(msgs, msgs->len - 1);
+	g_timer_start(timer);
+	thread_index_add(index, msginfo);
+	add = g_timer_elapsed(timer, NULL);
+
+	g_print("%u messages: index built in %.3f s, tree in %.3f s, "
+		"one message added in %.6f s\n",
+		msgs->len, build, tree, add);
+
+	prefs_common.thread_by_subject = FALSE;
+	g_timer_destroy(timer);
+	thread_index_free(index);
+	g_slist_free(mlist);
+	g_ptr_array_free(msgs, TRUE);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/core/threadindex/replies", test_thread_index_replies);
+	g_test_add_func("/core/threadindex/subject", test_thread_index_subject);
+	g_test_add_func("/core/threadindex/tree", test_thread_index_tree);
+	g_test_add_func("/core/threadindex/incremental",
+			test_thread_index_incremental);
+	g_test_add_func("/core/threadindex/perf", test_thread_index_perf);
+
+	return g_test_run();
+}
@@ -130,6 +130,24 @@ static gint textview_font_size_default = TEXTVIEW_FONT_SIZE_UNSET;
 
 static void textview_set_font_zoom(TextView *textview);
 
+/* bodies larger than this get their first lines shown at once and the
+ * rest written when idle */
+#define TEXTVIEW_PROGRESSIVE_SIZE	(256 * 1024)
+#define TEXTVIEW_FIRST_LINES		150
+/* time given to each idle write, in microseconds */
+#define TEXTVIEW_LOAD_CHUNK_TIME	(20 * 1000)
+
+struct _TextViewLoader
+{
+	FILE *fp;
+	CodeConverter *conv;
+	glong end;
+	glong length;
+	glong wrote;
+	gboolean continue_write;
+	guint id;
+};
+
 #define TEXTVIEW_STATUSBAR_PUSH(textview, str)				    \
 {	if (textview->messageview->statusbar)				    \
 	gtk_statusbar_push(GTK_STATUSBAR(textview->messageview->statusbar), \
@@ -150,7 +168,10 @@ static void textview_add_part		(TextView	*textview,
 static void textview_add_parts		(TextView	*textview,
 					 MimeInfo	*mimeinfo);
 static void textview_write_body		(TextView	*textview,
-					 MimeInfo	*mimeinfo);
+					 MimeInfo	*mimeinfo,
+					 gboolean	 progressive);
+static void textview_stop_loader	(TextView	*textview);
+static void textview_scan_visible	(TextView	*textview);
 static void textview_show_html		(TextView	*textview,
 					 FILE		*fp,
 					 CodeConverter	*conv);
@@ -278,6 +299,7 @@ static void scrolled_cb (GtkAdjustment *adj, gpointer data)
 	if (textview->image) {
 		move_textview_image_cb(textview);
 	}
+	textview_scan_visible(textview);
 }
 
 static void textview_size_allocate_cb	(GtkWidget	*widget,
@@ -289,6 +311,7 @@ static void textview_size_allocate_cb	(GtkWidget	*widget,
 	if (textview->image) {
 		g_timeout_add(0, &move_textview_image_cb, textview);
 	}
+	textview_scan_visible(textview);
 }
 
 TextView *textview_create(void)
@@ -496,6 +519,9 @@ static void textview_create_tags(GtkTextView *text, TextView *textview)
 	gtk_text_buffer_create_tag(buffer, "link-hover",
 			"underline", PANGO_UNDERLINE_SINGLE,
 			NULL);
+	/* text not yet looked through for links */
+	gtk_text_buffer_create_tag(buffer, "unscanned",
+			NULL);
 	gtk_text_buffer_create_tag(buffer, "diff-add",
 			"foreground-rgba", &diff_added_color,
 			NULL);
@@ -626,7 +652,7 @@ void textview_show_part(TextView *textview, MimeInfo *mimeinfo, FILE *fp)
 		if (fseek(fp, mimeinfo->offset, SEEK_SET) < 0)
 			perror("fseek");
 
-		textview_write_body(textview, mimeinfo);
+		textview_write_body(textview, mimeinfo, TRUE);
 	}
 
 	textview->loading = FALSE;
@@ -785,7 +811,7 @@ static void textview_add_part(TextView *textview, MimeInfo *mimeinfo)
 			gtk_text_buffer_create_mark(buffer, "body_start", &iter, TRUE);
 		}
 
-		textview_write_body(textview, mimeinfo);
+		textview_write_body(textview, mimeinfo, FALSE);
 
 		if (!gtk_text_buffer_get_mark(buffer, "body_end")) {
 			gtk_text_buffer_get_end_iter(buffer, &iter);
@@ -1006,7 +1032,127 @@ void textview_show_mime_part(TextView *textview, MimeInfo *partinfo)
 	textview_show_icon(textview, "dialog-information");
 }
 
-static void textview_write_body(TextView *textview, MimeInfo *mimeinfo)
+/* Writes the lines of a body until its end, or until max_lines are
+ * written or the deadline is past when they are set. Returns TRUE if
+ * lines are left. */
+static gboolean textview_write_lines(TextView *textview,
+				     TextViewLoader *loader,
+				     gint max_lines, gint64 deadline)
+{
+	gchar buf[BUFFSIZE];
+	glong i;
+	gint lines = 0;
+
+	while (((i = ftell(loader->fp)) < loader->end) &&
+	       (claws_fgets(buf, sizeof(buf), loader->fp) != NULL)
+	       && loader->continue_write) {
+		textview_write_line(textview, buf, loader->conv, TRUE);
+		if (textview->stop_loading)
+			return FALSE;
+		loader->wrote += ftell(loader->fp)-i;
+		if (loader->length > 1024*1024 
+		&&  loader->wrote > 1024*1024
+		&& !textview->messageview->show_full_text) {
+			loader->continue_write = FALSE;
+		}
+		lines++;
+		if (max_lines > 0 && lines >= max_lines)
+			return TRUE;
+		if (deadline > 0 && lines % 32 == 0 &&
+		    g_get_monotonic_time() > deadline)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static gint textview_uri_cmp(gconstpointer a, gconstpointer b)
+{
+	const ClickableText *uri_a = (const ClickableText *)a;
+	const ClickableText *uri_b = (const ClickableText *)b;
+
+	return (uri_a->start > uri_b->start) - (uri_a->start < uri_b->start);
+}
+
+/* Folds the quotes once the whole body is written */
+static void textview_write_body_end(TextView *textview, CodeConverter *conv,
+				    gboolean partial, glong length)
+{
+	GSList *cur;
+
+	account_sigsep_matchlist_delete();
+
+	conv_code_converter_destroy(conv);
+	procmime_force_encoding(0);
+
+	textview->uri_list = g_slist_reverse(textview->uri_list);
+	/* links in the text scrolled into view while loading came
+	 * first */
+	if (textview->loader)
+		textview->uri_list = g_slist_sort(textview->uri_list,
+						  textview_uri_cmp);
+	for (cur = textview->uri_list; cur; cur = cur->next) {
+		ClickableText *uri = (ClickableText *)cur->data;
+		if (!uri->is_quote)
+			continue;
+		if (!prefs_common.hide_quotes ||
+		    uri->quote_level+1 < prefs_common.hide_quotes) {
+			textview_toggle_quote(textview, cur, uri, TRUE);
+			if (textview->stop_loading) {
+				return;
+			}
+		}
+	}
+	
+	if (partial) {
+		messageview_show_partial_display(
+			textview->messageview, 
+			textview->messageview->msginfo,
+			length);
+	}
+}
+
+static gboolean textview_load_body_cb(gpointer data)
+{
+	TextView *textview = (TextView *)data;
+	TextViewLoader *loader = textview->loader;
+	gboolean more;
+
+	account_sigsep_matchlist_create();
+	more = textview_write_lines(textview, loader, 0,
+			g_get_monotonic_time() + TEXTVIEW_LOAD_CHUNK_TIME);
+	account_sigsep_matchlist_delete();
+
+	if (!more) {
+		debug_print("Textview: body loaded\n");
+		claws_fclose(loader->fp);
+		textview_write_body_end(textview, loader->conv,
+					!loader->continue_write, loader->length);
+		textview->loader = NULL;
+		g_free(loader);
+	}
+	textview_scan_visible(textview);
+
+	return more;
+}
+
+/* Drops the rest of a body being written */
+static void textview_stop_loader(TextView *textview)
+{
+	TextViewLoader *loader = textview->loader;
+
+	if (loader == NULL)
+		return;
+
+	debug_print("Textview: body loading stopped\n");
+	g_source_remove(loader->id);
+	claws_fclose(loader->fp);
+	conv_code_converter_destroy(loader->conv);
+	textview->loader = NULL;
+	g_free(loader);
+}
+
+static void textview_write_body(TextView *textview, MimeInfo *mimeinfo,
+				gboolean progressive)
 {
 	FILE *tmpfp;
 	gchar buf[BUFFSIZE];
@@ -1015,9 +1161,7 @@ static void textview_write_body(TextView *textview, MimeInfo *mimeinfo)
 #ifndef G_OS_WIN32
 	const gchar *p, *cmd;
 #endif
-	GSList *cur;
-	gboolean continue_write = TRUE;
-	glong wrote = 0, i = 0;
+	TextViewLoader *loader;
 	FolderItem *folder_item = NULL;
 
 	if (textview->messageview->forced_charset)
@@ -1180,51 +1324,45 @@ textview_default:
 			return;
 		}
 		debug_print("Viewing text content of type: %s (length: %ld)\n", mimeinfo->subtype, mimeinfo->length);
-		while (((i = ftell(tmpfp)) < mimeinfo->offset + mimeinfo->length) &&
-		       (claws_fgets(buf, sizeof(buf), tmpfp) != NULL)
-		       && continue_write) {
-			textview_write_line(textview, buf, conv, TRUE);
-			if (textview->stop_loading) {
-				claws_fclose(tmpfp);
-				account_sigsep_matchlist_delete();
-				conv_code_converter_destroy(conv);
-				return;
-			}
-			wrote += ftell(tmpfp)-i;
-			if (mimeinfo->length > 1024*1024 
-			&&  wrote > 1024*1024
-			&& !textview->messageview->show_full_text) {
-				continue_write = FALSE;
-			}
+
+		loader = g_new0(TextViewLoader, 1);
+		loader->fp = tmpfp;
+		loader->conv = conv;
+		loader->end = mimeinfo->offset + mimeinfo->length;
+		loader->length = mimeinfo->length;
+		loader->continue_write = TRUE;
+
+		/* show the first lines of a large body at once, and
+		 * look for links in the rest only as it is scrolled
+		 * into view */
+		if (progressive && mimeinfo->length > TEXTVIEW_PROGRESSIVE_SIZE &&
+		    textview_write_lines(textview, loader,
+					 TEXTVIEW_FIRST_LINES, 0)) {
+			debug_print("Textview: loading the rest of the body when idle\n");
+			account_sigsep_matchlist_delete();
+			procmime_force_encoding(0);
+			textview->loader = loader;
+			loader->id = g_idle_add(textview_load_body_cb, textview);
+			return;
 		}
+		if (!textview->stop_loading)
+			textview_write_lines(textview, loader, 0, 0);
 		claws_fclose(tmpfp);
-	}
-
-	account_sigsep_matchlist_delete();
-
-	conv_code_converter_destroy(conv);
-	procmime_force_encoding(0);
-
-	textview->uri_list = g_slist_reverse(textview->uri_list);
-	for (cur = textview->uri_list; cur; cur = cur->next) {
-		ClickableText *uri = (ClickableText *)cur->data;
-		if (!uri->is_quote)
-			continue;
-		if (!prefs_common.hide_quotes ||
-		    uri->quote_level+1 < prefs_common.hide_quotes) {
-			textview_toggle_quote(textview, cur, uri, TRUE);
-			if (textview->stop_loading) {
-				return;
-			}
+		if (textview->stop_loading) {
+			account_sigsep_matchlist_delete();
+			conv_code_converter_destroy(conv);
+			g_free(loader);
+			return;
 		}
+		textview_write_body_end(textview, conv,
+					!loader->continue_write,
+					mimeinfo->length);
+		g_free(loader);
+		GTK_EVENTS_FLUSH();
+		return;
 	}
-	
-	if (continue_write == FALSE) {
-		messageview_show_partial_display(
-			textview->messageview, 
-			textview->messageview->msginfo,
-			mimeinfo->length);
-	}
+
+	textview_write_body_end(textview, conv, FALSE, mimeinfo->length);
 	GTK_EVENTS_FLUSH();
 }
 
@@ -1585,6 +1723,72 @@ static void textview_make_clickable_parts_later(TextView *textview,
 
 #undef ADD_TXT_POS
 
+/* Writes a line of a body being loaded, leaving the links to be found
+ * when it is scrolled into view */
+static void textview_write_unscanned(TextView *textview, const gchar *fg_tag,
+				     const gchar *linebuf)
+{
+	GtkTextView *text = GTK_TEXT_VIEW(textview->text);
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(text);
+	GtkTextIter iter;
+	gchar *mybuf = NULL;
+
+	if (!g_utf8_validate(linebuf, -1, NULL)) {
+		mybuf = g_malloc(strlen(linebuf)*2 +1);
+		conv_localetodisp(mybuf, strlen(linebuf)*2 +1, linebuf);
+		linebuf = mybuf;
+	}
+
+	gtk_text_buffer_get_end_iter(buffer, &iter);
+	gtk_text_buffer_insert_with_tags_by_name
+		(buffer, &iter, linebuf, -1, "unscanned", fg_tag, NULL);
+	g_free(mybuf);
+}
+
+/* Looks for links in the text in view which was written without */
+static void textview_scan_visible(TextView *textview)
+{
+	GtkTextView *text = GTK_TEXT_VIEW(textview->text);
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(text);
+	GtkTextTag *tag;
+	GtkTextIter iter;
+	GdkRectangle rect;
+	gint start, end, scan_end;
+
+	tag = gtk_text_tag_table_lookup(gtk_text_buffer_get_tag_table(buffer),
+					"unscanned");
+	if (!tag)
+		return;
+
+	gtk_text_view_get_visible_rect(text, &rect);
+	gtk_text_view_get_line_at_y(text, &iter, rect.y + rect.height, NULL);
+	gtk_text_iter_forward_line(&iter);
+	end = gtk_text_iter_get_offset(&iter);
+	gtk_text_view_get_line_at_y(text, &iter, rect.y, NULL);
+
+	if (!gtk_text_iter_has_tag(&iter, tag))
+		gtk_text_iter_forward_to_tag_toggle(&iter, tag);
+	start = gtk_text_iter_get_offset(&iter);
+
+	/* the text is tagged by whole lines, so no link is cut */
+	while (start < end) {
+		GtkTextIter start_iter;
+
+		gtk_text_iter_forward_to_tag_toggle(&iter, tag);
+		scan_end = MIN(gtk_text_iter_get_offset(&iter), end);
+
+		gtk_text_buffer_get_iter_at_offset(buffer, &start_iter, start);
+		gtk_text_buffer_get_iter_at_offset(buffer, &iter, scan_end);
+		gtk_text_buffer_remove_tag(buffer, tag, &start_iter, &iter);
+		textview_make_clickable_parts_later(textview, start, scan_end);
+
+		gtk_text_buffer_get_iter_at_offset(buffer, &iter, scan_end);
+		if (!gtk_text_iter_has_tag(&iter, tag))
+			gtk_text_iter_forward_to_tag_toggle(&iter, tag);
+		start = gtk_text_iter_get_offset(&iter);
+	}
+}
+
 static void textview_write_line(TextView *textview, const gchar *str,
 				CodeConverter *conv, gboolean do_quote_folding)
 {
@@ -1719,6 +1923,9 @@ do_quote:
 				lasturi->data_len += n_len;
 			}
 		}
+	} else if (textview->loader) {
+		textview_write_unscanned(textview, fg_color, buf);
+		textview->prev_quote_level = -1;
 	} else {
 		textview_make_clickable_parts(textview, fg_color, "link", buf, FALSE);
 		textview->prev_quote_level = -1;
@@ -1790,6 +1997,8 @@ void textview_clear(TextView *textview)
 	GdkWindow *window = gtk_text_view_get_window(text,
 				GTK_TEXT_WINDOW_TEXT);
 
+	textview_stop_loader(textview);
+
 	buffer = gtk_text_view_get_buffer(text);
 	gtk_text_buffer_set_text(buffer, "", -1);
 	if (gtk_text_buffer_get_mark(buffer, "body_start"))
@@ -1821,6 +2030,8 @@ void textview_destroy(TextView *textview)
 	GtkTextBuffer *buffer;
 	GtkClipboard *clipboard;
 
+	textview_stop_loader(textview);
+
 	buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(textview->text));
 	clipboard = gtk_clipboard_get(GDK_SELECTION_PRIMARY);
 	gtk_text_buffer_remove_selection_clipboard(buffer, clipboard);
@@ -2923,8 +3134,14 @@ static void textview_toggle_quote(TextView *textview, GSList *start_list, Clicka
 				 strlen((gchar *)uri->data)-1,
 				 "qlink", (gchar *)uri->fg_color, NULL);
 		uri->end = gtk_text_iter_get_offset(&start);
-		textview_make_clickable_parts_later(textview,
-					  uri->start, uri->end);
+		if (textview->loader) {
+			gtk_text_buffer_get_iter_at_offset(buffer, &end, uri->start);
+			gtk_text_buffer_apply_tag_by_name(buffer, "unscanned",
+							  &end, &start);
+		} else {
+			textview_make_clickable_parts_later(textview,
+						  uri->start, uri->end);
+		}
 		uri->q_expanded = TRUE;
 	} else {
 		gtk_text_buffer_get_iter_at_offset(buffer, &start, uri->start);
@@ -2996,6 +3213,9 @@ static gboolean textview_uri_button_pressed(GtkTextTag *tag, GObject *obj,
 			} 
 			return TRUE;
 		} else if (qlink && bevent->button == 1) {
+			/* the quotes are folded once the body is loaded */
+			if (textview->loader)
+				return TRUE;
 			if (prefs_common.hide_quoted) {
 				textview_toggle_quote(textview, NULL, uri, FALSE);
 				return TRUE;
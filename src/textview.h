@@ -27,6 +27,7 @@
 #include <gtk/gtk.h>
 
 typedef struct _ClickableText	ClickableText;
+typedef struct _TextViewLoader	TextViewLoader;
 struct _ClickableText
 {
 	gchar *uri;
@@ -83,6 +84,9 @@ struct _TextView
 	gboolean loading;
 	gboolean stop_loading;
 	gint prev_quote_level;
+
+	/* the rest of a large body, written when idle */
+	TextViewLoader *loader;
 };
 
 TextView *textview_create		(void);
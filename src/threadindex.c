@@ -0,0 +1,451 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#include "claws-features.h"
+#endif
+
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "threadindex.h"
+#include "procmsg.h"
+#include "prefs_common.h"
+#include "utils.h"
+#include "timing.h"
+
+struct _ThreadIndex {
+	GHashTable *msgid_table;	/* msgid -> MsgInfos, first one wins */
+	GHashTable *subject_table;	/* subject without prefix -> MsgInfos */
+	GHashTable *referrer_table;	/* msgid -> MsgInfos referring to it */
+	GHashTable *parent_table;	/* MsgInfo -> parent MsgInfo or NULL */
+	GHashTable *children_table;	/* MsgInfo -> children MsgInfos */
+	gboolean thread_by_subject;
+	gint thread_by_subject_max_age;
+};
+
+static void thread_index_list_free(gpointer list)
+{
+	g_slist_free(list);
+}
+
+static void thread_index_list_add(GHashTable *table, const gchar *key,
+				  MsgInfo *msginfo)
+{
+	gpointer orig_key;
+	GSList *list;
+
+	/* prepending like procmsg_get_thread_tree() does, so that the
+	 * same one wins between messages of the same date */
+	if (g_hash_table_lookup_extended(table, key, &orig_key,
+					 (gpointer *)&list)) {
+		g_hash_table_steal(table, key);
+		g_hash_table_insert(table, orig_key,
+				    g_slist_prepend(list, msginfo));
+	} else
+		g_hash_table_insert(table, g_strdup(key),
+				    g_slist_prepend(NULL, msginfo));
+}
+
+/* like thread_index_list_add(), but keeps the messages in the order they
+ * were added, so that the first one stays first */
+static void thread_index_list_append(GHashTable *table, const gchar *key,
+				     MsgInfo *msginfo)
+{
+	GSList *list;
+
+	/* appending keeps the head; there are seldom several messages
+	 * with the same Message-ID */
+	list = g_hash_table_lookup(table, key);
+	if (list != NULL)
+		list = g_slist_append(list, msginfo);
+	else
+		g_hash_table_insert(table, g_strdup(key),
+				    g_slist_prepend(NULL, msginfo));
+}
+
+static void thread_index_list_remove(GHashTable *table, const gchar *key,
+				     MsgInfo *msginfo)
+{
+	gpointer orig_key;
+	GSList *list;
+
+	if (!g_hash_table_lookup_extended(table, key, &orig_key,
+					  (gpointer *)&list))
+		return;
+
+	g_hash_table_steal(table, key);
+	list = g_slist_remove_all(list, msginfo);
+	if (list != NULL)
+		g_hash_table_insert(table, orig_key, list);
+	else
+		g_free(orig_key);
+}
+
+static const gchar *thread_index_subject(MsgInfo *msginfo)
+{
+	if (msginfo->subject == NULL)
+		return NULL;
+
+	return msginfo->subject + subject_get_prefix_length(msginfo->subject);
+}
+
+static void thread_index_register(ThreadIndex *index, MsgInfo *msginfo,
+				  gboolean add)
+{
+	void (*list_func)(GHashTable *, const gchar *, MsgInfo *);
+	const gchar *subject;
+	GSList *cur;
+
+	list_func = add ? thread_index_list_add : thread_index_list_remove;
+
+	if (msginfo->msgid && *msginfo->msgid)
+		(add ? thread_index_list_append : thread_index_list_remove)
+			(index->msgid_table, msginfo->msgid, msginfo);
+	if (index->thread_by_subject &&
+	    (subject = thread_index_subject(msginfo)) != NULL)
+		list_func(index->subject_table, subject, msginfo);
+	if (msginfo->inreplyto)
+		list_func(index->referrer_table, msginfo->inreplyto, msginfo);
+	for (cur = msginfo->references; cur != NULL; cur = cur->next) {
+		if (msginfo->inreplyto &&
+		    !strcmp(msginfo->inreplyto, (gchar *)cur->data))
+			continue;
+		list_func(index->referrer_table, (gchar *)cur->data, msginfo);
+	}
+}
+
+static MsgInfo *thread_index_lookup_msgid(ThreadIndex *index,
+					  const gchar *msgid)
+{
+	GSList *list;
+
+	list = g_hash_table_lookup(index->msgid_table, msgid);
+
+	return list != NULL ? (MsgInfo *)list->data : NULL;
+}
+
+/* same rules as subject_hashtable_lookup() in procmsg.c */
+static MsgInfo *thread_index_lookup_subject(ThreadIndex *index,
+					    MsgInfo *msginfo)
+{
+	GSList *cur;
+	MsgInfo *best_msginfo = NULL;
+
+	if (msginfo->subject == NULL ||
+	    subject_get_prefix_length(msginfo->subject) <= 0)
+		return NULL;
+
+	for (cur = g_hash_table_lookup(index->subject_table,
+				       thread_index_subject(msginfo));
+	     cur != NULL; cur = cur->next) {
+		MsgInfo *list_msginfo = (MsgInfo *)cur->data;
+
+		if (list_msginfo->date_t >= msginfo->date_t)
+			continue;
+		if (best_msginfo != NULL &&
+		    best_msginfo->date_t <= list_msginfo->date_t)
+			continue;
+		if (fabs(difftime(msginfo->date_t, list_msginfo->date_t)) >
+		    index->thread_by_subject_max_age * 3600 * 24)
+			continue;
+		best_msginfo = list_msginfo;
+	}
+
+	return best_msginfo;
+}
+
+static gboolean thread_index_is_ancestor(ThreadIndex *index,
+					 MsgInfo *msginfo, MsgInfo *descendant)
+{
+	for (; descendant != NULL;
+	     descendant = g_hash_table_lookup(index->parent_table, descendant))
+		if (descendant == msginfo)
+			return TRUE;
+
+	return FALSE;
+}
+
+static MsgInfo *thread_index_find_parent(ThreadIndex *index,
+					 MsgInfo *msginfo)
+{
+	MsgInfo *parent = NULL;
+	GSList *cur;
+
+	if (msginfo->inreplyto)
+		parent = thread_index_lookup_msgid(index, msginfo->inreplyto);
+
+	/* try looking for the indirect parent */
+	for (cur = msginfo->references; parent == NULL && cur != NULL;
+	     cur = cur->next)
+		parent = thread_index_lookup_msgid(index, (gchar *)cur->data);
+
+	/* the message should not be an ancestor of its parent */
+	if (parent != NULL && thread_index_is_ancestor(index, msginfo, parent))
+		parent = NULL;
+
+	if (parent == NULL && index->thread_by_subject) {
+		parent = thread_index_lookup_subject(index, msginfo);
+		if (parent != NULL &&
+		    thread_index_is_ancestor(index, msginfo, parent))
+			parent = NULL;
+	}
+
+	return parent;
+}
+
+static void thread_index_set_parent(ThreadIndex *index, MsgInfo *msginfo,
+				    MsgInfo *parent)
+{
+	MsgInfo *old_parent;
+	GSList *children;
+
+	old_parent = g_hash_table_lookup(index->parent_table, msginfo);
+	if (old_parent == parent)
+		return;
+
+	if (old_parent != NULL) {
+		children = g_hash_table_lookup(index->children_table, old_parent);
+		g_hash_table_steal(index->children_table, old_parent);
+		children = g_slist_remove(children, msginfo);
+		if (children != NULL)
+			g_hash_table_insert(index->children_table,
+					    old_parent, children);
+	}
+	if (parent != NULL) {
+		children = g_hash_table_lookup(index->children_table, parent);
+		g_hash_table_steal(index->children_table, parent);
+		children = g_slist_prepend(children, msginfo);
+		g_hash_table_insert(index->children_table, parent, children);
+	}
+
+	g_hash_table_insert(index->parent_table, msginfo, parent);
+}
+
+static void thread_index_relink(ThreadIndex *index, MsgInfo *msginfo)
+{
+	thread_index_set_parent(index, msginfo,
+				thread_index_find_parent(index, msginfo));
+}
+
+static void thread_index_relink_all(ThreadIndex *index)
+{
+	GList *msgs, *cur;
+
+	msgs = g_hash_table_get_keys(index->parent_table);
+
+	/* subjects are only indexed while threading by subject */
+	if (index->thread_by_subject != prefs_common.thread_by_subject) {
+		index->thread_by_subject = prefs_common.thread_by_subject;
+		g_hash_table_remove_all(index->subject_table);
+		for (cur = msgs; index->thread_by_subject && cur != NULL;
+		     cur = cur->next) {
+			const gchar *subject;
+
+			subject = thread_index_subject((MsgInfo *)cur->data);
+			if (subject != NULL)
+				thread_index_list_add(index->subject_table,
+						      subject, cur->data);
+		}
+	}
+	index->thread_by_subject_max_age = prefs_common.thread_by_subject_max_age;
+
+	for (cur = msgs; cur != NULL; cur = cur->next)
+		thread_index_relink(index, (MsgInfo *)cur->data);
+	g_list_free(msgs);
+}
+
+/* Relinks the messages whose parent may have changed when msginfo was
+ * added or removed */
+static void thread_index_relink_related(ThreadIndex *index,
+					MsgInfo *msginfo)
+{
+	const gchar *subject;
+	GSList *cur;
+
+	if (msginfo->msgid && *msginfo->msgid)
+		for (cur = g_hash_table_lookup(index->referrer_table,
+					       msginfo->msgid);
+		     cur != NULL; cur = cur->next)
+			thread_index_relink(index, (MsgInfo *)cur->data);
+
+	/* only newer replies can be threaded to it by subject */
+	if (index->thread_by_subject &&
+	    (subject = thread_index_subject(msginfo)) != NULL)
+		for (cur = g_hash_table_lookup(index->subject_table, subject);
+		     cur != NULL; cur = cur->next) {
+			MsgInfo *list_msginfo = (MsgInfo *)cur->data;
+
+			if (list_msginfo->date_t > msginfo->date_t)
+				thread_index_relink(index, list_msginfo);
+		}
+}
+
+ThreadIndex *thread_index_new(MsgInfoList *mlist)
+{
+	ThreadIndex *index;
+	START_TIMING("");
+
+	index = g_new0(ThreadIndex, 1);
+	index->msgid_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+						   g_free, thread_index_list_free);
+	index->subject_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+						     g_free, thread_index_list_free);
+	index->referrer_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+						      g_free, thread_index_list_free);
+	index->parent_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	index->children_table = g_hash_table_new_full(g_direct_hash,
+						      g_direct_equal, NULL,
+						      thread_index_list_free);
+	index->thread_by_subject = prefs_common.thread_by_subject;
+
+	for (; mlist != NULL; mlist = mlist->next) {
+		MsgInfo *msginfo = (MsgInfo *)mlist->data;
+
+		if (g_hash_table_contains(index->parent_table, msginfo))
+			continue;
+		thread_index_register(index, msginfo, TRUE);
+		g_hash_table_insert(index->parent_table, msginfo, NULL);
+	}
+	thread_index_relink_all(index);
+
+	END_TIMING();
+	return index;
+}
+
+void thread_index_free(ThreadIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_hash_table_destroy(index->msgid_table);
+	g_hash_table_destroy(index->subject_table);
+	g_hash_table_destroy(index->referrer_table);
+	g_hash_table_destroy(index->parent_table);
+	g_hash_table_destroy(index->children_table);
+	g_free(index);
+}
+
+void thread_index_add(ThreadIndex *index, MsgInfo *msginfo)
+{
+	cm_return_if_fail(index != NULL);
+	cm_return_if_fail(msginfo != NULL);
+
+	if (g_hash_table_contains(index->parent_table, msginfo))
+		return;
+
+	thread_index_register(index, msginfo, TRUE);
+	g_hash_table_insert(index->parent_table, msginfo, NULL);
+	thread_index_relink(index, msginfo);
+	thread_index_relink_related(index, msginfo);
+}
+
+void thread_index_remove(ThreadIndex *index, MsgInfo *msginfo)
+{
+	GSList *children, *cur;
+
+	cm_return_if_fail(index != NULL);
+	cm_return_if_fail(msginfo != NULL);
+
+	if (!g_hash_table_contains(index->parent_table, msginfo))
+		return;
+
+	thread_index_register(index, msginfo, FALSE);
+	thread_index_set_parent(index, msginfo, NULL);
+	g_hash_table_remove(index->parent_table, msginfo);
+
+	children = g_hash_table_lookup(index->children_table, msginfo);
+	g_hash_table_steal(index->children_table, msginfo);
+	for (cur = children; cur != NULL; cur = cur->next)
+		g_hash_table_insert(index->parent_table, cur->data, NULL);
+	for (cur = children; cur != NULL; cur = cur->next)
+		thread_index_relink(index, (MsgInfo *)cur->data);
+	g_slist_free(children);
+
+	/* a message with the same Message-ID may take its place */
+	thread_index_relink_related(index, msginfo);
+}
+
+MsgInfo *thread_index_get_parent(ThreadIndex *index,
+					 MsgInfo *msginfo)
+{
+	cm_return_val_if_fail(index != NULL, NULL);
+
+	return g_hash_table_lookup(index->parent_table, msginfo);
+}
+
+GSList *thread_index_get_children(ThreadIndex *index,
+					  MsgInfo *msginfo)
+{
+	cm_return_val_if_fail(index != NULL, NULL);
+
+	return g_hash_table_lookup(index->children_table, msginfo);
+}
+
+GNode *thread_index_get_tree(ThreadIndex *index, GSList *mlist)
+{
+	GHashTable *node_table;
+	GNode *root;
+	GSList *cur;
+	START_TIMING("");
+
+	cm_return_val_if_fail(index != NULL, NULL);
+
+	if (index->thread_by_subject != prefs_common.thread_by_subject ||
+	    index->thread_by_subject_max_age !=
+	    prefs_common.thread_by_subject_max_age)
+		thread_index_relink_all(index);
+
+	for (cur = mlist; cur != NULL; cur = cur->next)
+		if (!g_hash_table_contains(index->parent_table, cur->data)) {
+			END_TIMING();
+			return NULL;
+		}
+
+	root = g_node_new(NULL);
+	node_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	for (cur = mlist; cur != NULL; cur = cur->next)
+		if (!g_hash_table_contains(node_table, cur->data))
+			g_hash_table_insert(node_table, cur->data,
+					    g_node_new(cur->data));
+
+	for (cur = mlist; cur != NULL; cur = cur->next) {
+		MsgInfo *parent = (MsgInfo *)cur->data;
+		GNode *node, *parent_node = NULL;
+
+		node = g_hash_table_lookup(node_table, cur->data);
+		if (node->parent != NULL)
+			continue;
+
+		while (parent_node == NULL &&
+		       (parent = g_hash_table_lookup(index->parent_table,
+						     parent)) != NULL)
+			parent_node = g_hash_table_lookup(node_table, parent);
+
+		g_node_prepend(parent_node != NULL ? parent_node : root, node);
+	}
+
+	g_hash_table_destroy(node_table);
+	END_TIMING();
+	return root;
+}
+
@@ -0,0 +1,58 @@
+/*
+ * Claws Mail -- a GTK based, lightweight, and fast e-mail client
+ * Copyright (C) 2026 the Claws Mail team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __THREADINDEX_H__
+#define __THREADINDEX_H__
+
+#ifdef HAVE_CONFIG_H
+#include "claws-features.h"
+#endif
+
+#include <glib.h>
+
+#include "proctypes.h"
+
+/* A thread index is kept with the message cache of a folder and follows
+ * its additions and removals, so that the folder doesn't have to be
+ * threaded again from scratch every time it is shown. It gives each
+ * message the parent procmsg_get_thread_tree() would give it in the
+ * whole folder. Adding or removing a message only links again the
+ * messages which refer to it, its children and the replies with the
+ * same subject. The index doesn't hold references on the messages. */
+
+typedef struct _ThreadIndex ThreadIndex;
+
+ThreadIndex *thread_index_new		(MsgInfoList	*mlist);
+void thread_index_free			(ThreadIndex	*index);
+void thread_index_add			(ThreadIndex	*index,
+					 MsgInfo	*msginfo);
+void thread_index_remove		(ThreadIndex	*index,
+					 MsgInfo	*msginfo);
+MsgInfo *thread_index_get_parent	(ThreadIndex	*index,
+					 MsgInfo	*msginfo);
+GSList *thread_index_get_children	(ThreadIndex	*index,
+					 MsgInfo	*msginfo);
+
+/* Like procmsg_get_thread_tree(), but takes the threads from the
+ * index. A message whose parent is not in mlist goes under its closest
+ * ancestor which is. Returns NULL if mlist holds messages which are
+ * not indexed. */
+GNode *thread_index_get_tree		(ThreadIndex	*index,
+					 MsgInfoList	*mlist);
+
+#endif /* __THREADINDEX_H__ */